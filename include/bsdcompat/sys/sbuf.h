@@ -0,0 +1,32 @@
+/*
+ * procfs extensions to <sys/sbuf.h>
+ */
+#ifndef _sbuf_h
+#define _sbuf_h
+
+#include <stdint.h>
+#include <sys/sbuf.h>
+
+/*
+ * Growth policy flag for sbuf_new(), in the user flag range. An
+ * SBUF_AUTOEXTEND buffer doubles while it is below a page and then grows
+ * one page at a time, so rendering N bytes copies O(N^2 / PAGE_SIZE) bytes
+ * in total - about a hundred reallocations for a 400 KB maps file. With
+ * SBUF_GEOMETRIC it keeps doubling, which bounds the total copy to 2N at the
+ * cost of at most N bytes of slack. The data stays in one block, so callers
+ * still uiomove it straight out of sbuf_data().
+ */
+#define SBUF_GEOMETRIC  0x00000100
+
+/*
+ * Numeric emitters (kext/lib/sbuf.c). These append exactly what the
+ * matching sbuf_printf() conversion would - "%llu", "%*llu", "%lld" and
+ * "%0*llx" - without a trip through vsnprintf(), for renderers that emit
+ * many numbers per line. Same return and overflow rules as sbuf_bcat().
+ */
+int sbuf_putu64(struct sbuf *s, uint64_t v);
+int sbuf_putu64_pad(struct sbuf *s, uint64_t v, int width);
+int sbuf_puti64(struct sbuf *s, int64_t v);
+int sbuf_puthex(struct sbuf *s, uint64_t v, int width);
+
+#endif /* _sbuf_h */
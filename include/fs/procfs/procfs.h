@@ -45,6 +45,8 @@ typedef struct pfsmount_args {
 #include <sys/queue.h>
 #include <sys/vnode.h>
 
+#include <fs/procfs/procfs_render.h>
+
 #pragma mark -
 #pragma mark External References
 
@@ -62,6 +64,12 @@ extern LIST_HEAD(procfs_hash_head, pfsnode) *pfsnode_hash_buckets;
 // The mask used to get the bucket number from a pfsnode hash.
 extern u_long pfsnode_hash_to_bucket_mask;
 
+// Secondary index of the process-related pfsnodes, hashed by pid only, so that
+// every node belonging to a process can be found without walking the whole
+// node hash. Protected by the node hash lock.
+extern LIST_HEAD(procfs_pid_hash_head, pfsnode) *pfsnode_pid_buckets;
+extern u_long pfsnode_pid_to_bucket_mask;
+
 #pragma mark -
 #pragma mark Type Definitions
 
@@ -92,8 +100,12 @@ typedef enum {
     PFSfilesystems, /* Linux-compatible /proc/filesystems */
     PFSproclink,    /* per-process symlink: exe/cwd/root (target by node name) */
     PFSsysctl,      /* dynamic /proc/sys node (objectid = struct sysctl_oid *, 0 = root) */
+    PFSstats,       /* /proc/procfs_stats: per-node-type activity counters */
 } pfstype;
 
+// Number of node types, for tables indexed by pfstype.
+#define PROCFS_STATS_NTYPES (PFSstats + 1)
+
 typedef struct pfsnode pfsnode_t;
 typedef struct pfsid pfsid_t;
 typedef struct pfsmount pfsmount_t;
@@ -193,15 +205,21 @@ struct pfssnode {
 
     // --- Function hooks. Set to null to use the defaults.
     // The node's size value. This is the size value for the node itself.
-    // For directory nodes, the sum of the size values of all of its children is
-    // used as the actual size, so this value has meaning only for nodes of type
-    // PFSfile. It is not used if the procfs_node_size_fn field is set.
+    // For directory nodes, psn_dir_entries is used as the actual size, so this
+    // value has meaning only for nodes of type PFSfile. It is not used if
+    // the procfs_node_size_fn field is set.
     size_t                            psn_node_size;
 
     // Gets the value for the node's size attribute. If NULL, psn_node_size
     // is used instead.
     procfs_node_size_fn               psn_getsize_fn;
 
+    // For directory nodes, the number of entries contributed by the static
+    // children, including "." and "..". Maintained as children are added.
+    // Entries that expand to dynamic content (processes, threads and file
+    // descriptors) are not counted, so a directory's size is a constant.
+    size_t                            psn_dir_entries;
+
     // Reads the file content.
     procfs_read_data_fn               psn_read_data_fn;
 };
@@ -237,6 +255,10 @@ struct pfsnode {
     // Linkage for the node hash. Protected by the node hash lock.
     LIST_ENTRY(pfsnode) node_hash;
 
+    // Linkage for the pid index, for nodes that have a pid. Nodes for the
+    // same pid are kept adjacent within a bucket. Protected by the node hash lock.
+    LIST_ENTRY(pfsnode) node_pid_hash;
+
     // Pointer to the associated vnode. Protected by the node hash lock.
     vnode_t             node_vnode;
 
@@ -253,6 +275,11 @@ struct pfsnode {
     // Protected by the node hash lock.
     boolean_t           node_thread_waiting_attach;
 
+    // Set once the reaper has asked for this node's vnode to be recycled
+    // because its process has gone, so that a vnode which is still open is not
+    // recycled again on every pass. Protected by the node hash lock.
+    boolean_t           node_reaped;
+
     // node_mnt_id and node_id taken together uniquely identify a node. There
     // must only ever be one procnfsnode instance (and hence one vnode) for each
     // (node_mnt_id, node_id) combination. The node_mnt_id value can be obtained
@@ -262,6 +289,12 @@ struct pfsnode {
 
     // Pointer to the pfssnode_t for this node.
     pfssnode_t         *node_structure_node;    // Set when allocated, never changes.
+
+    // Identity stamp (procfs_proc_stamp()) of the process incarnation that this
+    // node was last looked up for, or 0 if it has not been bound to one. Used to
+    // detect pid reuse so that stale name cache entries can be purged.
+    // Protected by the node hash lock.
+    uint64_t            node_proc_stamp;
 };
 
 /*
@@ -358,7 +391,22 @@ procfs_is_directory_type(pfstype type)
         && type != PFSstat && type != PFSvmstat
         && type != PFSuptime && type != PFSproclink
         && type != PFSswaps && type != PFSfilesystems
-        && type != PFSsysctl;
+        && type != PFSsysctl && type != PFSstats;
+}
+
+/*
+ * Returns whether the name of a node may be held in the VFS name cache. Only
+ * the static children of a process directory qualify: their names are fixed
+ * for the life of the process, so they can be served from the cache until the
+ * process exits or its pid is reused (see procfsnode_bind_process()).
+ */
+static inline boolean_t
+procfs_node_is_cacheable(pfssnode_t *snode)
+{
+    pfssnode_t *parent = snode->psn_parent;
+    pfstype type = snode->psn_node_type;
+    return parent != NULL && parent->psn_node_type == PFSproc
+        && (type == PFSfile || type == PFSdir || type == PFSproclink);
 }
 
 /* Gets the pid_t for the process corresponding to a pfsnode_t. */
@@ -378,6 +426,10 @@ extern const pfsid_t PROCFS_ROOT_NODE_ID;
 extern int procfsnode_find(pfsmount_t *pmp, pfsid_t node_id, pfssnode_t *snode, pfsnode_t **pnpp,
                            vnode_t *vnpp, create_vnode_func create_vnode_func, void *create_vnode_params);
 extern void procfsnode_free_node(pfsnode_t *pfsnode);
+extern void procfsnode_bind_process(pfsnode_t *pnp, uint64_t stamp);
+extern int procfsnode_reap_pid(pid_t pid, uint64_t live_stamp);
+extern void procfs_reaper_start(void);
+extern void procfs_reaper_stop(void);
 extern void procfs_get_parent_node_id(pfsnode_t *pnp, pfsid_t *idp);
 
 /* Gets the root node of the file system structure. */
@@ -428,25 +480,8 @@ extern int procfs_read_procargs(proc_t p, uint8_t **bufp, size_t *lenp,
         size_t *argv_off, size_t *env_off, size_t *apple_off);
 extern int procfs_domem(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 
-/*
- * One VM region, as handed to a map formatter. Plain scalars so formatters in
- * either file need no Mach VM headers; `prot`/`max_prot` carry VM_PROT_* bits.
- */
-struct sbuf;
-struct procfs_region {
-    uint64_t     start;
-    uint64_t     end;
-    uint64_t     offset;
-    int          prot;
-    int          max_prot;
-    int          shared;
-    unsigned int wired;
-};
-typedef void (*procfs_region_fmt_fn)(struct sbuf *sb, const struct procfs_region *r);
-
 /* Shared VM-region walk (procfs_map.c): enumerates the process's regions and
- * calls `fmt` per region. procfs_domap formats NetBSD-style here; procfs_domaps
- * (Linux-style) lives in procfs_linux.c and reuses this. */
+ * calls `fmt` (one of the formatters in procfs_render.h) per region. */
 extern int procfs_map_render(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx,
                              procfs_region_fmt_fn fmt);
 /* Sum a task's virtual and resident sizes via the VM-region walk (procfs_map.c);
@@ -458,6 +493,87 @@ extern kern_return_t procfs_ctl_register(void);
 extern void          procfs_ctl_deregister(void);
 extern int           procfs_ctl_request(uint32_t type, int pid, uint64_t arg,
                                          void *out, uint32_t outcap, uint32_t *outlen);
+
+/* A daemon request in flight, between procfs_ctl_submit() and _wait()/_cancel(). */
+typedef struct procfs_ctl_pending {
+    int       pc_slot;      /* -1 once finished, or if the submit failed */
+    int       pc_error;     /* the result, once pc_slot is -1 */
+    boolean_t pc_truncated; /* the reply had more than the buffer took */
+    int       pc_admit;     /* the breaker's PROCFS_CTL_BRK_PASS or _PROBE; _REJECT if not sent */
+    int       pc_conn;      /* the daemon it was sent to, or its leader's if it took one over */
+    uint32_t  pc_type;      /* its request type, for the breaker */
+    uint64_t  pc_deadline;  /* mach_absolute_time() the reply is due by */
+} procfs_ctl_pending_t;
+
+extern int           procfs_ctl_submit(uint32_t type, int pid, uint64_t arg,
+                                        void *out, uint32_t outcap, procfs_ctl_pending_t *pc);
+extern boolean_t     procfs_ctl_ready(const procfs_ctl_pending_t *pc);
+extern int           procfs_ctl_wait(procfs_ctl_pending_t *pc, uint32_t *outlen);
+extern void          procfs_ctl_cancel(procfs_ctl_pending_t *pc);
+struct sysctl_oid_list;
+extern void          procfs_ctl_sysctl_register(struct sysctl_oid_list *parent);
+extern void          procfs_ctl_sysctl_unregister(void);
+
+/*
+ * Process lifecycle events from procfsd (procfs_events.c): `count` events,
+ * none if `ev` is NULL, with `dropped` non-zero if any were lost since the
+ * previous batch.
+ */
+struct procfs_ctl_event;
+typedef void (*procfs_event_fn)(void *arg, const struct procfs_ctl_event *ev,
+                                uint32_t count, uint32_t dropped);
+
+struct procfs_event_counts {
+    uint64_t batches;
+    uint64_t events;
+    uint64_t dropped;
+};
+
+extern void procfs_events_init(void);
+extern void procfs_events_fini(void);
+extern int  procfs_event_subscribe(procfs_event_fn fn, void *arg);
+extern void procfs_event_unsubscribe(procfs_event_fn fn, void *arg);
+extern void procfs_events_deliver(const struct procfs_ctl_event *ev, uint32_t count,
+                                  uint32_t dropped);
+extern void procfs_events_counts(struct procfs_event_counts *out);
+
+/* Whole-process thread snapshots from procfsd (procfs_threads.c). */
+struct proc_threadinfo;
+typedef struct procfs_threads_pending {
+    procfs_ctl_pending_t tp_ctl;
+    boolean_t            tp_hit;    /* answered from a snapshot at submit */
+    uint8_t             *tp_buf;    /* where the reply lands; PROCFS_CTL_MAXPAYLOAD */
+} procfs_threads_pending_t;
+
+extern void procfs_threads_init(void);
+extern void procfs_threads_fini(void);
+extern void procfs_threads_submit(pfsnode_t *pnp, procfs_threads_pending_t *tp,
+                                  struct proc_threadinfo *ti);
+extern int  procfs_threads_wait(pfsnode_t *pnp, procfs_threads_pending_t *tp,
+                                struct proc_threadinfo *ti);
+extern int  procfs_threads_get(pfsnode_t *pnp, struct proc_threadinfo *ti);
+
+/* Readdir-driven taskinfo and io prefetch from procfsd (procfs_prefetch.c). */
+struct proc_taskinfo;
+struct procfs_ctl_ioinfo;
+struct procfs_prefetch_counts {
+    uint64_t batches;       /* ranges fetched */
+    uint64_t records;       /* processes fetched */
+    uint64_t hits;          /* taskinfo reads answered from a batch */
+    uint64_t misses;        /* taskinfo reads, with prefetch on, that were not */
+    uint64_t dropped;       /* ranges not fetched: queue full, every batch busy */
+    uint64_t errors;        /* PROCFS_REQ_TASKINFOS/IOINFOS requests that failed */
+    uint64_t io_hits;       /* io reads answered from a batch */
+    uint64_t io_misses;     /* io reads, with prefetch on, that were not */
+};
+
+extern int       procfs_prefetch_enabled;
+extern void      procfs_prefetch_init(void);
+extern void      procfs_prefetch_fini(void);
+extern void      procfs_prefetch_queue(pid_t first, pid_t last);
+extern boolean_t procfs_prefetch_taskinfo(pid_t pid, struct proc_taskinfo *ti);
+extern boolean_t procfs_prefetch_ioinfo(pid_t pid, struct procfs_ctl_ioinfo *io);
+extern void      procfs_prefetch_counts(struct procfs_prefetch_counts *out);
 extern int procfs_domap(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_domaps(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 
@@ -480,6 +596,21 @@ extern int  procfs_linux_mode;
 extern void procfs_sysctl_register(void);
 extern void procfs_sysctl_unregister(void);
 
+/*
+ * Per-node-type activity counters (procfs_stats.c). procfs_stats_read() takes
+ * the mach_absolute_time() at which the read started and the bytes it
+ * returned; procfs_stats_ctl() records a daemon request made for a node's
+ * read and whether it failed, so the read fell back.
+ */
+extern void procfs_stats_lookup(pfstype type);
+extern void procfs_stats_open(pfstype type);
+extern void procfs_stats_read(pfstype type, uint64_t start, int64_t bytes);
+extern void procfs_stats_ctl(pfsnode_t *pnp, int rc);
+extern void procfs_stats_reset(void);
+extern int  procfs_dostats(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern void procfs_stats_sysctl_register(struct sysctl_oid_list *parent);
+extern void procfs_stats_sysctl_unregister(void);
+
 /* Linux-compatible per-thread files (/proc/<pid>/task/<tid>/). */
 extern int procfs_dothreadcomm(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_dothreadstat(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
@@ -490,6 +621,7 @@ extern int procfs_dothreadsched(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_doprocstatus_linux(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_docomm(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_dostatm(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_doio(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_doprocstat(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_doenviron(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_douptime(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
@@ -510,15 +642,13 @@ extern int procfs_dopartitions(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_doversion(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_donote(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 
-/* Functions that return the data size for a node. */
+/* Gets the value of the size attribute for a node. */
 extern size_t procfs_get_node_size_attr(pfsnode_t *pnp, kauth_cred_t creds);
-extern size_t procfs_process_node_size(pfsnode_t *pnp, kauth_cred_t creds);
-extern size_t procfs_thread_node_size(pfsnode_t *pnp, kauth_cred_t creds);
-extern size_t procfs_fd_node_size(pfsnode_t *pnp, kauth_cred_t creds);
 
 /* Subroutine functions. */
 extern boolean_t procfs_node_type_has_pid(pfstype node_type);
 extern int procfs_get_process_info(vnode_t vp, pid_t *pidp, proc_t *procp);
+extern uint64_t procfs_proc_stamp(proc_t p);
 extern uint64_t procfs_get_node_fileid(pfsnode_t *pnp);
 extern uint64_t procfs_get_fileid(pid_t pid, uint64_t objectid, pfsbaseid_t base_id);
 extern int procfs_atoi(const char *p, const char **end_ptr);
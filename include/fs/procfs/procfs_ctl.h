@@ -14,10 +14,13 @@
 #define _FS_PROCFS_PROCFS_CTL_H_
 
 #include <stdint.h>
+#include <sys/proc_info.h>
 
 #define PROCFS_CTL_NAME        "com.beako.filesystems.procfs"
 #define PROCFS_CTL_MAGIC       0x50524F43u   /* 'PROC' */
-#define PROCFS_CTL_MAXPAYLOAD  2048u
+#define PROCFS_CTL_EVMAGIC     0x50455654u   /* 'PEVT': unsolicited lifecycle events */
+#define PROCFS_CTL_RINGMAGIC   0x50524E47u   /* 'PRNG': shared-memory ring doorbell */
+#define PROCFS_CTL_MAXPAYLOAD  8192u         /* room for ~70 PROCFS_REQ_THREADS records */
 
 /* Request types (procfs_ctl_req.type). */
 enum {
@@ -27,8 +30,47 @@ enum {
     PROCFS_REQ_LOADAVG    = 4,  /* payload: uint32_t[3] (getloadavg, scaled x100) */
     PROCFS_REQ_REGS       = 5,  /* payload: arm_thread_state64_t / x86_thread_state64_t */
     PROCFS_REQ_FPREGS     = 6,  /* payload: arm_neon_state64_t / x86_float_state64_t   */
+    PROCFS_REQ_THREADS    = 7,  /* arg = first index; payload: struct procfs_ctl_threads */
+    PROCFS_REQ_TASKINFOS  = 8,  /* pid..arg = pid range; payload: struct procfs_ctl_taskinfos */
+    PROCFS_REQ_IOINFOS    = 9,  /* pid..arg = pid range; payload: struct procfs_ctl_ioinfos */
 };
 
+/*
+ * Priority classes. Cheap lookups a node read blocks on, whole-process
+ * lists, and debugger-style register reads that suspend threads for
+ * thread_get_state() each have their own share of the kext's slots and
+ * their own queue and workers in procfsd, so a burst of one class cannot
+ * hold up another. Both sides take the class from the request type
+ * (procfs_ctl_prio()); the kext also sends it in procfs_ctl_req.prio, but
+ * procfsd does not trust it, since its bulk sources share buffers that only
+ * the one bulk worker may touch.
+ */
+enum {
+    PROCFS_CTL_PRIO_FAST  = 0,  /* taskinfo, threadinfo, vmstat, loadavg */
+    PROCFS_CTL_PRIO_BULK  = 1,  /* threads, taskinfos, ioinfos */
+    PROCFS_CTL_PRIO_DEBUG = 2,  /* regs, fpregs */
+};
+#define PROCFS_CTL_NPRIO    3
+
+/* The priority class of request `type`; unknown types are PROCFS_CTL_PRIO_DEBUG. */
+static inline uint32_t
+procfs_ctl_prio(uint32_t type)
+{
+    switch (type) {
+    case PROCFS_REQ_TASKINFO:
+    case PROCFS_REQ_THREADINFO:
+    case PROCFS_REQ_VMSTAT:
+    case PROCFS_REQ_LOADAVG:
+        return PROCFS_CTL_PRIO_FAST;
+    case PROCFS_REQ_THREADS:
+    case PROCFS_REQ_TASKINFOS:
+    case PROCFS_REQ_IOINFOS:
+        return PROCFS_CTL_PRIO_BULK;
+    default:
+        return PROCFS_CTL_PRIO_DEBUG;
+    }
+}
+
 /* kext -> daemon */
 struct procfs_ctl_req {
     uint32_t magic;
@@ -36,8 +78,13 @@ struct procfs_ctl_req {
     uint32_t type;
     int32_t  pid;
     uint64_t arg;       /* tid for thread requests, else 0 */
+    uint32_t prio;      /* PROCFS_CTL_PRIO_*, for tracing; procfsd goes by the type */
+    uint32_t reserved;
 };
 
+/* Kexts from before the priority classes send only the fields up to prio. */
+#define PROCFS_CTL_REQMIN   24u
+
 /* daemon -> kext, followed by `len` payload bytes */
 struct procfs_ctl_resp {
     uint32_t magic;
@@ -46,4 +93,144 @@ struct procfs_ctl_resp {
     uint32_t len;       /* payload bytes following this header (<= MAXPAYLOAD) */
 };
 
+/*
+ * Shared-memory rings, optional: instead of sending each request and reply
+ * as a datagram, the two sides can exchange them through a pair of
+ * single-producer/single-consumer rings (procfs_ring.h) in memory procfsd
+ * maps and hands to the kext with
+ *
+ *   setsockopt(fd, SYSPROTO_CONTROL, PROCFS_CTL_OPT_RING, &ringopt, sizeof(ringopt))
+ *
+ * (a size of 0 hands it back). The mapping is PROCFS_CTL_RINGMAP(size)
+ * bytes, page-aligned: a page with the two rings' shared indices, then the
+ * request ring's data, then the reply ring's. The request ring carries
+ * struct procfs_ctl_req records, the reply ring struct procfs_ctl_resp plus
+ * payload; event batches stay on the socket. The socket then only carries
+ * doorbells - a struct procfs_ctl_doorbell, sent whichever way a ring's
+ * consumer asked to be woken - and anything that did not fit a ring, which
+ * goes over the socket as before, so either side may fall back at any time.
+ */
+#define PROCFS_CTL_OPT_RING     1
+#define PROCFS_CTL_RINGSIZE     (64u * 1024)    /* procfsd's choice */
+#define PROCFS_CTL_RINGMIN      (32u * 1024)    /* a full reply must fit: procfs_ring.h */
+#define PROCFS_CTL_RINGMAX      (1024u * 1024)
+#define PROCFS_CTL_RINGHDR      4096u           /* the page of shared indices */
+#define PROCFS_CTL_RING_REQS    0u              /* offsets of the indices in it */
+#define PROCFS_CTL_RING_RESPS   2048u
+#define PROCFS_CTL_RINGMAP(size) (PROCFS_CTL_RINGHDR + 2 * (size_t)(size))
+
+struct procfs_ctl_ringopt {
+    uint64_t addr;      /* in procfsd's address space */
+    uint32_t size;      /* data bytes of each ring: a power of two, RINGMIN to RINGMAX */
+    uint32_t reserved;
+};
+
+struct procfs_ctl_doorbell {
+    uint32_t magic;     /* PROCFS_CTL_RINGMAGIC */
+    uint32_t reserved[3];
+};
+
+/*
+ * Several daemons may be connected at once (up to PROCFS_CTL_CONNS in
+ * procfs_ctl_core.h; one more is refused with EBUSY), and each request goes
+ * to one of them. A daemon that wants to exit without failing anything
+ * first calls
+ *
+ *   setsockopt(fd, SYSPROTO_CONTROL, PROCFS_CTL_OPT_DRAIN, NULL, 0)
+ *
+ * after which it is sent no new requests, keeps answering the ones it has,
+ * and reads a uint32_t count of those still outstanding with getsockopt on
+ * the same option until it is 0. Draining cannot be undone but by
+ * reconnecting.
+ */
+#define PROCFS_CTL_OPT_DRAIN    2
+
+/*
+ * daemon -> kext, unsolicited: process lifecycle events, batched - this
+ * header, then `count` records in the order they were observed. The daemon
+ * watches processes with kqueue EVFILT_PROC, so a process that forks and
+ * exits before it is seen can go unreported; `dropped` counts events known
+ * to be lost (a full batch, or a reconnect) since the previous batch, and
+ * a receiver keeping per-pid state must treat any of it as stale then.
+ */
+struct procfs_ctl_evhdr {
+    uint32_t magic;     /* PROCFS_CTL_EVMAGIC */
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t reserved;
+};
+
+/* Event kinds (procfs_ctl_event.kind). */
+enum {
+    PROCFS_EV_FORK = 1,         /* pid is a new child of ppid */
+    PROCFS_EV_EXEC = 2,         /* pid exec'd a new image */
+    PROCFS_EV_EXIT = 3,         /* pid exited */
+};
+
+struct procfs_ctl_event {
+    uint32_t kind;
+    int32_t  pid;
+    int32_t  ppid;      /* PROCFS_EV_FORK only, else 0 */
+    uint32_t reserved;
+};
+
+#define PROCFS_CTL_MAXEVENTS   (PROCFS_CTL_MAXPAYLOAD / sizeof(struct procfs_ctl_event))
+
+/*
+ * PROCFS_REQ_THREADS: every thread of a process in one reply - this header,
+ * then `count` records. Threads are listed in PROC_PIDLISTTHREADIDS order
+ * starting at index `arg`; a process with more threads than fit is fetched
+ * in pages, asking next for index `next`. Threads that exit while the list
+ * is walked are skipped, so `count` can fall short of `next - arg`.
+ */
+struct procfs_ctl_threads {
+    uint32_t total;     /* thread ids listed for the process */
+    uint32_t count;     /* records following this header */
+    uint32_t next;      /* index to ask for next; == total when complete */
+    uint32_t reserved;
+};
+
+struct procfs_ctl_thread {
+    uint64_t               tid;    /* thread_id, the kext's tid */
+    struct proc_threadinfo info;
+};
+
+/*
+ * PROCFS_REQ_TASKINFOS: the proc_taskinfo of every process whose pid lies
+ * in [pid, arg], in ascending pid order - this header, then `count`
+ * records. A range with more processes than fit is fetched in pages,
+ * asking next for the range [next, arg]. Processes that cannot be read
+ * (exited, or not the daemon's to see) are skipped.
+ */
+struct procfs_ctl_taskinfos {
+    uint32_t count;     /* records following this header */
+    int32_t  next;      /* first pid not looked at; > arg when complete */
+    uint32_t reserved[2];
+};
+
+struct procfs_ctl_taskinfo {
+    int32_t              pid;
+    uint32_t             reserved;
+    struct proc_taskinfo info;
+};
+
+/*
+ * PROCFS_REQ_IOINFOS: the I/O counters of every process whose pid lies in
+ * [pid, arg], from proc_pid_rusage(RUSAGE_INFO_V4), paged exactly like
+ * PROCFS_REQ_TASKINFOS. A single process is the range [pid, pid].
+ */
+struct procfs_ctl_ioinfos {
+    uint32_t count;     /* records following this header */
+    int32_t  next;      /* first pid not looked at; > arg when complete */
+    uint32_t reserved[2];
+};
+
+struct procfs_ctl_ioinfo {
+    int32_t  pid;
+    uint32_t reserved;
+    uint64_t diskio_bytesread;      /* ri_diskio_bytesread */
+    uint64_t diskio_byteswritten;   /* ri_diskio_byteswritten */
+    uint64_t logical_writes;        /* ri_logical_writes */
+};
+
 #endif /* _FS_PROCFS_PROCFS_CTL_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_ctl_breaker.h
+ *
+ * A circuit breaker for the procfsd bridge. A wedged procfsd would otherwise
+ * make every reader of loadavg, stat or status wait out a full deadline
+ * before falling back; instead, after `threshold` deadlines missed in a row
+ * the breaker opens, and requests fail at once (EHOSTDOWN) so the callers
+ * fall back to what the kext can compute itself. After `backoff_ms` a single
+ * request is let through as a probe: if it is answered the breaker closes,
+ * if it misses too the breaker opens again for twice as long, up to
+ * PROCFS_CTL_BRK_SHIFT_MAX doublings.
+ *
+ *   closed --misses--> open --backoff--> half-open --answered--> closed
+ *                        ^                   |
+ *                        +------missed-------+
+ *
+ * Only a missed deadline counts against the daemon: any reply, an errno
+ * included, shows it is alive, and requests that never reached it (no slot,
+ * no daemon, cancelled) say nothing either way. Results of requests admitted
+ * before the breaker opened are ignored once it has.
+ *
+ * Pure bookkeeping with the time passed in, like procfs_ctl_core.c, which
+ * keeps one per daemon connection: the caller serializes (g_ctl_lock in
+ * procfs_ctl.c), and test/host runs the same code
+ * (test/host/test_ctl_breaker.c).
+ */
+#ifndef _FS_PROCFS_PROCFS_CTL_BREAKER_H_
+#define _FS_PROCFS_PROCFS_CTL_BREAKER_H_
+
+#include <stdint.h>
+
+#define PROCFS_CTL_BRK_THRESHOLD    3       /* default misses in a row that open it */
+#define PROCFS_CTL_BRK_BACKOFF_MS   1000    /* default first wait for a probe */
+#define PROCFS_CTL_BRK_SHIFT_MAX    5       /* the wait doubles at most this often (32 s) */
+
+/* Breaker states, as procfs.ctl.breaker_state reports them. */
+enum {
+    PROCFS_CTL_BRK_CLOSED   = 0,    /* healthy: requests go to the daemon */
+    PROCFS_CTL_BRK_OPEN     = 1,    /* unhealthy: requests fail fast */
+    PROCFS_CTL_BRK_HALFOPEN = 2,    /* a probe is out; the rest fail fast */
+};
+
+/* What procfs_ctl_breaker_admit() says to do with a request. */
+enum {
+    PROCFS_CTL_BRK_REJECT = 0,      /* fail it with EHOSTDOWN */
+    PROCFS_CTL_BRK_PASS   = 1,      /* send it */
+    PROCFS_CTL_BRK_PROBE  = 2,      /* send it as the probe */
+};
+
+struct procfs_ctl_breaker_counts {
+    uint64_t misses;        /* deadlines missed, in any state */
+    uint64_t opened;        /* closed -> open: marked unhealthy */
+    uint64_t probes;        /* open -> half-open: probes sent */
+    uint64_t reopened;      /* half-open -> open: the probe missed too */
+    uint64_t closed;        /* half-open -> closed, or reset: healthy again */
+    uint64_t rejected;      /* requests failed fast */
+};
+
+struct procfs_ctl_breaker {
+    uint32_t state;
+    uint32_t threshold;     /* misses in a row that open it; 0 = never */
+    uint32_t backoff_ms;    /* first wait before a probe */
+    uint32_t missed;        /* misses in a row, while closed */
+    uint32_t shift;         /* failed probes since it opened, up to SHIFT_MAX */
+    uint64_t until;         /* open: no probe before this (ns) */
+    struct procfs_ctl_breaker_counts counts;
+};
+
+/* Closed, with the given tunables and zeroed counters. */
+void procfs_ctl_breaker_init(struct procfs_ctl_breaker *b, uint32_t threshold,
+    uint32_t backoff_ms);
+
+/* Whether a request made at `now` (ns) goes out: PROCFS_CTL_BRK_*. */
+int procfs_ctl_breaker_admit(struct procfs_ctl_breaker *b, uint64_t now);
+
+/*
+ * The request admitted as `admitted` (PASS or PROBE) finished at `now` with
+ * `error`: ETIMEDOUT for a missed deadline, anything else as above.
+ */
+void procfs_ctl_breaker_done(struct procfs_ctl_breaker *b, uint64_t now, int admitted,
+    int error);
+
+/* Close it whatever its state, as when a new daemon connects. */
+void procfs_ctl_breaker_reset(struct procfs_ctl_breaker *b);
+
+#endif /* _FS_PROCFS_PROCFS_CTL_BREAKER_H_ */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_ctl_core.h
+ *
+ * The kext's half of the procfsd protocol with the transport taken out: the
+ * table of in-flight requests, sequence numbering and reply matching
+ * (kext/procfs_ctl_core.c). It takes no locks and never sleeps; the caller
+ * serializes every call with its own lock and does its own waiting and
+ * waking. procfs_ctl.c drives it from the kernel control (lck_mtx, msleep,
+ * ctl_enqueuedata); test/host drives the same code over a socketpair.
+ *
+ * A transport only has to carry datagrams with their boundaries intact: one
+ * struct procfs_ctl_req down to the daemon, one struct procfs_ctl_resp plus
+ * payload back up. The request path is
+ *
+ *   lock;   conn = procfs_ctl_core_pick(core, now, &admit)
+ *           slot = procfs_ctl_core_submit(core, conn, type, pid, arg, out, cap, &req)
+ *           core->slots[slot].admit = admit; unlock
+ *   send req over connection conn
+ *   lock;   sleep until core->slots[slot].done or the deadline
+ *           error = procfs_ctl_core_collect(core, slot, &len, &truncated)
+ *           conn = procfs_ctl_core_judged_by(core, slot, &admit)
+ *           procfs_ctl_core_release(core, slot)
+ *           procfs_ctl_core_judge(core, conn, type, now, admit, error); unlock
+ *
+ * and the reply path, wherever the transport delivers a datagram,
+ *
+ *   lock;   slot = procfs_ctl_core_match(core, &resp, avail, &copy, &error)
+ *           copy `copy` payload bytes to core->slots[slot].out
+ *           procfs_ctl_core_complete(core, slot, error, copy)
+ *           wake every slot in procfs_ctl_core_wakes(core, slot); unlock
+ *
+ * The payload goes straight from the transport into the caller's buffer,
+ * registered at submit: there is no staging copy. That buffer therefore
+ * belongs to the request until procfs_ctl_core_release() - the caller must
+ * not read it before the slot is done, nor free it before releasing.
+ *
+ * Several daemons may be connected at once, up to PROCFS_CTL_CONNS: each
+ * connection is attached when it comes and detached when it goes, and
+ * procfs_ctl_core_pick() spreads requests over them, sending each to the one
+ * with the fewest unanswered. A connection that is draining - its daemon is
+ * about to exit, usually for an upgrade - gets nothing new, but its requests
+ * in flight are still answered; once procfs_ctl_core_outstanding() says none
+ * are left, the daemon can go without a single request failing. One that
+ * goes away without draining takes only its own requests down with it.
+ *
+ * Each connection has its own circuit breaker (procfs_ctl_breaker.h), so a
+ * wedged daemon fails fast without taking the healthy ones with it:
+ * procfs_ctl_core_pick() passes over a connection whose breaker is open
+ * until its backoff is over, and then sends it the next request as the
+ * probe. Only fast-class requests count against a daemon
+ * (procfs_ctl_core_judge()): a register read or a whole-process list can
+ * miss its deadline for reasons of its own.
+ *
+ * Each request type belongs to a priority class (procfs_ctl.h), and a class
+ * may only hold so many slots at once: register reads or thread lists that
+ * pile up when procfsd is slow get EBUSY while loadavg and taskinfo still
+ * find a slot.
+ *
+ * Identical requests in flight at once - fifty readers of one pid's status
+ * - need only one answer. Before submitting, a transport may try
+ * procfs_ctl_core_join(): if the same (type, pid, arg) is already on its
+ * way to a daemon, the new request rides along on it instead of being sent.
+ * A rider holds a slot of its own, to wait on and collect from like any
+ * other, but sends nothing, has no sequence number and counts against no
+ * connection or class; when its leader completes, the leader's payload is
+ * copied into each rider's buffer and they all complete with it. Should the
+ * leader give up first, one of its riders takes its place, and the reply
+ * still reaches the rest; the heir is then the one whose outcome the
+ * connection's breaker is told.
+ *
+ * A datagram that starts with PROCFS_CTL_EVMAGIC instead is a batch of
+ * lifecycle events, which is checked with procfs_ctl_core_events() and needs
+ * no slot.
+ */
+#ifndef _FS_PROCFS_PROCFS_CTL_CORE_H_
+#define _FS_PROCFS_PROCFS_CTL_CORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mach/boolean.h>
+
+#include <fs/procfs/procfs_ctl.h>
+#include <fs/procfs/procfs_ctl_breaker.h>
+
+#define PROCFS_CTL_SLOTS    32      /* requests waiting, riders included */
+#define PROCFS_CTL_INFLIGHT 16      /* requests sent and not yet answered */
+
+#define PROCFS_CTL_CONNS    4       /* daemons connected at once */
+
+/* Slots each priority class may send at once; the fast class may send them all. */
+#define PROCFS_CTL_QUOTA_FAST   PROCFS_CTL_INFLIGHT
+#define PROCFS_CTL_QUOTA_BULK   4
+#define PROCFS_CTL_QUOTA_DEBUG  4
+
+/* One in-flight request. */
+struct procfs_ctl_slot {
+    boolean_t in_use;
+    boolean_t done;
+    boolean_t truncated;    /* the payload was longer than outcap */
+    uint32_t  prio;         /* its PROCFS_CTL_PRIO_* class */
+    int       conn;         /* the connection it went to, until it completes; else -1 */
+    int       judge;        /* the connection whose breaker judges it; -1 for a rider */
+    int       admit;        /* that breaker's PROCFS_CTL_BRK_PASS or _PROBE for it */
+    uint32_t  seq;          /* 0 for a rider */
+    uint32_t  type;         /* what was asked, for procfs_ctl_core_join() */
+    int       pid;
+    uint64_t  arg;
+    int       lead;         /* a rider: the slot it rides on; else -1 */
+    uint32_t  riders;       /* a leader: mask of the slots riding on it */
+    int       error;
+    uint32_t  len;          /* payload bytes delivered to out */
+    void     *out;          /* the caller's buffer */
+    uint32_t  outcap;
+};
+
+/* Connection states. */
+enum {
+    PROCFS_CTL_CONN_FREE     = 0,
+    PROCFS_CTL_CONN_LIVE     = 1,   /* takes new requests */
+    PROCFS_CTL_CONN_DRAINING = 2,   /* answers the ones it has, takes no more */
+};
+
+struct procfs_ctl_conn {
+    uint32_t state;
+    uint32_t outstanding;   /* requests sent to it and not yet completed */
+    uint64_t sent;          /* requests ever sent to it */
+    uint32_t evsource;      /* it has sent lifecycle events */
+    struct procfs_ctl_breaker brk;  /* its health; reset when a daemon attaches */
+};
+
+struct procfs_ctl_core_counts {
+    uint64_t sent;          /* requests sent to a daemon */
+    uint64_t coalesced;     /* requests that rode on an identical one instead */
+    uint64_t handoffs;      /* leaders that gave up, a rider taking over */
+};
+
+struct procfs_ctl_core {
+    uint32_t               seq;         /* last sequence number handed out */
+    uint32_t               held[PROCFS_CTL_NPRIO];  /* slots sent and in use, by class */
+    uint32_t               riding;      /* slots in use by riders */
+    uint32_t               last;        /* the connection picked last */
+    struct procfs_ctl_core_counts counts;
+    struct procfs_ctl_slot slots[PROCFS_CTL_SLOTS];
+    struct procfs_ctl_conn conns[PROCFS_CTL_CONNS];
+};
+
+/* A daemon connected: returns its connection, or -1 if PROCFS_CTL_CONNS are. */
+int procfs_ctl_core_attach(struct procfs_ctl_core *core);
+
+/*
+ * Connection `conn` went away: every request still waiting on it completes
+ * with `error` (ENOTCONN), and the connection is free again. Returns a mask
+ * with bit i set for each slot completed, so the caller can wake exactly
+ * those.
+ */
+uint32_t procfs_ctl_core_detach(struct procfs_ctl_core *core, int conn, int error);
+
+/* Connection `conn` takes no new requests from now on. */
+void procfs_ctl_core_drain(struct procfs_ctl_core *core, int conn);
+
+/* Requests sent to `conn` and not yet answered, timed out or cancelled. */
+uint32_t procfs_ctl_core_outstanding(const struct procfs_ctl_core *core, int conn);
+
+/*
+ * The live connection to send a request made at `now` (ns) to: one whose
+ * breaker has been open for its backoff, as the probe, or else the closed
+ * one with the fewest outstanding, taking turns among equals. *admit is the
+ * request's PROCFS_CTL_BRK_PASS or _PROBE, for procfs_ctl_core_judge().
+ * Returns -1 if none is live (ENOTCONN), or -1 with *admit
+ * PROCFS_CTL_BRK_REJECT if every live one's breaker is open (EHOSTDOWN).
+ */
+int procfs_ctl_core_pick(struct procfs_ctl_core *core, uint64_t now, int *admit);
+
+/*
+ * Tell connection `conn`'s breaker that a request of `type` it was sent,
+ * admitted as `admit`, finished at `now` with `error`. A missed deadline
+ * counts against it only for a fast-class request.
+ */
+void procfs_ctl_core_judge(struct procfs_ctl_core *core, int conn, uint32_t type, uint64_t now,
+    int admit, int error);
+
+/* Set every connection's breaker tunables (procfs_ctl_breaker_init()'s). */
+void procfs_ctl_core_tune(struct procfs_ctl_core *core, uint32_t threshold, uint32_t backoff_ms);
+
+/*
+ * The breakers of all connections together: the worst state among the live
+ * ones (open, then probing, then closed), and the sum of their counters.
+ */
+uint32_t procfs_ctl_core_brk_state(const struct procfs_ctl_core *core);
+struct procfs_ctl_breaker_counts procfs_ctl_core_brk_counts(const struct procfs_ctl_core *core);
+
+/* The priority class of request `type`; unknown types are PROCFS_CTL_PRIO_DEBUG. */
+uint32_t procfs_ctl_core_prio(uint32_t type);
+
+/*
+ * Claim a free slot for a request to connection `conn` and fill in the
+ * datagram to send for it; up to `outcap` bytes of the reply's payload will
+ * be delivered to `out`. Returns the slot, or -1 if PROCFS_CTL_INFLIGHT
+ * requests are in flight, or the request's class already holds its quota,
+ * or every slot is taken (EBUSY). Sequence numbers skip 0, so a zeroed
+ * reply never matches.
+ */
+int procfs_ctl_core_submit(struct procfs_ctl_core *core, int conn, uint32_t type, int pid,
+    uint64_t arg, void *out, uint32_t outcap, struct procfs_ctl_req *req);
+
+/*
+ * Ride on a request for the same `type`, `pid` and `arg` already in flight,
+ * with room for at least `outcap` payload bytes, instead of sending another:
+ * returns a slot that completes when that one does, with the same result
+ * and up to `outcap` bytes of its payload in `out`. Returns -1 if there is
+ * no such request, or riders already hold PROCFS_CTL_SLOTS -
+ * PROCFS_CTL_INFLIGHT slots; then submit it as usual.
+ */
+int procfs_ctl_core_join(struct procfs_ctl_core *core, uint32_t type, int pid, uint64_t arg,
+    void *out, uint32_t outcap);
+
+/*
+ * Match a reply: `resp` is its header and `avail` the payload bytes that
+ * followed it in the datagram. Returns the slot waiting for it, or -1 if
+ * none is (bad magic, or a seq that was never sent or already timed out).
+ * On a match, *copy is how many payload bytes to copy to the slot's `out` -
+ * no more than its `outcap`; the slot notes if that cut the payload short -
+ * and *error the result to complete the slot with: a reply shorter than its
+ * header claims completes with EIO and no payload.
+ */
+int procfs_ctl_core_match(struct procfs_ctl_core *core, const struct procfs_ctl_resp *resp,
+    size_t avail, uint32_t *copy, int *error);
+
+/*
+ * Mark `slot` answered, with `len` payload bytes already in its `out`, and
+ * its riders with it, each with as much of the payload as it has room for.
+ */
+void procfs_ctl_core_complete(struct procfs_ctl_core *core, int slot, int error, uint32_t len);
+
+/* The slots to wake once `slot` has completed: it and its riders, as a mask. */
+uint32_t procfs_ctl_core_wakes(const struct procfs_ctl_core *core, int slot);
+
+/*
+ * Match and complete a reply held in one flat buffer, copying its payload.
+ * Returns the completed slot (to wake, with procfs_ctl_core_wakes()), or -1
+ * if the datagram was dropped.
+ */
+int procfs_ctl_core_reply(struct procfs_ctl_core *core, const void *dgram, size_t len);
+
+/*
+ * Complete every request still waiting, on any connection, with `error`.
+ * Returns a mask with bit i set for each slot completed, so the caller can
+ * wake exactly those.
+ */
+uint32_t procfs_ctl_core_fail_all(struct procfs_ctl_core *core, int error);
+
+/*
+ * The result of a completed slot: its error, and on success *outlen set to
+ * the payload bytes in its `out` and *truncated to whether the reply had
+ * more than fitted (either pointer may be NULL).
+ */
+int procfs_ctl_core_collect(const struct procfs_ctl_core *core, int slot, uint32_t *outlen,
+    boolean_t *truncated);
+
+/*
+ * The connection whose breaker is to judge `slot`'s request, with *admit
+ * its admission, for procfs_ctl_core_judge(); call it before releasing the
+ * slot. A submitted request is its own connection's, with the admission the
+ * caller stored at submit; a rider that took over from a leader that gave
+ * up inherits the leader's. Returns -1, *admit PROCFS_CTL_BRK_REJECT, for a
+ * rider, or a leader about to hand its request over to one.
+ */
+int procfs_ctl_core_judged_by(const struct procfs_ctl_core *core, int slot, int *admit);
+
+/*
+ * Return `slot` to the free pool; a late reply for it is then dropped -
+ * unless it has riders still waiting, in which case one of them takes the
+ * request over and the reply goes to them.
+ */
+void procfs_ctl_core_release(struct procfs_ctl_core *core, int slot);
+
+/*
+ * Check an event batch: `hdr` is its header and `avail` the bytes that
+ * followed it. Returns the number of records to deliver, or -1 if the
+ * datagram is not a well-formed batch (bad magic, more records claimed than
+ * sent or than PROCFS_CTL_MAXEVENTS).
+ */
+int procfs_ctl_core_events(const struct procfs_ctl_evhdr *hdr, size_t avail);
+
+/*
+ * A well-formed event batch came from connection `conn`, saying `dropped`
+ * events were lost. Returns the count to pass on to subscribers: a
+ * daemon's first batch counts one for whatever happened before it started,
+ * which nobody missed if another daemon was sending events all along.
+ */
+uint32_t procfs_ctl_core_evbatch(struct procfs_ctl_core *core, int conn, uint32_t dropped);
+
+/*
+ * Connection `conn` is going away (call before procfs_ctl_core_detach()):
+ * returns 1 if it was the last one sending events, so subscribers must be
+ * told that events may go missing, or 0 if another daemon still sends them.
+ */
+int procfs_ctl_core_evlast(const struct procfs_ctl_core *core, int conn);
+
+#endif /* _FS_PROCFS_PROCFS_CTL_CORE_H_ */
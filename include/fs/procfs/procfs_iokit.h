@@ -4,8 +4,8 @@
  * procfs_iokit.h
  *
  * Bridge between the C VFS code and the C++ IOKit helper (procfs_iokit.cpp),
- * which enumerates block devices for the partitions node. Included from both
- * languages.
+ * which enumerates block devices for the partitions node and maps procfsd's
+ * shared-memory rings into the kernel. Included from both languages.
  */
 #ifndef _FS_PROCFS_PROCFS_IOKIT_H_
 #define _FS_PROCFS_PROCFS_IOKIT_H_
@@ -31,6 +31,24 @@ struct procfs_partition {
  */
 int procfs_iokit_get_partitions(struct procfs_partition *out, int max, int *count);
 
+/* User memory wired and mapped into the kernel; the handles are opaque to C. */
+struct procfs_umap {
+    void *kaddr;            /* the kernel mapping */
+    void *md;               /* IOMemoryDescriptor */
+    void *map;              /* IOMemoryMap */
+};
+
+/*
+ * Wire `len` bytes at `uaddr` in the calling process and map them into the
+ * kernel. Returns 0 and fills `um`, or an errno. The memory stays wired, and
+ * the mapping valid, until procfs_iokit_unmap_user() - whatever the process
+ * does with its own mapping meanwhile.
+ */
+int procfs_iokit_map_user(uint64_t uaddr, uint64_t len, struct procfs_umap *um);
+
+/* Undo procfs_iokit_map_user(). */
+void procfs_iokit_unmap_user(struct procfs_umap *um);
+
 #ifdef __cplusplus
 }
 #endif
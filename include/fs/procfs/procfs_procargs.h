@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_procargs.h
+ *
+ * Layout parser for a flattened KERN_PROCARGS2 argument area
+ * (kext/procfs_procargs.c). It works on a plain byte buffer already copied
+ * out of the target, takes no locks and calls no kernel KPI, so the cmdline,
+ * environ and auxv nodes share it and it builds outside the kernel (see
+ * test/host).
+ */
+#ifndef _FS_PROCFS_PROCFS_PROCARGS_H_
+#define _FS_PROCFS_PROCFS_PROCARGS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * The bare executable path in the args area is prefixed with this key (see
+ * sysctl_procargsx() in XNU's kern_sysctl.c), and apple[0] starts with it.
+ */
+#define PROCFS_EXEC_KEY     "executable_path="
+
+/*
+ * Where each section of the area begins:
+ *
+ *   [ bare exec path \0 pad ][ argv strings ][ env strings ][ apple strings ]
+ *     ^0                       ^argv_off       ^env_off        ^apple_off
+ *
+ * 0 <= argv_off <= env_off <= apple_off <= len always holds; a section that
+ * is missing or cut off by the end of the buffer is empty.
+ */
+struct procfs_procargs {
+    size_t argv_off;
+    size_t env_off;
+    size_t apple_off;
+};
+
+/*
+ * Split `len` bytes of argument area holding `argc` argv strings into its
+ * sections. Any input is accepted: strings missing their terminator end at
+ * `len`, and nothing outside [buf, buf + len) is read.
+ */
+extern void procfs_procargs_parse(const uint8_t *buf, size_t len, int argc,
+        struct procfs_procargs *pa);
+
+/* Offset of the first NUL in [s, s + len), or len if there is none. */
+extern size_t procfs_procargs_strnlen(const uint8_t *s, size_t len);
+
+#endif /* _FS_PROCFS_PROCFS_PROCARGS_H_ */
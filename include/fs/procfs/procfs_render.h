@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_render.h
+ *
+ * The text-rendering layer (kext/procfs_render.c): formatters that turn
+ * plain data - regions, process context, load averages, memory totals, raw
+ * sysctl values, activity counters - into procfs file text in an sbuf. They take no locks,
+ * hold no references and call no kernel KPI beyond the sbuf API, so the
+ * node handlers gather the data and these only format it. That keeps them
+ * buildable outside the kernel (see test/host).
+ */
+#ifndef _FS_PROCFS_PROCFS_RENDER_H_
+#define _FS_PROCFS_PROCFS_RENDER_H_
+
+#include <stdint.h>
+#include <sys/param.h>
+#include <sys/types.h>
+
+struct sbuf;
+
+/*
+ * One VM region, as handed to a map formatter. Plain scalars so formatters
+ * need no Mach VM headers; `prot`/`max_prot` carry VM_PROT_* bits.
+ */
+struct procfs_region {
+    uint64_t     start;
+    uint64_t     end;
+    uint64_t     offset;
+    int          prot;
+    int          max_prot;
+    int          shared;
+    unsigned int wired;
+};
+typedef void (*procfs_region_fmt_fn)(struct sbuf *sb, const struct procfs_region *r);
+
+/* Per-region line formatters for the NetBSD-style map and Linux-style maps nodes. */
+extern void procfs_map_fmt_netbsd(struct sbuf *sb, const struct procfs_region *r);
+extern void procfs_maps_fmt_linux(struct sbuf *sb, const struct procfs_region *r);
+
+/* Process-level context of a process (or of a thread's owning process). */
+struct procfs_pctx {
+    int      pid, ppid, pgid, sid, nthreads;
+    uint64_t vsize, rsize;
+    char     comm[MAXCOMLEN + 1];
+    char     state;     /* Linux process-state char from p_stat */
+};
+
+/* The word Linux prints after a state character ("sleeping", "running", ...). */
+extern const char *procfs_thread_state_word(char c);
+
+/* One Linux stat line (52 fields), shared by /proc/<pid>/stat and the per-thread stat. */
+extern void procfs_render_stat_line(struct sbuf *sb, uint64_t id, const char *name,
+        char state, const struct procfs_pctx *c, uint64_t utime, uint64_t stime,
+        int64_t prio, uint64_t rss_pages, int64_t policy);
+
+/* /proc/<pid>/statm: "size resident 0 0 0 0 0", in pages. */
+extern void procfs_render_statm(struct sbuf *sb, uint64_t size_pages, uint64_t resident_pages);
+
+/* /proc/<pid>/io, in bytes; the syscall counts and cancelled writes read 0. */
+extern void procfs_render_io(struct sbuf *sb, uint64_t rchar, uint64_t wchar,
+        uint64_t read_bytes, uint64_t write_bytes);
+
+/* Building blocks of the Linux status text (process and per-thread). */
+extern void procfs_render_status_head(struct sbuf *sb, const char *name, char state,
+        int tgid, uint64_t pid, int ppid);
+extern void procfs_render_status_ids(struct sbuf *sb, const char *label, uint32_t real,
+        uint32_t eff, uint32_t saved, uint32_t fs);
+extern void procfs_render_status_kb(struct sbuf *sb, const char *label, uint64_t kb);
+extern void procfs_render_status_tail(struct sbuf *sb, int nthreads);
+
+/* One /proc/stat cpu line; cpu < 0 renders the aggregate "cpu " line. */
+extern void procfs_render_stat_cpu(struct sbuf *sb, int cpu, uint64_t user,
+        uint64_t nice, uint64_t sys, uint64_t idle);
+
+/* /proc/loadavg; the load averages are scaled by 100. */
+extern void procfs_render_loadavg(struct sbuf *sb, int load1, int load5, int load15,
+        int running, int total, int lastpid);
+
+/* /proc/meminfo; all sizes in bytes. */
+extern void procfs_render_meminfo(struct sbuf *sb, uint64_t memtotal, uint64_t memfree,
+        uint64_t shared, uint64_t buffers, uint64_t cached,
+        uint64_t swaptotal, uint64_t swapfree);
+
+/*
+ * A raw sysctl value as Linux-style text, by the oid's CTLTYPE_* and format
+ * string. Types with no text form (opaque, struct) and short values render
+ * nothing.
+ */
+extern void procfs_render_sysctl_value(struct sbuf *sb, int type, const char *fmt,
+        const void *raw, size_t rawlen);
+
+/*
+ * Activity counters for one node type (kext/procfs_stats.c). Render times
+ * are binned into power-of-two microsecond buckets: bucket 0 counts reads
+ * that took under 1us, bucket i those under 2^i us, and the last bucket
+ * everything slower. Each type's counters start on their own cache line,
+ * so types updated from different CPUs do not share one.
+ */
+#define PROCFS_STATS_HIST   16
+
+struct procfs_node_stats {
+    uint64_t lookups;
+    uint64_t opens;
+    uint64_t reads;
+    uint64_t bytes;         /* bytes returned by reads */
+    uint64_t daemon;        /* procfsd round-trips */
+    uint64_t fallbacks;     /* daemon requests that did not produce the data */
+    uint64_t render_ns;     /* total time spent producing read data */
+    uint64_t render_hist[PROCFS_STATS_HIST];
+} __attribute__((aligned(64)));
+
+/* The render-time bucket for a read that took `ns` nanoseconds. */
+static inline int
+procfs_stats_bucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    int b = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+    return b < PROCFS_STATS_HIST - 1 ? b : PROCFS_STATS_HIST - 1;
+}
+
+/*
+ * The procfs_stats table: a header line, then one line per node type that
+ * has a name in `names` (`n` entries, indexed like `st`).
+ */
+extern void procfs_render_stats(struct sbuf *sb, const char *const *names,
+        const struct procfs_node_stats *st, int n);
+
+#endif /* _FS_PROCFS_PROCFS_RENDER_H_ */
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_ring.h
+ *
+ * A lock-free single-producer/single-consumer ring of variable-length
+ * records in memory shared by two parties that need not trust each other -
+ * the kext and procfsd (kext/procfs_ctl.c, tools/procfsd.c), or two threads
+ * in test/host. The shared part is just the two indices and a wakeup flag
+ * (struct procfs_ring_shared) and the data area; everything else, the size
+ * included, is kept privately by each side in its struct procfs_ring, and
+ * whatever the other side writes is checked before it is used, so a
+ * corrupt peer can make a ring stop working (procfs_ring_broken()) but not
+ * make its user read or write outside it.
+ *
+ * A record is an 8-byte header (its length) and the bytes, padded to 8; a
+ * record never wraps, so the consumer can use it in place. The producer
+ * either copies a record in with procfs_ring_put(), or builds it in place
+ * with procfs_ring_reserve() and procfs_ring_commit(). The consumer takes
+ * them in order with procfs_ring_peek() and procfs_ring_consume().
+ *
+ * Neither side ever blocks; sleeping is left to the user, with some other
+ * channel to wake on (procfsd's kernel-control socket). A consumer that
+ * finds the ring empty calls procfs_ring_sleep_ok() and sleeps only if it
+ * returns true; a producer that has committed calls procfs_ring_wake_needed()
+ * and sends a wakeup only if it returns true. Between them no wakeup is
+ * lost, and none is sent while the consumer is busy.
+ *
+ * No locks: the caller makes sure there is one producer and one consumer
+ * per ring at a time, with its own lock if several threads take turns.
+ */
+#ifndef _FS_PROCFS_PROCFS_RING_H_
+#define _FS_PROCFS_PROCFS_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROCFS_RING_ALIGN       8u
+#define PROCFS_RING_RECHDR      8u          /* bytes of header before each record */
+#define PROCFS_RING_MINSIZE     64u
+
+/* The shared indices, each on its own cache line so the sides do not contend. */
+struct procfs_ring_shared {
+    uint64_t head;              /* bytes ever committed; written by the producer */
+    uint8_t  pad0[56];
+    uint64_t tail;              /* bytes ever consumed; written by the consumer */
+    uint8_t  pad1[56];
+    uint32_t sleeping;          /* the consumer may be asleep and wants a wakeup */
+    uint8_t  pad2[60];
+};
+
+/* One side's view of a ring. */
+struct procfs_ring {
+    struct procfs_ring_shared *sh;
+    uint8_t                   *data;
+    uint32_t                   size;        /* bytes of data; a power of two */
+    int                        broken;      /* the peer broke the protocol */
+    uint64_t                   head;        /* producer: committed, as we know it */
+    uint64_t                   tail;        /* consumer: consumed, as we know it */
+    uint64_t                   resv;        /* producer: where the reserved record starts */
+    uint32_t                   resv_len;    /* producer: bytes reserved */
+    int                        reserved;    /* producer: a reservation is outstanding */
+    uint32_t                   peek_size;   /* consumer: ring bytes of the peeked record */
+};
+
+/* Bytes a record of `len` takes in the ring, header and padding included. */
+#define PROCFS_RING_RECSIZE(len) \
+    ((PROCFS_RING_RECHDR + (uint32_t)(len) + PROCFS_RING_ALIGN - 1) & ~(PROCFS_RING_ALIGN - 1))
+
+/* The largest record a ring of `size` bytes takes: one that always fits once it drains. */
+#define PROCFS_RING_MAXREC(size) ((uint32_t)(size) / 2 - PROCFS_RING_RECHDR)
+
+/*
+ * Set up a view of the ring with `size` bytes of data at `data` and its
+ * indices at `sh`. The side that creates the ring passes `reset` to zero the
+ * indices first; the other side picks them up as they are. Returns 0, or
+ * EINVAL if `size` is not a power of two of at least PROCFS_RING_MINSIZE.
+ */
+int procfs_ring_init(struct procfs_ring *r, struct procfs_ring_shared *sh, void *data,
+    uint32_t size, int reset);
+
+/*
+ * Producer: room for a record of `len` bytes, to be filled in and then
+ * committed. Returns NULL with *error set to ENOBUFS if the ring is too full
+ * for now, EMSGSIZE if `len` is over PROCFS_RING_MAXREC, or EIO if the ring
+ * is broken. Only one reservation is outstanding at a time.
+ */
+void *procfs_ring_reserve(struct procfs_ring *r, uint32_t len, int *error);
+
+/* Producer: publish the reserved record with its first `len` bytes (<= reserved). */
+void procfs_ring_commit(struct procfs_ring *r, uint32_t len);
+
+/* Producer: reserve, copy `len` bytes from `rec` and commit. Returns 0 or an errno. */
+int procfs_ring_put(struct procfs_ring *r, const void *rec, uint32_t len);
+
+/*
+ * Consumer: the oldest record, in place, with *len set to its length; or
+ * NULL if there is none (or the ring is broken). The record stays valid,
+ * and the peer cannot reuse its space, until procfs_ring_consume().
+ */
+const void *procfs_ring_peek(struct procfs_ring *r, uint32_t *len);
+
+/* Consumer: done with the record procfs_ring_peek() returned. */
+void procfs_ring_consume(struct procfs_ring *r);
+
+/*
+ * Consumer, about to sleep: flag that it wants a wakeup, then look again.
+ * Returns 1 if the ring is still empty and it may sleep, or 0 (flag cleared)
+ * if a record arrived meanwhile.
+ */
+int procfs_ring_sleep_ok(struct procfs_ring *r);
+
+/*
+ * Producer, after committing: returns 1, and clears the flag, if the
+ * consumer may be asleep and must be sent a wakeup.
+ */
+int procfs_ring_wake_needed(struct procfs_ring *r);
+
+/* Nonzero once the peer has broken the protocol; the ring is then unusable. */
+int procfs_ring_broken(const struct procfs_ring *r);
+
+#endif /* _FS_PROCFS_PROCFS_RING_H_ */
@@ -58,6 +58,7 @@
 #include <os/overflow.h>
 #include <sys/param.h>
 #include <sys/sbuf.h>
+#include <bsdcompat/sys/sbuf.h>
 #include <sys/uio.h>
 
 #if DEBUG || DEVELOPMENT
@@ -71,6 +72,7 @@
 #define SBUF_CLEARFLAG(s, f)    do { (s)->s_flags &= ~(f); } while (0)
 
 #define SBUF_CANEXTEND(s)       SBUF_ISSET(s, SBUF_AUTOEXTEND)
+#define SBUF_ISGEOMETRIC(s)     SBUF_ISSET(s, SBUF_GEOMETRIC)
 #define SBUF_HASOVERFLOWED(s)   SBUF_ISSET(s, SBUF_OVERFLOWED)
 #define SBUF_ISDYNAMIC(s)       SBUF_ISSET(s, SBUF_DYNAMIC)
 #define SBUF_ISDYNSTRUCT(s)     SBUF_ISSET(s, SBUF_DYNSTRUCT)
@@ -115,11 +117,15 @@ sbuf_delete(struct sbuf *s)
  * actual new size on success (which will be greater than or equal to the
  * requested size).
  *
+ * @param geometric
+ * procfs: if non-zero, keep doubling past SBUF_MAXEXTENDSIZE instead of
+ * rounding up to the next page (see SBUF_GEOMETRIC).
+ *
  * @returns
  * 0 on success, -1 on failure.
  */
 static int
-sbuf_extendsize(size_t *size)
+sbuf_extendsize(size_t *size, int geometric)
 {
 	size_t target_size = *size;
 	size_t new_size;
@@ -128,7 +134,7 @@ sbuf_extendsize(size_t *size)
 		return -1;
 	}
 
-	if (target_size < SBUF_MAXEXTENDSIZE) {
+	if (target_size < SBUF_MAXEXTENDSIZE || geometric) {
 		new_size = SBUF_MINEXTENDSIZE;
 		while (new_size < target_size) {
 			new_size *= 2;
@@ -171,6 +177,9 @@ sbuf_extendsize(size_t *size)
  *                      to accommodate appended data.
  *   - SBUF_AUTOEXPAND: Automatically reallocate the backing buffer using the
  *                      heap if required.
+ *   - SBUF_GEOMETRIC:  (procfs) With SBUF_AUTOEXTEND, double the backing
+ *                      buffer on every reallocation, so that building a large
+ *                      buffer copies its contents a constant number of times.
  *
  * @returns
  * The new and/or initialized sbuf on success, or NULL on failure.
@@ -203,7 +212,7 @@ sbuf_new(struct sbuf *s, char *buf, int length_, int flags)
 		return s;
 	}
 
-	if (SBUF_CANEXTEND(s) && (-1 == sbuf_extendsize(&length))) {
+	if (SBUF_CANEXTEND(s) && (-1 == sbuf_extendsize(&length, SBUF_ISGEOMETRIC(s)))) {
 		goto fail;
 	}
 
@@ -306,7 +315,7 @@ sbuf_extend(struct sbuf *s, size_t addlen)
 		return -1;
 	}
 
-	if (-1 == sbuf_extendsize(&new_size)) {
+	if (-1 == sbuf_extendsize(&new_size, SBUF_ISGEOMETRIC(s))) {
 		return -1;
 	}
 
@@ -730,6 +739,182 @@ sbuf_done(struct sbuf *s)
 	return !!SBUF_ISFINISHED(s);
 }
 
+/*
+ * procfs additions: allocation-free numeric emitters for the hot renderers
+ * (maps, stat, statm, status). Each produces exactly what the equivalent
+ * sbuf_printf() conversion would, without going through vsnprintf().
+ */
+
+/* Largest rendering of a 64-bit value: 20 decimal digits plus a sign. */
+#define SBUF_NUMBUFSIZE         24
+
+static const char sbuf_hexdigits[] = "0123456789abcdef";
+
+static const char sbuf_decpairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*!
+ * @function sbuf_fmtdec
+ *
+ * @brief
+ * Formats an unsigned value in decimal, right-aligned so that the last digit
+ * lands just before @a end.
+ *
+ * @returns
+ * A pointer to the first digit.
+ */
+static char *
+sbuf_fmtdec(char *end, uint64_t v)
+{
+	char *p = end;
+
+	while (v >= 100) {
+		const char *pair = &sbuf_decpairs[(v % 100) * 2];
+		v /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	if (v >= 10) {
+		*--p = sbuf_decpairs[v * 2 + 1];
+		*--p = sbuf_decpairs[v * 2];
+	} else {
+		*--p = (char)('0' + v);
+	}
+	return p;
+}
+
+/*!
+ * @function sbuf_putfield
+ *
+ * @brief
+ * Appends @a len bytes of @a digits, preceded by enough copies of @a pad to
+ * make the field at least @a width bytes wide.
+ *
+ * @returns
+ * 0 on success, -1 on failure.  Always fails if the sbuf is marked as
+ * overflowed.
+ */
+static int
+sbuf_putfield(struct sbuf *s, const char *digits, size_t len, int width, char pad)
+{
+	size_t fill = (width > 0 && (size_t)width > len) ? (size_t)width - len : 0;
+
+	if (SBUF_HASOVERFLOWED(s)) {
+		return -1;
+	}
+
+	if (-1 == sbuf_ensure_capacity(s, fill + len)) {
+		SBUF_SETFLAG(s, SBUF_OVERFLOWED);
+		return -1;
+	}
+
+	if (fill != 0) {
+		memset(s->s_buf + s->s_len, pad, fill);
+	}
+	bcopy(digits, s->s_buf + s->s_len + fill, len);
+	s->s_len += (int)(fill + len); /* safe */
+
+	return 0;
+}
+
+/*!
+ * @function sbuf_putu64_pad
+ *
+ * @brief
+ * Appends an unsigned value in decimal, space-padded on the left to at least
+ * @a width characters.  Equivalent to sbuf_printf(s, "%*llu", width, v).
+ *
+ * @returns
+ * 0 on success, -1 on failure.  Always fails if the sbuf is marked as
+ * overflowed.
+ */
+int
+sbuf_putu64_pad(struct sbuf *s, uint64_t v, int width)
+{
+	char buf[SBUF_NUMBUFSIZE];
+	char *end = buf + sizeof(buf);
+	char *p = sbuf_fmtdec(end, v);
+
+	return sbuf_putfield(s, p, (size_t)(end - p), width, ' ');
+}
+
+/*!
+ * @function sbuf_putu64
+ *
+ * @brief
+ * Appends an unsigned value in decimal.  Equivalent to
+ * sbuf_printf(s, "%llu", v).
+ *
+ * @returns
+ * 0 on success, -1 on failure.  Always fails if the sbuf is marked as
+ * overflowed.
+ */
+int
+sbuf_putu64(struct sbuf *s, uint64_t v)
+{
+	return sbuf_putu64_pad(s, v, 0);
+}
+
+/*!
+ * @function sbuf_puti64
+ *
+ * @brief
+ * Appends a signed value in decimal.  Equivalent to
+ * sbuf_printf(s, "%lld", v).
+ *
+ * @returns
+ * 0 on success, -1 on failure.  Always fails if the sbuf is marked as
+ * overflowed.
+ */
+int
+sbuf_puti64(struct sbuf *s, int64_t v)
+{
+	char buf[SBUF_NUMBUFSIZE];
+	char *end = buf + sizeof(buf);
+	char *p = sbuf_fmtdec(end, v < 0 ? 0 - (uint64_t)v : (uint64_t)v);
+
+	if (v < 0) {
+		*--p = '-';
+	}
+	return sbuf_putfield(s, p, (size_t)(end - p), 0, ' ');
+}
+
+/*!
+ * @function sbuf_puthex
+ *
+ * @brief
+ * Appends an unsigned value in lower-case hexadecimal, zero-padded on the
+ * left to at least @a width digits.  Equivalent to
+ * sbuf_printf(s, "%0*llx", width, v).
+ *
+ * @returns
+ * 0 on success, -1 on failure.  Always fails if the sbuf is marked as
+ * overflowed.
+ */
+int
+sbuf_puthex(struct sbuf *s, uint64_t v, int width)
+{
+	char buf[SBUF_NUMBUFSIZE];
+	char *end = buf + sizeof(buf);
+	char *p = end;
+
+	do {
+		*--p = sbuf_hexdigits[v & 0xf];
+		v >>= 4;
+	} while (v != 0);
+
+	return sbuf_putfield(s, p, (size_t)(end - p), width, '0');
+}
+
 #if DEBUG || DEVELOPMENT
 
 /*
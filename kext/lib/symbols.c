@@ -16,6 +16,7 @@
  * symbol table (applying the KASLR slide), reaching symbols absent from every
  * .exports and jettisoned from the running kernel's __LINKEDIT. */
 extern int klookup_resolve(const char *const *names, void **out, int count);
+extern void klookup_flush(void);
 extern const char version[];
 
 /* Set once at load if libklookup validates (in resolve_symbols). Code that uses
@@ -155,3 +156,13 @@ resolve_symbols(void)
 
     return KERN_SUCCESS;
 }
+
+/*
+ * Free libklookup's parsed symbol table at unload. The addresses resolved
+ * above stay valid; only the staged-file copy goes.
+ */
+void
+release_symbols(void)
+{
+    klookup_flush();
+}
@@ -23,6 +23,7 @@
 #pragma mark External References
 
 extern kern_return_t resolve_symbols(void);
+extern void release_symbols(void);
 extern struct vfs_fsentry procfs_vfsentry;
 extern vfstable_t procfs_vfs_table_ref;
 
@@ -53,6 +54,10 @@ procfs_init(__unused struct vfsconf *vfsconf)
         // Allocate the lock group and the mutex lock for the hash table.
         pfsnode_lck_grp = lck_grp_alloc_init(PROCFS_LCKGRP_NAME, LCK_GRP_ATTR_NULL);
         pfsnode_hash_mutex = lck_mtx_alloc_init(pfsnode_lck_grp, LCK_ATTR_NULL);
+
+        procfs_events_init();
+        procfs_threads_init();
+        procfs_prefetch_init();
     }
 
     return 0;
@@ -65,6 +70,10 @@ procfs_init(__unused struct vfsconf *vfsconf)
 int
 procfs_fini(void)
 {
+    procfs_prefetch_fini();
+    procfs_threads_fini();
+    procfs_events_fini();
+
     if (procfs_osmalloc_tag != NULL) {
         OSMalloc_Tagfree(procfs_osmalloc_tag);
         procfs_osmalloc_tag = NULL;
@@ -125,12 +134,16 @@ procfs_start(kmod_info_t *ki, __unused void *d)
      * proc_pidinfo-backed fields the kext cannot compute itself. Non-fatal. */
     (void)procfs_ctl_register();
 
-    /* Register the `procfs.linux` sysctl (native vs Linux presentation mode). */
+    /* Register the `procfs.linux` sysctl (native vs Linux presentation mode)
+     * and the `procfs.stats` counters. */
     procfs_sysctl_register();
 
     /* Begin sampling CPU utilisation for the loadavg node (no-op without klookup). */
     procfs_loadavg_start();
 
+    /* Periodically recycle the nodes of processes that have exited. */
+    procfs_reaper_start();
+
     os_log(OS_LOG_DEFAULT, "loaded %s version %s build %s (%s) \n",
         BUNDLEID_S, KEXTVERSION_S, KEXTBUILD_S, __TS__);
 
@@ -149,10 +162,11 @@ procfs_stop(__unused kmod_info_t *ki, __unused void *d)
         return KERN_FAILURE;
     }
 
-    /* Stop the loadavg sampler before tearing anything else down. */
+    /* Stop the loadavg sampler and the node reaper before tearing anything else down. */
     procfs_loadavg_stop();
+    procfs_reaper_stop();
 
-    /* Remove the `procfs.linux` sysctl. */
+    /* Remove the `procfs.linux` and `procfs.stats` sysctls. */
     procfs_sysctl_unregister();
 
     /* Tear down the kernel-control bridge. */
@@ -167,6 +181,7 @@ procfs_stop(__unused kmod_info_t *ki, __unused void *d)
     }
 
     procfs_fini();
+    release_symbols();
     libkext_massert();
 
     os_log(OS_LOG_DEFAULT, "unloaded %s version %s build %s (%s) \n",
@@ -44,6 +44,7 @@
 #include <bsdcompat/sys/malloc.h>
 
 #include <fs/procfs/procfs.h>
+#include <fs/procfs/procfs_procargs.h>
 
 #include "lib/symbols.h"
 
@@ -60,10 +61,6 @@ extern pmap_t       get_task_pmap(task_t task);
 extern ppnum_t      pmap_find_phys(pmap_t pmap, addr64_t va);
 extern unsigned int ml_phys_read(vm_offset_t paddr);
 
-/* The bare executable path in the args section is prefixed with this key (see
- * sysctl_procargsx() in XNU's kern_sysctl.c); we skip past it to reach argv. */
-#define PROCFS_EXEC_KEY     "executable_path="
-
 /* Upper bound on how much of the args region we read. argv sits at the start of
  * the region (before the environment), so this comfortably covers any real
  * command line while bounding the work for a pathological one. */
@@ -130,9 +127,9 @@ procfs_cmdline_comm(proc_t p, uio_t uio)
 
 /*
  * Read the target's flattened argument region (the KERN_PROCARGS2 layout) and
- * locate its argv / env / apple[] sections. On success returns 0 with *bufp a
- * malloc'd buffer (free with M_TEMP), *lenp its length, and the byte offsets
- * where each section begins:
+ * locate its argv / env / apple[] sections with procfs_procargs_parse(). On
+ * success returns 0 with *bufp a malloc'd buffer (free with M_TEMP), *lenp its
+ * length, and the byte offsets where each section begins:
  *
  *   [ bare exec path \0 pad ][ argv strings ][ env strings ][ apple strings ]
  *     ^0                       ^*argv_off      ^*env_off       ^*apple_off
@@ -184,44 +181,11 @@ procfs_read_procargs(proc_t p, uint8_t **bufp, size_t *lenp,
         return EIO;
     }
 
-    /* Index 0 is the bare exec path, possibly with NUL alignment padding. */
-    size_t pos = strnlen((const char *)buf, n);
-    if (pos < n) {
-        pos++;                                       /* path's NUL */
-        while (pos < n && buf[pos] == '\0') {
-            pos++;                                   /* alignment padding */
-        }
-    }
-    *argv_off = pos;
-
-    /* Skip the argc argv strings -> start of env. */
-    for (int got = 0; got < argc && pos < n; got++) {
-        size_t remaining = n - pos;
-        size_t arglen = strnlen((const char *)buf + pos, remaining);
-        if (arglen < remaining) {
-            arglen++;                                /* include the NUL */
-        }
-        pos += arglen;
-    }
-    *env_off = pos;
-
-    /* apple[] begins at the first "executable_path=" entry (apple[0]). */
-    const size_t keylen = sizeof(PROCFS_EXEC_KEY) - 1;
-    size_t apple = n;
-    for (size_t scan = pos; scan < n; ) {
-        size_t remaining = n - scan;
-        if (remaining >= keylen &&
-            memcmp(buf + scan, PROCFS_EXEC_KEY, keylen) == 0) {
-            apple = scan;
-            break;
-        }
-        size_t slen = strnlen((const char *)buf + scan, remaining);
-        if (slen == remaining) {
-            break;                                   /* no terminator; stop */
-        }
-        scan += slen + 1;
-    }
-    *apple_off = apple;
+    struct procfs_procargs pa;
+    procfs_procargs_parse(buf, n, argc, &pa);
+    *argv_off = pa.argv_off;
+    *env_off = pa.env_off;
+    *apple_off = pa.apple_off;
 
     *bufp = buf;
     *lenp = n;
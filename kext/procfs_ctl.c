@@ -10,103 +10,379 @@
  *
  * A node read calls procfs_ctl_request(), which enqueues a request to the
  * connected daemon and sleeps (with a timeout) until the daemon's reply arrives
- * in the ctl_send callback. If no daemon is connected, or it does not answer in
- * time, the caller falls back to whatever the kext can compute itself.
+ * in the ctl_send callback, which copies the payload straight into the
+ * caller's buffer. If no daemon is connected, or it does not answer in time,
+ * the caller falls back to whatever the kext can compute itself. A node that
+ * can do local work meanwhile, or needs several answers, splits the call into
+ * procfs_ctl_submit() and procfs_ctl_wait().
+ *
+ * Each request type has its own reply deadline, tunable as
+ * procfs.ctl.deadline_<type> (ms): a loadavg is not worth waiting for as
+ * long as a register read. A circuit breaker per daemon
+ * (procfs_ctl_breaker.c) watches the fast-class deadlines: once one misses
+ * several in a row, it gets no requests for a while, so readers go to
+ * another daemon or, if none is healthy, fail at once with EHOSTDOWN and
+ * fall back without waiting, and a single probe then finds out whether it
+ * is back. procfs.ctl.breaker_* tunes them and reports their state and
+ * transitions, all daemons together.
+ *
+ * Readers asking the same question at the same moment - many agents reading
+ * one pid's status - share a single request: one goes to procfsd, and the
+ * others ride on it and get a copy of its answer (procfs_ctl_core_join()).
+ * procfs.ctl.coalesce turns that off; procfs.ctl.sent and .coalesced count
+ * requests sent and requests that rode along instead.
+ *
+ * The slot table and reply matching live in procfs_ctl_core.c; this file is
+ * the transport around them - the kernel control, the lock and the sleeps.
+ *
+ * Several procfsd instances may be connected at once (PROCFS_CTL_CONNS), each
+ * a link of its own; the core spreads requests over them. A daemon about to
+ * exit sets PROCFS_CTL_OPT_DRAIN, gets no new requests, answers the ones it
+ * has and polls the same option until none are left: a new procfsd started
+ * first takes over without a gap, and a daemon that dies only fails the
+ * requests it held.
+ *
+ * If a procfsd hands us shared-memory rings (PROCFS_CTL_OPT_RING), requests
+ * to it go into its request ring and replies come back through its reply
+ * ring, with the socket left to carry doorbells. The rings are only touched
+ * under g_ctl_lock, which makes us the single producer of one and the single
+ * consumer of the other. Replies in a ring are picked up by whoever holds
+ * the lock next - a waiter, procfs_ctl_ready(), or a doorbell from procfsd
+ * when a waiter went to sleep. Anything the rings cannot take falls back to
+ * the socket, and a ring procfsd corrupts is dropped for good.
  */
+#include <stddef.h>
 #include <sys/errno.h>
 #include <sys/kern_control.h>
 #include <sys/kpi_mbuf.h>
 #include <sys/param.h>
 #include <sys/proc.h>
+#include <sys/sysctl.h>
 #include <sys/systm.h>
 #include <sys/time.h>
+#include <kern/clock.h>
 #include <kern/locks.h>
 #include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
 #include <string.h>
 
 #include <fs/procfs/procfs.h>
 #include <fs/procfs/procfs_ctl.h>
+#include <fs/procfs/procfs_ctl_breaker.h>
+#include <fs/procfs/procfs_ctl_core.h>
+#include <fs/procfs/procfs_iokit.h>
+#include <fs/procfs/procfs_ring.h>
+
+#define PROCFS_CTL_DEADLINE_MS      2000    /* reply deadline for a type not below */
+#define PROCFS_CTL_DEADLINE_MAX_MS  60000
+
+/* Reply deadlines by request type (ms); procfs.ctl.deadline_<type>. */
+static uint32_t g_ctl_deadline_ms[PROCFS_REQ_IOINFOS + 1] = {
+    [PROCFS_REQ_TASKINFO]   = 500,
+    [PROCFS_REQ_THREADINFO] = 500,
+    [PROCFS_REQ_VMSTAT]     = 500,
+    [PROCFS_REQ_LOADAVG]    = 250,
+    [PROCFS_REQ_REGS]       = 2000,
+    [PROCFS_REQ_FPREGS]     = 2000,
+    [PROCFS_REQ_THREADS]    = 1000,
+    [PROCFS_REQ_TASKINFOS]  = 1000,
+    [PROCFS_REQ_IOINFOS]    = 1000,
+};
 
-#define PROCFS_CTL_SLOTS   16
-#define PROCFS_CTL_TIMEO_S  2       /* daemon reply timeout (seconds) */
-
-/* One in-flight request. */
-struct procfs_ctl_slot {
-    boolean_t in_use;
-    boolean_t done;
-    uint32_t  seq;
-    int       error;
-    uint32_t  len;
-    uint8_t   buf[PROCFS_CTL_MAXPAYLOAD];
+/* One connected procfsd, by its core connection number. */
+struct procfs_ctl_link {
+    u_int32_t           unit;
+    boolean_t           ringed;     /* the rings below are in use */
+    struct procfs_ring  reqs;       /* we produce */
+    struct procfs_ring  resps;      /* we consume */
+    struct procfs_umap  umap;       /* their mapping */
 };
 
 static kern_ctl_ref            g_ctl_ref;
-static u_int32_t               g_ctl_unit;
-static boolean_t               g_ctl_connected;
 static lck_grp_t              *g_ctl_grp;
 static lck_mtx_t              *g_ctl_lock;
-static uint32_t                g_ctl_seq;
-static struct procfs_ctl_slot  g_ctl_slots[PROCFS_CTL_SLOTS];
+static struct procfs_ctl_core  g_ctl_core;      /* guarded by g_ctl_lock */
+static struct procfs_ctl_link  g_ctl_links[PROCFS_CTL_CONNS];  /* ditto */
+static int                     g_ctl_sleepers;  /* waiters in msleep; ditto */
+static int                     g_ctl_coalesce = 1;  /* procfs.ctl.coalesce */
+
+static const struct procfs_ctl_doorbell g_ctl_doorbell = { .magic = PROCFS_CTL_RINGMAGIC };
+
+#pragma mark -
+#pragma mark Shared-memory rings
+
+/* The core connection a callback's unitinfo stands for (set at connect). */
+static int
+procfs_ctl_conn(void *unitinfo)
+{
+    return (int)(uintptr_t)unitinfo - 1;
+}
+
+/* Wake the waiters of every slot in `mask`. Called with g_ctl_lock held. */
+static void
+procfs_ctl_wake(uint32_t mask)
+{
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        if (mask & (1u << i)) {
+            wakeup(&g_ctl_core.slots[i]);
+        }
+    }
+}
+
+/*
+ * Complete every reply waiting in every link's reply ring. Called with
+ * g_ctl_lock held. There is one doorbell flag per ring for all the waiters,
+ * and procfsd clears it when it rings; so while any waiter is (about to be)
+ * asleep, whoever drains sets it again - or, if a reply slipped in
+ * meanwhile, drains that too.
+ */
+static void
+procfs_ctl_ring_drain(void)
+{
+    const void *rec;
+    uint32_t len;
+
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        struct procfs_ctl_link *l = &g_ctl_links[c];
+        if (!l->ringed) {
+            continue;
+        }
+        do {
+            while ((rec = procfs_ring_peek(&l->resps, &len)) != NULL) {
+                int slot = procfs_ctl_core_reply(&g_ctl_core, rec, len);
+                if (slot >= 0) {
+                    procfs_ctl_wake(procfs_ctl_core_wakes(&g_ctl_core, slot));
+                }
+                procfs_ring_consume(&l->resps);
+            }
+        } while (g_ctl_sleepers > 0 && !procfs_ring_sleep_ok(&l->resps));
+        if (procfs_ring_broken(&l->resps)) {
+            l->ringed = FALSE;
+            printf("procfs: ctl reply ring %d corrupt; back to the socket\n", c);
+        }
+    }
+}
+
+/* Stop using a link's rings and unmap them. Called without g_ctl_lock. */
+static void
+procfs_ctl_ring_detach(int conn)
+{
+    struct procfs_ctl_link *l = &g_ctl_links[conn];
+    lck_mtx_lock(g_ctl_lock);
+    procfs_ctl_ring_drain();
+    l->ringed = FALSE;
+    struct procfs_umap um = l->umap;
+    bzero(&l->umap, sizeof(l->umap));
+    lck_mtx_unlock(g_ctl_lock);
+    /* Nobody touches the rings without the lock, so nobody is using them now. */
+    procfs_iokit_unmap_user(&um);
+}
+
+/*
+ * PROCFS_CTL_OPT_RING: procfsd hands us its rings (or, with size 0, takes
+ * them back). Runs in procfsd's context, so the address is in its map.
+ * Requests still in the old rings, if any, are answered never and time out.
+ */
+static errno_t
+procfs_ctl_setopt_ring(int conn, void *data, size_t len)
+{
+    struct procfs_ctl_ringopt ro;
+    if (len != sizeof(ro) || data == NULL) {
+        return EINVAL;
+    }
+    memcpy(&ro, data, sizeof(ro));
+
+    procfs_ctl_ring_detach(conn);
+    if (ro.size == 0) {
+        printf("procfs: ctl daemon dropped its rings\n");
+        return 0;
+    }
+    if (ro.size < PROCFS_CTL_RINGMIN || ro.size > PROCFS_CTL_RINGMAX ||
+        (ro.size & (ro.size - 1)) != 0 || (ro.addr & PAGE_MASK) != 0) {
+        return EINVAL;
+    }
+
+    struct procfs_umap um;
+    int e = procfs_iokit_map_user(ro.addr, PROCFS_CTL_RINGMAP(ro.size), &um);
+    if (e != 0) {
+        return e;
+    }
+    uint8_t *base = um.kaddr;
+    struct procfs_ctl_link *l = &g_ctl_links[conn];
+    lck_mtx_lock(g_ctl_lock);
+    (void)procfs_ring_init(&l->reqs,
+        (struct procfs_ring_shared *)(void *)(base + PROCFS_CTL_RING_REQS),
+        base + PROCFS_CTL_RINGHDR, ro.size, 1);
+    (void)procfs_ring_init(&l->resps,
+        (struct procfs_ring_shared *)(void *)(base + PROCFS_CTL_RING_RESPS),
+        base + PROCFS_CTL_RINGHDR + ro.size, ro.size, 1);
+    l->umap   = um;
+    l->ringed = TRUE;
+    lck_mtx_unlock(g_ctl_lock);
+    printf("procfs: ctl daemon %d rings attached (2 x %u bytes)\n", conn, ro.size);
+    return 0;
+}
+
+static errno_t
+procfs_ctl_setopt(__unused kern_ctl_ref kctlref, __unused u_int32_t unit,
+    void *unitinfo, int opt, void *data, size_t len)
+{
+    int conn = procfs_ctl_conn(unitinfo);
+    switch (opt) {
+    case PROCFS_CTL_OPT_RING:
+        return procfs_ctl_setopt_ring(conn, data, len);
+    case PROCFS_CTL_OPT_DRAIN:
+        lck_mtx_lock(g_ctl_lock);
+        procfs_ctl_core_drain(&g_ctl_core, conn);
+        lck_mtx_unlock(g_ctl_lock);
+        printf("procfs: ctl daemon %d draining\n", conn);
+        return 0;
+    default:
+        return ENOPROTOOPT;
+    }
+}
+
+/* PROCFS_CTL_OPT_DRAIN: how many requests the daemon still owes us. */
+static errno_t
+procfs_ctl_getopt(__unused kern_ctl_ref kctlref, __unused u_int32_t unit,
+    void *unitinfo, int opt, void *data, size_t *len)
+{
+    if (opt != PROCFS_CTL_OPT_DRAIN) {
+        return ENOPROTOOPT;
+    }
+    if (data == NULL || *len < sizeof(uint32_t)) {
+        *len = sizeof(uint32_t);
+        return data == NULL ? 0 : EINVAL;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    uint32_t n = procfs_ctl_core_outstanding(&g_ctl_core, procfs_ctl_conn(unitinfo));
+    lck_mtx_unlock(g_ctl_lock);
+    memcpy(data, &n, sizeof(n));
+    *len = sizeof(n);
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Kernel control callbacks
 
 static errno_t
 procfs_ctl_connect(__unused kern_ctl_ref kctlref, struct sockaddr_ctl *sac, void **unitinfo)
 {
     lck_mtx_lock(g_ctl_lock);
-    g_ctl_unit      = sac->sc_unit;
-    g_ctl_connected = TRUE;
+    int conn = procfs_ctl_core_attach(&g_ctl_core);
+    if (conn >= 0) {
+        bzero(&g_ctl_links[conn], sizeof(g_ctl_links[conn]));
+        g_ctl_links[conn].unit = sac->sc_unit;
+    }
     lck_mtx_unlock(g_ctl_lock);
-    *unitinfo = NULL;
-    printf("procfs: ctl daemon connected (unit %u)\n", sac->sc_unit);
+    if (conn < 0) {
+        printf("procfs: ctl daemon refused: %d already connected\n", PROCFS_CTL_CONNS);
+        return EBUSY;
+    }
+    *unitinfo = (void *)(uintptr_t)(conn + 1);
+    printf("procfs: ctl daemon %d connected (unit %u)\n", conn, sac->sc_unit);
     return 0;
 }
 
 static errno_t
 procfs_ctl_disconnect(__unused kern_ctl_ref kctlref, __unused u_int32_t unit,
-    __unused void *unitinfo)
+    void *unitinfo)
 {
-    lck_mtx_lock(g_ctl_lock);
-    g_ctl_connected = FALSE;
-    /* Wake any waiters so they fall back instead of blocking for the timeout. */
-    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
-        if (g_ctl_slots[i].in_use && !g_ctl_slots[i].done) {
-            g_ctl_slots[i].error = ENOTCONN;
-            g_ctl_slots[i].done  = TRUE;
-            wakeup(&g_ctl_slots[i]);
-        }
+    int conn = procfs_ctl_conn(unitinfo);
+    if (conn < 0) {
+        return 0;
     }
+    /* Replies already in the ring still count; then the mapping goes. */
+    procfs_ctl_ring_detach(conn);
+    lck_mtx_lock(g_ctl_lock);
+    int evlast = procfs_ctl_core_evlast(&g_ctl_core, conn);
+    /* Wake its waiters so they fail with ENOTCONN instead of blocking for the timeout. */
+    uint32_t woken = procfs_ctl_core_detach(&g_ctl_core, conn, ENOTCONN);
+    procfs_ctl_wake(woken);
     lck_mtx_unlock(g_ctl_lock);
-    printf("procfs: ctl daemon disconnected\n");
+    /* If no other daemon sends events, they stop; per-pid state can go stale. */
+    if (evlast) {
+        procfs_events_deliver(NULL, 0, 1);
+    }
+    printf("procfs: ctl daemon %d disconnected (%u requests failed)\n", conn,
+        (unsigned)__builtin_popcount(woken));
     return 0;
 }
 
-/* Reply from the daemon: [struct procfs_ctl_resp][payload]. */
+/*
+ * A batch of lifecycle events from daemon `conn`: [struct procfs_ctl_evhdr]
+ * [records]. The records are copied out of the mbuf chain and handed to the
+ * subscribers (procfs_events.c); no slot of ours is involved, and the lock
+ * only to note that `conn` sends events.
+ */
+static void
+procfs_ctl_events(int conn, mbuf_t m, size_t total)
+{
+    struct procfs_ctl_evhdr hdr;
+    if (total < sizeof(hdr) || mbuf_copydata(m, 0, sizeof(hdr), &hdr) != 0) {
+        return;
+    }
+    int count = procfs_ctl_core_events(&hdr, total - sizeof(hdr));
+    if (count < 0) {
+        return;
+    }
+    if (conn >= 0) {
+        lck_mtx_lock(g_ctl_lock);
+        hdr.dropped = procfs_ctl_core_evbatch(&g_ctl_core, conn, hdr.dropped);
+        lck_mtx_unlock(g_ctl_lock);
+    }
+    if (count == 0) {
+        procfs_events_deliver(NULL, 0, hdr.dropped);
+        return;
+    }
+
+    size_t size = (size_t)count * sizeof(struct procfs_ctl_event);
+    struct procfs_ctl_event *ev = OSMalloc((uint32_t)size, procfs_osmalloc_tag);
+    if (ev == NULL) {
+        procfs_events_deliver(NULL, 0, hdr.dropped + (uint32_t)count);
+        return;
+    }
+    if (mbuf_copydata(m, sizeof(hdr), size, ev) == 0) {
+        procfs_events_deliver(ev, (uint32_t)count, hdr.dropped);
+    }
+    OSFree(ev, (uint32_t)size, procfs_osmalloc_tag);
+}
+
+/*
+ * Reply from the daemon: [struct procfs_ctl_resp][payload]. The payload is
+ * copied straight from the mbuf chain into the waiting caller's buffer, as
+ * much of it as fits, and from there to any riders'. Event batches
+ * and ring doorbells arrive on the same socket, told apart by their magic.
+ */
 static errno_t
 procfs_ctl_send(__unused kern_ctl_ref kctlref, __unused u_int32_t unit,
-    __unused void *unitinfo, mbuf_t m, __unused int flags)
+    void *unitinfo, mbuf_t m, __unused int flags)
 {
     struct procfs_ctl_resp resp;
     size_t total = mbuf_pkthdr_len(m);
 
-    if (total >= sizeof(resp) &&
-        mbuf_copydata(m, 0, sizeof(resp), &resp) == 0 &&
-        resp.magic == PROCFS_CTL_MAGIC) {
-        uint32_t plen = resp.len;
-        if (plen > PROCFS_CTL_MAXPAYLOAD) {
-            plen = PROCFS_CTL_MAXPAYLOAD;
-        }
+    if (total < sizeof(resp) || mbuf_copydata(m, 0, sizeof(resp), &resp) != 0) {
+        /* runt; drop it */
+    } else if (resp.magic == PROCFS_CTL_EVMAGIC) {
+        procfs_ctl_events(procfs_ctl_conn(unitinfo), m, total);
+    } else if (resp.magic == PROCFS_CTL_RINGMAGIC) {
         lck_mtx_lock(g_ctl_lock);
-        for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
-            if (g_ctl_slots[i].in_use && !g_ctl_slots[i].done &&
-                g_ctl_slots[i].seq == resp.seq) {
-                if (plen > 0 && total >= sizeof(resp) + plen) {
-                    mbuf_copydata(m, sizeof(resp), plen, g_ctl_slots[i].buf);
-                }
-                g_ctl_slots[i].len   = plen;
-                g_ctl_slots[i].error = resp.error;
-                g_ctl_slots[i].done  = TRUE;
-                wakeup(&g_ctl_slots[i]);
-                break;
+        procfs_ctl_ring_drain();
+        lck_mtx_unlock(g_ctl_lock);
+    } else {
+        lck_mtx_lock(g_ctl_lock);
+        uint32_t copy;
+        int error;
+        int slot = procfs_ctl_core_match(&g_ctl_core, &resp, total - sizeof(resp),
+            &copy, &error);
+        if (slot >= 0) {
+            if (copy > 0 &&
+                mbuf_copydata(m, sizeof(resp), copy, g_ctl_core.slots[slot].out) != 0) {
+                copy  = 0;
+                error = EIO;
             }
+            procfs_ctl_core_complete(&g_ctl_core, slot, error, copy);
+            procfs_ctl_wake(procfs_ctl_core_wakes(&g_ctl_core, slot));
         }
         lck_mtx_unlock(g_ctl_lock);
     }
@@ -114,90 +390,249 @@ procfs_ctl_send(__unused kern_ctl_ref kctlref, __unused u_int32_t unit,
     return 0;
 }
 
+#pragma mark -
+#pragma mark Requests
+
+static uint32_t
+procfs_ctl_deadline_ms(uint32_t type)
+{
+    if (type >= sizeof(g_ctl_deadline_ms) / sizeof(g_ctl_deadline_ms[0]) ||
+        g_ctl_deadline_ms[type] == 0) {
+        return PROCFS_CTL_DEADLINE_MS;
+    }
+    return g_ctl_deadline_ms[type];
+}
+
+static uint64_t
+procfs_ctl_now_ns(void)
+{
+    uint64_t ns;
+    absolutetime_to_nanoseconds(mach_absolute_time(), &ns);
+    return ns;
+}
+
 /*
- * Request `type` for `pid` (and `arg`, e.g. a tid) from the daemon. On success
- * copies up to `outcap` payload bytes into `out` and sets *outlen. Returns 0, or
- * an errno (ENOTCONN if no daemon, ETIMEDOUT if it didn't answer in time) so the
- * caller can fall back.
+ * Send request `type` for `pid` (and `arg`, e.g. a tid) to the daemon and
+ * return without waiting for the answer; collect it with procfs_ctl_wait(),
+ * or drop it with procfs_ctl_cancel(). The reply deadline starts now, so a
+ * caller that submits several requests and then waits for each sleeps for
+ * the slowest, not their sum.
+ *
+ * Up to `outcap` bytes of the reply's payload are delivered to `out` as soon
+ * as it arrives, so `out` belongs to the request until the wait or cancel:
+ * the caller must not read it, free it or return from its frame before.
+ *
+ * It goes to the connected daemon with the fewest requests outstanding that
+ * is neither draining nor failing fast - or to one whose breaker is due a
+ * probe - and is due within its type's deadline - unless the same
+ * request is already on its way, in which case it waits for that one's
+ * answer instead of being sent again.
+ *
+ * `pc` is always initialized. If the request could not be sent (ENOTCONN, no
+ * daemon is taking requests; EHOSTDOWN, every daemon's breaker is open;
+ * EBUSY, every slot or its priority class's share of them taken; or the
+ * enqueue failed), that errno is returned and also kept in `pc`, so
+ * procfs_ctl_wait() returns it at once: callers can submit, do their local
+ * work and wait without checking in between.
  */
 int
-procfs_ctl_request(uint32_t type, int pid, uint64_t arg, void *out,
-    uint32_t outcap, uint32_t *outlen)
+procfs_ctl_submit(uint32_t type, int pid, uint64_t arg, void *out, uint32_t outcap,
+    procfs_ctl_pending_t *pc)
 {
-    if (!g_ctl_connected || g_ctl_ref == NULL) {
+    pc->pc_slot      = -1;
+    pc->pc_error     = 0;
+    pc->pc_truncated = FALSE;
+    pc->pc_admit     = PROCFS_CTL_BRK_REJECT;
+    pc->pc_conn      = -1;
+    pc->pc_type      = type;
+
+    if (g_ctl_ref == NULL) {
+        pc->pc_error = ENOTCONN;
         return ENOTCONN;
     }
 
+    struct procfs_ctl_req req;
     lck_mtx_lock(g_ctl_lock);
-    int slot = -1;
-    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
-        if (!g_ctl_slots[i].in_use) {
-            slot = i;
-            break;
-        }
+    int slot = g_ctl_coalesce ?
+        procfs_ctl_core_join(&g_ctl_core, type, pid, arg, out, outcap) : -1;
+    if (slot >= 0) {
+        /* Nothing sent, so nothing for the breaker to judge. */
+        lck_mtx_unlock(g_ctl_lock);
+        clock_interval_to_deadline(procfs_ctl_deadline_ms(type), NSEC_PER_MSEC,
+            &pc->pc_deadline);
+        pc->pc_slot = slot;
+        return 0;
     }
+    int conn = procfs_ctl_core_pick(&g_ctl_core, procfs_ctl_now_ns(), &pc->pc_admit);
+    if (conn < 0) {
+        lck_mtx_unlock(g_ctl_lock);
+        pc->pc_error = pc->pc_admit == PROCFS_CTL_BRK_REJECT ? EHOSTDOWN : ENOTCONN;
+        pc->pc_admit = PROCFS_CTL_BRK_REJECT;
+        return pc->pc_error;
+    }
+    pc->pc_conn = conn;
+    slot = procfs_ctl_core_submit(&g_ctl_core, conn, type, pid, arg, out, outcap, &req);
     if (slot < 0) {
+        procfs_ctl_core_judge(&g_ctl_core, conn, type, procfs_ctl_now_ns(), pc->pc_admit, EBUSY);
         lck_mtx_unlock(g_ctl_lock);
+        pc->pc_error = EBUSY;
         return EBUSY;
     }
-    uint32_t seq = ++g_ctl_seq;
-    if (seq == 0) {
-        seq = ++g_ctl_seq;
-    }
-    g_ctl_slots[slot].in_use = TRUE;
-    g_ctl_slots[slot].done   = FALSE;
-    g_ctl_slots[slot].seq    = seq;
-    g_ctl_slots[slot].error  = 0;
-    g_ctl_slots[slot].len    = 0;
-    u_int32_t    unit = g_ctl_unit;
+    g_ctl_core.slots[slot].admit = pc->pc_admit;
+    struct procfs_ctl_link *l = &g_ctl_links[conn];
+    u_int32_t    unit = l->unit;
     kern_ctl_ref ref  = g_ctl_ref;
-    lck_mtx_unlock(g_ctl_lock);
+    clock_interval_to_deadline(procfs_ctl_deadline_ms(type), NSEC_PER_MSEC, &pc->pc_deadline);
 
-    struct procfs_ctl_req req = {
-        .magic = PROCFS_CTL_MAGIC,
-        .seq   = seq,
-        .type  = type,
-        .pid   = pid,
-        .arg   = arg,
-    };
+    if (l->ringed && procfs_ring_put(&l->reqs, &req, sizeof(req)) == 0) {
+        boolean_t ring = procfs_ring_wake_needed(&l->reqs);
+        lck_mtx_unlock(g_ctl_lock);
+        /*
+         * If the doorbell does not fit, the socket is full of datagrams
+         * procfsd has yet to read, and it looks at the ring after each.
+         */
+        if (ring) {
+            (void)ctl_enqueuedata(ref, unit, (void *)(uintptr_t)&g_ctl_doorbell,
+                sizeof(g_ctl_doorbell), 0);
+        }
+        pc->pc_slot = slot;
+        return 0;
+    }
+    lck_mtx_unlock(g_ctl_lock);
 
-    int error;
     errno_t e = ctl_enqueuedata(ref, unit, &req, sizeof(req), 0);
     if (e != 0) {
-        error = e;
-    } else {
-        struct timespec ts = { .tv_sec = PROCFS_CTL_TIMEO_S, .tv_nsec = 0 };
         lck_mtx_lock(g_ctl_lock);
-        while (!g_ctl_slots[slot].done) {
-            int r = msleep(&g_ctl_slots[slot], g_ctl_lock, PCATCH, "procfsctl", &ts);
-            if (r != 0) {
-                break;      /* timeout (EWOULDBLOCK) or signal */
-            }
-        }
-        if (g_ctl_slots[slot].done) {
-            error = g_ctl_slots[slot].error;
-            if (error == 0) {
-                uint32_t n = g_ctl_slots[slot].len;
-                if (n > outcap) {
-                    n = outcap;
-                }
-                memcpy(out, g_ctl_slots[slot].buf, n);
-                if (outlen != NULL) {
-                    *outlen = n;
-                }
-            }
-        } else {
-            error = ETIMEDOUT;
-        }
+        /* Whoever joined it meanwhile fails with it. */
+        procfs_ctl_core_complete(&g_ctl_core, slot, e, 0);
+        procfs_ctl_wake(procfs_ctl_core_wakes(&g_ctl_core, slot));
+        procfs_ctl_core_release(&g_ctl_core, slot);
+        procfs_ctl_core_judge(&g_ctl_core, conn, type, procfs_ctl_now_ns(), pc->pc_admit, e);
         lck_mtx_unlock(g_ctl_lock);
+        pc->pc_error = e;
+        return e;
+    }
+    pc->pc_slot = slot;
+    return 0;
+}
+
+/* TRUE once procfs_ctl_wait() on `pc` would not sleep. */
+boolean_t
+procfs_ctl_ready(const procfs_ctl_pending_t *pc)
+{
+    if (pc->pc_slot < 0) {
+        return TRUE;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    procfs_ctl_ring_drain();
+    boolean_t done = g_ctl_core.slots[pc->pc_slot].done;
+    lck_mtx_unlock(g_ctl_lock);
+    return done;
+}
+
+/*
+ * Wait for a submitted request until its deadline. On success the payload is
+ * in the submit's `out`, *outlen is its length and pc_truncated says whether
+ * the reply had more than `outcap`. Returns 0, or an errno (the submit error,
+ * ENOTCONN if the daemon went away, ETIMEDOUT if it did not answer in time
+ * or a signal came first, or the daemon's own error) with `out` undefined.
+ * Releases the request, and tells the breaker how it went if it was sent.
+ */
+int
+procfs_ctl_wait(procfs_ctl_pending_t *pc, uint32_t *outlen)
+{
+    int slot = pc->pc_slot;
+    if (slot < 0) {
+        return pc->pc_error;
     }
 
+    int error;
     lck_mtx_lock(g_ctl_lock);
-    g_ctl_slots[slot].in_use = FALSE;
+    while (!g_ctl_core.slots[slot].done) {
+        uint64_t now = mach_absolute_time(), ns;
+        if (now >= pc->pc_deadline) {
+            break;
+        }
+        /* Counted first, so the drain leaves the doorbell armed for us. */
+        g_ctl_sleepers++;
+        procfs_ctl_ring_drain();
+        if (g_ctl_core.slots[slot].done) {
+            g_ctl_sleepers--;
+            break;
+        }
+        absolutetime_to_nanoseconds(pc->pc_deadline - now, &ns);
+        struct timespec ts = {
+            .tv_sec  = (long)(ns / NSEC_PER_SEC),
+            .tv_nsec = (long)(ns % NSEC_PER_SEC),
+        };
+        int r = msleep(&g_ctl_core.slots[slot], g_ctl_lock, PCATCH, "procfsctl", &ts);
+        g_ctl_sleepers--;
+        if (r != 0 && r != EWOULDBLOCK) {
+            break;          /* signal */
+        }
+    }
+    int seen;       /* what the breaker makes of it: a signal is no miss */
+    if (g_ctl_core.slots[slot].done) {
+        error = seen = procfs_ctl_core_collect(&g_ctl_core, slot, outlen, &pc->pc_truncated);
+    } else {
+        error = ETIMEDOUT;
+        seen  = mach_absolute_time() >= pc->pc_deadline ? ETIMEDOUT : EINTR;
+    }
+    /* A rider that took the request over answers for it now; a leader handing it on does not. */
+    pc->pc_conn = procfs_ctl_core_judged_by(&g_ctl_core, slot, &pc->pc_admit);
+    procfs_ctl_core_release(&g_ctl_core, slot);
+    if (pc->pc_admit != PROCFS_CTL_BRK_REJECT) {
+        procfs_ctl_core_judge(&g_ctl_core, pc->pc_conn, pc->pc_type, procfs_ctl_now_ns(),
+            pc->pc_admit, seen);
+    }
     lck_mtx_unlock(g_ctl_lock);
+
+    pc->pc_slot  = -1;
+    pc->pc_error = error;
     return error;
 }
 
+/*
+ * Give up on a submitted request; its reply, if it still comes, is dropped,
+ * and the submit's `out` is the caller's again.
+ */
+void
+procfs_ctl_cancel(procfs_ctl_pending_t *pc)
+{
+    if (pc->pc_slot < 0) {
+        return;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    pc->pc_conn = procfs_ctl_core_judged_by(&g_ctl_core, pc->pc_slot, &pc->pc_admit);
+    procfs_ctl_core_release(&g_ctl_core, pc->pc_slot);
+    if (pc->pc_admit != PROCFS_CTL_BRK_REJECT) {
+        procfs_ctl_core_judge(&g_ctl_core, pc->pc_conn, pc->pc_type, procfs_ctl_now_ns(),
+            pc->pc_admit, ECANCELED);
+    }
+    lck_mtx_unlock(g_ctl_lock);
+    pc->pc_slot  = -1;
+    pc->pc_error = ECANCELED;
+}
+
+/*
+ * Request `type` for `pid` (and `arg`, e.g. a tid) from the daemon and wait
+ * for the answer. On success up to `outcap` payload bytes are in `out` and
+ * *outlen is their count; a longer reply is cut short. Returns 0, or an
+ * errno (ENOTCONN if no daemon, ETIMEDOUT if it didn't answer in time) so
+ * the caller can fall back.
+ */
+int
+procfs_ctl_request(uint32_t type, int pid, uint64_t arg, void *out,
+    uint32_t outcap, uint32_t *outlen)
+{
+    procfs_ctl_pending_t pc;
+    (void)procfs_ctl_submit(type, pid, arg, out, outcap, &pc);
+    return procfs_ctl_wait(&pc, outlen);
+}
+
+#pragma mark -
+#pragma mark Registration
+
 kern_return_t
 procfs_ctl_register(void)
 {
@@ -211,16 +646,19 @@ procfs_ctl_register(void)
         g_ctl_grp = NULL;
         return KERN_FAILURE;
     }
+    procfs_ctl_core_tune(&g_ctl_core, PROCFS_CTL_BRK_THRESHOLD, PROCFS_CTL_BRK_BACKOFF_MS);
 
     struct kern_ctl_reg reg;
     bzero(&reg, sizeof(reg));
     strlcpy(reg.ctl_name, PROCFS_CTL_NAME, sizeof(reg.ctl_name));
     reg.ctl_flags      = CTL_FLAG_PRIVILEGED;   /* only root may connect */
-    reg.ctl_sendsize   = 8192;
-    reg.ctl_recvsize   = 8192;
+    reg.ctl_sendsize   = 4 * (sizeof(struct procfs_ctl_resp) + PROCFS_CTL_MAXPAYLOAD);  /* replies */
+    reg.ctl_recvsize   = 8192;                                                        /* requests */
     reg.ctl_connect    = procfs_ctl_connect;
     reg.ctl_disconnect = procfs_ctl_disconnect;
     reg.ctl_send       = procfs_ctl_send;
+    reg.ctl_setopt     = procfs_ctl_setopt;
+    reg.ctl_getopt     = procfs_ctl_getopt;
 
     errno_t e = ctl_register(&reg, &g_ctl_ref);
     if (e != 0) {
@@ -242,7 +680,6 @@ procfs_ctl_deregister(void)
         ctl_deregister(g_ctl_ref);
         g_ctl_ref = NULL;
     }
-    g_ctl_connected = FALSE;
     if (g_ctl_lock != NULL) {
         lck_mtx_free(g_ctl_lock, g_ctl_grp);
         g_ctl_lock = NULL;
@@ -252,3 +689,244 @@ procfs_ctl_deregister(void)
         g_ctl_grp = NULL;
     }
 }
+
+#pragma mark -
+#pragma mark Tunables
+
+/* procfs.ctl.deadline_<type>: that type's reply deadline (ms). */
+static int
+procfs_ctl_sysctl_deadline(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    int value = (int)procfs_ctl_deadline_ms((uint32_t)arg2);
+    int error = sysctl_handle_int(oidp, &value, 0, req);
+    if (error != 0 || req->newptr == USER_ADDR_NULL) {
+        return error;
+    }
+    if (value < 1 || value > PROCFS_CTL_DEADLINE_MAX_MS) {
+        return EINVAL;
+    }
+    g_ctl_deadline_ms[arg2] = (uint32_t)value;
+    return 0;
+}
+
+/* procfs.ctl.breaker_threshold and _backoff_ms: every daemon's breaker's tunables. */
+static int
+procfs_ctl_sysctl_tunable(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    if (g_ctl_lock == NULL) {
+        return ENXIO;
+    }
+    struct procfs_ctl_breaker *b = &g_ctl_core.conns[0].brk;   /* they all agree */
+    uint32_t *field = (uint32_t *)(void *)((char *)b + arg2);
+    boolean_t misses = arg2 == (int)offsetof(struct procfs_ctl_breaker, threshold);
+    int min = misses ? 0 : 1;
+    int max = misses ? 1000 : 600000;
+
+    lck_mtx_lock(g_ctl_lock);
+    int value = (int)*field;
+    lck_mtx_unlock(g_ctl_lock);
+    int error = sysctl_handle_int(oidp, &value, 0, req);
+    if (error != 0 || req->newptr == USER_ADDR_NULL) {
+        return error;
+    }
+    if (value < min || value > max) {
+        return EINVAL;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    *field = (uint32_t)value;
+    procfs_ctl_core_tune(&g_ctl_core, b->threshold, b->backoff_ms);
+    lck_mtx_unlock(g_ctl_lock);
+    return 0;
+}
+
+/* procfs.ctl.breaker_state: the worst of the daemons' PROCFS_CTL_BRK_CLOSED, _OPEN or _HALFOPEN. */
+static int
+procfs_ctl_sysctl_state(struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2,
+    struct sysctl_req *req)
+{
+    if (g_ctl_lock == NULL) {
+        return ENXIO;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    int state = (int)procfs_ctl_core_brk_state(&g_ctl_core);
+    lck_mtx_unlock(g_ctl_lock);
+    return sysctl_handle_int(oidp, &state, 0, req);
+}
+
+/* procfs.ctl.breaker_<counter>: struct procfs_ctl_breaker_counts, summed over the daemons. */
+static int
+procfs_ctl_sysctl_count(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    if (g_ctl_lock == NULL) {
+        return ENXIO;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    struct procfs_ctl_breaker_counts c = procfs_ctl_core_brk_counts(&g_ctl_core);
+    lck_mtx_unlock(g_ctl_lock);
+    uint64_t value = *(const uint64_t *)((const char *)&c + arg2);
+    return sysctl_handle_quad(oidp, &value, 0, req);
+}
+
+/* procfs.ctl.coalesce: whether identical requests in flight share one. */
+static int
+procfs_ctl_sysctl_coalesce(struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2,
+    struct sysctl_req *req)
+{
+    int value = g_ctl_coalesce;
+    int error = sysctl_handle_int(oidp, &value, 0, req);
+    if (error != 0 || req->newptr == USER_ADDR_NULL) {
+        return error;
+    }
+    if (value != 0 && value != 1) {
+        return EINVAL;
+    }
+    g_ctl_coalesce = value;
+    return 0;
+}
+
+/* procfs.ctl.sent, .coalesced and .handoffs: struct procfs_ctl_core_counts. */
+static int
+procfs_ctl_sysctl_core_count(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    if (g_ctl_lock == NULL) {
+        return ENXIO;
+    }
+    lck_mtx_lock(g_ctl_lock);
+    struct procfs_ctl_core_counts c = g_ctl_core.counts;
+    lck_mtx_unlock(g_ctl_lock);
+    uint64_t value = *(const uint64_t *)((const char *)&c + arg2);
+    return sysctl_handle_quad(oidp, &value, 0, req);
+}
+
+/*
+ * Built by hand and registered through sysctl_register_oid() for the same
+ * reason as the procfs node itself (see procfs_linux.c). The node's parent
+ * is filled in at registration.
+ */
+static struct sysctl_oid_list procfs_ctl_children;
+
+static struct sysctl_oid procfs_ctl_node = {
+    .oid_parent  = NULL,
+    .oid_number  = OID_AUTO,
+    .oid_kind    = CTLTYPE_NODE | CTLFLAG_RW | CTLFLAG_LOCKED | CTLFLAG_OID2,
+    .oid_arg1    = &procfs_ctl_children,
+    .oid_arg2    = 0,
+    .oid_name    = "ctl",
+    .oid_handler = NULL,
+    .oid_fmt     = "N",
+    .oid_descr   = "procfsd bridge deadlines, circuit breaker and coalescing",
+    .oid_version = SYSCTL_OID_VERSION,
+};
+
+#define PROCFS_CTL_OID(var, kind, arg2_, name, handler, fmt, descr)  \
+    static struct sysctl_oid var = {                                  \
+        .oid_parent  = &procfs_ctl_children,                          \
+        .oid_number  = OID_AUTO,                                      \
+        .oid_kind    = (kind) | CTLFLAG_LOCKED | CTLFLAG_OID2,        \
+        .oid_arg1    = NULL,                                          \
+        .oid_arg2    = (arg2_),                                       \
+        .oid_name    = (name),                                        \
+        .oid_handler = (handler),                                     \
+        .oid_fmt     = (fmt),                                         \
+        .oid_descr   = (descr),                                       \
+        .oid_version = SYSCTL_OID_VERSION,                            \
+    }
+
+#define PROCFS_CTL_DEADLINE(type, name)                               \
+    PROCFS_CTL_OID(procfs_ctl_deadline_##name##_oid,                  \
+        CTLTYPE_INT | CTLFLAG_RW, (type), "deadline_" #name,          \
+        procfs_ctl_sysctl_deadline, "I", "ms to wait for procfsd's " #name " reply")
+
+PROCFS_CTL_DEADLINE(PROCFS_REQ_TASKINFO, taskinfo);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_THREADINFO, threadinfo);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_VMSTAT, vmstat);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_LOADAVG, loadavg);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_REGS, regs);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_FPREGS, fpregs);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_THREADS, threads);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_TASKINFOS, taskinfos);
+PROCFS_CTL_DEADLINE(PROCFS_REQ_IOINFOS, ioinfos);
+
+PROCFS_CTL_OID(procfs_ctl_threshold_oid, CTLTYPE_INT | CTLFLAG_RW,
+    offsetof(struct procfs_ctl_breaker, threshold), "breaker_threshold",
+    procfs_ctl_sysctl_tunable, "I", "fast deadlines missed in a row that open a daemon's breaker; 0 = never");
+PROCFS_CTL_OID(procfs_ctl_backoff_oid, CTLTYPE_INT | CTLFLAG_RW,
+    offsetof(struct procfs_ctl_breaker, backoff_ms), "breaker_backoff_ms",
+    procfs_ctl_sysctl_tunable, "I", "ms the breaker stays open before its first probe");
+PROCFS_CTL_OID(procfs_ctl_state_oid, CTLTYPE_INT | CTLFLAG_RD, 0, "breaker_state",
+    procfs_ctl_sysctl_state, "I", "0 = all closed (healthy), 1 = one open (failing fast), 2 = one probing");
+
+#define PROCFS_CTL_COUNT(field, descr)                                \
+    PROCFS_CTL_OID(procfs_ctl_##field##_oid, CTLTYPE_QUAD | CTLFLAG_RD, \
+        offsetof(struct procfs_ctl_breaker_counts, field), "breaker_" #field, \
+        procfs_ctl_sysctl_count, "QU", descr)
+
+PROCFS_CTL_COUNT(misses, "procfsd fast-class reply deadlines missed");
+PROCFS_CTL_COUNT(opened, "times the breaker opened: procfsd marked unhealthy");
+PROCFS_CTL_COUNT(probes, "recovery probes sent while open");
+PROCFS_CTL_COUNT(reopened, "probes that missed too, reopening the breaker");
+PROCFS_CTL_COUNT(closed, "times the breaker closed again: procfsd back");
+PROCFS_CTL_COUNT(rejected, "requests failed fast while open");
+
+PROCFS_CTL_OID(procfs_ctl_coalesce_oid, CTLTYPE_INT | CTLFLAG_RW, 0, "coalesce",
+    procfs_ctl_sysctl_coalesce, "I", "1 = identical requests in flight share one answer");
+
+#define PROCFS_CTL_CORE_COUNT(field, descr)                           \
+    PROCFS_CTL_OID(procfs_ctl_core_##field##_oid, CTLTYPE_QUAD | CTLFLAG_RD, \
+        offsetof(struct procfs_ctl_core_counts, field), #field,       \
+        procfs_ctl_sysctl_core_count, "QU", descr)
+
+PROCFS_CTL_CORE_COUNT(sent, "requests sent to procfsd");
+PROCFS_CTL_CORE_COUNT(coalesced, "requests that shared an identical one in flight instead");
+PROCFS_CTL_CORE_COUNT(handoffs, "shared requests whose first asker gave up, another taking over");
+
+static struct sysctl_oid *const procfs_ctl_oids[] = {
+    &procfs_ctl_deadline_taskinfo_oid,
+    &procfs_ctl_deadline_threadinfo_oid,
+    &procfs_ctl_deadline_vmstat_oid,
+    &procfs_ctl_deadline_loadavg_oid,
+    &procfs_ctl_deadline_regs_oid,
+    &procfs_ctl_deadline_fpregs_oid,
+    &procfs_ctl_deadline_threads_oid,
+    &procfs_ctl_deadline_taskinfos_oid,
+    &procfs_ctl_deadline_ioinfos_oid,
+    &procfs_ctl_threshold_oid,
+    &procfs_ctl_backoff_oid,
+    &procfs_ctl_state_oid,
+    &procfs_ctl_misses_oid,
+    &procfs_ctl_opened_oid,
+    &procfs_ctl_probes_oid,
+    &procfs_ctl_reopened_oid,
+    &procfs_ctl_closed_oid,
+    &procfs_ctl_rejected_oid,
+    &procfs_ctl_coalesce_oid,
+    &procfs_ctl_core_sent_oid,
+    &procfs_ctl_core_coalesced_oid,
+    &procfs_ctl_core_handoffs_oid,
+};
+
+#define PROCFS_CTL_NOIDS    (int)(sizeof(procfs_ctl_oids) / sizeof(procfs_ctl_oids[0]))
+
+/* Registers procfs.ctl below `parent`, which must already be registered. */
+void
+procfs_ctl_sysctl_register(struct sysctl_oid_list *parent)
+{
+    procfs_ctl_node.oid_parent = parent;
+    sysctl_register_oid(&procfs_ctl_node);
+    for (int i = 0; i < PROCFS_CTL_NOIDS; i++) {
+        sysctl_register_oid(procfs_ctl_oids[i]);
+    }
+}
+
+void
+procfs_ctl_sysctl_unregister(void)
+{
+    for (int i = PROCFS_CTL_NOIDS - 1; i >= 0; i--) {
+        sysctl_unregister_oid(procfs_ctl_oids[i]);
+    }
+    sysctl_unregister_oid(&procfs_ctl_node);
+}
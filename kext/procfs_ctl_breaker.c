@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_ctl_breaker.c
+ *
+ * Circuit breaker for procfsd requests (see procfs_ctl_breaker.h). No locks,
+ * no clock and no kernel KPI, so procfs_ctl.c and test/host run the same
+ * state machine.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <sys/errno.h>
+
+#include <fs/procfs/procfs_ctl_breaker.h>
+
+#define PROCFS_CTL_BRK_NSEC_PER_MS  1000000ULL
+
+void
+procfs_ctl_breaker_init(struct procfs_ctl_breaker *b, uint32_t threshold, uint32_t backoff_ms)
+{
+    memset(b, 0, sizeof(*b));
+    b->state      = PROCFS_CTL_BRK_CLOSED;
+    b->threshold  = threshold;
+    b->backoff_ms = backoff_ms;
+}
+
+/* Open it for the current backoff, from `now`. */
+static void
+procfs_ctl_breaker_open(struct procfs_ctl_breaker *b, uint64_t now)
+{
+    b->state = PROCFS_CTL_BRK_OPEN;
+    b->until = now + ((uint64_t)b->backoff_ms << b->shift) * PROCFS_CTL_BRK_NSEC_PER_MS;
+}
+
+int
+procfs_ctl_breaker_admit(struct procfs_ctl_breaker *b, uint64_t now)
+{
+    switch (b->state) {
+    case PROCFS_CTL_BRK_CLOSED:
+        return PROCFS_CTL_BRK_PASS;
+    case PROCFS_CTL_BRK_OPEN:
+        if (now >= b->until) {
+            b->state = PROCFS_CTL_BRK_HALFOPEN;
+            b->counts.probes++;
+            return PROCFS_CTL_BRK_PROBE;
+        }
+        break;
+    default:
+        break;
+    }
+    b->counts.rejected++;
+    return PROCFS_CTL_BRK_REJECT;
+}
+
+/*
+ * A result that says nothing about the daemon: no slot, no daemon, no room
+ * in the socket, or the caller stopped waiting before the deadline.
+ */
+static int
+procfs_ctl_breaker_moot(int error)
+{
+    return error == EBUSY || error == ENOTCONN || error == ENOBUFS ||
+           error == ECANCELED || error == EINTR;
+}
+
+void
+procfs_ctl_breaker_done(struct procfs_ctl_breaker *b, uint64_t now, int admitted, int error)
+{
+    if (error == ETIMEDOUT) {
+        b->counts.misses++;
+    }
+
+    if (admitted == PROCFS_CTL_BRK_PROBE) {
+        if (b->state != PROCFS_CTL_BRK_HALFOPEN) {
+            return;     /* reset while it was out */
+        }
+        if (error == ETIMEDOUT) {
+            if (b->shift < PROCFS_CTL_BRK_SHIFT_MAX) {
+                b->shift++;
+            }
+            procfs_ctl_breaker_open(b, now);
+            b->counts.reopened++;
+        } else if (procfs_ctl_breaker_moot(error)) {
+            /* It proved nothing: the next request probes instead. */
+            b->state = PROCFS_CTL_BRK_OPEN;
+            b->until = now;
+        } else {
+            procfs_ctl_breaker_reset(b);
+        }
+        return;
+    }
+
+    if (b->state != PROCFS_CTL_BRK_CLOSED) {
+        return;
+    }
+    if (error == ETIMEDOUT) {
+        b->missed++;
+        if (b->threshold != 0 && b->missed >= b->threshold) {
+            b->shift = 0;
+            procfs_ctl_breaker_open(b, now);
+            b->counts.opened++;
+        }
+    } else if (!procfs_ctl_breaker_moot(error)) {
+        b->missed = 0;
+    }
+}
+
+void
+procfs_ctl_breaker_reset(struct procfs_ctl_breaker *b)
+{
+    if (b->state != PROCFS_CTL_BRK_CLOSED) {
+        b->counts.closed++;
+    }
+    b->state  = PROCFS_CTL_BRK_CLOSED;
+    b->missed = 0;
+    b->shift  = 0;
+    b->until  = 0;
+}
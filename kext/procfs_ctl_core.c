@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_ctl_core.c
+ *
+ * Slot table and reply matching for procfsd requests (see procfs_ctl_core.h).
+ * Pure bookkeeping on a struct procfs_ctl_core: no locks, no sleeping and no
+ * kernel KPI, so the kernel control in procfs_ctl.c and the loopback harness
+ * in test/host run exactly the same code.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/errno.h>
+
+#include <fs/procfs/procfs_ctl_core.h>
+
+static const uint32_t procfs_ctl_core_quota[PROCFS_CTL_NPRIO] = {
+    [PROCFS_CTL_PRIO_FAST]  = PROCFS_CTL_QUOTA_FAST,
+    [PROCFS_CTL_PRIO_BULK]  = PROCFS_CTL_QUOTA_BULK,
+    [PROCFS_CTL_PRIO_DEBUG] = PROCFS_CTL_QUOTA_DEBUG,
+};
+
+uint32_t
+procfs_ctl_core_prio(uint32_t type)
+{
+    return procfs_ctl_prio(type);
+}
+
+int
+procfs_ctl_core_attach(struct procfs_ctl_core *core)
+{
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        if (core->conns[c].state == PROCFS_CTL_CONN_FREE) {
+            core->conns[c].state       = PROCFS_CTL_CONN_LIVE;
+            core->conns[c].outstanding = 0;
+            core->conns[c].sent        = 0;
+            core->conns[c].evsource    = 0;
+            procfs_ctl_breaker_reset(&core->conns[c].brk);  /* a new daemon gets a fresh start */
+            return c;
+        }
+    }
+    return -1;
+}
+
+uint32_t
+procfs_ctl_core_detach(struct procfs_ctl_core *core, int conn, int error)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        struct procfs_ctl_slot *s = &core->slots[i];
+        if (s->in_use && !s->done && s->conn == conn) {
+            procfs_ctl_core_complete(core, i, error, 0);
+            mask |= procfs_ctl_core_wakes(core, i);
+        }
+    }
+    core->conns[conn].state    = PROCFS_CTL_CONN_FREE;
+    core->conns[conn].evsource = 0;
+    return mask;
+}
+
+void
+procfs_ctl_core_drain(struct procfs_ctl_core *core, int conn)
+{
+    if (core->conns[conn].state == PROCFS_CTL_CONN_LIVE) {
+        core->conns[conn].state = PROCFS_CTL_CONN_DRAINING;
+    }
+}
+
+uint32_t
+procfs_ctl_core_outstanding(const struct procfs_ctl_core *core, int conn)
+{
+    return core->conns[conn].outstanding;
+}
+
+int
+procfs_ctl_core_pick(struct procfs_ctl_core *core, uint64_t now, int *admit)
+{
+    int best = -1, probe = -1, held = -1;
+    for (int k = 1; k <= PROCFS_CTL_CONNS; k++) {
+        int c = (int)((core->last + (uint32_t)k) % PROCFS_CTL_CONNS);
+        const struct procfs_ctl_conn *cn = &core->conns[c];
+        if (cn->state != PROCFS_CTL_CONN_LIVE) {
+            continue;
+        }
+        if (cn->brk.state == PROCFS_CTL_BRK_CLOSED) {
+            if (best < 0 || cn->outstanding < core->conns[best].outstanding) {
+                best = c;
+            }
+        } else if (cn->brk.state == PROCFS_CTL_BRK_OPEN && now >= cn->brk.until) {
+            if (probe < 0) {
+                probe = c;
+            }
+        } else if (held < 0) {
+            held = c;
+        }
+    }
+    if (probe >= 0) {
+        best = probe;
+    }
+    if (best < 0) {
+        /* Counted as a rejection by one of the open breakers. */
+        *admit = held >= 0 ? procfs_ctl_breaker_admit(&core->conns[held].brk, now) :
+                             PROCFS_CTL_BRK_PASS;
+        return -1;
+    }
+    *admit = procfs_ctl_breaker_admit(&core->conns[best].brk, now);
+    core->last = (uint32_t)best;
+    return best;
+}
+
+void
+procfs_ctl_core_judge(struct procfs_ctl_core *core, int conn, uint32_t type, uint64_t now,
+    int admit, int error)
+{
+    /* As moot for the daemon's health as a caller giving up. */
+    if (error == ETIMEDOUT && procfs_ctl_prio(type) != PROCFS_CTL_PRIO_FAST) {
+        error = ECANCELED;
+    }
+    procfs_ctl_breaker_done(&core->conns[conn].brk, now, admit, error);
+}
+
+void
+procfs_ctl_core_tune(struct procfs_ctl_core *core, uint32_t threshold, uint32_t backoff_ms)
+{
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        core->conns[c].brk.threshold  = threshold;
+        core->conns[c].brk.backoff_ms = backoff_ms;
+    }
+}
+
+uint32_t
+procfs_ctl_core_brk_state(const struct procfs_ctl_core *core)
+{
+    uint32_t state = PROCFS_CTL_BRK_CLOSED;
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        const struct procfs_ctl_conn *cn = &core->conns[c];
+        if (cn->state == PROCFS_CTL_CONN_FREE || cn->brk.state == PROCFS_CTL_BRK_CLOSED) {
+            continue;
+        }
+        if (cn->brk.state == PROCFS_CTL_BRK_OPEN) {
+            return PROCFS_CTL_BRK_OPEN;
+        }
+        state = cn->brk.state;
+    }
+    return state;
+}
+
+struct procfs_ctl_breaker_counts
+procfs_ctl_core_brk_counts(const struct procfs_ctl_core *core)
+{
+    struct procfs_ctl_breaker_counts sum;
+    memset(&sum, 0, sizeof(sum));
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        const struct procfs_ctl_breaker_counts *n = &core->conns[c].brk.counts;
+        sum.misses   += n->misses;
+        sum.opened   += n->opened;
+        sum.probes   += n->probes;
+        sum.reopened += n->reopened;
+        sum.closed   += n->closed;
+        sum.rejected += n->rejected;
+    }
+    return sum;
+}
+
+/* The slot is answered or abandoned: its connection no longer owes it. */
+static void
+procfs_ctl_core_unlink(struct procfs_ctl_core *core, struct procfs_ctl_slot *s)
+{
+    if (s->conn >= 0) {
+        core->conns[s->conn].outstanding--;
+        s->conn = -1;
+    }
+}
+
+int
+procfs_ctl_core_submit(struct procfs_ctl_core *core, int conn, uint32_t type, int pid,
+    uint64_t arg, void *out, uint32_t outcap, struct procfs_ctl_req *req)
+{
+    uint32_t prio = procfs_ctl_core_prio(type);
+    uint32_t sent = 0;
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        sent += core->held[p];
+    }
+    if (sent >= PROCFS_CTL_INFLIGHT || core->held[prio] >= procfs_ctl_core_quota[prio]) {
+        return -1;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        if (!core->slots[i].in_use) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        return -1;
+    }
+
+    uint32_t seq = ++core->seq;
+    if (seq == 0) {
+        seq = ++core->seq;
+    }
+    struct procfs_ctl_slot *s = &core->slots[slot];
+    s->in_use    = TRUE;
+    s->done      = FALSE;
+    s->truncated = FALSE;
+    s->prio      = prio;
+    s->conn      = conn;
+    s->judge     = conn;
+    s->admit     = PROCFS_CTL_BRK_PASS;
+    s->seq       = seq;
+    s->type      = type;
+    s->pid       = pid;
+    s->arg       = arg;
+    s->lead      = -1;
+    s->riders    = 0;
+    s->error     = 0;
+    s->len       = 0;
+    s->out       = out;
+    s->outcap    = out != NULL ? outcap : 0;
+
+    memset(req, 0, sizeof(*req));
+    req->magic = PROCFS_CTL_MAGIC;
+    req->seq   = seq;
+    req->type  = type;
+    req->pid   = pid;
+    req->arg   = arg;
+    req->prio  = prio;
+    core->held[prio]++;
+    core->conns[conn].outstanding++;
+    core->conns[conn].sent++;
+    core->counts.sent++;
+    return slot;
+}
+
+int
+procfs_ctl_core_join(struct procfs_ctl_core *core, uint32_t type, int pid, uint64_t arg,
+    void *out, uint32_t outcap)
+{
+    if (core->riding >= PROCFS_CTL_SLOTS - PROCFS_CTL_INFLIGHT) {
+        return -1;
+    }
+    if (out == NULL) {
+        outcap = 0;
+    }
+
+    int lead = -1, slot = -1;
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        const struct procfs_ctl_slot *s = &core->slots[i];
+        if (!s->in_use) {
+            if (slot < 0) {
+                slot = i;
+            }
+        } else if (lead < 0 && !s->done && s->lead < 0 && s->type == type &&
+                   s->pid == pid && s->arg == arg && s->outcap >= outcap) {
+            lead = i;
+        }
+    }
+    if (lead < 0 || slot < 0) {
+        return -1;
+    }
+
+    struct procfs_ctl_slot *s = &core->slots[slot];
+    s->in_use    = TRUE;
+    s->done      = FALSE;
+    s->truncated = FALSE;
+    s->prio      = core->slots[lead].prio;
+    s->conn      = -1;
+    s->judge     = -1;
+    s->admit     = PROCFS_CTL_BRK_REJECT;
+    s->seq       = 0;
+    s->type      = type;
+    s->pid       = pid;
+    s->arg       = arg;
+    s->lead      = lead;
+    s->riders    = 0;
+    s->error     = 0;
+    s->len       = 0;
+    s->out       = out;
+    s->outcap    = outcap;
+    core->slots[lead].riders |= 1u << slot;
+    core->riding++;
+    core->counts.coalesced++;
+    return slot;
+}
+
+int
+procfs_ctl_core_match(struct procfs_ctl_core *core, const struct procfs_ctl_resp *resp,
+    size_t avail, uint32_t *copy, int *error)
+{
+    if (resp->magic != PROCFS_CTL_MAGIC || resp->seq == 0) {
+        return -1;
+    }
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        struct procfs_ctl_slot *s = &core->slots[i];
+        if (s->in_use && !s->done && s->seq == resp->seq) {
+            uint32_t plen = resp->len;
+            if (plen > PROCFS_CTL_MAXPAYLOAD) {
+                plen = PROCFS_CTL_MAXPAYLOAD;
+            }
+            if (plen > avail) {
+                *copy  = 0;
+                *error = EIO;
+            } else {
+                *copy  = plen < s->outcap ? plen : s->outcap;
+                *error = resp->error;
+                s->truncated = plen > s->outcap;
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+void
+procfs_ctl_core_complete(struct procfs_ctl_core *core, int slot, int error, uint32_t len)
+{
+    struct procfs_ctl_slot *s = &core->slots[slot];
+    procfs_ctl_core_unlink(core, s);
+    s->len   = len;
+    s->error = error;
+    s->done  = TRUE;
+
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        struct procfs_ctl_slot *r = &core->slots[i];
+        if (!(s->riders & (1u << i)) || r->done) {
+            continue;
+        }
+        uint32_t copy = len < r->outcap ? len : r->outcap;
+        if (copy > 0) {
+            memcpy(r->out, s->out, copy);
+        }
+        r->truncated = s->truncated || len > r->outcap;
+        r->len       = copy;
+        r->error     = error;
+        r->done      = TRUE;
+    }
+}
+
+uint32_t
+procfs_ctl_core_wakes(const struct procfs_ctl_core *core, int slot)
+{
+    return (1u << slot) | core->slots[slot].riders;
+}
+
+int
+procfs_ctl_core_reply(struct procfs_ctl_core *core, const void *dgram, size_t len)
+{
+    struct procfs_ctl_resp resp;
+    if (len < sizeof(resp)) {
+        return -1;
+    }
+    memcpy(&resp, dgram, sizeof(resp));
+
+    uint32_t copy;
+    int error;
+    int slot = procfs_ctl_core_match(core, &resp, len - sizeof(resp), &copy, &error);
+    if (slot >= 0) {
+        if (copy > 0) {
+            memcpy(core->slots[slot].out, (const uint8_t *)dgram + sizeof(resp), copy);
+        }
+        procfs_ctl_core_complete(core, slot, error, copy);
+    }
+    return slot;
+}
+
+uint32_t
+procfs_ctl_core_fail_all(struct procfs_ctl_core *core, int error)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        /* Riders complete with their leaders. */
+        if (core->slots[i].in_use && !core->slots[i].done && core->slots[i].lead < 0) {
+            procfs_ctl_core_complete(core, i, error, 0);
+            mask |= procfs_ctl_core_wakes(core, i);
+        }
+    }
+    return mask;
+}
+
+int
+procfs_ctl_core_collect(const struct procfs_ctl_core *core, int slot, uint32_t *outlen,
+    boolean_t *truncated)
+{
+    const struct procfs_ctl_slot *s = &core->slots[slot];
+    if (s->error != 0) {
+        return s->error;
+    }
+    if (outlen != NULL) {
+        *outlen = s->len;
+    }
+    if (truncated != NULL) {
+        *truncated = s->truncated;
+    }
+    return 0;
+}
+
+/*
+ * `slot` is giving up on a request that still has riders: the rider with
+ * the most room takes it over - its seq, its connection and its share of
+ * the class, and the breaker's verdict on it - so the reply still has
+ * someone to go to, and a miss still someone to report it.
+ */
+static void
+procfs_ctl_core_handoff(struct procfs_ctl_core *core, int slot)
+{
+    struct procfs_ctl_slot *s = &core->slots[slot];
+    int heir = -1;
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        if ((s->riders & (1u << i)) &&
+            (heir < 0 || core->slots[i].outcap > core->slots[heir].outcap)) {
+            heir = i;
+        }
+    }
+
+    struct procfs_ctl_slot *h = &core->slots[heir];
+    h->lead   = -1;
+    h->seq    = s->seq;
+    h->conn   = s->conn;
+    h->judge  = s->judge;
+    h->admit  = s->admit;
+    h->riders = s->riders & ~(1u << heir);
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        if (h->riders & (1u << i)) {
+            core->slots[i].lead = heir;
+        }
+    }
+    s->conn   = -1;
+    s->judge  = -1;
+    s->admit  = PROCFS_CTL_BRK_REJECT;
+    s->riders = 0;
+    core->riding--;
+    core->counts.handoffs++;
+}
+
+int
+procfs_ctl_core_judged_by(const struct procfs_ctl_core *core, int slot, int *admit)
+{
+    const struct procfs_ctl_slot *s = &core->slots[slot];
+    if (s->judge < 0 || (!s->done && s->riders != 0)) {
+        /* A rider, or a leader whose request is about to pass to one. */
+        *admit = PROCFS_CTL_BRK_REJECT;
+        return -1;
+    }
+    *admit = s->admit;
+    return s->judge;
+}
+
+void
+procfs_ctl_core_release(struct procfs_ctl_core *core, int slot)
+{
+    struct procfs_ctl_slot *s = &core->slots[slot];
+    if (s->in_use) {
+        if (s->lead >= 0) {
+            core->slots[s->lead].riders &= ~(1u << slot);
+            core->riding--;
+        } else if (!s->done && s->riders != 0) {
+            procfs_ctl_core_handoff(core, slot);
+        } else {
+            core->held[s->prio]--;
+            procfs_ctl_core_unlink(core, s);
+        }
+    }
+    s->in_use = FALSE;
+    s->done   = FALSE;
+    s->lead   = -1;
+    s->riders = 0;
+    s->out    = NULL;
+}
+
+int
+procfs_ctl_core_events(const struct procfs_ctl_evhdr *hdr, size_t avail)
+{
+    if (hdr->magic != PROCFS_CTL_EVMAGIC || hdr->count > PROCFS_CTL_MAXEVENTS ||
+        (size_t)hdr->count * sizeof(struct procfs_ctl_event) > avail) {
+        return -1;
+    }
+    return (int)hdr->count;
+}
+
+/* Whether a connection other than `conn` has been sending events. */
+static int
+procfs_ctl_core_evothers(const struct procfs_ctl_core *core, int conn)
+{
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        if (c != conn && core->conns[c].state != PROCFS_CTL_CONN_FREE && core->conns[c].evsource) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+uint32_t
+procfs_ctl_core_evbatch(struct procfs_ctl_core *core, int conn, uint32_t dropped)
+{
+    if (!core->conns[conn].evsource && dropped > 0 && procfs_ctl_core_evothers(core, conn)) {
+        dropped--;
+    }
+    core->conns[conn].evsource = 1;
+    return dropped;
+}
+
+int
+procfs_ctl_core_evlast(const struct procfs_ctl_core *core, int conn)
+{
+    return core->conns[conn].evsource && !procfs_ctl_core_evothers(core, conn);
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_events.c
+ *
+ * Process lifecycle events from procfsd. The kext has no hook of its own
+ * into fork, exec or exit, so anything it keeps per pid could only expire
+ * by time. procfsd watches processes with kqueue EVFILT_PROC and sends what
+ * it sees in unsolicited batches on the control socket (procfs_ctl.c); this
+ * file hands each batch to whoever subscribed.
+ *
+ * Subscribers run on the kernel-control input thread with no procfs lock
+ * held. They may take their own locks but must not sleep on the daemon.
+ * A batch with `dropped` set means events were lost - the daemon went away,
+ * or could not keep up - and per-pid state should be thrown away rather than
+ * trusted.
+ */
+#include <kern/locks.h>
+#include <libkern/OSAtomic.h>
+#include <sys/errno.h>
+#include <sys/systm.h>
+
+#include <fs/procfs/procfs.h>
+#include <fs/procfs/procfs_ctl.h>
+
+#define PROCFS_EVENT_SUBS   4
+
+struct procfs_event_sub {
+    procfs_event_fn  es_fn;
+    void            *es_arg;
+};
+
+static lck_rw_t                   *procfs_events_lock;
+static struct procfs_event_sub     procfs_event_subs[PROCFS_EVENT_SUBS];
+static struct procfs_event_counts  procfs_event_counts;
+
+void
+procfs_events_init(void)
+{
+    procfs_events_lock = lck_rw_alloc_init(pfsnode_lck_grp, LCK_ATTR_NULL);
+}
+
+void
+procfs_events_fini(void)
+{
+    if (procfs_events_lock != NULL) {
+        lck_rw_free(procfs_events_lock, pfsnode_lck_grp);
+        procfs_events_lock = NULL;
+    }
+    bzero(procfs_event_subs, sizeof(procfs_event_subs));
+}
+
+/* Call `fn(arg, ...)` for every batch from now on. Returns 0, or ENOSPC. */
+int
+procfs_event_subscribe(procfs_event_fn fn, void *arg)
+{
+    int error = ENOSPC;
+    lck_rw_lock_exclusive(procfs_events_lock);
+    for (int i = 0; i < PROCFS_EVENT_SUBS; i++) {
+        if (procfs_event_subs[i].es_fn == NULL) {
+            procfs_event_subs[i].es_fn  = fn;
+            procfs_event_subs[i].es_arg = arg;
+            error = 0;
+            break;
+        }
+    }
+    lck_rw_unlock_exclusive(procfs_events_lock);
+    return error;
+}
+
+/* Stop calling `fn(arg, ...)`; once this returns, no call is in progress. */
+void
+procfs_event_unsubscribe(procfs_event_fn fn, void *arg)
+{
+    lck_rw_lock_exclusive(procfs_events_lock);
+    for (int i = 0; i < PROCFS_EVENT_SUBS; i++) {
+        if (procfs_event_subs[i].es_fn == fn && procfs_event_subs[i].es_arg == arg) {
+            procfs_event_subs[i].es_fn  = NULL;
+            procfs_event_subs[i].es_arg = NULL;
+        }
+    }
+    lck_rw_unlock_exclusive(procfs_events_lock);
+}
+
+/*
+ * Hand a batch of `count` events (none if `ev` is NULL) to every subscriber.
+ * Called from the control socket, and with no events but `dropped` set when
+ * the daemon disconnects.
+ */
+void
+procfs_events_deliver(const struct procfs_ctl_event *ev, uint32_t count, uint32_t dropped)
+{
+    if (procfs_events_lock == NULL) {
+        return;
+    }
+    OSIncrementAtomic64((volatile SInt64 *)&procfs_event_counts.batches);
+    OSAddAtomic64((SInt64)count, (volatile SInt64 *)&procfs_event_counts.events);
+    OSAddAtomic64((SInt64)dropped, (volatile SInt64 *)&procfs_event_counts.dropped);
+
+    lck_rw_lock_shared(procfs_events_lock);
+    for (int i = 0; i < PROCFS_EVENT_SUBS; i++) {
+        if (procfs_event_subs[i].es_fn != NULL) {
+            procfs_event_subs[i].es_fn(procfs_event_subs[i].es_arg, ev, count, dropped);
+        }
+    }
+    lck_rw_unlock_shared(procfs_events_lock);
+}
+
+/* The counters so far, for procfs.stats. */
+void
+procfs_events_counts(struct procfs_event_counts *out)
+{
+    *out = procfs_event_counts;
+}
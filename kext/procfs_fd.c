@@ -180,31 +180,6 @@ procfs_read_socket_data(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     return error;
 }
 
-/*
- * Gets the size for the node that represents the file descriptors 
- * of a process. Counts one for every open file in the process.
- */
-size_t
-procfs_fd_node_size(pfsnode_t *pnp, __unused kauth_cred_t creds)
-{
-    size_t count = 0;
-
-    int pid = pnp->node_id.nodeid_pid;
-    proc_t p = proc_find(pid);
-
-    if (p != PROC_NULL) {
-        struct proc_fdinfo *fdlist = NULL;
-        size_t fd_count = 0;
-        if (procfs_get_fd_list(p, &fdlist, &fd_count) == 0) {
-            count = fd_count;
-        }
-        procfs_release_fd_list(fdlist);
-        proc_rele(p);
-    }
-
-    return count;
-}
-
 /*
  * Resolve the target path of a per-process symlink (exe/cwd/root) for `pid` into
  * `buf`. "exe" -> the executable vnode (p_textvp); "cwd"/"root" -> the process's
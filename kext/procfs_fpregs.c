@@ -72,6 +72,7 @@ procfs_dofpregs(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     uint32_t got = 0;
     int rc = procfs_ctl_request(PROCFS_REQ_FPREGS, pnp->node_id.nodeid_pid, 0,
                                 &state, sizeof(state), &got);
+    procfs_stats_ctl(pnp, rc);
     if (rc != 0) {
         return (rc == ENOTCONN) ? ENOTSUP : rc;
     }
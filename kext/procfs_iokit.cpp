@@ -3,18 +3,24 @@
  *
  * procfs_iokit.cpp
  *
- * IOKit block-device enumeration for the partitions node. Linux's
+ * IOKit block-device enumeration for the partitions node, and mapping of
+ * procfsd's shared-memory rings (procfs_ctl.c). Linux's
  * /proc/partitions lists every block device (whole disks and partitions,
  * mounted or not); on macOS that information lives in the IORegistry, reachable
  * only through the C++ IOKit runtime (the C IOKit KPI exposes no registry
- * matching). This is the kext's one C++ translation unit; it exposes a single
- * C-linkage entry point that the C partitions node calls.
+ * matching). This is the kext's one C++ translation unit; it exposes
+ * C-linkage entry points for the C code to call.
  *
  * We match the "IOMedia" class by name and read properties off the base
  * IORegistryEntry, so no dependency on IOStorageFamily's IOMedia C++ class (and
  * its metaclass) is needed - only the base IOKit and libkern KPIs, both already
  * declared in Info.plist.
+ *
+ * Wiring a range of a user process and mapping it into the kernel is likewise
+ * only offered by IOMemoryDescriptor, which is why the ring mapping is here.
  */
+#include <IOKit/IOLib.h>
+#include <IOKit/IOMemoryDescriptor.h>
 #include <IOKit/IOService.h>
 #include <libkern/c++/OSObject.h>
 #include <libkern/c++/OSString.h>
@@ -83,3 +89,47 @@ procfs_iokit_get_partitions(struct procfs_partition *out, int max, int *count)
     *count = n;
     return 0;
 }
+
+extern "C" int
+procfs_iokit_map_user(uint64_t uaddr, uint64_t len, struct procfs_umap *um)
+{
+    if (um == nullptr || len == 0) {
+        return EINVAL;
+    }
+    um->kaddr = um->md = um->map = nullptr;
+
+    IOMemoryDescriptor *md = IOMemoryDescriptor::withAddressRange(uaddr, len,
+        kIODirectionOutIn, current_task());
+    if (md == nullptr) {
+        return EFAULT;
+    }
+    /* Wires the pages: the kernel mapping must not fault, nor follow a COW copy. */
+    if (md->prepare() != kIOReturnSuccess) {
+        md->release();
+        return EFAULT;
+    }
+    IOMemoryMap *map = md->createMappingInTask(kernel_task, 0, kIOMapAnywhere);
+    if (map == nullptr) {
+        md->complete();
+        md->release();
+        return ENOMEM;
+    }
+
+    um->kaddr = reinterpret_cast<void *>(map->getVirtualAddress());
+    um->md    = md;
+    um->map   = map;
+    return 0;
+}
+
+extern "C" void
+procfs_iokit_unmap_user(struct procfs_umap *um)
+{
+    if (um == nullptr || um->md == nullptr) {
+        return;
+    }
+    static_cast<IOMemoryMap *>(um->map)->release();
+    IOMemoryDescriptor *md = static_cast<IOMemoryDescriptor *>(um->md);
+    md->complete();
+    md->release();
+    um->kaddr = um->md = um->map = nullptr;
+}
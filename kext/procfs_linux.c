@@ -62,6 +62,7 @@
 #include <sys/proc_info.h>
 
 #include <bsdcompat/sys/malloc.h>
+#include <bsdcompat/sys/sbuf.h>
 
 #include <fs/procfs/procfs.h>
 #include <fs/procfs/procfs_iokit.h>
@@ -640,16 +641,8 @@ procfs_loadavg_stop(void)
  * Linux-compatible /proc/loadavg
  */
 int
-procfs_doloadavg(__unused pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
+procfs_doloadavg(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
 {
-    int error = 0;
-    int len = 0, xlen = 0;
-    vm_offset_t off = uio_offset(uio);
-    vm_offset_t pgno = trunc_page(off);
-    off_t pgoff = (off - pgno);
-
-    char *buf = malloc(LBFSZ, M_TEMP, M_WAITOK);
-
     // Report the load averages from our local averunnable (lib/kern.c), which
     // procfs_loadavg_start()'s sampler keeps populated from per-CPU utilisation
     // (the kernel's own averunnable and every run-queue source are stripped on
@@ -665,8 +658,9 @@ procfs_doloadavg(__unused pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
     // utilisation approximation from the local averunnable above.
     uint32_t la[3] = { 0, 0, 0 };
     uint32_t got = 0;
-    if (procfs_ctl_request(PROCFS_REQ_LOADAVG, 0, 0, &la, sizeof(la), &got) == 0 &&
-        got == sizeof(la)) {
+    int rc = procfs_ctl_request(PROCFS_REQ_LOADAVG, 0, 0, &la, sizeof(la), &got);
+    procfs_stats_ctl(pnp, rc);
+    if (rc == 0 && got == sizeof(la)) {
         load1  = (int)la[0];
         load5  = (int)la[1];
         load15 = (int)la[2];
@@ -676,20 +670,13 @@ procfs_doloadavg(__unused pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
     int running = 1;
     int lastpid = 0;
 
-    len = snprintf(buf, LBFSZ,
-        "%d.%02d %d.%02d %d.%02d %d/%d %d\n",
-        load1  / 100, load1  % 100,
-        load5  / 100, load5  % 100,
-        load15 / 100, load15 % 100,
-        running,
-        total_procs,
-        lastpid
-    );
-
-    xlen = (len - pgoff);
-    error = uiomove((const char *)buf, xlen, uio);
-
-    free(buf, M_TEMP);
+    char buf[128];
+    struct sbuf sb;
+    sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+    procfs_render_loadavg(&sb, load1, load5, load15, running, total_procs, lastpid);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
 
     return error;
 }
@@ -750,14 +737,9 @@ procfs_dostat(__unused pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
         }
     }
 
-    /* cpu line columns: user nice system idle iowait irq softirq steal guest guest_nice */
-    sbuf_printf(&sb, "cpu  %llu %llu %llu %llu 0 0 0 0 0 0\n",
-        (unsigned long long)agg.user, (unsigned long long)agg.nice,
-        (unsigned long long)agg.sys,  (unsigned long long)agg.idle);
+    procfs_render_stat_cpu(&sb, -1, agg.user, agg.nice, agg.sys, agg.idle);
     for (int i = 0; i < ncpu; i++) {
-        sbuf_printf(&sb, "cpu%d %llu %llu %llu %llu 0 0 0 0 0 0\n", i,
-            (unsigned long long)cl[i].user, (unsigned long long)cl[i].nice,
-            (unsigned long long)cl[i].sys,  (unsigned long long)cl[i].idle);
+        procfs_render_stat_cpu(&sb, i, cl[i].user, cl[i].nice, cl[i].sys, cl[i].idle);
     }
     free(cl, M_TEMP);
 
@@ -793,12 +775,12 @@ procfs_dostat(__unused pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
  * are in pages. Without a daemon every value reads 0.
  */
 int
-procfs_dovmstat(__unused pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
+procfs_dovmstat(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 {
     vm_statistics64_data_t vm;
     bzero(&vm, sizeof(vm));
     uint32_t got = 0;
-    (void)procfs_ctl_request(PROCFS_REQ_VMSTAT, 0, 0, &vm, sizeof(vm), &got);
+    procfs_stats_ctl(pnp, procfs_ctl_request(PROCFS_REQ_VMSTAT, 0, 0, &vm, sizeof(vm), &got));
 
     struct sbuf sb;
     if (sbuf_new(&sb, NULL, 2048, SBUF_AUTOEXTEND) == NULL) {
@@ -886,17 +868,7 @@ procfs_domeminfo(__unused pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
         return ENOMEM;
     }
 
-    sbuf_printf(&sb,
-        "MemTotal: %9lu kB\n"
-        "MemFree:  %9lu kB\n"
-        "MemShared:%9lu kB\n"
-        "Buffers:  %9lu kB\n"
-        "Cached:   %9lu kB\n"
-        "SwapTotal:%9llu kB\n"
-        "SwapFree: %9llu kB\n",
-        (unsigned long)B2K(memtotal), (unsigned long)B2K(memfree), 0UL,
-        (unsigned long)B2K(buffers), (unsigned long)B2K(cached),
-        (unsigned long long)B2K(swaptotal), (unsigned long long)B2K(swapfree));
+    procfs_render_meminfo(&sb, memtotal, memfree, 0, buffers, cached, swaptotal, swapfree);
     sbuf_finish(&sb);
 
     int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
@@ -1061,20 +1033,9 @@ procfs_domtab(__unused pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
  * line format is Linux-specific:
  *   start-end perms offset dev inode path
  * The dev/inode/path columns are reported as "00:00 0" with no path, since the
- * region's backing file is not reachable here (see procfs_map.c).
+ * region's backing file is not reachable here (see procfs_map.c). The line
+ * itself is formatted by procfs_maps_fmt_linux() in procfs_render.c.
  */
-static void
-procfs_maps_fmt_linux(struct sbuf *sb, const struct procfs_region *r)
-{
-    sbuf_printf(sb, "%016llx-%016llx %c%c%c%c %016llx 00:00 0 \n",
-        (unsigned long long)r->start, (unsigned long long)r->end,
-        (r->prot & VM_PROT_READ)    ? 'r' : '-',
-        (r->prot & VM_PROT_WRITE)   ? 'w' : '-',
-        (r->prot & VM_PROT_EXECUTE) ? 'x' : '-',
-        r->shared ? 's' : 'p',
-        (unsigned long long)r->offset);
-}
-
 int
 procfs_domaps(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
 {
@@ -1091,30 +1052,43 @@ procfs_domaps(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
  */
 #define PROCFS_NS_PER_TICK 10000000ULL   /* 100 Hz: ns -> clock ticks */
 
-/* Fetch per-thread info from the daemon (ti left zeroed if unavailable). */
+/*
+ * Per-thread and per-task info from the daemon, in two halves so a node can
+ * build its process context while the daemon works: _submit() sends the
+ * request, _wait() collects it. The info is left zeroed if unavailable.
+ * Thread info comes from the process's thread snapshot (procfs_threads.c),
+ * so reading every thread's files costs one round-trip, not one each.
+ * Task info may already be at hand from a readdir prefetch
+ * (procfs_prefetch.c): then _submit() fills it in, sends nothing and
+ * returns TRUE, and there is nothing to wait for.
+ */
 static int
 procfs_thread_info(pfsnode_t *pnp, struct proc_threadinfo *ti)
 {
-    bzero(ti, sizeof(*ti));
-    uint32_t got = 0;
-    if (procfs_ctl_request(PROCFS_REQ_THREADINFO, pnp->node_id.nodeid_pid,
-            pnp->node_id.nodeid_objectid, ti, sizeof(*ti), &got) == 0 &&
-        got == sizeof(*ti)) {
-        return 0;
+    return procfs_threads_get(pnp, ti) == 0 ? 0 : ENOTSUP;
+}
+
+static boolean_t
+procfs_task_info_submit(pfsnode_t *pnp, procfs_ctl_pending_t *pc, struct proc_taskinfo *ti)
+{
+    if (procfs_prefetch_taskinfo(pnp->node_id.nodeid_pid, ti)) {
+        return TRUE;
     }
-    return ENOTSUP;     /* best-effort: callers format the zeroed struct */
+    /* The reply goes straight into `ti`; it is not ours to touch until the wait. */
+    (void)procfs_ctl_submit(PROCFS_REQ_TASKINFO, pnp->node_id.nodeid_pid, 0, ti, sizeof(*ti), pc);
+    return FALSE;
 }
 
-/* Fetch proc_taskinfo from the daemon (ti left zeroed if unavailable). */
 static int
-procfs_task_info(pfsnode_t *pnp, struct proc_taskinfo *ti)
+procfs_task_info_wait(pfsnode_t *pnp, procfs_ctl_pending_t *pc, struct proc_taskinfo *ti)
 {
-    bzero(ti, sizeof(*ti));
     uint32_t got = 0;
-    if (procfs_ctl_request(PROCFS_REQ_TASKINFO, pnp->node_id.nodeid_pid, 0,
-            ti, sizeof(*ti), &got) == 0 && got == sizeof(*ti)) {
+    int rc = procfs_ctl_wait(pc, &got);
+    procfs_stats_ctl(pnp, rc);
+    if (rc == 0 && got == sizeof(*ti)) {
         return 0;
     }
+    bzero(ti, sizeof(*ti));
     return ENOTSUP;     /* best-effort: callers format the zeroed struct */
 }
 
@@ -1132,14 +1106,7 @@ procfs_proc_state(int p_stat)
     }
 }
 
-/* Process-level context for the thread's owning process. */
-struct procfs_pctx {
-    int      pid, ppid, pgid, sid, nthreads;
-    uint64_t vsize, rsize;
-    char     comm[MAXCOMLEN + 1];
-    char     state;     /* Linux process-state char from p_stat */
-};
-
+/* Fill the process-level context (procfs_render.h) for the node's process. */
 static void
 procfs_pctx_get(pfsnode_t *pnp, struct procfs_pctx *c)
 {
@@ -1173,19 +1140,6 @@ procfs_thread_state(int run_state)
     }
 }
 
-static const char *
-procfs_thread_state_word(char c)
-{
-    switch (c) {
-    case 'R': return "running";
-    case 'T': return "stopped";
-    case 'D': return "disk sleep";
-    case 'Z': return "zombie";
-    case 'I': return "idle";
-    default:  return "sleeping";
-    }
-}
-
 int
 procfs_dothreadcomm(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 {
@@ -1209,8 +1163,10 @@ procfs_dothreadstat(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 {
     struct proc_threadinfo ti;
     struct procfs_pctx     c;
-    procfs_thread_info(pnp, &ti);
+    procfs_threads_pending_t tp;
+    procfs_threads_submit(pnp, &tp, &ti);
     procfs_pctx_get(pnp, &c);
+    (void)procfs_threads_wait(pnp, &tp, &ti);
 
     uint64_t    tid   = pnp->node_id.nodeid_objectid;
     const char *name  = ti.pth_name[0] ? ti.pth_name : c.comm;
@@ -1222,19 +1178,14 @@ procfs_dothreadstat(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     /* Linux /proc/<pid>/task/<tid>/stat: 52 space-separated fields. Field 41 is
      * the scheduling policy; fields with no macOS source are 0/-1. */
     char buf[640];
-    int len = snprintf(buf, sizeof(buf),
-        "%llu (%s) %c %d %d %d 0 -1 0 0 0 0 0 "                /* 1-13  */
-        "%llu %llu 0 0 %d 0 %d 0 0 "                           /* 14-22 */
-        "%llu %llu 18446744073709551615 "                     /* 23-25 */
-        "0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 "                       /* 26-40 */
-        "%d "                                                  /* 41 policy */
-        "0 0 0 0 0 0 0 0 0 0 0\n",                             /* 42-52 */
-        (unsigned long long)tid, name, state, c.ppid, c.pgid, c.sid,
-        (unsigned long long)utime, (unsigned long long)stime,
-        ti.pth_curpri, c.nthreads,
-        (unsigned long long)c.vsize, (unsigned long long)rss_pages,
-        ti.pth_policy);
-    return procfs_copy_data(buf, len, uio);
+    struct sbuf sb;
+    sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+    procfs_render_stat_line(&sb, tid, name, state, &c, utime, stime,
+        ti.pth_curpri, rss_pages, ti.pth_policy);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
+    return error;
 }
 
 int
@@ -1242,29 +1193,26 @@ procfs_dothreadstatus(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 {
     struct proc_threadinfo ti;
     struct procfs_pctx     c;
-    procfs_thread_info(pnp, &ti);
+    procfs_threads_pending_t tp;
+    procfs_threads_submit(pnp, &tp, &ti);
     procfs_pctx_get(pnp, &c);
+    (void)procfs_threads_wait(pnp, &tp, &ti);
 
     uint64_t    tid  = pnp->node_id.nodeid_objectid;
     const char *name = ti.pth_name[0] ? ti.pth_name : c.comm;
     char        st   = procfs_thread_state(ti.pth_run_state);
 
     char buf[512];
-    int len = snprintf(buf, sizeof(buf),
-        "Name:\t%s\n"
-        "State:\t%c (%s)\n"
-        "Tgid:\t%d\n"
-        "Pid:\t%llu\n"
-        "PPid:\t%d\n"
-        "VmSize:\t%8llu kB\n"
-        "VmStk:\t%8llu kB\n"
-        "Threads:\t%d\n"
-        "voluntary_ctxt_switches:\t0\n"
-        "nonvoluntary_ctxt_switches:\t0\n",
-        name, st, procfs_thread_state_word(st),
-        c.pid, (unsigned long long)tid, c.ppid,
-        (unsigned long long)(c.vsize >> 10), 0ULL, c.nthreads);
-    return procfs_copy_data(buf, len, uio);
+    struct sbuf sb;
+    sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+    procfs_render_status_head(&sb, name, st, c.pid, tid, c.ppid);
+    procfs_render_status_kb(&sb, "VmSize:\t", c.vsize >> 10);
+    procfs_render_status_kb(&sb, "VmStk:\t", 0);
+    procfs_render_status_tail(&sb, c.nthreads);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
+    return error;
 }
 
 int
@@ -1272,8 +1220,10 @@ procfs_dothreadsched(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 {
     struct proc_threadinfo ti;
     struct procfs_pctx     c;
-    procfs_thread_info(pnp, &ti);
+    procfs_threads_pending_t tp;
+    procfs_threads_submit(pnp, &tp, &ti);
     procfs_pctx_get(pnp, &c);
+    (void)procfs_threads_wait(pnp, &tp, &ti);
 
     uint64_t    tid  = pnp->node_id.nodeid_objectid;
     const char *name = ti.pth_name[0] ? ti.pth_name : c.comm;
@@ -1361,8 +1311,10 @@ procfs_doregs_linux(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 #if defined(__arm64__) || defined(__aarch64__)
     arm_thread_state64_t st;
     uint32_t got = 0;
-    if (procfs_ctl_request(PROCFS_REQ_REGS, pnp->node_id.nodeid_pid, 0,
-                           &st, sizeof(st), &got) == 0 && got > 0) {
+    int rc = procfs_ctl_request(PROCFS_REQ_REGS, pnp->node_id.nodeid_pid, 0,
+                                &st, sizeof(st), &got);
+    procfs_stats_ctl(pnp, rc);
+    if (rc == 0 && got > 0) {
         /* non-opaque arm_thread_state64 layout; pc/lr carry PAC bits, emitted raw. */
         for (int i = 0; i < 29; i++) {
             sbuf_printf(&sb, "x%-2d  0x%016llx\n", i, (uint64_t)st.x[i]);
@@ -1376,8 +1328,10 @@ procfs_doregs_linux(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 #elif defined(__x86_64__)
     x86_thread_state64_t st;
     uint32_t got = 0;
-    if (procfs_ctl_request(PROCFS_REQ_REGS, pnp->node_id.nodeid_pid, 0,
-                           &st, sizeof(st), &got) == 0 && got > 0) {
+    int rc = procfs_ctl_request(PROCFS_REQ_REGS, pnp->node_id.nodeid_pid, 0,
+                                &st, sizeof(st), &got);
+    procfs_stats_ctl(pnp, rc);
+    if (rc == 0 && got > 0) {
         sbuf_printf(&sb, "rax 0x%016llx\nrbx 0x%016llx\nrcx 0x%016llx\n"
                          "rdx 0x%016llx\nrsi 0x%016llx\nrdi 0x%016llx\n"
                          "rbp 0x%016llx\nrsp 0x%016llx\n",
@@ -1434,8 +1388,10 @@ procfs_dofpregs_linux(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 #if defined(__arm64__) || defined(__aarch64__)
     arm_neon_state64_t st;
     uint32_t got = 0;
-    if (procfs_ctl_request(PROCFS_REQ_FPREGS, pnp->node_id.nodeid_pid, 0,
-                           &st, sizeof(st), &got) == 0 && got > 0) {
+    int rc = procfs_ctl_request(PROCFS_REQ_FPREGS, pnp->node_id.nodeid_pid, 0,
+                                &st, sizeof(st), &got);
+    procfs_stats_ctl(pnp, rc);
+    if (rc == 0 && got > 0) {
         /* Each q register is 128-bit; print as hi:lo 64-bit halves. */
         for (int i = 0; i < 32; i++) {
             const uint64_t *qw = (const uint64_t *)&st.q[i];
@@ -1533,10 +1489,56 @@ procfs_dostatm(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     procfs_pctx_get(pnp, &c);
 
     char buf[128];
-    int len = snprintf(buf, sizeof(buf), "%llu %llu 0 0 0 0 0\n",
-        (unsigned long long)(c.vsize / PAGE_SIZE),
-        (unsigned long long)(c.rsize / PAGE_SIZE));
-    return procfs_copy_data(buf, len, uio);
+    struct sbuf sb;
+    sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+    procfs_render_statm(&sb, c.vsize / PAGE_SIZE, c.rsize / PAGE_SIZE);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
+    return error;
+}
+
+/*
+ * /proc/<pid>/io - the process's I/O counters, from procfsd's
+ * proc_pid_rusage(). read_bytes/write_bytes are the bytes that reached
+ * the disk; wchar is the logical writes, which include those absorbed by
+ * the cache. macOS keeps no logical read count, so rchar is read_bytes,
+ * a lower bound. The syscall counts and cancelled writes have no source
+ * and read 0, as does everything without the daemon. A readdir prefetch
+ * (procfs_prefetch.c) answers a sweep over every process in one
+ * PROCFS_REQ_IOINFOS exchange per readdir page.
+ */
+int
+procfs_doio(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
+{
+    pid_t pid = pnp->node_id.nodeid_pid;
+    struct procfs_ctl_ioinfo io;
+
+    if (!procfs_prefetch_ioinfo(pid, &io)) {
+        struct {
+            struct procfs_ctl_ioinfos hdr;
+            struct procfs_ctl_ioinfo  rec;
+        } reply;
+        uint32_t got = 0;
+        int rc = procfs_ctl_request(PROCFS_REQ_IOINFOS, pid, (uint64_t)pid, &reply,
+            sizeof(reply), &got);
+        procfs_stats_ctl(pnp, rc);
+        if (rc == 0 && got == sizeof(reply) && reply.hdr.count == 1 && reply.rec.pid == pid) {
+            io = reply.rec;
+        } else {
+            bzero(&io, sizeof(io));
+        }
+    }
+
+    char buf[256];
+    struct sbuf sb;
+    sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+    procfs_render_io(&sb, io.diskio_bytesread, io.logical_writes, io.diskio_bytesread,
+        io.diskio_byteswritten);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
+    return error;
 }
 
 /*
@@ -1549,25 +1551,26 @@ procfs_doprocstat(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 {
     struct procfs_pctx   c;
     struct proc_taskinfo ti;
+    procfs_ctl_pending_t pc;
+    boolean_t prefetched = procfs_task_info_submit(pnp, &pc, &ti);
     procfs_pctx_get(pnp, &c);
-    procfs_task_info(pnp, &ti);
+    if (!prefetched) {
+        procfs_task_info_wait(pnp, &pc, &ti);
+    }
 
     uint64_t utime = ti.pti_total_user   / PROCFS_NS_PER_TICK;
     uint64_t stime = ti.pti_total_system / PROCFS_NS_PER_TICK;
     uint64_t rss_pages = c.rsize / PAGE_SIZE;
 
     char buf[640];
-    int len = snprintf(buf, sizeof(buf),
-        "%d (%s) %c %d %d %d 0 -1 0 0 0 0 0 "                  /* 1-13  */
-        "%llu %llu 0 0 20 0 %d 0 0 "                           /* 14-22 */
-        "%llu %llu 18446744073709551615 "                     /* 23-25 */
-        "0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 "                       /* 26-40 */
-        "0 "                                                  /* 41 policy */
-        "0 0 0 0 0 0 0 0 0 0 0\n",                             /* 42-52 */
-        c.pid, c.comm, c.state, c.ppid, c.pgid, c.sid,
-        (unsigned long long)utime, (unsigned long long)stime, c.nthreads,
-        (unsigned long long)c.vsize, (unsigned long long)rss_pages);
-    return procfs_copy_data(buf, len, uio);
+    struct sbuf sb;
+    sbuf_new(&sb, buf, sizeof(buf), SBUF_FIXEDLEN);
+    procfs_render_stat_line(&sb, (uint64_t)c.pid, c.comm, c.state, &c, utime, stime,
+        20, rss_pages, 0);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
+    return error;
 }
 
 /*
@@ -1600,27 +1603,14 @@ procfs_doprocstatus_linux(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     if (sbuf_new(&sb, NULL, 1024, SBUF_AUTOEXTEND) == NULL) {
         return ENOMEM;
     }
-    sbuf_printf(&sb,
-        "Name:\t%s\n"
-        "State:\t%c (%s)\n"
-        "Tgid:\t%d\n"
-        "Pid:\t%d\n"
-        "PPid:\t%d\n"
-        "TracerPid:\t0\n"
-        "Uid:\t%u\t%u\t%u\t%u\n"
-        "Gid:\t%u\t%u\t%u\t%u\n"
-        "VmSize:\t%8llu kB\n"
-        "VmRSS:\t%8llu kB\n"
-        "Threads:\t%d\n"
-        "voluntary_ctxt_switches:\t0\n"
-        "nonvoluntary_ctxt_switches:\t0\n",
-        c.comm, c.state, procfs_thread_state_word(c.state),
-        c.pid, c.pid, c.ppid,
-        ruid, euid, svuid, euid,        /* Uid: real effective saved fs (fs~=eff) */
-        rgid, egid, svgid, egid,        /* Gid: real effective saved fs           */
-        (unsigned long long)(c.vsize >> 10),
-        (unsigned long long)(c.rsize >> 10),
-        c.nthreads);
+    procfs_render_status_head(&sb, c.comm, c.state, c.pid, c.pid, c.ppid);
+    sbuf_cat(&sb, "TracerPid:\t0\n");
+    /* Uid/Gid: real effective saved fs (fs~=eff) */
+    procfs_render_status_ids(&sb, "Uid:", ruid, euid, svuid, euid);
+    procfs_render_status_ids(&sb, "Gid:", rgid, egid, svgid, egid);
+    procfs_render_status_kb(&sb, "VmSize:\t", c.vsize >> 10);
+    procfs_render_status_kb(&sb, "VmRSS:\t", c.rsize >> 10);
+    procfs_render_status_tail(&sb, c.nthreads);
 
     sbuf_finish(&sb);
     int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
@@ -1789,16 +1779,35 @@ static struct sysctl_oid procfs_sysctl_linux = {
     .oid_version = SYSCTL_OID_VERSION,
 };
 
+static struct sysctl_oid procfs_sysctl_prefetch = {
+    .oid_parent  = &procfs_sysctl_children,
+    .oid_number  = OID_AUTO,
+    .oid_kind    = CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_LOCKED | CTLFLAG_OID2,
+    .oid_arg1    = &procfs_prefetch_enabled,
+    .oid_arg2    = 0,
+    .oid_name    = "prefetch",
+    .oid_handler = sysctl_handle_int,
+    .oid_fmt     = "I",
+    .oid_descr   = "fetch the taskinfo of the processes a /proc readdir lists in one batch: 0 = off, 1 = on",
+    .oid_version = SYSCTL_OID_VERSION,
+};
+
 void
 procfs_sysctl_register(void)
 {
     sysctl_register_oid(&procfs_sysctl_node);   /* parent first */
     sysctl_register_oid(&procfs_sysctl_linux);
+    sysctl_register_oid(&procfs_sysctl_prefetch);
+    procfs_stats_sysctl_register(&procfs_sysctl_children);
+    procfs_ctl_sysctl_register(&procfs_sysctl_children);
 }
 
 void
 procfs_sysctl_unregister(void)
 {
+    procfs_ctl_sysctl_unregister();
+    procfs_stats_sysctl_unregister();
+    sysctl_unregister_oid(&procfs_sysctl_prefetch);
     sysctl_unregister_oid(&procfs_sysctl_linux);
     sysctl_unregister_oid(&procfs_sysctl_node);
 }
\ No newline at end of file
@@ -11,7 +11,7 @@
  *   Linux Documentation/filesystems/proc.rst (/proc/<pid>/maps)
  *
  * Both nodes share the region walk in procfs_map_render() and differ only in
- * the per-region formatter. The walk uses mach_vm_region(), resolved from the
+ * the per-region formatter, both of which live in procfs_render.c. The walk uses mach_vm_region(), resolved from the
  * on-disk kernel collection via libklookup along with get_task_map(): macOS
  * exports no region-enumeration KPI a third-party kext may link, and the
  * internal walkers (vm_map_region/vm_map_lookup_entry) are stripped from the
@@ -45,6 +45,7 @@
 #include <ptrauth.h>
 
 #include <bsdcompat/sys/malloc.h>
+#include <bsdcompat/sys/sbuf.h>
 
 #include <fs/procfs/procfs.h>
 
@@ -104,9 +105,10 @@ procfs_map_render(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx, procfs_region_fm
         return EIO;
     }
 
-    /* A large address space can have thousands of regions, so grow on demand. */
+    /* A large address space can have thousands of regions, so grow on demand,
+     * doubling each time so that a large render is not copied once per page. */
     struct sbuf sb;
-    if (sbuf_new(&sb, NULL, 4096, SBUF_AUTOEXTEND) == NULL) {
+    if (sbuf_new(&sb, NULL, 4096, SBUF_AUTOEXTEND | SBUF_GEOMETRIC) == NULL) {
         proc_rele(p);
         return ENOMEM;
     }
@@ -226,24 +228,7 @@ procfs_task_vm_sizes(proc_t p, uint64_t *vsize, uint64_t *rsize)
 }
 
 /*
- * NetBSD-style formatter: start-end curprot maxprot sharing wired.
- */
-static void
-procfs_map_fmt_netbsd(struct sbuf *sb, const struct procfs_region *r)
-{
-    sbuf_printf(sb, "%#018llx %#018llx %c%c%c %c%c%c %s %u\n",
-        (unsigned long long)r->start, (unsigned long long)r->end,
-        (r->prot & VM_PROT_READ)        ? 'r' : '-',
-        (r->prot & VM_PROT_WRITE)       ? 'w' : '-',
-        (r->prot & VM_PROT_EXECUTE)     ? 'x' : '-',
-        (r->max_prot & VM_PROT_READ)    ? 'r' : '-',
-        (r->max_prot & VM_PROT_WRITE)   ? 'w' : '-',
-        (r->max_prot & VM_PROT_EXECUTE) ? 'x' : '-',
-        r->shared ? "share" : "priv", r->wired);
-}
-
-/*
- * "map" node - NetBSD procfs format.
+ * "map" node - NetBSD procfs format (procfs_map_fmt_netbsd, in procfs_render.c).
  */
 int
 procfs_domap(pfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
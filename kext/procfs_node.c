@@ -7,13 +7,18 @@
  * Functions for the management of vnodes and pfsnodes.
  */
 #include <kern/assert.h>
+#include <kern/clock.h>
+#include <kern/thread_call.h>
+#include <libkern/OSAtomic.h>
 #include <libkern/OSMalloc.h>
 #include <sys/malloc.h>
+#include <sys/proc.h>
 #include <sys/systm.h>
 #include <sys/types.h>
 #include <sys/vnode.h>
 
 #include <fs/procfs/procfs.h>
+#include <fs/procfs/procfs_ctl.h>
 
 #pragma mark -
 #pragma mark Global Definitions
@@ -35,6 +40,14 @@ struct procfs_hash_head *pfsnode_hash_buckets;
 // The mask used to get the bucket number from a pfsnode hash.
 u_long pfsnode_hash_to_bucket_mask;
 
+// The buckets and bucket mask for the pid index of process-related
+// nodes. Allocated alongside the node hash on first mount.
+struct procfs_pid_hash_head *pfsnode_pid_buckets;
+u_long pfsnode_pid_to_bucket_mask;
+
+// Number of nodes in the pid index. Protected by the node hash lock.
+STATIC int pfsnode_pid_node_count = 0;
+
 // Lock used to protect the hash table.
 lck_grp_t *pfsnode_lck_grp = NULL;
 lck_mtx_t *pfsnode_hash_mutex = NULL;
@@ -50,6 +63,18 @@ OSMallocTag procfs_osmalloc_tag = NULL;
 // Gets the hash value for a given mount id and identifier.
 #define HASH_FOR_MOUNT_AND_ID(mount_id, node_id) (int)(((mount_id) << 16) ^ (node_id.nodeid_pid) ^ (node_id.nodeid_objectid) ^ (node_id.nodeid_base_id))
 
+// Macro that gets the header of the pid index bucket for a given pid.
+#define PROCFS_PID_TO_BUCKET_HEADER(pid) \
+        (struct procfs_pid_hash_head *)(&pfsnode_pid_buckets[(u_long)(pid) & pfsnode_pid_to_bucket_mask])
+
+// Interval between reaper passes - a fallback for exits procfsd did not
+// report, so it can be long - and the number of vnodes that are recycled
+// per acquisition of the hash lock.
+#define PROCFS_REAP_INTERVAL_SECS   120
+#define PROCFS_REAP_BATCH           32
+
+STATIC void procfsnode_pid_index_insert(pfsnode_t *pnp);
+
 #pragma mark -
 #pragma mark Management of vnodes and pfsnodes
 
@@ -149,8 +174,9 @@ procfsnode_find(pfsmount_t *pmp, pfsid_t node_id, pfssnode_t *snode,
                 target_pfsnode->node_structure_node = snode;
 
                 // Add the node to the node hash. We already know which bucket
-                // it belongs to.
+                // it belongs to. Process-related nodes also go into the pid index.
                 LIST_INSERT_HEAD(hash_bucket, target_pfsnode, node_hash);
+                procfsnode_pid_index_insert(target_pfsnode);
             }
         }
 
@@ -286,9 +312,68 @@ void
 procfsnode_free_node(pfsnode_t *pfsnode)
 {
     LIST_REMOVE(pfsnode, node_hash);
+    if (pfsnode->node_id.nodeid_pid != PRNODE_NO_PID) {
+        LIST_REMOVE(pfsnode, node_pid_hash);
+        pfsnode_pid_node_count--;
+    }
     OSFree(pfsnode, sizeof(pfsnode_t), procfs_osmalloc_tag);
 }
 
+/*
+ * Adds a newly created node to the pid index, if it belongs to a process.
+ * The node is placed next to any existing node for the same pid, so that
+ * a walk of a bucket sees each pid's nodes as a single run. This method
+ * must be called with the hash table lock held.
+ */
+STATIC void
+procfsnode_pid_index_insert(pfsnode_t *pnp)
+{
+    pid_t pid = pnp->node_id.nodeid_pid;
+    if (pid == PRNODE_NO_PID) {
+        return;
+    }
+
+    struct procfs_pid_hash_head *bucket = PROCFS_PID_TO_BUCKET_HEADER(pid);
+    pfsnode_t *peer;
+    LIST_FOREACH(peer, bucket, node_pid_hash) {
+        if (peer->node_id.nodeid_pid == pid) {
+            break;
+        }
+    }
+    if (peer != NULL) {
+        LIST_INSERT_AFTER(peer, pnp, node_pid_hash);
+    } else {
+        LIST_INSERT_HEAD(bucket, pnp, node_pid_hash);
+    }
+    pfsnode_pid_node_count++;
+}
+
+/*
+ * Binds a node to the process incarnation identified by "stamp" (as returned
+ * by procfs_proc_stamp()). If the node was previously bound to a different
+ * incarnation, the pid has been reused since it was last looked up, so any
+ * name cache entries that refer to the node's vnode, or that were entered
+ * below it when it is a process directory, are purged. The caller must hold
+ * an iocount on the node's vnode and must not hold the hash table lock.
+ */
+void
+procfsnode_bind_process(pfsnode_t *pnp, uint64_t stamp)
+{
+    if (stamp == 0) {
+        return;
+    }
+
+    lck_mtx_lock(pfsnode_hash_mutex);
+    boolean_t stale = pnp->node_proc_stamp != 0 && pnp->node_proc_stamp != stamp;
+    pnp->node_proc_stamp = stamp;
+    vnode_t vp = pnp->node_vnode;
+    lck_mtx_unlock(pfsnode_hash_mutex);
+
+    if (stale && vp != NULLVP) {
+        cache_purge(vp);
+    }
+}
+
 /*
  * Given a pfsnode_t, returns the procfs node id for the node
  * that would be the parent of the given node. If the node is the
@@ -316,3 +401,224 @@ procfs_get_parent_node_id(pfsnode_t *pnp, pfsid_t *return_idp)
     return_idp->nodeid_pid = pid_node ? pnp->node_id.nodeid_pid : PRNODE_NO_PID;
     return_idp->nodeid_objectid = thread_node ? pnp->node_id.nodeid_objectid : PRNODE_NO_OBJECTID;
 }
+
+#pragma mark -
+#pragma mark Reclamation of nodes for dead processes
+
+// Timer for the periodic reaper pass, and whether it is being stopped (a
+// pass then does not re-arm it).
+STATIC thread_call_t procfs_reaper_call = NULL;
+STATIC volatile boolean_t procfs_reaper_stopping = FALSE;
+
+/*
+ * Recycles the vnodes of the nodes that belong to a process that has gone.
+ * If "live_stamp" is 0, the process with the given pid has exited and all
+ * of its nodes are stale. Otherwise the pid now belongs to the process
+ * incarnation identified by "live_stamp" and only nodes bound to an earlier
+ * incarnation are stale. The vnodes are purged from the name cache and
+ * recycled, which reclaims them (and frees their pfsnodes) as soon as they
+ * are no longer in use. The cost is one walk of a single pid index bucket
+ * per batch of stale nodes. Returns the number of vnodes recycled.
+ */
+int
+procfsnode_reap_pid(pid_t pid, uint64_t live_stamp)
+{
+    struct {
+        vnode_t     vp;
+        uint32_t    vid;
+    } batch[PROCFS_REAP_BATCH];
+    int reaped = 0;
+    int count;
+
+    do {
+        // Collect a batch of stale vnodes under the lock. The nodes are marked
+        // so that a vnode that is still open is not collected again.
+        count = 0;
+        lck_mtx_lock(pfsnode_hash_mutex);
+        if (pfsnode_pid_buckets != NULL) {
+            pfsnode_t *pnp;
+            LIST_FOREACH(pnp, PROCFS_PID_TO_BUCKET_HEADER(pid), node_pid_hash) {
+                if (pnp->node_id.nodeid_pid != pid || pnp->node_reaped
+                        || pnp->node_vnode == NULLVP) {
+                    continue;
+                }
+                if (live_stamp != 0 && (pnp->node_proc_stamp == 0
+                        || pnp->node_proc_stamp == live_stamp)) {
+                    continue;
+                }
+                pnp->node_reaped = TRUE;
+                batch[count].vp = pnp->node_vnode;
+                batch[count].vid = vnode_vid(pnp->node_vnode);
+                if (++count == PROCFS_REAP_BATCH) {
+                    break;
+                }
+            }
+        }
+        lck_mtx_unlock(pfsnode_hash_mutex);
+
+        // Recycle outside the lock, since reclaim takes it. A vnode whose id
+        // has changed has already been reclaimed.
+        for (int i = 0; i < count; i++) {
+            if (vnode_getwithvid(batch[i].vp, batch[i].vid) == 0) {
+                cache_purge(batch[i].vp);
+                vnode_recycle(batch[i].vp);
+                vnode_put(batch[i].vp);
+                reaped++;
+            }
+        }
+    } while (count == PROCFS_REAP_BATCH);
+
+    return reaped;
+}
+
+/*
+ * One reaper pass. Takes a snapshot of the pids in the pid index, along with
+ * the incarnation their nodes are bound to, then checks each pid once and
+ * reaps only those whose process has exited or been replaced. The pass is
+ * not cheap: it walks every bucket of the pid index with pfsnode_hash_mutex
+ * held, which every lookup needs, allocates a table sized by the number of
+ * indexed nodes, and calls proc_find() once for every indexed pid, live or
+ * not. Only the vnode recycling is proportional to the stale nodes. Exits
+ * procfsd reports are therefore reaped one pid at a time as they come
+ * (procfs_reaper_event()), and the pass only catches the rest, rarely.
+ */
+STATIC void
+procfs_reaper_sweep(void)
+{
+    struct procfs_reap_entry {
+        pid_t       pid;
+        uint64_t    stamp;
+    } *entries;
+
+    lck_mtx_lock(pfsnode_hash_mutex);
+    int capacity = pfsnode_pid_node_count;
+    lck_mtx_unlock(pfsnode_hash_mutex);
+    if (capacity == 0) {
+        return;
+    }
+
+    uint32_t size = (uint32_t)(capacity * sizeof(struct procfs_reap_entry));
+    entries = (struct procfs_reap_entry *)OSMalloc(size, procfs_osmalloc_tag);
+    if (entries == NULL) {
+        return;
+    }
+
+    // Nodes for the same pid are adjacent within a bucket, so each run
+    // produces one entry. Nodes already handed to the reaper are skipped.
+    int count = 0;
+    lck_mtx_lock(pfsnode_hash_mutex);
+    for (u_long b = 0; pfsnode_pid_buckets != NULL && b <= pfsnode_pid_to_bucket_mask; b++) {
+        pfsnode_t *pnp;
+        pid_t run_pid = PRNODE_NO_PID;
+        LIST_FOREACH(pnp, &pfsnode_pid_buckets[b], node_pid_hash) {
+            if (pnp->node_reaped) {
+                continue;
+            }
+            if (pnp->node_id.nodeid_pid != run_pid) {
+                if (count == capacity) {
+                    break;
+                }
+                run_pid = pnp->node_id.nodeid_pid;
+                entries[count].pid = run_pid;
+                entries[count].stamp = 0;
+                count++;
+            }
+            // Remember the incarnation the run is bound to. Mixed stamps
+            // (UINT64_MAX) force the pid's nodes to be checked individually.
+            struct procfs_reap_entry *e = &entries[count - 1];
+            if (pnp->node_proc_stamp != 0 && e->stamp != pnp->node_proc_stamp) {
+                e->stamp = e->stamp == 0 ? pnp->node_proc_stamp : UINT64_MAX;
+            }
+        }
+    }
+    lck_mtx_unlock(pfsnode_hash_mutex);
+
+    for (int i = 0; i < count; i++) {
+        proc_t p = proc_find(entries[i].pid);
+        if (p == PROC_NULL) {
+            procfsnode_reap_pid(entries[i].pid, 0);
+            continue;
+        }
+        uint64_t live_stamp = procfs_proc_stamp(p);
+        proc_rele(p);
+        if (entries[i].stamp != 0 && entries[i].stamp != live_stamp) {
+            procfsnode_reap_pid(entries[i].pid, live_stamp);
+        }
+    }
+
+    OSFree(entries, size, procfs_osmalloc_tag);
+}
+
+/*
+ * Lifecycle events from procfsd: the nodes of a process that exited are
+ * reaped at once, at the cost of one walk of its pid's bucket. Exits lost
+ * when events were dropped are left to the next pass.
+ */
+STATIC void
+procfs_reaper_event(__unused void *arg, const struct procfs_ctl_event *ev, uint32_t count,
+    __unused uint32_t dropped)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (ev[i].kind == PROCFS_EV_EXIT) {
+            (void)procfsnode_reap_pid(ev[i].pid, 0);
+        }
+    }
+}
+
+STATIC void
+procfs_reaper_timer(__unused thread_call_param_t a, __unused thread_call_param_t b)
+{
+    uint64_t deadline;
+
+    procfs_reaper_sweep();
+    if (procfs_reaper_stopping) {
+        return;
+    }
+    clock_interval_to_deadline(PROCFS_REAP_INTERVAL_SECS, NSEC_PER_SEC, &deadline);
+    thread_call_enter_delayed(procfs_reaper_call, deadline);
+}
+
+/*
+ * Starts the reaper, which recycles the nodes of processes that have exited
+ * as procfsd reports them, and periodically those of any other process that
+ * has exited or whose pid has been reused. Callers that learn of a process
+ * exit directly can call procfsnode_reap_pid() instead of waiting for it.
+ */
+void
+procfs_reaper_start(void)
+{
+    if (procfs_reaper_call != NULL) {
+        return;
+    }
+
+    procfs_reaper_call = thread_call_allocate(procfs_reaper_timer, NULL);
+    if (procfs_reaper_call == NULL) {
+        return;
+    }
+    procfs_reaper_stopping = FALSE;
+    (void)procfs_event_subscribe(procfs_reaper_event, NULL);
+
+    uint64_t deadline;
+    clock_interval_to_deadline(PROCFS_REAP_INTERVAL_SECS, NSEC_PER_SEC, &deadline);
+    thread_call_enter_delayed(procfs_reaper_call, deadline);
+}
+
+/*
+ * Stops the reaper (kext unload), waiting for a pass in progress to finish.
+ * A pass re-arms the timer as it ends, so it is told not to first; should
+ * one have re-armed it anyway, thread_call_free() refuses the pending call
+ * and it is cancelled again.
+ */
+void
+procfs_reaper_stop(void)
+{
+    if (procfs_reaper_call != NULL) {
+        procfs_event_unsubscribe(procfs_reaper_event, NULL);
+        procfs_reaper_stopping = TRUE;
+        OSMemoryBarrier();
+        do {
+            thread_call_cancel_wait(procfs_reaper_call);
+        } while (!thread_call_free(procfs_reaper_call));
+        procfs_reaper_call = NULL;
+    }
+}
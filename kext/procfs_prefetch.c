@@ -0,0 +1,648 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_prefetch.c
+ *
+ * Readdir-driven task info prefetch. A tool like top or ps lists /proc and
+ * then reads a file or two of every process it found, which costs one
+ * PROCFS_REQ_TASKINFO round-trip per process. With `procfs.prefetch` set,
+ * each readdir of the process list queues one PROCFS_REQ_TASKINFOS request
+ * for the range of pids it just returned; a thread call fetches it in the
+ * background, and for PROCFS_PREFETCH_WINDOW_MS the per-process taskinfo
+ * reads (/proc/<pid>/taskinfo and the Linux-mode stat) are answered from
+ * the batch. A read that arrives while its batch is still being fetched
+ * waits for it, briefly, rather than asking for its process alone.
+ *
+ * /proc/<pid>/io reads are batched on demand instead, since few readers of
+ * the process list want them: the first io read of a process that a
+ * readdir batch covers fetches, with PROCFS_REQ_IOINFOS, the I/O counters
+ * of that batch's whole range, and the io reads of the other processes in
+ * it are answered from the result (or wait for it, like the above).
+ *
+ * A batch answers only for the processes it lists: a process created after
+ * it was taken, one the daemon could not read, or a daemon that predates
+ * the batch request falls back to the per-process request. A process
+ * reported by procfsd to have exec'd or exited (procfs_events.c) is no
+ * longer answered for.
+ *
+ * Off by default, since a batch that nobody reads from is wasted work for
+ * the daemon. procfs.stats.prefetch_* count what it saved.
+ */
+#include <kern/clock.h>
+#include <kern/locks.h>
+#include <kern/thread_call.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/OSMalloc.h>
+#include <sys/errno.h>
+#include <sys/param.h>
+#include <sys/proc_info.h>
+#include <sys/systm.h>
+#include <sys/time.h>
+#include <string.h>
+
+#include <fs/procfs/procfs.h>
+#include <fs/procfs/procfs_ctl.h>
+
+#define PROCFS_PREFETCH_BATCHES     8       /* batches at once, of either kind */
+#define PROCFS_PREFETCH_QUEUE       8       /* ranges waiting to be fetched */
+#define PROCFS_PREFETCH_MAX         1024    /* processes per batch, as procfs_get_pids() */
+#define PROCFS_PREFETCH_WINDOW_MS   1000    /* how long a batch answers for */
+#define PROCFS_PREFETCH_WAIT_MS     100     /* how long a read waits for a batch in flight */
+#define PROCFS_PREFETCH_GONE        16      /* exits and execs kept while a batch is fetched */
+
+/* Set through the procfs.prefetch sysctl (procfs_linux.c). */
+int procfs_prefetch_enabled = 0;
+
+enum {
+    PROCFS_PB_FREE = 0,
+    PROCFS_PB_FETCHING,
+    PROCFS_PB_READY,
+};
+
+/* What a batch holds. */
+enum {
+    PROCFS_PB_TASKINFO = 0,     /* struct procfs_ctl_taskinfo, queued by readdir */
+    PROCFS_PB_IO,               /* struct procfs_ctl_ioinfo, fetched by an io read */
+};
+
+static const struct {
+    uint32_t type;              /* the batch request */
+    uint32_t recsize;
+} procfs_prefetch_kinds[] = {
+    [PROCFS_PB_TASKINFO] = { PROCFS_REQ_TASKINFOS, sizeof(struct procfs_ctl_taskinfo) },
+    [PROCFS_PB_IO]       = { PROCFS_REQ_IOINFOS, sizeof(struct procfs_ctl_ioinfo) },
+};
+
+/* The head every batch record starts with. */
+struct procfs_prefetch_rec {
+    int32_t  pid;
+    uint32_t reserved;          /* != 0: stale */
+};
+
+struct procfs_prefetch_batch {
+    int         pb_state;
+    int         pb_kind;        /* PROCFS_PB_TASKINFO or _IO */
+    pid_t       pb_first;       /* the range asked for */
+    pid_t       pb_last;
+    uint32_t    pb_count;
+    uint32_t    pb_size;        /* bytes allocated for pb_recs */
+    uint64_t    pb_expires;     /* mach_absolute_time(), once ready */
+    uint8_t    *pb_recs;        /* pb_count records, ascending pid */
+    uint32_t    pb_ngone;       /* while fetching; > PROCFS_PREFETCH_GONE = all stale */
+    pid_t       pb_gone[PROCFS_PREFETCH_GONE];  /* pids that exec'd or exited meanwhile */
+};
+
+struct procfs_prefetch_range {
+    pid_t pr_first;
+    pid_t pr_last;
+};
+
+static lck_mtx_t                    *procfs_prefetch_lock;
+static thread_call_t                 procfs_prefetch_call;
+static struct procfs_prefetch_batch  procfs_prefetch_batches[PROCFS_PREFETCH_BATCHES];
+static struct procfs_prefetch_range  procfs_prefetch_queue_[PROCFS_PREFETCH_QUEUE];
+static uint32_t                      procfs_prefetch_qhead;
+static uint32_t                      procfs_prefetch_qcount;
+static struct procfs_prefetch_counts procfs_prefetch_counts_;
+
+#define PROCFS_PREFETCH_INC(field) \
+    OSIncrementAtomic64((volatile SInt64 *)&procfs_prefetch_counts_.field)
+
+#pragma mark -
+#pragma mark Batches
+
+/* Free `pb`'s records and mark it unused. Called with the lock held. */
+static void
+procfs_prefetch_drop(struct procfs_prefetch_batch *pb)
+{
+    if (pb->pb_recs != NULL) {
+        OSFree(pb->pb_recs, pb->pb_size, procfs_osmalloc_tag);
+    }
+    bzero(pb, sizeof(*pb));
+}
+
+/* The batch of `kind` whose range covers `pid` and that can still answer, or NULL. */
+static struct procfs_prefetch_batch *
+procfs_prefetch_covering(int kind, pid_t pid, uint64_t now)
+{
+    for (int i = 0; i < PROCFS_PREFETCH_BATCHES; i++) {
+        struct procfs_prefetch_batch *pb = &procfs_prefetch_batches[i];
+        if (pb->pb_state == PROCFS_PB_FREE || pb->pb_kind != kind ||
+            pid < pb->pb_first || pid > pb->pb_last) {
+            continue;
+        }
+        if (pb->pb_state == PROCFS_PB_FETCHING || now < pb->pb_expires) {
+            return pb;
+        }
+    }
+    return NULL;
+}
+
+/* Record `i` of a ready batch. */
+static struct procfs_prefetch_rec *
+procfs_prefetch_at(const struct procfs_prefetch_batch *pb, uint32_t i)
+{
+    return (struct procfs_prefetch_rec *)
+        (pb->pb_recs + i * procfs_prefetch_kinds[pb->pb_kind].recsize);
+}
+
+/* `pid`'s record in a ready batch, or NULL. */
+static struct procfs_prefetch_rec *
+procfs_prefetch_find(const struct procfs_prefetch_batch *pb, pid_t pid)
+{
+    uint32_t lo = 0, hi = pb->pb_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (procfs_prefetch_at(pb, mid)->pid < pid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < pb->pb_count) {
+        struct procfs_prefetch_rec *rec = procfs_prefetch_at(pb, lo);
+        if (rec->pid == pid && rec->reserved == 0) {
+            return rec;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * A process in the range of batch `pb`, which is still being fetched,
+ * exec'd or exited: remember it, so that its record, which may have been
+ * read before, is stale once the batch is ready. Past PROCFS_PREFETCH_GONE
+ * the whole batch is. Called with the lock held.
+ */
+static void
+procfs_prefetch_gone(struct procfs_prefetch_batch *pb, pid_t pid)
+{
+    if (pid < pb->pb_first || pid > pb->pb_last) {
+        return;
+    }
+    if (pb->pb_ngone < PROCFS_PREFETCH_GONE) {
+        pb->pb_gone[pb->pb_ngone++] = pid;
+    } else {
+        pb->pb_ngone = PROCFS_PREFETCH_GONE + 1;
+    }
+}
+
+/*
+ * Lifecycle events: an exec or exit makes the process's record stale, in a
+ * ready batch at once and in one being fetched once it arrives.
+ */
+static void
+procfs_prefetch_event(__unused void *arg, const struct procfs_ctl_event *ev, uint32_t count,
+    uint32_t dropped)
+{
+    lck_mtx_lock(procfs_prefetch_lock);
+    for (int i = 0; i < PROCFS_PREFETCH_BATCHES; i++) {
+        struct procfs_prefetch_batch *pb = &procfs_prefetch_batches[i];
+        if (pb->pb_state == PROCFS_PB_FETCHING) {
+            if (dropped != 0) {
+                pb->pb_ngone = PROCFS_PREFETCH_GONE + 1;
+                continue;
+            }
+            for (uint32_t j = 0; j < count; j++) {
+                if (ev[j].kind != PROCFS_EV_FORK) {
+                    procfs_prefetch_gone(pb, ev[j].pid);
+                }
+            }
+            continue;
+        }
+        if (pb->pb_state != PROCFS_PB_READY) {
+            continue;
+        }
+        if (dropped != 0) {
+            procfs_prefetch_drop(pb);
+            continue;
+        }
+        for (uint32_t j = 0; j < count; j++) {
+            if (ev[j].kind == PROCFS_EV_FORK) {
+                continue;
+            }
+            struct procfs_prefetch_rec *rec = procfs_prefetch_find(pb, ev[j].pid);
+            if (rec != NULL) {
+                rec->reserved = 1;
+            }
+        }
+    }
+    lck_mtx_unlock(procfs_prefetch_lock);
+}
+
+#pragma mark -
+#pragma mark Fetching
+
+/*
+ * The records of one batch reply page in `buf` (`got` bytes), or NULL if
+ * it is malformed. PROCFS_REQ_TASKINFOS and PROCFS_REQ_IOINFOS pages have
+ * the same header.
+ */
+static const uint8_t *
+procfs_prefetch_page(int kind, const uint8_t *buf, uint32_t got, struct procfs_ctl_taskinfos *hdr)
+{
+    if (got < sizeof(*hdr)) {
+        return NULL;
+    }
+    memcpy(hdr, buf, sizeof(*hdr));
+    if (hdr->count > (got - sizeof(*hdr)) / procfs_prefetch_kinds[kind].recsize) {
+        return NULL;
+    }
+    return buf + sizeof(*hdr);
+}
+
+/*
+ * Fetch the `kind` records of every process in [first, last] into `recs`
+ * (room for `cap`), page by page. Returns the number of records, in
+ * ascending pid order; records out of range or out of order are dropped.
+ */
+static uint32_t
+procfs_prefetch_fetch(int kind, pid_t first, pid_t last, uint8_t *recs, uint32_t cap,
+    uint8_t *buf)
+{
+    uint32_t recsize = procfs_prefetch_kinds[kind].recsize;
+    uint32_t count = 0;
+    pid_t    from  = first;
+    pid_t    prev  = 0;
+
+    while (from <= last && count < cap) {
+        struct procfs_ctl_taskinfos hdr;
+        const uint8_t *page;
+        uint32_t got = 0;
+        int rc = procfs_ctl_request(procfs_prefetch_kinds[kind].type, from, (uint64_t)last,
+            buf, PROCFS_CTL_MAXPAYLOAD, &got);
+        if (rc != 0 || (page = procfs_prefetch_page(kind, buf, got, &hdr)) == NULL) {
+            PROCFS_PREFETCH_INC(errors);
+            break;          /* keep what we have */
+        }
+        for (uint32_t i = 0; i < hdr.count && count < cap; i++) {
+            struct procfs_prefetch_rec rec;
+            memcpy(&rec, page + i * recsize, sizeof(rec));
+            if (rec.pid < from || rec.pid > last || (count > 0 && rec.pid <= prev)) {
+                continue;
+            }
+            memcpy(recs + count * recsize, page + i * recsize, recsize);
+            ((struct procfs_prefetch_rec *)(recs + count * recsize))->reserved = 0;
+            prev = rec.pid;
+            count++;
+        }
+        /* `next` must advance, so a confused daemon cannot loop us. */
+        if (hdr.next <= from) {
+            break;
+        }
+        from = hdr.next;
+    }
+    return count;
+}
+
+/*
+ * Take a batch for fetching the `kind` records of [first, last]: a free or
+ * expired one, else the one closest to expiring, or NULL if every batch is
+ * being fetched. The records it held are handed back in `*old` (`*old_size`
+ * bytes) to free once the lock is dropped. Called with the lock held.
+ */
+static struct procfs_prefetch_batch *
+procfs_prefetch_claim(int kind, pid_t first, pid_t last, uint8_t **old, uint32_t *old_size)
+{
+    uint64_t now = mach_absolute_time();
+    struct procfs_prefetch_batch *pb = NULL;
+    for (int i = 0; i < PROCFS_PREFETCH_BATCHES; i++) {
+        struct procfs_prefetch_batch *cand = &procfs_prefetch_batches[i];
+        if (cand->pb_state == PROCFS_PB_FETCHING) {
+            continue;
+        }
+        if (cand->pb_state == PROCFS_PB_FREE || now >= cand->pb_expires) {
+            pb = cand;
+            break;
+        }
+        if (pb == NULL || cand->pb_expires < pb->pb_expires) {
+            pb = cand;
+        }
+    }
+    if (pb == NULL) {
+        return NULL;
+    }
+    *old      = pb->pb_recs;
+    *old_size = pb->pb_size;
+    bzero(pb, sizeof(*pb));
+    pb->pb_state = PROCFS_PB_FETCHING;
+    pb->pb_kind  = kind;
+    pb->pb_first = first;
+    pb->pb_last  = last;
+    return pb;
+}
+
+/*
+ * Fill the claimed batch `pb`, with the lock not held: fetch its range,
+ * then make it ready, less the processes that exec'd or exited meanwhile,
+ * and wake whoever waits for it. `buf` is a PROCFS_CTL_MAXPAYLOAD scratch
+ * page; without one the batch is let go, as it is if too many processes
+ * went stale to remember.
+ */
+static void
+procfs_prefetch_load(struct procfs_prefetch_batch *pb, uint8_t *old, uint32_t old_size,
+    uint8_t *buf)
+{
+    int   kind  = pb->pb_kind;
+    pid_t first = pb->pb_first, last = pb->pb_last;
+
+    if (old != NULL) {
+        OSFree(old, old_size, procfs_osmalloc_tag);
+    }
+
+    uint32_t span = (uint32_t)(last - first) + 1;
+    uint32_t cap  = span < PROCFS_PREFETCH_MAX ? span : PROCFS_PREFETCH_MAX;
+    uint32_t size = cap * procfs_prefetch_kinds[kind].recsize;
+    uint8_t *recs = OSMalloc(size, procfs_osmalloc_tag);
+    uint32_t count = 0;
+    if (recs != NULL && buf != NULL) {
+        count = procfs_prefetch_fetch(kind, first, last, recs, cap, buf);
+    }
+    PROCFS_PREFETCH_INC(batches);
+    OSAddAtomic64((SInt64)count, (volatile SInt64 *)&procfs_prefetch_counts_.records);
+
+    uint64_t expires;
+    clock_interval_to_deadline(PROCFS_PREFETCH_WINDOW_MS, NSEC_PER_MSEC, &expires);
+
+    lck_mtx_lock(procfs_prefetch_lock);
+    if (count > 0 && pb->pb_ngone <= PROCFS_PREFETCH_GONE) {
+        pb->pb_state   = PROCFS_PB_READY;
+        pb->pb_count   = count;
+        pb->pb_size    = size;
+        pb->pb_recs    = recs;
+        pb->pb_expires = expires;
+        recs = NULL;
+        /* What exec'd or exited while it was fetched may have been read before. */
+        for (uint32_t i = 0; i < pb->pb_ngone; i++) {
+            struct procfs_prefetch_rec *rec = procfs_prefetch_find(pb, pb->pb_gone[i]);
+            if (rec != NULL) {
+                rec->reserved = 1;
+            }
+        }
+        pb->pb_ngone = 0;
+    } else {
+        bzero(pb, sizeof(*pb));
+    }
+    wakeup(pb);
+    lck_mtx_unlock(procfs_prefetch_lock);
+
+    if (recs != NULL) {
+        OSFree(recs, size, procfs_osmalloc_tag);
+    }
+}
+
+/* Thread call: fetch every queued range into a taskinfo batch. */
+static void
+procfs_prefetch_run(__unused thread_call_param_t a, __unused thread_call_param_t b)
+{
+    uint8_t *buf = OSMalloc(PROCFS_CTL_MAXPAYLOAD, procfs_osmalloc_tag);
+    if (buf == NULL) {
+        return;
+    }
+
+    for (;;) {
+        lck_mtx_lock(procfs_prefetch_lock);
+        if (procfs_prefetch_qcount == 0) {
+            lck_mtx_unlock(procfs_prefetch_lock);
+            break;
+        }
+        struct procfs_prefetch_range r = procfs_prefetch_queue_[procfs_prefetch_qhead];
+        procfs_prefetch_qhead = (procfs_prefetch_qhead + 1) % PROCFS_PREFETCH_QUEUE;
+        procfs_prefetch_qcount--;
+
+        uint8_t *old;
+        uint32_t old_size;
+        struct procfs_prefetch_batch *pb =
+            procfs_prefetch_claim(PROCFS_PB_TASKINFO, r.pr_first, r.pr_last, &old, &old_size);
+        lck_mtx_unlock(procfs_prefetch_lock);
+        if (pb == NULL) {
+            /* Every batch is being fetched. */
+            PROCFS_PREFETCH_INC(dropped);
+            continue;
+        }
+        procfs_prefetch_load(pb, old, old_size, buf);
+    }
+
+    OSFree(buf, PROCFS_CTL_MAXPAYLOAD, procfs_osmalloc_tag);
+}
+
+/*
+ * Wait, with the lock held, for the batch `pb` being fetched, until
+ * `give_up`. Returns FALSE if the caller should stop waiting (time is up,
+ * or a signal).
+ */
+static boolean_t
+procfs_prefetch_wait(struct procfs_prefetch_batch *pb, uint64_t now, uint64_t give_up)
+{
+    uint64_t ns;
+    if (now >= give_up) {
+        return FALSE;
+    }
+    absolutetime_to_nanoseconds(give_up - now, &ns);
+    struct timespec ts = {
+        .tv_sec  = (long)(ns / NSEC_PER_SEC),
+        .tv_nsec = (long)(ns % NSEC_PER_SEC),
+    };
+    int r = msleep(pb, procfs_prefetch_lock, PCATCH, "pfsprefetch", &ts);
+    return r == 0 || r == EWOULDBLOCK;
+}
+
+#pragma mark -
+#pragma mark Interface
+
+void
+procfs_prefetch_init(void)
+{
+    procfs_prefetch_lock = lck_mtx_alloc_init(pfsnode_lck_grp, LCK_ATTR_NULL);
+    procfs_prefetch_call = thread_call_allocate(procfs_prefetch_run, NULL);
+    (void)procfs_event_subscribe(procfs_prefetch_event, NULL);
+}
+
+void
+procfs_prefetch_fini(void)
+{
+    procfs_event_unsubscribe(procfs_prefetch_event, NULL);
+    if (procfs_prefetch_call != NULL) {
+        thread_call_cancel_wait(procfs_prefetch_call);
+        thread_call_free(procfs_prefetch_call);
+        procfs_prefetch_call = NULL;
+    }
+    for (int i = 0; i < PROCFS_PREFETCH_BATCHES; i++) {
+        procfs_prefetch_drop(&procfs_prefetch_batches[i]);
+    }
+    procfs_prefetch_qcount = 0;
+    if (procfs_prefetch_lock != NULL) {
+        lck_mtx_free(procfs_prefetch_lock, pfsnode_lck_grp);
+        procfs_prefetch_lock = NULL;
+    }
+}
+
+/*
+ * A readdir of the process list has just returned the pids `first` to
+ * `last`, in ascending order: fetch their taskinfo in the background, unless
+ * prefetch is off or a batch already covers the range.
+ */
+void
+procfs_prefetch_queue(pid_t first, pid_t last)
+{
+    if (!procfs_prefetch_enabled || procfs_prefetch_call == NULL || first > last) {
+        return;
+    }
+
+    boolean_t queued = FALSE;
+    uint64_t now = mach_absolute_time();
+    lck_mtx_lock(procfs_prefetch_lock);
+    for (int i = 0; i < PROCFS_PREFETCH_BATCHES; i++) {
+        const struct procfs_prefetch_batch *pb = &procfs_prefetch_batches[i];
+        if (pb->pb_state != PROCFS_PB_FREE && pb->pb_kind == PROCFS_PB_TASKINFO &&
+            pb->pb_first <= first && pb->pb_last >= last &&
+            (pb->pb_state == PROCFS_PB_FETCHING || now < pb->pb_expires)) {
+            lck_mtx_unlock(procfs_prefetch_lock);
+            return;
+        }
+    }
+    for (uint32_t i = 0; i < procfs_prefetch_qcount; i++) {
+        const struct procfs_prefetch_range *r =
+            &procfs_prefetch_queue_[(procfs_prefetch_qhead + i) % PROCFS_PREFETCH_QUEUE];
+        if (r->pr_first <= first && r->pr_last >= last) {
+            lck_mtx_unlock(procfs_prefetch_lock);
+            return;
+        }
+    }
+    if (procfs_prefetch_qcount < PROCFS_PREFETCH_QUEUE) {
+        uint32_t tail = (procfs_prefetch_qhead + procfs_prefetch_qcount) % PROCFS_PREFETCH_QUEUE;
+        procfs_prefetch_queue_[tail] = (struct procfs_prefetch_range){ first, last };
+        procfs_prefetch_qcount++;
+        queued = TRUE;
+    }
+    lck_mtx_unlock(procfs_prefetch_lock);
+
+    if (queued) {
+        (void)thread_call_enter(procfs_prefetch_call);
+    } else {
+        PROCFS_PREFETCH_INC(dropped);
+    }
+}
+
+/*
+ * Copy `pid`'s taskinfo from a prefetched batch into `ti`, waiting up to
+ * PROCFS_PREFETCH_WAIT_MS for a batch that covers it to arrive. Returns
+ * TRUE on a hit; FALSE if prefetch is off or the batch did not have it.
+ */
+boolean_t
+procfs_prefetch_taskinfo(pid_t pid, struct proc_taskinfo *ti)
+{
+    if (!procfs_prefetch_enabled || procfs_prefetch_lock == NULL) {
+        return FALSE;
+    }
+
+    boolean_t hit = FALSE;
+    uint64_t give_up;
+    clock_interval_to_deadline(PROCFS_PREFETCH_WAIT_MS, NSEC_PER_MSEC, &give_up);
+
+    lck_mtx_lock(procfs_prefetch_lock);
+    for (;;) {
+        uint64_t now = mach_absolute_time();
+        struct procfs_prefetch_batch *pb = procfs_prefetch_covering(PROCFS_PB_TASKINFO, pid, now);
+        if (pb == NULL) {
+            break;
+        }
+        if (pb->pb_state == PROCFS_PB_READY) {
+            const struct procfs_prefetch_rec *rec = procfs_prefetch_find(pb, pid);
+            if (rec != NULL) {
+                *ti = ((const struct procfs_ctl_taskinfo *)rec)->info;
+                hit = TRUE;
+            }
+            break;
+        }
+        if (!procfs_prefetch_wait(pb, now, give_up)) {
+            break;
+        }
+    }
+    lck_mtx_unlock(procfs_prefetch_lock);
+
+    if (hit) {
+        PROCFS_PREFETCH_INC(hits);
+    } else {
+        PROCFS_PREFETCH_INC(misses);
+    }
+    return hit;
+}
+
+/*
+ * Copy `pid`'s I/O counters from a prefetched batch into `io`. With none
+ * at hand but a readdir batch covering `pid`, fetch the counters of that
+ * batch's whole range here and now, so that a sweep of every process's io
+ * file costs one PROCFS_REQ_IOINFOS exchange per readdir page; a read that
+ * finds that fetch in progress waits for it as procfs_prefetch_taskinfo()
+ * does. Returns TRUE on a hit; FALSE if prefetch is off, no readdir covered
+ * `pid` or the batch did not have it.
+ */
+boolean_t
+procfs_prefetch_ioinfo(pid_t pid, struct procfs_ctl_ioinfo *io)
+{
+    if (!procfs_prefetch_enabled || procfs_prefetch_lock == NULL) {
+        return FALSE;
+    }
+
+    boolean_t hit = FALSE, fetched = FALSE;
+    uint64_t give_up;
+    clock_interval_to_deadline(PROCFS_PREFETCH_WAIT_MS, NSEC_PER_MSEC, &give_up);
+
+    lck_mtx_lock(procfs_prefetch_lock);
+    for (;;) {
+        uint64_t now = mach_absolute_time();
+        struct procfs_prefetch_batch *pb = procfs_prefetch_covering(PROCFS_PB_IO, pid, now);
+        if (pb != NULL && pb->pb_state == PROCFS_PB_READY) {
+            const struct procfs_prefetch_rec *rec = procfs_prefetch_find(pb, pid);
+            if (rec != NULL) {
+                *io = *(const struct procfs_ctl_ioinfo *)rec;
+                hit = TRUE;
+            }
+            break;
+        }
+        if (pb != NULL) {
+            if (!procfs_prefetch_wait(pb, now, give_up)) {
+                break;
+            }
+            continue;
+        }
+
+        /* None yet: fetch one for the range of the readdir that listed `pid`. */
+        const struct procfs_prefetch_batch *tb =
+            procfs_prefetch_covering(PROCFS_PB_TASKINFO, pid, now);
+        if (fetched || tb == NULL) {
+            break;
+        }
+        uint8_t *old;
+        uint32_t old_size;
+        pb = procfs_prefetch_claim(PROCFS_PB_IO, tb->pb_first, tb->pb_last, &old, &old_size);
+        if (pb == NULL) {
+            PROCFS_PREFETCH_INC(dropped);
+            break;
+        }
+        lck_mtx_unlock(procfs_prefetch_lock);
+        uint8_t *buf = OSMalloc(PROCFS_CTL_MAXPAYLOAD, procfs_osmalloc_tag);
+        procfs_prefetch_load(pb, old, old_size, buf);
+        if (buf != NULL) {
+            OSFree(buf, PROCFS_CTL_MAXPAYLOAD, procfs_osmalloc_tag);
+        }
+        fetched = TRUE;
+        lck_mtx_lock(procfs_prefetch_lock);
+    }
+    lck_mtx_unlock(procfs_prefetch_lock);
+
+    if (hit) {
+        PROCFS_PREFETCH_INC(io_hits);
+    } else {
+        PROCFS_PREFETCH_INC(io_misses);
+    }
+    return hit;
+}
+
+/* The counters so far, for procfs.stats. */
+void
+procfs_prefetch_counts(struct procfs_prefetch_counts *out)
+{
+    *out = procfs_prefetch_counts_;
+}
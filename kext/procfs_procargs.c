@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_procargs.c
+ *
+ * Layout parser for the flattened KERN_PROCARGS2 argument area, shared by
+ * the cmdline, environ and auxv nodes through procfs_read_procargs()
+ * (procfs_cmdline.c). That reader copies up to 256 KB of the target's user
+ * stack; this file only locates the argv / env / apple[] sections in the
+ * copy, so it is pure and host-buildable (test/host fuzzes and benchmarks
+ * it).
+ *
+ * The area is all NUL-terminated strings, and an environment-heavy process
+ * puts tens of kilobytes of them between argv and apple[], so finding the
+ * terminators is the whole cost. Everything here looks at a 64-bit word per
+ * step instead of a byte, and neither section walk goes string by string: a
+ * run of 100k one-character arguments costs the same as one long one.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <fs/procfs/procfs_procargs.h>
+
+#pragma mark -
+#pragma mark Word-at-a-time scanning
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "procfs_procargs.c maps mask bits to bytes little-endian"
+#endif
+
+typedef uint64_t procargs_word_t;
+
+#define PROCARGS_WORD       sizeof(procargs_word_t)
+#define PROCARGS_LOWS       0x7f7f7f7f7f7f7f7fULL
+#define PROCARGS_BYTES(c)   (0x0101010101010101ULL * (uint8_t)(c))
+
+/*
+ * Both kext targets (x86_64, arm64) take unaligned loads at full speed, so
+ * scans load from wherever they start rather than stepping to a word
+ * boundary first; most argument strings are shorter than that walk.
+ * memcpy() keeps the load well-defined and compiles to a single move.
+ */
+static inline procargs_word_t
+procargs_load(const uint8_t *p)
+{
+    procargs_word_t w;
+
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+/*
+ * The top bit of each byte of `w` that is zero, and nothing else. Unlike
+ * the shorter (w - 0x01..) & ~w & 0x80.. test this has no false positives
+ * above a zero byte, so the result can be counted and combined with other
+ * masks. Byte k of the load is bit 8k + 7.
+ */
+static inline procargs_word_t
+procargs_zeros(procargs_word_t w)
+{
+    return ~(((w & PROCARGS_LOWS) + PROCARGS_LOWS) | w | PROCARGS_LOWS);
+}
+
+static inline size_t
+procargs_first(procargs_word_t mask)
+{
+    return (size_t)__builtin_ctzll(mask) >> 3;
+}
+
+size_t
+procfs_procargs_strnlen(const uint8_t *s, size_t len)
+{
+    size_t i = 0;
+
+    /* Whole words only: never load past s + len. */
+    for (; len - i >= PROCARGS_WORD; i += PROCARGS_WORD) {
+        procargs_word_t z = procargs_zeros(procargs_load(s + i));
+        if (z != 0) {
+            return i + procargs_first(z);
+        }
+    }
+    while (i < len && s[i] != '\0') {
+        i++;
+    }
+    return i;
+}
+
+/* Offset of the first non-NUL byte in [s, s + len), or len if there is none. */
+static size_t
+procargs_skipnul(const uint8_t *s, size_t len)
+{
+    size_t i = 0;
+
+    for (; len - i >= PROCARGS_WORD; i += PROCARGS_WORD) {
+        if (procargs_load(s + i) != 0) {
+            break;
+        }
+    }
+    while (i < len && s[i] == '\0') {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Offset just past the `count`th NUL in [s, s + len) - the end of `count`
+ * consecutive strings - or len if the strings run off the end. Terminators
+ * are counted a word at a time rather than found one by one.
+ */
+static size_t
+procargs_skip_strings(const uint8_t *s, size_t len, int count)
+{
+    size_t i = 0;
+
+    if (count <= 0) {
+        return 0;
+    }
+    for (; len - i >= PROCARGS_WORD; i += PROCARGS_WORD) {
+        procargs_word_t z = procargs_zeros(procargs_load(s + i));
+        if (z == 0) {
+            continue;                               /* inside a string */
+        }
+        int n = __builtin_popcountll(z);
+        if (n < count) {
+            count -= n;
+            continue;
+        }
+        while (--count > 0) {
+            z &= z - 1;                             /* drop earlier terminators */
+        }
+        return i + procargs_first(z) + 1;
+    }
+    for (; i < len; i++) {
+        if (s[i] == '\0' && --count == 0) {
+            return i + 1;
+        }
+    }
+    return len;
+}
+
+/*
+ * Offset of the first string in [s, s + len) - one at 0 or just after a NUL
+ * - that begins with PROCFS_EXEC_KEY, or len if none does. Rather than
+ * walking the strings, each word yields the starts that are preceded by a
+ * NUL and open with the key's first two bytes ("ex"); only those are
+ * compared in full.
+ */
+static size_t
+procargs_find_key(const uint8_t *s, size_t len)
+{
+    const size_t keylen = sizeof(PROCFS_EXEC_KEY) - 1;
+    const procargs_word_t e = PROCARGS_BYTES(PROCFS_EXEC_KEY[0]);
+    const procargs_word_t x = PROCARGS_BYTES(PROCFS_EXEC_KEY[1]);
+
+    if (len < keylen) {
+        return len;
+    }
+    if (memcmp(s, PROCFS_EXEC_KEY, keylen) == 0) {
+        return 0;
+    }
+
+    /* Candidate starts are 1 .. len - keylen; each needs bytes [at - 1, at + 1]. */
+    size_t last = len - keylen;
+    size_t i = 1;
+    for (; last - i + 1 >= PROCARGS_WORD; i += PROCARGS_WORD) {
+        procargs_word_t m = procargs_zeros(procargs_load(s + i - 1));
+        if (m == 0) {
+            continue;                               /* no string starts here */
+        }
+        m &= procargs_zeros(procargs_load(s + i) ^ e) &
+             procargs_zeros(procargs_load(s + i + 1) ^ x);
+        for (; m != 0; m &= m - 1) {
+            size_t at = i + procargs_first(m);
+            if (memcmp(s + at, PROCFS_EXEC_KEY, keylen) == 0) {
+                return at;
+            }
+        }
+    }
+    for (; i <= last; i++) {
+        if (s[i - 1] == '\0' && memcmp(s + i, PROCFS_EXEC_KEY, keylen) == 0) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#pragma mark -
+#pragma mark Layout
+
+void
+procfs_procargs_parse(const uint8_t *buf, size_t len, int argc,
+    struct procfs_procargs *pa)
+{
+    size_t pos;
+
+    /* Index 0 is the bare exec path, possibly with NUL alignment padding. */
+    pos = procfs_procargs_strnlen(buf, len);
+    if (pos < len) {
+        pos++;                                      /* path's NUL */
+        pos += procargs_skipnul(buf + pos, len - pos);
+    }
+    pa->argv_off = pos;
+
+    /* Skip the argc argv strings -> start of env. */
+    pos += procargs_skip_strings(buf + pos, len - pos, argc);
+    pa->env_off = pos;
+
+    /* apple[] begins at the first "executable_path=" entry (apple[0]). */
+    pa->apple_off = pos + procargs_find_key(buf + pos, len - pos);
+}
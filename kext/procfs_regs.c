@@ -79,6 +79,7 @@ procfs_doregs(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     uint32_t got = 0;
     int rc = procfs_ctl_request(PROCFS_REQ_REGS, pnp->node_id.nodeid_pid, 0,
                                 &state, sizeof(state), &got);
+    procfs_stats_ctl(pnp, rc);
     if (rc != 0) {
         /* ENOTCONN: the daemon is not running. Otherwise the daemon's errno
          * (EPERM for a SIP/AMFI-protected target, ESRCH/EIO otherwise). */
@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_render.c
+ *
+ * Text formatters for the Linux-compatible and NetBSD-style nodes. Each one
+ * appends a file's text (or one line of it) to an sbuf from plain data the
+ * node handler has already gathered, using the sbuf numeric emitters rather
+ * than one printf per line. Nothing here locks, allocates or touches a
+ * process, so this file also builds on the host (test/host) for unit tests
+ * and benchmarks.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <mach/vm_prot.h>
+#include <sys/sbuf.h>
+#include <sys/sysctl.h>
+
+#include <bsdcompat/sys/sbuf.h>
+
+#include <fs/procfs/procfs_render.h>
+
+#define B2K(x) ((x) >> 10)              /* bytes to kbytes */
+
+#pragma mark -
+#pragma mark Map formatters
+
+/* "%#018llx": printf drops the 0x prefix for zero but keeps the width. */
+static void
+procfs_map_fmt_addr(struct sbuf *sb, uint64_t addr)
+{
+    if (addr == 0) {
+        sbuf_puthex(sb, 0, 18);
+    } else {
+        sbuf_cat(sb, "0x");
+        sbuf_puthex(sb, addr, 16);
+    }
+}
+
+/*
+ * NetBSD-style map line: start-end curprot maxprot sharing wired, i.e.
+ * "%#018llx %#018llx %c%c%c %c%c%c %s %u\n".
+ */
+void
+procfs_map_fmt_netbsd(struct sbuf *sb, const struct procfs_region *r)
+{
+    char perms[9] = {
+        ' ',
+        (r->prot & VM_PROT_READ)        ? 'r' : '-',
+        (r->prot & VM_PROT_WRITE)       ? 'w' : '-',
+        (r->prot & VM_PROT_EXECUTE)     ? 'x' : '-',
+        ' ',
+        (r->max_prot & VM_PROT_READ)    ? 'r' : '-',
+        (r->max_prot & VM_PROT_WRITE)   ? 'w' : '-',
+        (r->max_prot & VM_PROT_EXECUTE) ? 'x' : '-',
+        ' ',
+    };
+    procfs_map_fmt_addr(sb, r->start);
+    sbuf_putc(sb, ' ');
+    procfs_map_fmt_addr(sb, r->end);
+    sbuf_bcat(sb, perms, sizeof(perms));
+    sbuf_cat(sb, r->shared ? "share " : "priv ");
+    sbuf_putu64(sb, r->wired);
+    sbuf_putc(sb, '\n');
+}
+
+/*
+ * Linux maps line: start-end perms offset dev inode path, i.e.
+ * "%016llx-%016llx %c%c%c%c %016llx 00:00 0 \n". The dev/inode/path columns
+ * are reported as "00:00 0" with no path (see procfs_map.c).
+ */
+void
+procfs_maps_fmt_linux(struct sbuf *sb, const struct procfs_region *r)
+{
+    char perms[6] = {
+        ' ',
+        (r->prot & VM_PROT_READ)    ? 'r' : '-',
+        (r->prot & VM_PROT_WRITE)   ? 'w' : '-',
+        (r->prot & VM_PROT_EXECUTE) ? 'x' : '-',
+        r->shared ? 's' : 'p',
+        ' ',
+    };
+    sbuf_puthex(sb, r->start, 16);
+    sbuf_putc(sb, '-');
+    sbuf_puthex(sb, r->end, 16);
+    sbuf_bcat(sb, perms, sizeof(perms));
+    sbuf_puthex(sb, r->offset, 16);
+    sbuf_cat(sb, " 00:00 0 \n");
+}
+
+#pragma mark -
+#pragma mark Process text
+
+const char *
+procfs_thread_state_word(char c)
+{
+    switch (c) {
+    case 'R': return "running";
+    case 'T': return "stopped";
+    case 'D': return "disk sleep";
+    case 'Z': return "zombie";
+    case 'I': return "idle";
+    default:  return "sleeping";
+    }
+}
+
+/*
+ * One Linux stat line (52 space-separated fields). Equivalent to
+ *   "%llu (%s) %c %d %d %d 0 -1 0 0 0 0 0 "                  1-13
+ *   "%llu %llu 0 0 %d 0 %d 0 0 "                             14-22
+ *   "%llu %llu 18446744073709551615 "                       23-25
+ *   "0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 "                         26-40
+ *   "%d "                                                    41 policy
+ *   "0 0 0 0 0 0 0 0 0 0 0\n"                                42-52
+ */
+void
+procfs_render_stat_line(struct sbuf *sb, uint64_t id, const char *name, char state,
+                        const struct procfs_pctx *c, uint64_t utime, uint64_t stime,
+                        int64_t prio, uint64_t rss_pages, int64_t policy)
+{
+    sbuf_putu64(sb, id);
+    sbuf_cat(sb, " (");
+    sbuf_cat(sb, name);
+    sbuf_cat(sb, ") ");
+    sbuf_putc(sb, state);
+    sbuf_putc(sb, ' ');
+    sbuf_puti64(sb, c->ppid);
+    sbuf_putc(sb, ' ');
+    sbuf_puti64(sb, c->pgid);
+    sbuf_putc(sb, ' ');
+    sbuf_puti64(sb, c->sid);
+    sbuf_cat(sb, " 0 -1 0 0 0 0 0 ");
+    sbuf_putu64(sb, utime);
+    sbuf_putc(sb, ' ');
+    sbuf_putu64(sb, stime);
+    sbuf_cat(sb, " 0 0 ");
+    sbuf_puti64(sb, prio);
+    sbuf_cat(sb, " 0 ");
+    sbuf_puti64(sb, c->nthreads);
+    sbuf_cat(sb, " 0 0 ");
+    sbuf_putu64(sb, c->vsize);
+    sbuf_putc(sb, ' ');
+    sbuf_putu64(sb, rss_pages);
+    sbuf_cat(sb, " 18446744073709551615 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 ");
+    sbuf_puti64(sb, policy);
+    sbuf_cat(sb, " 0 0 0 0 0 0 0 0 0 0 0\n");
+}
+
+/* "%llu %llu 0 0 0 0 0\n" */
+void
+procfs_render_statm(struct sbuf *sb, uint64_t size_pages, uint64_t resident_pages)
+{
+    sbuf_putu64(sb, size_pages);
+    sbuf_putc(sb, ' ');
+    sbuf_putu64(sb, resident_pages);
+    sbuf_cat(sb, " 0 0 0 0 0\n");
+}
+
+/* "rchar: %llu\nwchar: %llu\nsyscr: 0\n...write_bytes: %llu\ncancelled_write_bytes: 0\n" */
+void
+procfs_render_io(struct sbuf *sb, uint64_t rchar, uint64_t wchar, uint64_t read_bytes,
+                 uint64_t write_bytes)
+{
+    sbuf_cat(sb, "rchar: ");
+    sbuf_putu64(sb, rchar);
+    sbuf_cat(sb, "\nwchar: ");
+    sbuf_putu64(sb, wchar);
+    sbuf_cat(sb, "\nsyscr: 0\nsyscw: 0\nread_bytes: ");
+    sbuf_putu64(sb, read_bytes);
+    sbuf_cat(sb, "\nwrite_bytes: ");
+    sbuf_putu64(sb, write_bytes);
+    sbuf_cat(sb, "\ncancelled_write_bytes: 0\n");
+}
+
+/* "Name:\t%s\nState:\t%c (%s)\nTgid:\t%d\nPid:\t%llu\nPPid:\t%d\n" */
+void
+procfs_render_status_head(struct sbuf *sb, const char *name, char state, int tgid,
+                          uint64_t pid, int ppid)
+{
+    sbuf_cat(sb, "Name:\t");
+    sbuf_cat(sb, name);
+    sbuf_cat(sb, "\nState:\t");
+    sbuf_putc(sb, state);
+    sbuf_cat(sb, " (");
+    sbuf_cat(sb, procfs_thread_state_word(state));
+    sbuf_cat(sb, ")\nTgid:\t");
+    sbuf_puti64(sb, tgid);
+    sbuf_cat(sb, "\nPid:\t");
+    sbuf_putu64(sb, pid);
+    sbuf_cat(sb, "\nPPid:\t");
+    sbuf_puti64(sb, ppid);
+    sbuf_putc(sb, '\n');
+}
+
+/* "<label>\t%u\t%u\t%u\t%u\n" */
+void
+procfs_render_status_ids(struct sbuf *sb, const char *label, uint32_t real, uint32_t eff,
+                         uint32_t saved, uint32_t fs)
+{
+    sbuf_cat(sb, label);
+    sbuf_putc(sb, '\t');
+    sbuf_putu64(sb, real);
+    sbuf_putc(sb, '\t');
+    sbuf_putu64(sb, eff);
+    sbuf_putc(sb, '\t');
+    sbuf_putu64(sb, saved);
+    sbuf_putc(sb, '\t');
+    sbuf_putu64(sb, fs);
+    sbuf_putc(sb, '\n');
+}
+
+/* "<label>%8llu kB\n" */
+void
+procfs_render_status_kb(struct sbuf *sb, const char *label, uint64_t kb)
+{
+    sbuf_cat(sb, label);
+    sbuf_putu64_pad(sb, kb, 8);
+    sbuf_cat(sb, " kB\n");
+}
+
+/* "Threads:\t%d\n" and the context-switch counters, which have no source. */
+void
+procfs_render_status_tail(struct sbuf *sb, int nthreads)
+{
+    sbuf_cat(sb, "Threads:\t");
+    sbuf_puti64(sb, nthreads);
+    sbuf_cat(sb, "\nvoluntary_ctxt_switches:\t0\n"
+                 "nonvoluntary_ctxt_switches:\t0\n");
+}
+
+#pragma mark -
+#pragma mark System text
+
+/*
+ * "cpu  %llu %llu %llu %llu 0 0 0 0 0 0\n" for the aggregate line, or
+ * "cpu%d %llu %llu %llu %llu 0 0 0 0 0 0\n" for one CPU. The columns are
+ * user nice system idle iowait irq softirq steal guest guest_nice.
+ */
+void
+procfs_render_stat_cpu(struct sbuf *sb, int cpu, uint64_t user, uint64_t nice,
+                       uint64_t sys, uint64_t idle)
+{
+    if (cpu < 0) {
+        sbuf_cat(sb, "cpu  ");
+    } else {
+        sbuf_cat(sb, "cpu");
+        sbuf_puti64(sb, cpu);
+        sbuf_putc(sb, ' ');
+    }
+    sbuf_putu64(sb, user);
+    sbuf_putc(sb, ' ');
+    sbuf_putu64(sb, nice);
+    sbuf_putc(sb, ' ');
+    sbuf_putu64(sb, sys);
+    sbuf_putc(sb, ' ');
+    sbuf_putu64(sb, idle);
+    sbuf_cat(sb, " 0 0 0 0 0 0\n");
+}
+
+/* A value scaled by 100 as "%d.%02d". */
+static void
+procfs_render_centi(struct sbuf *sb, int v)
+{
+    if (v < 0) {
+        sbuf_printf(sb, "%d.%02d", v / 100, v % 100);
+        return;
+    }
+    char frac[3] = { '.', (char)('0' + (v % 100) / 10), (char)('0' + v % 10) };
+    sbuf_puti64(sb, v / 100);
+    sbuf_bcat(sb, frac, sizeof(frac));
+}
+
+/* "%d.%02d %d.%02d %d.%02d %d/%d %d\n" */
+void
+procfs_render_loadavg(struct sbuf *sb, int load1, int load5, int load15,
+                      int running, int total, int lastpid)
+{
+    procfs_render_centi(sb, load1);
+    sbuf_putc(sb, ' ');
+    procfs_render_centi(sb, load5);
+    sbuf_putc(sb, ' ');
+    procfs_render_centi(sb, load15);
+    sbuf_putc(sb, ' ');
+    sbuf_puti64(sb, running);
+    sbuf_putc(sb, '/');
+    sbuf_puti64(sb, total);
+    sbuf_putc(sb, ' ');
+    sbuf_puti64(sb, lastpid);
+    sbuf_putc(sb, '\n');
+}
+
+/* "<label>%9llu kB\n" */
+static void
+procfs_render_meminfo_kb(struct sbuf *sb, const char *label, uint64_t bytes)
+{
+    sbuf_cat(sb, label);
+    sbuf_putu64_pad(sb, B2K(bytes), 9);
+    sbuf_cat(sb, " kB\n");
+}
+
+void
+procfs_render_meminfo(struct sbuf *sb, uint64_t memtotal, uint64_t memfree,
+                      uint64_t shared, uint64_t buffers, uint64_t cached,
+                      uint64_t swaptotal, uint64_t swapfree)
+{
+    procfs_render_meminfo_kb(sb, "MemTotal: ", memtotal);
+    procfs_render_meminfo_kb(sb, "MemFree:  ", memfree);
+    procfs_render_meminfo_kb(sb, "MemShared:", shared);
+    procfs_render_meminfo_kb(sb, "Buffers:  ", buffers);
+    procfs_render_meminfo_kb(sb, "Cached:   ", cached);
+    procfs_render_meminfo_kb(sb, "SwapTotal:", swaptotal);
+    procfs_render_meminfo_kb(sb, "SwapFree: ", swapfree);
+}
+
+#pragma mark -
+#pragma mark sysctl values
+
+void
+procfs_render_sysctl_value(struct sbuf *sb, int type, const char *fmt,
+                           const void *raw, size_t rawlen)
+{
+    if (fmt == NULL) {
+        fmt = "";
+    }
+
+    switch (type) {
+    case CTLTYPE_STRING: {
+        const char *s = (const char *)raw;
+        if (rawlen > 0 && s[rawlen - 1] == '\0') {
+            rawlen--;                              /* drop the trailing NUL */
+        }
+        sbuf_bcat(sb, s, strnlen(s, rawlen));      /* as "%.*s": stop at a NUL */
+        sbuf_putc(sb, '\n');
+        break;
+    }
+    case CTLTYPE_INT: {
+        if (rawlen >= sizeof(int32_t)) {
+            int32_t v;
+            memcpy(&v, raw, sizeof(v));
+            if (fmt[0] == 'I' && fmt[1] == 'U') {
+                sbuf_putu64(sb, (uint32_t)v);
+            } else {
+                sbuf_puti64(sb, v);
+            }
+            sbuf_putc(sb, '\n');
+        }
+        break;
+    }
+    case CTLTYPE_QUAD: {
+        if (rawlen >= sizeof(int64_t)) {
+            int64_t v;
+            memcpy(&v, raw, sizeof(v));
+            if (fmt[0] == 'Q' && fmt[1] == 'U') {
+                sbuf_putu64(sb, (uint64_t)v);
+            } else {
+                sbuf_puti64(sb, v);
+            }
+            sbuf_putc(sb, '\n');
+        }
+        break;
+    }
+    default:
+        break;                                      /* opaque/struct: no text */
+    }
+}
+
+#pragma mark -
+#pragma mark Activity counters
+
+void
+procfs_render_stats(struct sbuf *sb, const char *const *names,
+                    const struct procfs_node_stats *st, int n)
+{
+    sbuf_cat(sb, "type lookups opens reads bytes daemon fallbacks render_ns <1us");
+    for (int i = 1; i < PROCFS_STATS_HIST - 1; i++) {
+        sbuf_cat(sb, " <");
+        sbuf_putu64(sb, 1ULL << i);
+        sbuf_cat(sb, "us");
+    }
+    sbuf_cat(sb, " >=");
+    sbuf_putu64(sb, 1ULL << (PROCFS_STATS_HIST - 2));
+    sbuf_cat(sb, "us\n");
+
+    for (int t = 0; t < n; t++) {
+        const struct procfs_node_stats *s = &st[t];
+        if (names[t] == NULL) {
+            continue;
+        }
+        sbuf_cat(sb, names[t]);
+        const uint64_t v[] = {
+            s->lookups, s->opens, s->reads, s->bytes,
+            s->daemon, s->fallbacks, s->render_ns,
+        };
+        for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+            sbuf_putc(sb, ' ');
+            sbuf_putu64(sb, v[i]);
+        }
+        for (int i = 0; i < PROCFS_STATS_HIST; i++) {
+            sbuf_putc(sb, ' ');
+            sbuf_putu64(sb, s->render_hist[i]);
+        }
+        sbuf_putc(sb, '\n');
+    }
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_ring.c
+ *
+ * Shared-memory SPSC record ring (see procfs_ring.h). No locks, no kernel
+ * KPI: the kext, procfsd and test/host build this same file. The indices
+ * only ever grow, so head - tail is the bytes in use even across a wrap of
+ * the data area. Anything read from the shared page is copied to a local
+ * before it is checked and used.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/errno.h>
+
+#include <fs/procfs/procfs_ring.h>
+
+/* A record header. A pad record fills the end of the data area before a wrap. */
+struct procfs_ring_rec {
+    uint32_t len;
+    uint32_t kind;
+};
+
+#define PROCFS_RING_DATA    0u
+#define PROCFS_RING_PAD     1u
+
+static void
+procfs_ring_break(struct procfs_ring *r)
+{
+    r->broken = 1;
+}
+
+int
+procfs_ring_init(struct procfs_ring *r, struct procfs_ring_shared *sh, void *data,
+    uint32_t size, int reset)
+{
+    if (size < PROCFS_RING_MINSIZE || (size & (size - 1)) != 0) {
+        return EINVAL;
+    }
+    memset(r, 0, sizeof(*r));
+    r->sh   = sh;
+    r->data = data;
+    r->size = size;
+    if (reset) {
+        memset(sh, 0, sizeof(*sh));
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } else {
+        /* Joining a ring in use: each side only ever reads its own index back. */
+        r->head = __atomic_load_n(&sh->head, __ATOMIC_ACQUIRE);
+        r->tail = __atomic_load_n(&sh->tail, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+void *
+procfs_ring_reserve(struct procfs_ring *r, uint32_t len, int *error)
+{
+    if (r->broken) {
+        *error = EIO;
+        return NULL;
+    }
+    if (len > PROCFS_RING_MAXREC(r->size)) {
+        *error = EMSGSIZE;
+        return NULL;
+    }
+
+    uint64_t tail = __atomic_load_n(&r->sh->tail, __ATOMIC_ACQUIRE);
+    if (tail > r->head || r->head - tail > r->size) {
+        procfs_ring_break(r);
+        *error = EIO;
+        return NULL;
+    }
+
+    uint32_t need   = PROCFS_RING_RECSIZE(len);
+    uint32_t pos    = (uint32_t)(r->head & (r->size - 1));
+    uint32_t contig = r->size - pos;
+    uint32_t pad    = need > contig ? contig : 0;
+    if (r->size - (r->head - tail) < (uint64_t)pad + need) {
+        *error = ENOBUFS;
+        return NULL;
+    }
+    if (pad != 0) {
+        struct procfs_ring_rec rec = { .len = pad - PROCFS_RING_RECHDR, .kind = PROCFS_RING_PAD };
+        memcpy(r->data + pos, &rec, sizeof(rec));
+        pos = 0;
+    }
+    r->resv     = r->head + pad;
+    r->resv_len = len;
+    r->reserved = 1;
+    return r->data + pos + PROCFS_RING_RECHDR;
+}
+
+void
+procfs_ring_commit(struct procfs_ring *r, uint32_t len)
+{
+    if (!r->reserved) {
+        return;
+    }
+    if (len > r->resv_len) {
+        len = r->resv_len;
+    }
+    struct procfs_ring_rec rec = { .len = len, .kind = PROCFS_RING_DATA };
+    memcpy(r->data + (r->resv & (r->size - 1)), &rec, sizeof(rec));
+
+    r->head     = r->resv + PROCFS_RING_RECSIZE(len);
+    r->reserved = 0;
+    __atomic_store_n(&r->sh->head, r->head, __ATOMIC_RELEASE);
+}
+
+int
+procfs_ring_put(struct procfs_ring *r, const void *rec, uint32_t len)
+{
+    int error;
+    void *p = procfs_ring_reserve(r, len, &error);
+    if (p == NULL) {
+        return error;
+    }
+    memcpy(p, rec, len);
+    procfs_ring_commit(r, len);
+    return 0;
+}
+
+const void *
+procfs_ring_peek(struct procfs_ring *r, uint32_t *len)
+{
+    if (r->broken) {
+        return NULL;
+    }
+    uint64_t head = __atomic_load_n(&r->sh->head, __ATOMIC_ACQUIRE);
+    if (head < r->tail || head - r->tail > r->size) {
+        procfs_ring_break(r);
+        return NULL;
+    }
+
+    while (head != r->tail) {
+        uint32_t pos    = (uint32_t)(r->tail & (r->size - 1));
+        uint32_t contig = r->size - pos;
+        struct procfs_ring_rec rec;
+        memcpy(&rec, r->data + pos, sizeof(rec));
+
+        if (rec.kind == PROCFS_RING_PAD) {
+            /* Skip to the start of the data area, and give the space back. */
+            if (head - r->tail < contig) {
+                break;
+            }
+            r->tail += contig;
+            __atomic_store_n(&r->sh->tail, r->tail, __ATOMIC_RELEASE);
+            continue;
+        }
+        uint32_t need = PROCFS_RING_RECSIZE(rec.len);
+        if (rec.kind != PROCFS_RING_DATA || rec.len > PROCFS_RING_MAXREC(r->size) ||
+            need > contig || need > head - r->tail) {
+            break;
+        }
+        r->peek_size = need;
+        *len = rec.len;
+        return r->data + pos + PROCFS_RING_RECHDR;
+    }
+    if (head != r->tail) {
+        procfs_ring_break(r);
+    }
+    return NULL;
+}
+
+void
+procfs_ring_consume(struct procfs_ring *r)
+{
+    if (r->peek_size == 0) {
+        return;
+    }
+    r->tail += r->peek_size;
+    r->peek_size = 0;
+    __atomic_store_n(&r->sh->tail, r->tail, __ATOMIC_RELEASE);
+}
+
+int
+procfs_ring_sleep_ok(struct procfs_ring *r)
+{
+    __atomic_store_n(&r->sh->sleeping, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!r->broken && __atomic_load_n(&r->sh->head, __ATOMIC_ACQUIRE) != r->tail) {
+        __atomic_store_n(&r->sh->sleeping, 0, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return 1;
+}
+
+int
+procfs_ring_wake_needed(struct procfs_ring *r)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->sh->sleeping, __ATOMIC_RELAXED) == 0) {
+        return 0;
+    }
+    return __atomic_exchange_n(&r->sh->sleeping, 0, __ATOMIC_SEQ_CST) != 0;
+}
+
+int
+procfs_ring_broken(const struct procfs_ring *r)
+{
+    return r->broken;
+}
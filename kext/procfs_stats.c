@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_stats.c
+ *
+ * Per-node-type activity counters: lookups, opens, reads, bytes returned,
+ * render time, procfsd round-trips and the reads the daemon could not serve.
+ * The vnode operations and the daemon call sites bump them with one atomic
+ * add each, so the hot path takes no lock. They are read through the root
+ * procfs_stats node and the procfs.stats sysctls, and zeroed by writing a
+ * non-zero value to procfs.stats.reset.
+ *
+ *   cat /proc/procfs_stats
+ *   sysctl procfs.stats
+ *   sysctl -w procfs.stats.reset=1
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kern/clock.h>
+#include <libkern/OSAtomic.h>
+#include <sys/errno.h>
+#include <sys/sbuf.h>
+#include <sys/sysctl.h>
+#include <sys/uio.h>
+
+#include <bsdcompat/sys/sbuf.h>
+
+#include <fs/procfs/procfs.h>
+
+/* The counters, indexed by pfstype. */
+static struct procfs_node_stats procfs_stats[PROCFS_STATS_NTYPES];
+
+/* Row names in the procfs_stats table. "." and ".." never get a vnode. */
+static const char *const procfs_stats_names[PROCFS_STATS_NTYPES] = {
+    [PFSroot]        = "root",
+    [PFSproc]        = "proc",
+    [PFSthread]      = "thread",
+    [PFSdir]         = "dir",
+    [PFSfile]        = "file",
+    [PFScurproc]     = "curproc",
+    [PFSprocnamedir] = "procnamedir",
+    [PFSfd]          = "fd",
+    [PFScpuinfo]     = "cpuinfo",
+    [PFSloadavg]     = "loadavg",
+    [PFSpartitions]  = "partitions",
+    [PFSversion]     = "version",
+    [PFSmeminfo]     = "meminfo",
+    [PFSmtab]        = "mtab",
+    [PFSstat]        = "stat",
+    [PFSvmstat]      = "vmstat",
+    [PFSuptime]      = "uptime",
+    [PFSswaps]       = "swaps",
+    [PFSfilesystems] = "filesystems",
+    [PFSproclink]    = "proclink",
+    [PFSsysctl]      = "sysctl",
+    [PFSstats]       = "stats",
+};
+
+#define PROCFS_STATS_INC(field)     OSIncrementAtomic64((volatile SInt64 *)&(field))
+#define PROCFS_STATS_ADD(field, n)  OSAddAtomic64((SInt64)(n), (volatile SInt64 *)&(field))
+
+static inline struct procfs_node_stats *
+procfs_stats_of(pfstype type)
+{
+    return (unsigned)type < PROCFS_STATS_NTYPES ? &procfs_stats[type] : NULL;
+}
+
+#pragma mark -
+#pragma mark Counting
+
+void
+procfs_stats_lookup(pfstype type)
+{
+    struct procfs_node_stats *st = procfs_stats_of(type);
+    if (st != NULL) {
+        PROCFS_STATS_INC(st->lookups);
+    }
+}
+
+void
+procfs_stats_open(pfstype type)
+{
+    struct procfs_node_stats *st = procfs_stats_of(type);
+    if (st != NULL) {
+        PROCFS_STATS_INC(st->opens);
+    }
+}
+
+void
+procfs_stats_read(pfstype type, uint64_t start, int64_t bytes)
+{
+    struct procfs_node_stats *st = procfs_stats_of(type);
+    if (st == NULL) {
+        return;
+    }
+
+    uint64_t ns;
+    absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+    PROCFS_STATS_INC(st->reads);
+    if (bytes > 0) {
+        PROCFS_STATS_ADD(st->bytes, bytes);
+    }
+    PROCFS_STATS_ADD(st->render_ns, ns);
+    PROCFS_STATS_INC(st->render_hist[procfs_stats_bucket(ns)]);
+}
+
+void
+procfs_stats_ctl(pfsnode_t *pnp, int rc)
+{
+    struct procfs_node_stats *st = procfs_stats_of(pnp->node_structure_node->psn_node_type);
+    if (st == NULL) {
+        return;
+    }
+
+    // ENOTCONN: there was no daemon to ask, so no round-trip was made.
+    if (rc != ENOTCONN) {
+        PROCFS_STATS_INC(st->daemon);
+    }
+    if (rc != 0) {
+        PROCFS_STATS_INC(st->fallbacks);
+    }
+}
+
+/*
+ * Zeroes every counter. Increments racing with the reset may survive it;
+ * each counter is a single aligned word, so none is ever torn.
+ */
+void
+procfs_stats_reset(void)
+{
+    volatile uint64_t *p = (volatile uint64_t *)procfs_stats;
+    for (size_t i = 0; i < sizeof(procfs_stats) / sizeof(*p); i++) {
+        p[i] = 0;
+    }
+}
+
+/*
+ * The counters are read without stopping the writers, so a row is not a
+ * consistent snapshot: reads still in progress may show in one column and
+ * not yet in another.
+ */
+static int
+procfs_stats_render(struct sbuf *sb)
+{
+    if (sbuf_new(sb, NULL, 2048, SBUF_AUTOEXTEND) == NULL) {
+        return ENOMEM;
+    }
+    procfs_render_stats(sb, procfs_stats_names, procfs_stats, PROCFS_STATS_NTYPES);
+    sbuf_finish(sb);
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Root Node
+
+/* /proc/procfs_stats - the counter table. */
+int
+procfs_dostats(__unused pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
+{
+    struct sbuf sb;
+    int error = procfs_stats_render(&sb);
+    if (error == 0) {
+        error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+        sbuf_delete(&sb);
+    }
+    return error;
+}
+
+#pragma mark -
+#pragma mark procfs.stats sysctls
+
+/* procfs.stats.<counter>: one counter summed over all node types. */
+static int
+procfs_stats_sysctl_total(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    uint64_t total = 0;
+    for (int t = 0; t < PROCFS_STATS_NTYPES; t++) {
+        total += *(const uint64_t *)((const char *)&procfs_stats[t] + arg2);
+    }
+    return sysctl_handle_quad(oidp, &total, 0, req);
+}
+
+/* procfs.stats.events_*: the lifecycle-event counters (procfs_events.c). */
+static int
+procfs_stats_sysctl_events(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    struct procfs_event_counts c;
+    procfs_events_counts(&c);
+    uint64_t value = *(const uint64_t *)((const char *)&c + arg2);
+    return sysctl_handle_quad(oidp, &value, 0, req);
+}
+
+/* procfs.stats.prefetch_*: the readdir prefetch counters (procfs_prefetch.c). */
+static int
+procfs_stats_sysctl_prefetch(struct sysctl_oid *oidp, __unused void *arg1, int arg2,
+    struct sysctl_req *req)
+{
+    struct procfs_prefetch_counts c;
+    procfs_prefetch_counts(&c);
+    uint64_t value = *(const uint64_t *)((const char *)&c + arg2);
+    return sysctl_handle_quad(oidp, &value, 0, req);
+}
+
+/* procfs.stats.prefetch_hit_pct: hits per hundred taskinfo reads with prefetch on. */
+static int
+procfs_stats_sysctl_prefetch_pct(struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+    struct procfs_prefetch_counts c;
+    procfs_prefetch_counts(&c);
+    uint64_t reads = c.hits + c.misses;
+    int pct = reads > 0 ? (int)(c.hits * 100 / reads) : 0;
+    return sysctl_handle_int(oidp, &pct, 0, req);
+}
+
+/* procfs.stats.table: the text of /proc/procfs_stats. */
+static int
+procfs_stats_sysctl_table(__unused struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+    struct sbuf sb;
+    int error = procfs_stats_render(&sb);
+    if (error == 0) {
+        error = SYSCTL_OUT(req, sbuf_data(&sb), sbuf_len(&sb) + 1);
+        sbuf_delete(&sb);
+    }
+    return error;
+}
+
+/* procfs.stats.raw: the counter array, struct procfs_node_stats[PROCFS_STATS_NTYPES]. */
+static int
+procfs_stats_sysctl_raw(__unused struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+    return SYSCTL_OUT(req, procfs_stats, sizeof(procfs_stats));
+}
+
+/* procfs.stats.reset: reads as 0; writing a non-zero value zeroes the counters. */
+static int
+procfs_stats_sysctl_reset(struct sysctl_oid *oidp, __unused void *arg1,
+    __unused int arg2, struct sysctl_req *req)
+{
+    int value = 0;
+    int error = sysctl_handle_int(oidp, &value, 0, req);
+    if (error == 0 && req->newptr != USER_ADDR_NULL && value != 0) {
+        procfs_stats_reset();
+    }
+    return error;
+}
+
+/*
+ * Built by hand and registered through sysctl_register_oid() for the same
+ * reason as the procfs node itself (see procfs_linux.c). The node's parent
+ * is filled in at registration.
+ */
+static struct sysctl_oid_list procfs_stats_children;
+
+static struct sysctl_oid procfs_stats_node = {
+    .oid_parent  = NULL,
+    .oid_number  = OID_AUTO,
+    .oid_kind    = CTLTYPE_NODE | CTLFLAG_RW | CTLFLAG_LOCKED | CTLFLAG_OID2,
+    .oid_arg1    = &procfs_stats_children,
+    .oid_arg2    = 0,
+    .oid_name    = "stats",
+    .oid_handler = NULL,
+    .oid_fmt     = "N",
+    .oid_descr   = "procfs per-node-type activity counters",
+    .oid_version = SYSCTL_OID_VERSION,
+};
+
+#define PROCFS_STATS_OID(var, kind, arg2_, name, handler, fmt, descr) \
+    static struct sysctl_oid var = {                                  \
+        .oid_parent  = &procfs_stats_children,                        \
+        .oid_number  = OID_AUTO,                                      \
+        .oid_kind    = (kind) | CTLFLAG_LOCKED | CTLFLAG_OID2,        \
+        .oid_arg1    = NULL,                                          \
+        .oid_arg2    = (arg2_),                                       \
+        .oid_name    = (name),                                        \
+        .oid_handler = (handler),                                     \
+        .oid_fmt     = (fmt),                                         \
+        .oid_descr   = (descr),                                       \
+        .oid_version = SYSCTL_OID_VERSION,                            \
+    }
+
+#define PROCFS_STATS_TOTAL(field, descr)                              \
+    PROCFS_STATS_OID(procfs_stats_##field##_oid,                      \
+        CTLTYPE_QUAD | CTLFLAG_RD,                                    \
+        offsetof(struct procfs_node_stats, field), #field,            \
+        procfs_stats_sysctl_total, "QU", descr)
+
+PROCFS_STATS_TOTAL(lookups, "lookups resolved to a procfs node");
+PROCFS_STATS_TOTAL(opens, "opens of procfs nodes");
+PROCFS_STATS_TOTAL(reads, "reads of procfs nodes");
+PROCFS_STATS_TOTAL(bytes, "bytes returned by reads");
+PROCFS_STATS_TOTAL(daemon, "procfsd round-trips");
+PROCFS_STATS_TOTAL(fallbacks, "procfsd requests that did not produce the data");
+PROCFS_STATS_TOTAL(render_ns, "nanoseconds spent producing read data");
+
+#define PROCFS_STATS_EVENTS(field, descr)                             \
+    PROCFS_STATS_OID(procfs_stats_events_##field##_oid,               \
+        CTLTYPE_QUAD | CTLFLAG_RD,                                    \
+        offsetof(struct procfs_event_counts, field), "events_" #field, \
+        procfs_stats_sysctl_events, "QU", descr)
+
+PROCFS_STATS_EVENTS(batches, "lifecycle event batches from procfsd");
+PROCFS_STATS_EVENTS(events, "lifecycle events from procfsd");
+PROCFS_STATS_EVENTS(dropped, "lifecycle events procfsd reported lost");
+
+#define PROCFS_STATS_PREFETCH(field, descr)                           \
+    PROCFS_STATS_OID(procfs_stats_prefetch_##field##_oid,             \
+        CTLTYPE_QUAD | CTLFLAG_RD,                                    \
+        offsetof(struct procfs_prefetch_counts, field), "prefetch_" #field, \
+        procfs_stats_sysctl_prefetch, "QU", descr)
+
+PROCFS_STATS_PREFETCH(batches, "readdir prefetch batches fetched");
+PROCFS_STATS_PREFETCH(records, "processes fetched by readdir prefetch");
+PROCFS_STATS_PREFETCH(hits, "taskinfo reads answered from a prefetch batch");
+PROCFS_STATS_PREFETCH(misses, "taskinfo reads, with prefetch on, that went to procfsd");
+PROCFS_STATS_PREFETCH(dropped, "prefetch batches not made: queue full or every batch busy");
+PROCFS_STATS_PREFETCH(errors, "readdir prefetch requests that failed");
+PROCFS_STATS_PREFETCH(io_hits, "io reads answered from a prefetch batch");
+PROCFS_STATS_PREFETCH(io_misses, "io reads, with prefetch on, that went to procfsd");
+PROCFS_STATS_OID(procfs_stats_prefetch_hit_pct_oid, CTLTYPE_INT | CTLFLAG_RD, 0,
+    "prefetch_hit_pct", procfs_stats_sysctl_prefetch_pct, "I",
+    "percentage of taskinfo reads answered from a prefetch batch");
+
+PROCFS_STATS_OID(procfs_stats_table_oid, CTLTYPE_STRING | CTLFLAG_RD, 0, "table",
+    procfs_stats_sysctl_table, "A", "per-node-type counter table");
+PROCFS_STATS_OID(procfs_stats_raw_oid, CTLTYPE_OPAQUE | CTLFLAG_RD, 0, "raw",
+    procfs_stats_sysctl_raw, "S,procfs_node_stats", "per-node-type counters, indexed by pfstype");
+PROCFS_STATS_OID(procfs_stats_reset_oid, CTLTYPE_INT | CTLFLAG_RW, 0, "reset",
+    procfs_stats_sysctl_reset, "I", "write non-zero to zero the counters");
+
+static struct sysctl_oid *const procfs_stats_oids[] = {
+    &procfs_stats_lookups_oid,
+    &procfs_stats_opens_oid,
+    &procfs_stats_reads_oid,
+    &procfs_stats_bytes_oid,
+    &procfs_stats_daemon_oid,
+    &procfs_stats_fallbacks_oid,
+    &procfs_stats_render_ns_oid,
+    &procfs_stats_events_batches_oid,
+    &procfs_stats_events_events_oid,
+    &procfs_stats_events_dropped_oid,
+    &procfs_stats_prefetch_batches_oid,
+    &procfs_stats_prefetch_records_oid,
+    &procfs_stats_prefetch_hits_oid,
+    &procfs_stats_prefetch_misses_oid,
+    &procfs_stats_prefetch_dropped_oid,
+    &procfs_stats_prefetch_errors_oid,
+    &procfs_stats_prefetch_io_hits_oid,
+    &procfs_stats_prefetch_io_misses_oid,
+    &procfs_stats_prefetch_hit_pct_oid,
+    &procfs_stats_table_oid,
+    &procfs_stats_raw_oid,
+    &procfs_stats_reset_oid,
+};
+
+#define PROCFS_STATS_NOIDS  (int)(sizeof(procfs_stats_oids) / sizeof(procfs_stats_oids[0]))
+
+/* Registers procfs.stats below `parent`, which must already be registered. */
+void
+procfs_stats_sysctl_register(struct sysctl_oid_list *parent)
+{
+    procfs_stats_node.oid_parent = parent;
+    sysctl_register_oid(&procfs_stats_node);
+    for (int i = 0; i < PROCFS_STATS_NOIDS; i++) {
+        sysctl_register_oid(procfs_stats_oids[i]);
+    }
+}
+
+void
+procfs_stats_sysctl_unregister(void)
+{
+    for (int i = PROCFS_STATS_NOIDS - 1; i >= 0; i--) {
+        sysctl_unregister_oid(procfs_stats_oids[i]);
+    }
+    sysctl_unregister_oid(&procfs_stats_node);
+}
@@ -202,9 +202,17 @@ procfs_read_task_info(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
         // (all 18 fields) via libproc's proc_pidinfo(). Only when no daemon is
         // connected (or it doesn't answer in time) do we fall back to what the
         // kext can compute itself.
+        // A /proc readdir may just have prefetched it (procfs_prefetch.c).
         uint32_t got = 0;
-        if (procfs_ctl_request(PROCFS_REQ_TASKINFO, pnp->node_id.nodeid_pid, 0,
-                &info, sizeof(info), &got) == 0 && got == sizeof(info)) {
+        int rc = 0;
+        if (procfs_prefetch_taskinfo(pnp->node_id.nodeid_pid, &info)) {
+            got = sizeof(info);
+        } else {
+            rc = procfs_ctl_request(PROCFS_REQ_TASKINFO, pnp->node_id.nodeid_pid, 0,
+                    &info, sizeof(info), &got);
+            procfs_stats_ctl(pnp, rc);
+        }
+        if (rc == 0 && got == sizeof(info)) {
             error = procfs_copy_data((const char *)&info, sizeof(info), uio);
             proc_rele(p);
             return error;
@@ -277,12 +285,10 @@ procfs_read_thread_info(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
         struct proc_threadinfo info;
         uint64_t threadid = pnp->node_id.nodeid_objectid;
 
-        // Preferred: the daemon returns the exact per-thread info via
-        // proc_pidinfo(PROC_PIDTHREADID64INFO), keyed on thread_id == our tid.
+        // Preferred: the daemon's exact per-thread info, from the process's
+        // thread snapshot (procfs_threads.c), keyed on thread_id == our tid.
         // Fall back to the local (zeroed on arm64) proc_pidthreadinfo otherwise.
-        uint32_t got = 0;
-        if (procfs_ctl_request(PROCFS_REQ_THREADINFO, pnp->node_id.nodeid_pid,
-                threadid, &info, sizeof(info), &got) == 0 && got == sizeof(info)) {
+        if (procfs_threads_get(pnp, &info) == 0) {
             error = procfs_copy_data((const char *)&info, sizeof(info), uio);
         } else if (proc_pidthreadinfo(p, threadid, TRUE, &info) == 0) {
             error = procfs_copy_data((const char *)&info, sizeof(info), uio);
@@ -294,91 +300,3 @@ procfs_read_thread_info(pfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
 
     return error;
 }
-
-/*
- * Gets the value of the st_size field of a node's attributes. POSIX
- * allows us to use this value as we choose. This function calculates 
- * the appropriate size for a node by calling that node's psn_getsize()
- * function. For directories, the size reported by all non-directory
- * child nodes is aggregated to get the result.
- */
-size_t
-procfs_get_node_size_attr(pfsnode_t *pnp, kauth_cred_t creds)
-{
-    pfssnode_t *snode = pnp->node_structure_node;
-    pfstype node_type = snode->psn_node_type;
-
-    // In the special cases of "." and "..", we need to first move up
-    // to the parent and grandparent structure node to get the correct result.
-    if (node_type == PFSdirthis) {
-        snode = snode->psn_parent;
-    } else if (node_type == PFSdirparent) {
-        snode = snode->psn_parent;
-        if (snode != NULL && snode->psn_node_type != PFSroot) {
-            snode = snode->psn_parent;
-        }
-    }
-
-    assert(snode != NULL);
-
-    // For file types, get the size from the node itself. For
-    // directory types, get the size by traversing child structure
-    // nodes and adding in any implied children, such as process and
-    // thread entries.
-    size_t size = 0;
-    if (procfs_is_directory_type(node_type)) {
-        // Directory
-        pfssnode_t *next_snode;
-        TAILQ_FOREACH(next_snode, &snode->psn_children, psn_next) {
-            procfs_node_size_fn node_size_fn = next_snode->psn_getsize_fn;
-            size += node_size_fn == NULL ? 1 : node_size_fn(pnp, creds);
-        }
-    } else {
-        // File or symlink
-        procfs_node_size_fn node_size_fn = snode->psn_getsize_fn;
-        size = node_size_fn == NULL ? snode->psn_node_size : node_size_fn(pnp, creds);
-    }
-    
-    return size;
-}
-
-/*
- * Gets the size for a node that represents a process.
- */
-size_t
-procfs_process_node_size(pfsnode_t *pnp, kauth_cred_t creds)
-{
-    // Nodes of this type contribute a size of 1 for each visible process.
-    size_t size = 0;
-    int pid = pnp->node_id.nodeid_pid;
-    proc_t p = proc_find(pid);
-    if (p != PROC_NULL) {
-        if (size == 0) {
-            size += sizeof(procfs_get_process_count(creds));
-        }
-        proc_rele(p);
-    }
-
-    return size;
-}
-
-/*
- * Gets the size for a node that represents a thread.
- */
-size_t
-procfs_thread_node_size(pfsnode_t *pnp, __unused kauth_cred_t creds)
-{
-    // Nodes of this type contribute a size of 1 for each thread
-    // in the owning process. Because of the way the file system is
-    // structured, the pid of the owning process is available in the
-    // node_id of the procfs node.
-    size_t size = 0;
-    int pid = pnp->node_id.nodeid_pid;
-    proc_t p = proc_find(pid);
-    if (p != PROC_NULL) {
-        int tcount = procfs_get_task_thread_count(p);
-        size += (tcount > 0) ? tcount : 1;
-        proc_rele(p);
-    }
-    return size;
-}
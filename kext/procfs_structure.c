@@ -40,6 +40,7 @@ STATIC pfssnode_t *add_file(pfssnode_t *parent, const char *name, pfsbaseid_t no
                         procfs_node_size_fn node_size_fn, procfs_read_data_fn node_read_data_fn);
 
 STATIC void release_node(pfssnode_t *node);
+STATIC boolean_t is_dynamic_node_type(pfstype type);
 
 // Next node id. No need to lock this value because access
 // is guaranteed to be single-threaded. Start at 2 because the
@@ -133,6 +134,10 @@ procfs_structure_init(void)
         pfssnode_t *filesystems = add_node(root_node, "filesystems",
                         PFSfilesystems, next_node_id++, 0, 0, NULL, procfs_dofilesystems);
 
+        // Per-node-type activity counters (see procfs_stats.c).
+        pfssnode_t *stats = add_node(root_node, "procfs_stats",
+                        PFSstats, next_node_id++, 0, 0, NULL, procfs_dostats);
+
         // Linux-compatible /proc/sys - a dynamic mirror of the sysctl tree. This
         // single PFSsysctl node backs /proc/sys and every descendant; the
         // specific sysctl oid is carried per-vnode in the node id's objectid
@@ -148,12 +153,12 @@ procfs_structure_init(void)
         // A pseudo-entry below "byname" that is replaced by nodes for all of the visible processes.
         // NOTE: this must be the last child entry for the "byname" node.
         pfssnode_t *proc_name_dir = add_directory(proc_by_name_dir, "__Process_N__",
-                        PFSprocnamedir, next_node_id++, PSN_FLAG_PROCESS, 0, procfs_process_node_size, NULL);
+                        PFSprocnamedir, next_node_id++, PSN_FLAG_PROCESS, 0, NULL, NULL);
 
         // A pseudo-entry below "/" that is replaced by nodes for all of the visible processes.
         // NOTE: this must be the last child entry for the root node.
         pfssnode_t *one_proc_dir = add_directory(root_node, "__Process__",
-                       PFSproc, next_node_id++, PSN_FLAG_PROCESS, 0, procfs_process_node_size, NULL);
+                       PFSproc, next_node_id++, PSN_FLAG_PROCESS, 0, NULL, NULL);
 
         // A directory below the node for a process to hold all the file descriptors for that process.
         pfssnode_t *fd_dir = add_directory(one_proc_dir, "fd",
@@ -163,7 +168,7 @@ procfs_structure_init(void)
         // the current process.
         // NOTE: this must be the last child entry for the "fd" node.
         pfssnode_t *one_fd_dir = add_directory(fd_dir, "__File__",
-                      PFSfd, next_node_id++, PSN_FLAG_PROCESS, 0, procfs_fd_node_size, NULL);
+                      PFSfd, next_node_id++, PSN_FLAG_PROCESS, 0, NULL, NULL);
 
         // A directory below the node for a process to hold all the threads for that process.
         pfssnode_t *threads_dir = add_directory(one_proc_dir, "threads",
@@ -173,7 +178,7 @@ procfs_structure_init(void)
         // the current process.
         // NOTE: this must be the last child entry for the threads node.
         pfssnode_t *one_thread_dir = add_directory(threads_dir, "__Thread__",
-                      PFSthread, next_node_id++, PSN_FLAG_PROCESS | PSN_FLAG_THREAD, 0, procfs_thread_node_size, NULL);
+                      PFSthread, next_node_id++, PSN_FLAG_PROCESS | PSN_FLAG_THREAD, 0, NULL, NULL);
 
         // The Linux name for the same per-thread view: /proc/<pid>/task/<tid>.
         // It mirrors "threads" (a separate structure node, so thread fileids do
@@ -185,7 +190,7 @@ procfs_structure_init(void)
         // threads of the current process.
         // NOTE: this must be the last child entry for the task node.
         pfssnode_t *one_task_dir = add_directory(task_dir, "__Thread__",
-                      PFSthread, next_node_id++, PSN_FLAG_PROCESS | PSN_FLAG_THREAD, 0, procfs_thread_node_size, NULL);
+                      PFSthread, next_node_id++, PSN_FLAG_PROCESS | PSN_FLAG_THREAD, 0, NULL, NULL);
 
         // --- Per-proccess sub-directories and files.
 
@@ -216,6 +221,7 @@ procfs_structure_init(void)
         add_file(one_proc_dir, "comm", next_node_id++, PSN_FLAG_PROCESS, 0, NULL, procfs_docomm);
         add_file(one_proc_dir, "stat", next_node_id++, PSN_FLAG_PROCESS, 0, NULL, procfs_doprocstat);
         add_file(one_proc_dir, "statm", next_node_id++, PSN_FLAG_PROCESS, 0, NULL, procfs_dostatm);
+        add_file(one_proc_dir, "io", next_node_id++, PSN_FLAG_PROCESS, 0, NULL, procfs_doio);
         add_file(one_proc_dir, "environ", next_node_id++, PSN_FLAG_PROCESS, 0, NULL, procfs_doenviron);
 
         // Native Mach register dumps for the process's representative thread.
@@ -258,6 +264,47 @@ procfs_structure_free()
     }
 }
 
+/*
+ * Gets the value of the st_size field of a node's attributes. POSIX
+ * allows us to use this value as we choose. For files, the size is
+ * reported by the node's psn_getsize_fn function, or is the fixed
+ * psn_node_size value. For directories, it is the number of static
+ * entries, which is computed when the structure is built. Entries that
+ * expand to the running processes, threads or open files are not
+ * counted, so that stat(2) on a directory never has to enumerate them.
+ */
+size_t
+procfs_get_node_size_attr(pfsnode_t *pnp, kauth_cred_t creds)
+{
+    pfssnode_t *snode = pnp->node_structure_node;
+    pfstype node_type = snode->psn_node_type;
+
+    // In the special cases of "." and "..", we need to first move up
+    // to the parent and grandparent structure node to get the correct result.
+    if (node_type == PFSdirthis) {
+        snode = snode->psn_parent;
+    } else if (node_type == PFSdirparent) {
+        snode = snode->psn_parent;
+        if (snode != NULL && snode->psn_node_type != PFSroot) {
+            snode = snode->psn_parent;
+        }
+    }
+
+    assert(snode != NULL);
+
+    size_t size = 0;
+    if (procfs_is_directory_type(node_type)) {
+        // Directory
+        size = snode->psn_dir_entries;
+    } else {
+        // File or symlink
+        procfs_node_size_fn node_size_fn = snode->psn_getsize_fn;
+        size = node_size_fn == NULL ? snode->psn_node_size : node_size_fn(pnp, creds);
+    }
+
+    return size;
+}
+
 #pragma mark -
 #pragma mark Creation of Structure Nodes
 
@@ -292,10 +339,27 @@ add_node(pfssnode_t *parent, const char *name, pfstype type, pfsbaseid_t node_id
 
         // Propagate the PSN_FLAG_PROCESS and PSN_FLAG_THREAD flags downward.
         node->psn_flags |= (parent->psn_flags & (PSN_FLAG_PROCESS | PSN_FLAG_THREAD));
+
+        // Count the entry towards the parent's size, unless it expands to
+        // dynamic content.
+        if (!is_dynamic_node_type(type)) {
+            parent->psn_dir_entries++;
+        }
     }
     return node;
 }
 
+/*
+ * Returns whether a structure node is a placeholder that readdir replaces
+ * with a variable set of entries (processes, threads or file descriptors).
+ */
+STATIC boolean_t
+is_dynamic_node_type(pfstype type)
+{
+    return type == PFSproc || type == PFSprocnamedir
+        || type == PFSthread || type == PFSfd;
+}
+
 /*
  * Adds a directory node to the file system structure. Since all directories
  * must have "." and ".." entries, these are added here by a recursive call
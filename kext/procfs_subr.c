@@ -58,6 +58,7 @@ procfs_allocvp(pfstype pfs_type)
     case PFSuptime:         /* FALLTHROUGH */
     case PFSswaps:          /* FALLTHROUGH */
     case PFSfilesystems:    /* FALLTHROUGH */
+    case PFSstats:          /* FALLTHROUGH */
         return VREG;
 
     case PFSprocnamedir:    /* FALLTHROUGH */
@@ -96,6 +97,20 @@ procfs_get_process_info(vnode_t vp, pid_t *pidp, proc_t *procp)
     return 0;
 }
 
+/*
+ * Returns a value that identifies a particular incarnation of a process,
+ * so that a node looked up for one process can be told apart from a node
+ * for a later process that reuses the same pid. The process start time is
+ * used, which is fixed at fork. Never returns 0, which callers use to mean
+ * "no process".
+ */
+uint64_t
+procfs_proc_stamp(proc_t p)
+{
+    uint64_t stamp = ((uint64_t)p->p_start.tv_sec << 20) | (uint64_t)p->p_start.tv_usec;
+    return stamp != 0 ? stamp : 1;
+}
+
 /*
  * Returns whether a node of a given type must have an
  * associated process id.
@@ -109,7 +124,7 @@ procfs_node_type_has_pid(pfstype node_type)
         && node_type != PFSmtab && node_type != PFSstat
         && node_type != PFSvmstat && node_type != PFSuptime
         && node_type != PFSswaps && node_type != PFSfilesystems
-        && node_type != PFSsysctl;
+        && node_type != PFSsysctl && node_type != PFSstats;
 }
 
 /*
@@ -18,6 +18,7 @@
 #include <string.h>
 
 #include <sys/errno.h>
+#include <sys/sbuf.h>
 #include <sys/sysctl.h>
 #include <sys/uio.h>
 #include <sys/vnode.h>
@@ -140,8 +141,9 @@ procfs_sysctl_build_name(struct sysctl_oid_list *list, const char *prefix,
 /*
  * Read a leaf's value as Linux-style text. Builds the MIB name, fetches the
  * raw value via sysctlbyname(), and formats it by the oid's declared type
- * (int / quad / string). Opaque/struct sysctls have no text rendering and read
- * empty. A directory objectid returns EISDIR.
+ * (int / quad / string) with procfs_render_sysctl_value(). Opaque/struct
+ * sysctls have no text rendering and read empty. A directory objectid
+ * returns EISDIR.
  */
 int
 procfs_sysctl_read(uint64_t objectid, uio_t uio)
@@ -164,41 +166,12 @@ procfs_sysctl_read(uint64_t objectid, uio_t uio)
     }
 
     char out[1100];
-    int  len  = 0;
-    int  type = oid->oid_kind & CTLTYPE;
-    const char *fmt = (oid->oid_fmt != NULL) ? oid->oid_fmt : "";
+    struct sbuf sb;
+    sbuf_new(&sb, out, sizeof(out), SBUF_FIXEDLEN);
+    procfs_render_sysctl_value(&sb, oid->oid_kind & CTLTYPE, oid->oid_fmt, raw, rawlen);
+    sbuf_finish(&sb);
+    int error = procfs_copy_data(sbuf_data(&sb), sbuf_len(&sb), uio);
+    sbuf_delete(&sb);
 
-    switch (type) {
-    case CTLTYPE_STRING: {
-        if (raw[rawlen - 1] == '\0') {
-            rawlen--;                              /* drop the trailing NUL */
-        }
-        len = snprintf(out, sizeof(out), "%.*s\n", (int)rawlen, (char *)raw);
-        break;
-    }
-    case CTLTYPE_INT: {
-        if (rawlen >= sizeof(int32_t)) {
-            int32_t v;
-            memcpy(&v, raw, sizeof(v));
-            len = (fmt[0] == 'I' && fmt[1] == 'U')
-                ? snprintf(out, sizeof(out), "%u\n", (uint32_t)v)
-                : snprintf(out, sizeof(out), "%d\n", v);
-        }
-        break;
-    }
-    case CTLTYPE_QUAD: {
-        if (rawlen >= sizeof(int64_t)) {
-            int64_t v;
-            memcpy(&v, raw, sizeof(v));
-            len = (fmt[0] == 'Q' && fmt[1] == 'U')
-                ? snprintf(out, sizeof(out), "%llu\n", (unsigned long long)v)
-                : snprintf(out, sizeof(out), "%lld\n", (long long)v);
-        }
-        break;
-    }
-    default:
-        return procfs_copy_data("", 0, uio);        /* opaque/struct: no text */
-    }
-
-    return procfs_copy_data(out, len, uio);
+    return error;
 }
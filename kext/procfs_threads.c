@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfs_threads.c
+ *
+ * Whole-process thread snapshots from procfsd. Listing /proc/<pid>/task and
+ * reading each thread's stat, status and sched used to cost one
+ * PROCFS_REQ_THREADINFO round-trip per thread and file. Instead the first
+ * per-thread read of a process asks for PROCFS_REQ_THREADS - the ids and
+ * proc_threadinfo of every thread in one reply - and keeps the result for
+ * PROCFS_THREADS_TTL_MS, so the reads that follow are answered without the
+ * daemon.
+ *
+ * A snapshot only ever answers for the threads it lists; a thread created
+ * after it was taken, or a daemon that predates PROCFS_REQ_THREADS, falls
+ * back to the per-thread request. A snapshot is dropped early when procfsd
+ * reports that its process exec'd or exited (procfs_events.c).
+ */
+#include <kern/clock.h>
+#include <kern/locks.h>
+#include <libkern/OSMalloc.h>
+#include <os/overflow.h>
+#include <sys/errno.h>
+#include <sys/proc_info.h>
+#include <sys/systm.h>
+#include <string.h>
+
+#include <fs/procfs/procfs.h>
+#include <fs/procfs/procfs_ctl.h>
+
+#define PROCFS_THREADS_SNAPS    8       /* processes with a snapshot at once */
+#define PROCFS_THREADS_TTL_MS   100     /* how long a snapshot answers for */
+#define PROCFS_THREADS_MAX      8192    /* threads a snapshot takes; above XNU's per-task limit */
+
+struct procfs_threads_snap {
+    pid_t                     ts_pid;
+    uint32_t                  ts_count;
+    uint32_t                  ts_size;      /* bytes allocated for ts_recs */
+    uint64_t                  ts_expires;   /* mach_absolute_time(); 0 = free */
+    struct procfs_ctl_thread *ts_recs;
+};
+
+static lck_mtx_t                  *procfs_threads_lock;
+static struct procfs_threads_snap  procfs_threads_snaps[PROCFS_THREADS_SNAPS];
+
+#pragma mark -
+#pragma mark Snapshot cache
+
+/* Free `ts`'s records and mark it unused. Called with the lock held. */
+static void
+procfs_threads_drop(struct procfs_threads_snap *ts)
+{
+    if (ts->ts_recs != NULL) {
+        OSFree(ts->ts_recs, ts->ts_size, procfs_osmalloc_tag);
+    }
+    bzero(ts, sizeof(*ts));
+}
+
+/* Lifecycle events: an exec or exit makes the process's snapshot stale. */
+static void
+procfs_threads_event(__unused void *arg, const struct procfs_ctl_event *ev, uint32_t count,
+    uint32_t dropped)
+{
+    lck_mtx_lock(procfs_threads_lock);
+    for (int i = 0; i < PROCFS_THREADS_SNAPS; i++) {
+        struct procfs_threads_snap *ts = &procfs_threads_snaps[i];
+        if (ts->ts_expires == 0) {
+            continue;
+        }
+        boolean_t stale = (dropped != 0);
+        for (uint32_t j = 0; j < count && !stale; j++) {
+            stale = ev[j].pid == ts->ts_pid && ev[j].kind != PROCFS_EV_FORK;
+        }
+        if (stale) {
+            procfs_threads_drop(ts);
+        }
+    }
+    lck_mtx_unlock(procfs_threads_lock);
+}
+
+void
+procfs_threads_init(void)
+{
+    procfs_threads_lock = lck_mtx_alloc_init(pfsnode_lck_grp, LCK_ATTR_NULL);
+    (void)procfs_event_subscribe(procfs_threads_event, NULL);
+}
+
+void
+procfs_threads_fini(void)
+{
+    procfs_event_unsubscribe(procfs_threads_event, NULL);
+    for (int i = 0; i < PROCFS_THREADS_SNAPS; i++) {
+        procfs_threads_drop(&procfs_threads_snaps[i]);
+    }
+    if (procfs_threads_lock != NULL) {
+        lck_mtx_free(procfs_threads_lock, pfsnode_lck_grp);
+        procfs_threads_lock = NULL;
+    }
+}
+
+/* Copy `tid`'s info from a live snapshot of `pid`. Returns TRUE if there was one. */
+static boolean_t
+procfs_threads_lookup(pid_t pid, uint64_t tid, struct proc_threadinfo *ti)
+{
+    boolean_t found = FALSE;
+    uint64_t now = mach_absolute_time();
+
+    lck_mtx_lock(procfs_threads_lock);
+    for (int i = 0; i < PROCFS_THREADS_SNAPS && !found; i++) {
+        const struct procfs_threads_snap *ts = &procfs_threads_snaps[i];
+        if (ts->ts_pid != pid || now >= ts->ts_expires) {
+            continue;
+        }
+        for (uint32_t j = 0; j < ts->ts_count; j++) {
+            if (ts->ts_recs[j].tid == tid) {
+                *ti = ts->ts_recs[j].info;
+                found = TRUE;
+                break;
+            }
+        }
+    }
+    lck_mtx_unlock(procfs_threads_lock);
+    return found;
+}
+
+/*
+ * Keep `recs` (allocated with `size` bytes, `count` used) as the snapshot of
+ * `pid`, replacing an older one of the same process, else an expired
+ * entry, else the one closest to expiring. Takes ownership of `recs`.
+ */
+static void
+procfs_threads_install(pid_t pid, struct procfs_ctl_thread *recs, uint32_t count, uint32_t size)
+{
+    uint64_t expires;
+    clock_interval_to_deadline(PROCFS_THREADS_TTL_MS, NSEC_PER_MSEC, &expires);
+
+    lck_mtx_lock(procfs_threads_lock);
+    struct procfs_threads_snap *victim = &procfs_threads_snaps[0];
+    for (int i = 0; i < PROCFS_THREADS_SNAPS; i++) {
+        struct procfs_threads_snap *ts = &procfs_threads_snaps[i];
+        if (ts->ts_pid == pid && ts->ts_expires != 0) {
+            victim = ts;
+            break;
+        }
+        if (ts->ts_expires < victim->ts_expires) {
+            victim = ts;
+        }
+    }
+    struct procfs_ctl_thread *old = victim->ts_recs;
+    uint32_t old_size = victim->ts_size;
+    victim->ts_pid     = pid;
+    victim->ts_count   = count;
+    victim->ts_size    = size;
+    victim->ts_expires = expires;
+    victim->ts_recs    = recs;
+    lck_mtx_unlock(procfs_threads_lock);
+
+    if (old != NULL) {
+        OSFree(old, old_size, procfs_osmalloc_tag);
+    }
+}
+
+#pragma mark -
+#pragma mark Fetching
+
+/*
+ * The records of one PROCFS_REQ_THREADS page in `buf` (`got` bytes), or
+ * NULL if it is malformed.
+ */
+static const struct procfs_ctl_thread *
+procfs_threads_page(const uint8_t *buf, uint32_t got, struct procfs_ctl_threads *hdr)
+{
+    if (got < sizeof(*hdr)) {
+        return NULL;
+    }
+    memcpy(hdr, buf, sizeof(*hdr));
+    if (hdr->count > (got - sizeof(*hdr)) / sizeof(struct procfs_ctl_thread) ||
+        hdr->next > hdr->total) {
+        return NULL;
+    }
+    return (const struct procfs_ctl_thread *)(buf + sizeof(*hdr));
+}
+
+/*
+ * Build and install a snapshot of `pid` from the first page in `buf`,
+ * fetching any further pages synchronously. Returns 0 or an errno.
+ */
+static int
+procfs_threads_fill(pfsnode_t *pnp, pid_t pid, uint8_t *buf, uint32_t got)
+{
+    struct procfs_ctl_threads hdr;
+    const struct procfs_ctl_thread *page = procfs_threads_page(buf, got, &hdr);
+    if (page == NULL) {
+        return EIO;
+    }
+
+    /* `total` is the daemon's word: bound it before sizing an allocation by it. */
+    uint32_t cap  = hdr.total > 0 ? hdr.total : 1;
+    uint32_t size;
+    if (cap > PROCFS_THREADS_MAX ||
+        os_mul_overflow(cap, (uint32_t)sizeof(struct procfs_ctl_thread), &size)) {
+        return EIO;
+    }
+    struct procfs_ctl_thread *recs = OSMalloc(size, procfs_osmalloc_tag);
+    if (recs == NULL) {
+        return ENOMEM;
+    }
+
+    uint32_t count = 0;
+    for (;;) {
+        uint32_t n = hdr.count < cap - count ? hdr.count : cap - count;
+        memcpy(&recs[count], page, n * sizeof(*recs));
+        count += n;
+
+        /* `next` must advance, so a confused daemon cannot loop us. */
+        uint32_t from = hdr.next;
+        if (from >= hdr.total || count >= cap) {
+            break;
+        }
+        int rc = procfs_ctl_request(PROCFS_REQ_THREADS, pid, from, buf,
+            PROCFS_CTL_MAXPAYLOAD, &got);
+        procfs_stats_ctl(pnp, rc);
+        if (rc != 0 || (page = procfs_threads_page(buf, got, &hdr)) == NULL || hdr.next <= from) {
+            break;          /* keep what we have */
+        }
+    }
+
+    procfs_threads_install(pid, recs, count, size);
+    return 0;
+}
+
+/*
+ * Look up a thread's info for a per-thread node in two halves, like the
+ * procfs_ctl_submit()/procfs_ctl_wait() pair they wrap: _submit() answers
+ * from a live snapshot into `ti` or sends PROCFS_REQ_THREADS for the whole
+ * process, and _wait() collects that, installs the snapshot and takes the
+ * thread from it. Returns 0 with `ti` filled in, or an errno with `ti`
+ * zeroed for the caller to fall back. The reply lands in a buffer taken at
+ * submit, which _wait() frees.
+ */
+void
+procfs_threads_submit(pfsnode_t *pnp, procfs_threads_pending_t *tp, struct proc_threadinfo *ti)
+{
+    pid_t pid = pnp->node_id.nodeid_pid;
+    tp->tp_buf = NULL;
+    tp->tp_hit = procfs_threads_lookup(pid, pnp->node_id.nodeid_objectid, ti);
+    if (!tp->tp_hit) {
+        tp->tp_buf = OSMalloc(PROCFS_CTL_MAXPAYLOAD, procfs_osmalloc_tag);
+        if (tp->tp_buf != NULL) {
+            (void)procfs_ctl_submit(PROCFS_REQ_THREADS, pid, 0, tp->tp_buf,
+                PROCFS_CTL_MAXPAYLOAD, &tp->tp_ctl);
+        }
+    }
+}
+
+int
+procfs_threads_wait(pfsnode_t *pnp, procfs_threads_pending_t *tp, struct proc_threadinfo *ti)
+{
+    if (tp->tp_hit) {
+        return 0;
+    }
+
+    pid_t    pid = pnp->node_id.nodeid_pid;
+    uint64_t tid = pnp->node_id.nodeid_objectid;
+    uint8_t *buf = tp->tp_buf;
+    if (buf == NULL) {
+        bzero(ti, sizeof(*ti));
+        return ENOMEM;
+    }
+
+    uint32_t got = 0;
+    int rc = procfs_ctl_wait(&tp->tp_ctl, &got);
+    procfs_stats_ctl(pnp, rc);
+    if (rc == 0) {
+        rc = procfs_threads_fill(pnp, pid, buf, got);
+    }
+    OSFree(buf, PROCFS_CTL_MAXPAYLOAD, procfs_osmalloc_tag);
+    tp->tp_buf = NULL;
+
+    if (rc == 0 && procfs_threads_lookup(pid, tid, ti)) {
+        return 0;
+    }
+    if (rc == 0 || rc == EINVAL || rc == EIO) {
+        /* Not in the snapshot (newer than it), or the daemon does not batch. */
+        got = 0;
+        rc = procfs_ctl_request(PROCFS_REQ_THREADINFO, pid, tid, ti, sizeof(*ti), &got);
+        procfs_stats_ctl(pnp, rc);
+        if (rc == 0 && got == sizeof(*ti)) {
+            return 0;
+        }
+        rc = (rc != 0) ? rc : EIO;
+    }
+    bzero(ti, sizeof(*ti));
+    return rc;
+}
+
+int
+procfs_threads_get(pfsnode_t *pnp, struct proc_threadinfo *ti)
+{
+    procfs_threads_pending_t tp;
+    procfs_threads_submit(pnp, &tp, ti);
+    return procfs_threads_wait(pnp, &tp, ti);
+}
@@ -164,6 +164,7 @@ procfs_mount(struct mount *mp, __unused vnode_t devvp, user_addr_t data, __unuse
             // Set up the hash buckets only on first mount. Rather than define a
             // a new BSD zone, we use the existing zone M_CACHE.
             pfsnode_hash_buckets = hashinit(HASH_BUCKET_COUNT, M_CACHE, &pfsnode_hash_to_bucket_mask);
+            pfsnode_pid_buckets = hashinit(HASH_BUCKET_COUNT, M_CACHE, &pfsnode_pid_to_bucket_mask);
         }
         lck_mtx_unlock(pfsnode_hash_mutex);
     }
@@ -6,6 +6,7 @@
  *
  * Vnode operations for the ProcFS file system.
  */
+#include <kern/clock.h>
 #include <libkern/libkern.h>
 #include <sys/dirent.h>
 #include <sys/errno.h>
@@ -128,13 +129,6 @@ struct vnodeopv_desc *procfs_vnodeops_list[1] = {
 /*
  * Vnode operations that don't require us to do anything.
  */
-STATIC int
-procfs_vnop_open(__unused struct vnop_open_args *ap)
-{
-    return 0;
-}
-
-
 STATIC int
 procfs_vnop_access(__unused struct vnop_access_args *ap)
 {
@@ -160,6 +154,19 @@ int procfs_vnop_default(__unused struct vnop_generic_args *arg)
     return 0;
 }
 
+/*
+ * Opening a node needs nothing beyond counting it.
+ */
+STATIC int
+procfs_vnop_open(struct vnop_open_args *ap)
+{
+    pfsnode_t *pnp = VTOPFS(ap->a_vp);
+    if (pnp != NULL) {
+        procfs_stats_open(pnp->node_structure_node->psn_node_type);
+    }
+    return 0;
+}
+
 /*
  * We do not implement bulk attribute enumeration. Returning ENOTSUP here
  * overrides XNU's default getattrlistbulk implementation (which mis-packs
@@ -220,10 +227,12 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap)
         goto out;
     }
 
-    // Preparation: get the component that we are looking up, clear
-    // the returned vnode and ensure that nothing is added to the
-    // name cache.
+    // Preparation: get the component that we are looking up and clear
+    // the returned vnode. Whether the name may be entered in the name
+    // cache is decided once we know which node it resolves to, so note
+    // whether the caller asked for it and clear it for now.
     strlcpy(name, cnp->cn_nameptr, min(sizeof(name), cnp->cn_namelen + 1));
+    boolean_t make_entry = (cnp->cn_flags & MAKEENTRY) != 0;
     cnp->cn_flags &= ~MAKEENTRY;
     *ap->a_vpp = NULLVP;
     pfsmount_t *mp = vfs_mp_to_procfs_mp(vnode_mount(dvp));      // procfs file system mount.
@@ -244,6 +253,10 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap)
                                 (create_vnode_func)&procfs_create_vnode,
                                 &create_args);
         if (error == 0) {
+            // A process-related parent belongs to the same process as this directory.
+            if (target_pfsnode->node_structure_node->psn_flags & PSN_FLAG_PROCESS) {
+                procfsnode_bind_process(target_pfsnode, dir_pnp->node_proc_stamp);
+            }
             *ap->a_vpp = target_vnode;
         }
     } else if (cnp->cn_namelen == 1 && name[0] == '.') {
@@ -261,6 +274,10 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap)
         pfsid_t match_node_id;
         proc_t target_proc = PROC_NULL;
 
+        // Identity of the process incarnation that the matched node belongs
+        // to. Static children inherit it from their process directory.
+        uint64_t match_stamp = dir_pnp->node_proc_stamp;
+
         // /proc/sys is a dynamic mirror of the sysctl tree: its children are the
         // live sysctl oids, not static structure children. Match by name against
         // the oid's children and reuse the single PFSsysctl structure node,
@@ -350,6 +367,7 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap)
                         error = ENOENT;
                         break;
                     }
+                    match_stamp = procfs_proc_stamp(target_proc);
 
                     // For the case of PFSprocnamedir, the name must be a complete
                     // and literal match to the full name that corresponds to the process
@@ -433,6 +451,15 @@ sysctl_matched:
                                     (create_vnode_func)&procfs_create_vnode,
                                     &create_args);
             if (error == 0) {
+                // Rebind the node to the process it now refers to. If the pid was
+                // reused, this purges cached names that belong to the old process.
+                procfsnode_bind_process(target_pfsnode, match_stamp);
+
+                // Static children of a process directory are stable for the life
+                // of the process, so let the name cache serve repeated lookups.
+                if (make_entry && procfs_node_is_cacheable(match_node)) {
+                    cache_enter(dvp, target_vnode, cnp);
+                }
                 *ap->a_vpp = target_vnode;
             }
         } else if (error == 0) {
@@ -442,6 +469,9 @@ sysctl_matched:
     }
 
 out:
+    if (error == 0 && *ap->a_vpp != NULLVP) {
+        procfs_stats_lookup(VTOPFS(*ap->a_vpp)->node_structure_node->psn_node_type);
+    }
     return error;
 }
 
@@ -498,6 +528,14 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap)
     boolean_t check_access = !suser && procfs_should_access_check(pmp);
     kauth_cred_t creds = vfs_context_ucred(ap->a_context);
 
+    // Every entry of this directory inherits the directory's pid, so the
+    // caller's access to that process is the same for all of them. Decide
+    // it once for the whole pass rather than once per entry, since each
+    // check costs a proc_find() and a credential reference round-trip.
+    pid_t dir_pid = dir_pnp->node_id.nodeid_pid;
+    boolean_t dir_accessible = dir_pid == PRNODE_NO_PID || !check_access
+            || procfs_check_can_access_proc_pid(creds, dir_pid) == 0;
+
     pfssnode_t *snode = TAILQ_FIRST(&dir_snode->psn_children);
     while (snode != NULL && uio_resid(uio) > 0) {
         // We inherit the parent directory's pid and thread id for
@@ -508,10 +546,9 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap)
         pfsbaseid_t base_node_id = snode->psn_base_node_id;
         const char *name = snode->psn_name;
 
-        // If there is a process id associated with this node, perform
-        // an access check if required. Skip the entry if the user
-        // does not have permission to see it.
-        if (pid == PRNODE_NO_PID || !check_access || procfs_check_can_access_proc_pid(creds, pid) == 0) {
+        // If there is a process id associated with this node, skip the
+        // entry if the user does not have permission to see it.
+        if (dir_accessible) {
             boolean_t procdir = FALSE;
             boolean_t procnamedir = FALSE;
             boolean_t threaddir = FALSE;
@@ -564,7 +601,8 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap)
 
             case PFSuptime:         /* FALLTHROUGH */
             case PFSswaps:          /* FALLTHROUGH */
-            case PFSfilesystems:
+            case PFSfilesystems:    /* FALLTHROUGH */
+            case PFSstats:
                 type = DT_REG;
                 break;
 
@@ -631,6 +669,7 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap)
                 // Process each process in turn. We only get back process ids for the
                 // processes that the caller has permission to access.
                 boolean_t pids_exhausted = TRUE;
+                pid_t first_pid = -1, last_pid = -1;
                 for (int i = 0; i < pid_count; i++) {
                     pid_t this_pid = pid_list[i];
                     if (procdir) {
@@ -652,12 +691,22 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap)
                             break;
                         }
                         numentries++;
+                        if (first_pid < 0) {
+                            first_pid = this_pid;
+                        }
+                        last_pid = this_pid;
                     }
                     nextpos += size;
                 }
 
                 procfs_release_pids(pid_list, pid_list_size);
                 pid_list = NULL;
+                // The pids come in ascending order, so the ones just returned are
+                // the range [first_pid, last_pid]; their per-process reads are
+                // likely to follow (no-op unless procfs.prefetch is set).
+                if (first_pid >= 0) {
+                    procfs_prefetch_queue(first_pid, last_pid);
+                }
                 // Advance snode only when every PID was emitted so that eofflag
                 // is set correctly.  If the buffer filled mid-way, snode stays
                 // on this node and the caller will resume from nextpos.
@@ -903,13 +952,18 @@ procfs_vnop_getattr(struct vnop_getattr_args *ap)
      && node_type != PFSmeminfo && node_type != PFSmtab
      && node_type != PFSstat && node_type != PFSvmstat
      && node_type != PFSuptime && node_type != PFSswaps
-     && node_type != PFSfilesystems && node_type != PFSsysctl) {
+     && node_type != PFSfilesystems && node_type != PFSsysctl
+     && node_type != PFSstats) {
         // Get the process pid and proc_t for the target vnode.
         // Returns ENOENT if the process does not exist. For the
         // root vnode, p is zero and pid is PRNODE_NO_PID, but the
         // return value is zero.
         int error = procfs_get_process_info(vp, &pid, &p);
         if (error != 0) {
+            // The process has gone. Drop any cached names for the node and
+            // have the vnode reclaimed as soon as it is no longer in use.
+            cache_purge(vp);
+            vnode_recycle(vp);
             return error;
         }
     }
@@ -978,7 +1032,8 @@ procfs_vnop_getattr(struct vnop_getattr_args *ap)
 
     case PFSuptime:         /* FALLTHROUGH */
     case PFSswaps:          /* FALLTHROUGH */
-    case PFSfilesystems:
+    case PFSfilesystems:    /* FALLTHROUGH */
+    case PFSstats:
         VATTR_RETURN(vap, va_mode, READ_EXECUTE_ALL & modemask);
         break;
 
@@ -1108,19 +1163,20 @@ procfs_vnop_read(struct vnop_read_args *ap)
     pfsnode_t *pnp = VTOPFS(vp);
     pfssnode_t *snode = pnp->node_structure_node;
     procfs_read_data_fn read_data_fn = snode->psn_read_data_fn;
-
-    // /proc/sys nodes have no static read fn; read the sysctl value (or EISDIR
-    // for a sysctl directory) from the oid carried in the node id.
-    if (snode->psn_node_type == PFSsysctl) {
-        return procfs_sysctl_read(pnp->node_id.nodeid_objectid, ap->a_uio);
-    }
+    uint64_t start = mach_absolute_time();
+    user_ssize_t resid = uio_resid(ap->a_uio);
 
     int error = EINVAL;
-    if (procfs_is_directory_type(snode->psn_node_type)) {
+    if (snode->psn_node_type == PFSsysctl) {
+        // /proc/sys nodes have no static read fn; read the sysctl value (or EISDIR
+        // for a sysctl directory) from the oid carried in the node id.
+        error = procfs_sysctl_read(pnp->node_id.nodeid_objectid, ap->a_uio);
+    } else if (procfs_is_directory_type(snode->psn_node_type)) {
         error = EISDIR;
     } else if (read_data_fn != NULL) {
         error = read_data_fn(pnp, ap->a_uio, ap->a_context);
     }
+    procfs_stats_read(snode->psn_node_type, start, resid - uio_resid(ap->a_uio));
     return error;
 }
 
@@ -1186,7 +1242,9 @@ procfs_create_vnode(procfs_vnode_create_args *cap, pfsnode_t *pnp, vnode_t *vpp)
     vnode_create_params.vnfs_fsnode = pnp;
     vnode_create_params.vnfs_vops = procfs_vnodeop_p;
     vnode_create_params.vnfs_markroot = 0;
-    vnode_create_params.vnfs_flags = VNFS_CANTCACHE;
+    // Only nodes whose names are stable for the life of their process may be
+    // cached. Those are entered explicitly by procfs_vnop_lookup(), not here.
+    vnode_create_params.vnfs_flags = procfs_node_is_cacheable(snode) ? VNFS_NOCACHE : VNFS_CANTCACHE;
 
     // Create the vnode, if possible.
     vnode_t new_vnode;
@@ -0,0 +1,122 @@
+/*
+ * kl_symtab.c
+ *
+ * Parse the staged procfs_ksyms file once into a sorted name -> address
+ * table, so lookups are a binary search rather than a rescan of the text.
+ *
+ * SPDX-License-Identifier: 0BSD
+ *
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * Nothing here touches the file system or allocates: klookup.c reads the
+ * file and owns the memory, which keeps this part buildable and testable
+ * outside the kernel (test/host).
+ */
+
+#include <libkern/libkern.h>
+#include <string.h>
+
+#include <libklookup/kl_symtab.h>
+
+int
+kl_symtab_capacity(const char *buf, size_t len)
+{
+    int lines = 1;
+    const char *p = buf;
+    const char *end = buf + len;
+
+    while (p < end && (p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+/* The hex value after a name: optional 0x, then digits up to the first non-hex. */
+static uint64_t
+kl_parse_hex(const char *h, const char *lend)
+{
+    uint64_t v = 0;
+
+    if (h + 2 <= lend && h[0] == '0' && (h[1] == 'x' || h[1] == 'X')) {
+        h += 2;
+    }
+    while (h < lend) {
+        char c = *h++;
+        int d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            d = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            d = c - 'A' + 10;
+        } else {
+            break;
+        }
+        v = (v << 4) | (uint64_t)d;
+    }
+    return v;
+}
+
+/*
+ * Order by name, then by position in the text: entries point into one
+ * buffer, so the earlier line of a duplicated name sorts first.
+ */
+static int
+kl_sym_cmp(const void *a, const void *b)
+{
+    const struct kl_sym *x = a;
+    const struct kl_sym *y = b;
+    int c = strcmp(x->name, y->name);
+
+    if (c != 0) {
+        return c;
+    }
+    return (x->name > y->name) - (x->name < y->name);
+}
+
+int
+kl_symtab_parse(char *buf, size_t len, struct kl_sym *syms, int cap)
+{
+    char *p = buf;
+    char *end = buf + len;
+    int n = 0;
+
+    while (p < end && n < cap) {
+        char *eol = memchr(p, '\n', (size_t)(end - p));
+        char *lend = eol ? eol : end;
+        char *sp = memchr(p, ' ', (size_t)(lend - p));
+
+        if (sp != NULL && sp > p && sp + 1 < lend &&
+            memchr(p, '\0', (size_t)(sp - p)) == NULL) {
+            syms[n].value = kl_parse_hex(sp + 1, lend);
+            *sp = '\0';
+            syms[n].name = p;
+            n++;
+        }
+        p = eol ? eol + 1 : end;
+    }
+
+    qsort(syms, (size_t)n, sizeof(syms[0]), kl_sym_cmp);
+    return n;
+}
+
+const struct kl_sym *
+kl_symtab_find(const struct kl_sym *syms, int n, const char *name)
+{
+    int lo = 0, hi = n;
+
+    /* Lower bound, so the first of several equal names is found. */
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(syms[mid].name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < n && strcmp(syms[lo].name, name) == 0) {
+        return &syms[lo];
+    }
+    return NULL;
+}
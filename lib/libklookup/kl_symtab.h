@@ -0,0 +1,43 @@
+/*
+ * kl_symtab.h
+ *
+ * Name -> address table parsed from the staged procfs_ksyms file.
+ *
+ * SPDX-License-Identifier: 0BSD
+ *
+ * Copyright (c) 2026 Sunneva N. Mariu
+ */
+#ifndef KL_SYMTAB_H
+#define KL_SYMTAB_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * One staged symbol. `name` points into the parsed text, which must outlive
+ * the table; `value` is the link-time address (0 when the line gave none).
+ */
+struct kl_sym {
+    const char *name;
+    uint64_t    value;
+};
+
+/* Upper bound on the entries kl_symtab_parse() can produce from `len` bytes. */
+int kl_symtab_capacity(const char *buf, size_t len);
+
+/*
+ * Parse the staged "<name> 0x<hex>" lines of `buf` into `syms` (room for
+ * `cap` entries), sorted by name, and return the count. Names are
+ * NUL-terminated in place, so `buf` is modified and the entries point into
+ * it. Lines without a name, a separating space or anything after it, and
+ * names containing a NUL, are skipped.
+ */
+int kl_symtab_parse(char *buf, size_t len, struct kl_sym *syms, int cap);
+
+/*
+ * The entry for `name` in a table from kl_symtab_parse(), or NULL. When the
+ * file lists a name more than once, the first line wins.
+ */
+const struct kl_sym *kl_symtab_find(const struct kl_sym *syms, int n, const char *name);
+
+#endif /* KL_SYMTAB_H */
@@ -19,10 +19,15 @@
  * `kernel_pmap`, and return runtime addresses (link-time + slide). If the staged
  * file is missing or does not match the running kernel, every lookup fails
  * safely (NULL) and the caller leaves the affected features disabled.
+ *
+ * The file is read and parsed (kl_symtab.c) once, on the first lookup that
+ * finds it valid; the sorted table and the slide are kept until
+ * klookup_flush(), so later lookups neither touch the file nor rescan text.
  */
 
 #include <libkern/libkern.h>
 #include <libkern/version.h>
+#include <libkern/OSAtomic.h>
 #include <libkern/OSMalloc.h>
 #include <sys/vnode.h>
 #include <sys/uio.h>
@@ -30,6 +35,7 @@
 #include <string.h>
 
 #include <libklookup/klookup.h>
+#include <libklookup/kl_symtab.h>
 
 #define KL_STAGED_PATH  "/var/db/procfs.ksyms"
 #define KL_MAX          8192        /* the staged file is a few hundred bytes */
@@ -63,109 +69,157 @@ kl_slurp(const char *path, char *buf, size_t cap, size_t *outlen, vfs_context_t
 }
 
 /*
- * Find a "<name> 0x<hex>" line in the staged buffer and return the hex value, or
- * 0 if absent.
+ * The parsed staged file: its text (which the entries point into), the
+ * sorted table and the validated slide.
  */
-static uint64_t
-kl_line_value(const char *buf, size_t len, const char *name)
+struct kl_cache {
+    char          *text;
+    struct kl_sym *syms;
+    uint32_t       syms_size;
+    int            nsyms;
+    int64_t        slide;
+};
+
+static struct kl_cache *volatile g_kl_cache = NULL;
+
+static void
+kl_cache_free(struct kl_cache *kc)
 {
-    size_t nl = strlen(name);
-    const char *p = buf;
-    const char *end = buf + len;
-
-    while (p < end) {
-        const char *eol = memchr(p, '\n', (size_t)(end - p));
-        const char *lend = eol ? eol : end;
-        if ((size_t)(lend - p) > nl + 1 &&
-            strncmp(p, name, nl) == 0 && p[nl] == ' ') {
-            const char *h = p + nl + 1;
-            if (h + 2 <= lend && h[0] == '0' && (h[1] == 'x' || h[1] == 'X')) {
-                h += 2;
-            }
-            uint64_t v = 0;
-            while (h < lend) {
-                char c = *h++;
-                int d;
-                if (c >= '0' && c <= '9') {
-                    d = c - '0';
-                } else if (c >= 'a' && c <= 'f') {
-                    d = c - 'a' + 10;
-                } else if (c >= 'A' && c <= 'F') {
-                    d = c - 'A' + 10;
-                } else {
-                    break;
-                }
-                v = (v << 4) | (uint64_t)d;
-            }
-            return v;
-        }
-        p = eol ? eol + 1 : end;
+    if (kc->syms != NULL) {
+        OSFree(kc->syms, kc->syms_size, g_kl_tag);
+    }
+    if (kc->text != NULL) {
+        OSFree(kc->text, KL_MAX, g_kl_tag);
     }
-    return 0;
+    OSFree(kc, sizeof(*kc), g_kl_tag);
+}
+
+static uint64_t
+kl_cache_value(const struct kl_cache *kc, const char *name)
+{
+    const struct kl_sym *sym = kl_symtab_find(kc->syms, kc->nsyms, name);
+    return sym != NULL ? sym->value : 0;
 }
 
 /*
- * Resolve `count` symbol names to their runtime addresses (out[i] = address or
- * NULL). Returns the number resolved.
+ * Read and parse the staged file, and validate it against the running kernel.
+ * Returns NULL (having said why) if it is missing or stale.
  */
-int
-klookup_resolve(const char *const *names, void **out, int count)
+static struct kl_cache *
+kl_cache_load(void)
 {
-    for (int i = 0; i < count; i++) {
-        out[i] = NULL;
-    }
-
-    if (g_kl_tag == NULL) {
-        g_kl_tag = OSMalloc_Tagalloc("klookup", OSMT_DEFAULT);
-        if (g_kl_tag == NULL) {
-            return 0;
-        }
+    struct kl_cache *kc = OSMalloc(sizeof(*kc), g_kl_tag);
+    if (kc == NULL) {
+        return NULL;
     }
+    bzero(kc, sizeof(*kc));
 
-    char *buf = OSMalloc(KL_MAX, g_kl_tag);
-    if (buf == NULL) {
-        return 0;
+    kc->text = OSMalloc(KL_MAX, g_kl_tag);
+    if (kc->text == NULL) {
+        kl_cache_free(kc);
+        return NULL;
     }
 
     vfs_context_t ctx = vfs_context_create(NULL);
     size_t len = 0;
-    int err = kl_slurp(KL_STAGED_PATH, buf, KL_MAX - 1, &len, ctx);
+    int err = kl_slurp(KL_STAGED_PATH, kc->text, KL_MAX - 1, &len, ctx);
     vfs_context_rele(ctx);
     if (err != 0 || len == 0) {
         printf("KLOOKUP: staged symbols unavailable (%s)\n", KL_STAGED_PATH);
-        OSFree(buf, KL_MAX, g_kl_tag);
-        return 0;
+        kl_cache_free(kc);
+        return NULL;
+    }
+    kc->text[len] = '\0';
+
+    int cap = kl_symtab_capacity(kc->text, len);
+    kc->syms_size = (uint32_t)cap * sizeof(struct kl_sym);
+    kc->syms = OSMalloc(kc->syms_size, g_kl_tag);
+    if (kc->syms == NULL) {
+        kl_cache_free(kc);
+        return NULL;
     }
-    buf[len] = '\0';
+    kc->nsyms = kl_symtab_parse(kc->text, len, kc->syms, cap);
 
     /* Recover the slide from `version`; validate against `kernel_pmap`. */
-    uint64_t version_raw = kl_line_value(buf, len, "_version");
-    uint64_t kpmap_raw   = kl_line_value(buf, len, "_kernel_pmap");
+    uint64_t version_raw = kl_cache_value(kc, "_version");
+    uint64_t kpmap_raw   = kl_cache_value(kc, "_kernel_pmap");
     if (version_raw == 0) {
         printf("KLOOKUP: staged file has no _version anchor\n");
-        OSFree(buf, KL_MAX, g_kl_tag);
-        return 0;
+        kl_cache_free(kc);
+        return NULL;
     }
-    int64_t slide = (int64_t)(uintptr_t)(void *)version - (int64_t)version_raw;
+    kc->slide = (int64_t)(uintptr_t)(void *)version - (int64_t)version_raw;
     if (kpmap_raw != 0 &&
-        (uintptr_t)(kpmap_raw + slide) != (uintptr_t)(void *)&kernel_pmap) {
+        (uintptr_t)(kpmap_raw + kc->slide) != (uintptr_t)(void *)&kernel_pmap) {
         printf("KLOOKUP: staged symbols do not match running kernel\n");
-        OSFree(buf, KL_MAX, g_kl_tag);
+        kl_cache_free(kc);
+        return NULL;
+    }
+
+    return kc;
+}
+
+/*
+ * The cached table, loading it on first use. Concurrent first callers may each
+ * load; one publishes and the others free theirs. A failed load is not cached,
+ * so a file staged after the first attempt is picked up by the next lookup.
+ */
+static struct kl_cache *
+kl_cache_get(void)
+{
+    struct kl_cache *kc = g_kl_cache;
+    if (kc != NULL) {
+        return kc;
+    }
+
+    if (g_kl_tag == NULL) {
+        OSMallocTag tag = OSMalloc_Tagalloc("klookup", OSMT_DEFAULT);
+        if (tag == NULL) {
+            return NULL;
+        }
+        if (!OSCompareAndSwapPtr(NULL, tag, (void *volatile *)&g_kl_tag)) {
+            OSMalloc_Tagfree(tag);
+        }
+    }
+
+    kc = kl_cache_load();
+    if (kc == NULL) {
+        return NULL;
+    }
+    if (!OSCompareAndSwapPtr(NULL, kc, (void *volatile *)&g_kl_cache)) {
+        kl_cache_free(kc);
+        kc = g_kl_cache;
+    }
+    return kc;
+}
+
+/*
+ * Resolve `count` symbol names to their runtime addresses (out[i] = address or
+ * NULL). Returns the number resolved.
+ */
+int
+klookup_resolve(const char *const *names, void **out, int count)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = NULL;
+    }
+
+    struct kl_cache *kc = kl_cache_get();
+    if (kc == NULL) {
         return 0;
     }
 
     int resolved = 0;
     for (int w = 0; w < count; w++) {
-        uint64_t raw = kl_line_value(buf, len, names[w]);
+        uint64_t raw = kl_cache_value(kc, names[w]);
         if (raw != 0) {
-            out[w] = (void *)(uintptr_t)((int64_t)raw + slide);
+            out[w] = (void *)(uintptr_t)((int64_t)raw + kc->slide);
             resolved++;
         }
     }
     printf("KLOOKUP: resolved %d/%d (slide=0x%llx)\n",
-           resolved, count, (unsigned long long)slide);
+           resolved, count, (unsigned long long)kc->slide);
 
-    OSFree(buf, KL_MAX, g_kl_tag);
     return resolved;
 }
 
@@ -179,3 +233,21 @@ SymbolLookup(const char *Symbol)
     klookup_resolve(&Symbol, &addr, 1);
     return addr;
 }
+
+/*
+ * Drop the cached table. Only for teardown: no lookup may be in flight.
+ */
+void
+klookup_flush(void)
+{
+    struct kl_cache *kc = g_kl_cache;
+
+    g_kl_cache = NULL;
+    if (kc != NULL) {
+        kl_cache_free(kc);
+    }
+    if (g_kl_tag != NULL) {
+        OSMalloc_Tagfree(g_kl_tag);
+        g_kl_tag = NULL;
+    }
+}
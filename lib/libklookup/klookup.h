@@ -43,14 +43,18 @@ extern "C" {
 
     /*
      * Resolve `count` symbol names to runtime addresses (out[i] = address or
-     * NULL). Returns the number resolved. Reads the on-disk kernelcache once,
-     * so batch everything you need in a single call.
+     * NULL). Returns the number resolved. The staged symbol file is read and
+     * parsed on the first call that finds it valid and kept until
+     * klookup_flush(); later calls only search the parsed table.
      */
     int klookup_resolve(const char *const *names, void **out, int count);
 
     /* Single-symbol convenience wrapper around klookup_resolve(). */
     void *SymbolLookup(const char *symbol);
 
+    /* Free the parsed table (kext unload; no lookups may be in flight). */
+    void klookup_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * bench_procargs.c
+ *
+ * Microbenchmark for the argument-area parser (kext/procfs_procargs.c) over
+ * synthetic areas up to the 256 KB procfs_read_procargs() reads: a typical
+ * process, an environment-heavy one, a few very long arguments, and the
+ * pathological shapes - 100k one-character strings in argv or in the
+ * environment, and areas with no terminators at all. Each is parsed by the
+ * word-at-a-time parser and by the byte-at-a-time reference it replaced
+ * (procargs_ref.h); the offsets are compared before anything is timed.
+ *
+ *   make -C test/host bench
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fs/procfs/procfs_procargs.h>
+
+#include "procargs_ref.h"
+
+#define AREA_MAX    (256 * 1024)
+#define BYTES_PER_CASE  (256 * 1024 * 1024)
+
+typedef void (*parse_fn)(const uint8_t *buf, size_t len, int argc, struct procfs_procargs *pa);
+
+struct area {
+    const char *name;
+    uint8_t    *buf;
+    size_t      len;
+    int         argc;
+};
+
+static size_t
+put(uint8_t *p, size_t len, const char *s)
+{
+    size_t n = strlen(s) + 1;
+
+    if (len + n > AREA_MAX) {
+        return len;
+    }
+    memcpy(p + len, s, n);
+    return len + n;
+}
+
+static size_t
+put_fill(uint8_t *p, size_t len, char c, size_t n)
+{
+    if (len + n + 1 > AREA_MAX) {
+        n = AREA_MAX - len - 1;
+    }
+    memset(p + len, c, n);
+    p[len + n] = '\0';
+    return len + n + 1;
+}
+
+static size_t
+put_apple(uint8_t *p, size_t len)
+{
+    char s[64];
+
+    len = put(p, len, PROCFS_EXEC_KEY "/usr/bin/example");
+    for (int i = 0; i < 10; i++) {
+        snprintf(s, sizeof(s), "apple_%d=0x%016llx", i, 0x1234567890abcdefULL * (i + 1));
+        len = put(p, len, s);
+    }
+    return len;
+}
+
+static void
+make_area(struct area *a, const char *name, int shape)
+{
+    uint8_t *p = calloc(AREA_MAX, 1);
+    size_t len = 0;
+    char s[256];
+    int argc = 0;
+
+    a->name = name;
+    len = put(p, len, "/Applications/Example.app/Contents/MacOS/Example");
+    len += 3;                                   /* alignment padding */
+
+    switch (shape) {
+    case 0:                                     /* typical */
+        argc = 4;
+        len = put(p, len, "/Applications/Example.app/Contents/MacOS/Example");
+        len = put(p, len, "-psn_0_1234567");
+        len = put(p, len, "--verbose");
+        len = put(p, len, "--config=/Users/someone/Library/Preferences/example.plist");
+        for (int i = 0; i < 40; i++) {
+            snprintf(s, sizeof(s), "VARIABLE_%02d=/usr/local/share/value/for/this/one/%d", i, i);
+            len = put(p, len, s);
+        }
+        len = put_apple(p, len);
+        break;
+    case 1:                                     /* environment-heavy */
+        argc = 1;
+        len = put(p, len, "example");
+        while (len < AREA_MAX - 4096) {
+            snprintf(s, sizeof(s), "ENVIRONMENT_%06zu=/some/rather/long/path/value/that/goes/on/%zu", len, len);
+            len = put(p, len, s);
+        }
+        len = put_apple(p, len);
+        break;
+    case 2:                                     /* three long arguments */
+        argc = 3;
+        for (int i = 0; i < argc; i++) {
+            len = put_fill(p, len, 'x', 80 * 1024);
+        }
+        len = put_apple(p, len);
+        break;
+    case 3:                                     /* 100k one-character argv strings */
+        argc = 100000;
+        for (int i = 0; i < argc; i++) {
+            len = put(p, len, "a");
+        }
+        len = put_apple(p, len);
+        break;
+    case 4:                                     /* 100k one-character env strings */
+        argc = 1;
+        len = put(p, len, "example");
+        for (int i = 0; i < 100000; i++) {
+            len = put(p, len, "e");             /* starts like the apple[] key */
+        }
+        len = put_apple(p, len);
+        break;
+    case 5:                                     /* no terminator anywhere */
+        argc = 1;
+        memset(p, 'z', AREA_MAX);
+        len = AREA_MAX;
+        break;
+    case 6:                                     /* argv ends unterminated mid-area */
+        argc = 1000;
+        len = put(p, len, "example");
+        memset(p + len, 'q', AREA_MAX - len);
+        len = AREA_MAX;
+        break;
+    }
+
+    a->buf = p;
+    a->len = len;
+    a->argc = argc;
+}
+
+static double
+time_ns_per_parse(const struct area *a, parse_fn fn, int rounds)
+{
+    struct procfs_procargs pa;
+    struct timespec t0, t1;
+    volatile size_t sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < rounds; i++) {
+        fn(a->buf, a->len, a->argc, &pa);
+        sink += pa.apple_off;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    (void)sink;
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / rounds;
+}
+
+int
+main(void)
+{
+    static const char *names[] = {
+        "typical", "env-heavy", "long-args", "argv-100k", "env-100k", "no-nul", "unterm",
+    };
+    int failures = 0;
+
+    printf("%-10s %8s %8s %11s %10s %11s %9s\n",
+           "area", "KB", "argc", "ns/parse", "MB/s", "bytewise ns", "speedup");
+    for (int shape = 0; shape < (int)(sizeof(names) / sizeof(names[0])); shape++) {
+        struct area a;
+        struct procfs_procargs got, want;
+
+        make_area(&a, names[shape], shape);
+        procfs_procargs_parse(a.buf, a.len, a.argc, &got);
+        ref_procargs_parse(a.buf, a.len, a.argc, &want);
+        if (memcmp(&got, &want, sizeof(got)) != 0) {
+            printf("  FAIL: %s offsets differ from the reference\n", a.name);
+            failures++;
+            free(a.buf);
+            continue;
+        }
+
+        int rounds = (int)(BYTES_PER_CASE / a.len) + 1;
+        double ref_ns = time_ns_per_parse(&a, ref_procargs_parse, rounds / 4 + 1);
+        double ns = time_ns_per_parse(&a, procfs_procargs_parse, rounds);
+        printf("%-10s %8.1f %8d %11.0f %10.0f %11.0f %8.2fx\n", a.name, a.len / 1024.0,
+               a.argc, ns, a.len / ns * 1e3, ref_ns, ref_ns / ns);
+        free(a.buf);
+    }
+
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * bench_render.c
+ *
+ * Microbenchmark for the rendering layer (kext/procfs_render.c), built
+ * against the host shim. Each formatter is fed synthetic process, region,
+ * CPU, memory and sysctl data and timed per rendered line. It reports
+ * ns/line and output MB/s. Alongside runs the single-printf form the node
+ * used before, which is the reference: both outputs are compared byte for
+ * byte before anything is timed.
+ *
+ *   make -C test/host bench
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/malloc.h>
+#include <sys/sysctl.h>
+#include <mach/vm_prot.h>
+
+#include <bsdcompat/sys/sbuf.h>
+#include <fs/procfs/procfs_render.h>
+
+#define LINES       20000
+#define ROUNDS      20
+
+struct sample {
+    struct procfs_region region;
+    struct procfs_pctx   pctx;
+    uint64_t             id, utime, stime, rss;
+    int                  prio, policy, loads[3];
+    uint64_t             ticks[4], mem[7];
+    uint32_t             ids[4];
+    int                  sysctl_type;
+    const char          *sysctl_fmt;
+    uint8_t              sysctl_raw[24];
+    size_t               sysctl_len;
+};
+
+static struct sample samples[LINES];
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t
+next(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void
+make_data(void)
+{
+    static const char *names[] = { "launchd", "kernel_task", "WindowServer", "a", "com.apple.WebKit.WebContent" };
+    uint64_t addr = 0;
+    for (int i = 0; i < LINES; i++) {
+        struct sample *s = &samples[i];
+        uint64_t size = ((next() % 64) + 1) * 0x4000;
+
+        s->region = (struct procfs_region){ addr, addr + size, next() % 0x100000000ULL,
+            (int)(next() & 7), (int)(next() & 7), (int)(next() & 1), (unsigned)(next() % 4) };
+        addr += size + ((next() & 3) == 0 ? 0x100000 : 0);
+
+        struct procfs_pctx *c = &s->pctx;
+        c->pid      = (int)(next() % 100000);
+        c->ppid     = (int)(next() % 100000);
+        c->pgid     = (int)(next() % 100000);
+        c->sid      = (int)(next() % 100000);
+        c->nthreads = (int)(next() % 200) + 1;
+        c->vsize    = (next() % 0x1000000000ULL) & ~0xfffULL;
+        c->rsize    = (next() % 0x100000000ULL) & ~0xfffULL;
+        c->state    = "RSTZDI"[next() % 6];
+        snprintf(c->comm, sizeof(c->comm), "%s", names[next() % 5]);
+
+        s->id     = next() % 10000000;
+        s->utime  = next() % 10000000;
+        s->stime  = next() % 1000000;
+        s->rss    = c->rsize / 4096;
+        s->prio   = (int)(next() % 128);
+        s->policy = (int)(next() % 3);
+        for (int k = 0; k < 3; k++) {
+            s->loads[k] = (int)(next() % 10000);
+        }
+        for (int k = 0; k < 4; k++) {
+            s->ticks[k] = next() % 100000000000ULL;
+            s->ids[k] = (uint32_t)(next() % 600);
+        }
+        for (int k = 0; k < 7; k++) {
+            s->mem[k] = next() % 0x4000000000ULL;
+        }
+
+        switch (i % 3) {
+        case 0: {
+            int32_t v = (int32_t)next();
+            s->sysctl_type = CTLTYPE_INT;
+            s->sysctl_fmt = (i & 1) ? "IU" : "I";
+            memcpy(s->sysctl_raw, &v, sizeof(v));
+            s->sysctl_len = sizeof(v);
+            break;
+        }
+        case 1: {
+            int64_t v = (int64_t)next();
+            s->sysctl_type = CTLTYPE_QUAD;
+            s->sysctl_fmt = (i & 1) ? "QU" : "Q";
+            memcpy(s->sysctl_raw, &v, sizeof(v));
+            s->sysctl_len = sizeof(v);
+            break;
+        }
+        default:
+            s->sysctl_type = CTLTYPE_STRING;
+            s->sysctl_fmt = "A";
+            s->sysctl_len = (size_t)snprintf((char *)s->sysctl_raw, sizeof(s->sysctl_raw),
+                "Darwin %d.%d", (int)(next() % 30), (int)(next() % 10)) + 1;
+            break;
+        }
+    }
+    samples[0].region.start = 0;    /* exercise the "%#018llx" zero case */
+}
+
+#pragma mark -
+#pragma mark Reference (single printf) forms
+
+static void
+maps_printf(struct sbuf *sb, const struct sample *s)
+{
+    const struct procfs_region *r = &s->region;
+    sbuf_printf(sb, "%016llx-%016llx %c%c%c%c %016llx 00:00 0 \n",
+        (unsigned long long)r->start, (unsigned long long)r->end,
+        (r->prot & VM_PROT_READ)    ? 'r' : '-',
+        (r->prot & VM_PROT_WRITE)   ? 'w' : '-',
+        (r->prot & VM_PROT_EXECUTE) ? 'x' : '-',
+        r->shared ? 's' : 'p',
+        (unsigned long long)r->offset);
+}
+
+static void
+map_printf(struct sbuf *sb, const struct sample *s)
+{
+    const struct procfs_region *r = &s->region;
+    sbuf_printf(sb, "%#018llx %#018llx %c%c%c %c%c%c %s %u\n",
+        (unsigned long long)r->start, (unsigned long long)r->end,
+        (r->prot & VM_PROT_READ)        ? 'r' : '-',
+        (r->prot & VM_PROT_WRITE)       ? 'w' : '-',
+        (r->prot & VM_PROT_EXECUTE)     ? 'x' : '-',
+        (r->max_prot & VM_PROT_READ)    ? 'r' : '-',
+        (r->max_prot & VM_PROT_WRITE)   ? 'w' : '-',
+        (r->max_prot & VM_PROT_EXECUTE) ? 'x' : '-',
+        r->shared ? "share" : "priv", r->wired);
+}
+
+static void
+stat_printf(struct sbuf *sb, const struct sample *s)
+{
+    const struct procfs_pctx *c = &s->pctx;
+    sbuf_printf(sb,
+        "%llu (%s) %c %d %d %d 0 -1 0 0 0 0 0 "
+        "%llu %llu 0 0 %d 0 %d 0 0 "
+        "%llu %llu 18446744073709551615 "
+        "0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 "
+        "%d "
+        "0 0 0 0 0 0 0 0 0 0 0\n",
+        (unsigned long long)s->id, c->comm, c->state, c->ppid, c->pgid, c->sid,
+        (unsigned long long)s->utime, (unsigned long long)s->stime,
+        s->prio, c->nthreads,
+        (unsigned long long)c->vsize, (unsigned long long)s->rss, s->policy);
+}
+
+static void
+statm_printf(struct sbuf *sb, const struct sample *s)
+{
+    sbuf_printf(sb, "%llu %llu 0 0 0 0 0\n",
+        (unsigned long long)(s->pctx.vsize / 4096), (unsigned long long)s->rss);
+}
+
+static void
+status_printf(struct sbuf *sb, const struct sample *s)
+{
+    const struct procfs_pctx *c = &s->pctx;
+    sbuf_printf(sb,
+        "Name:\t%s\n"
+        "State:\t%c (%s)\n"
+        "Tgid:\t%d\n"
+        "Pid:\t%d\n"
+        "PPid:\t%d\n"
+        "TracerPid:\t0\n"
+        "Uid:\t%u\t%u\t%u\t%u\n"
+        "Gid:\t%u\t%u\t%u\t%u\n"
+        "VmSize:\t%8llu kB\n"
+        "VmRSS:\t%8llu kB\n"
+        "Threads:\t%d\n"
+        "voluntary_ctxt_switches:\t0\n"
+        "nonvoluntary_ctxt_switches:\t0\n",
+        c->comm, c->state, procfs_thread_state_word(c->state),
+        c->pid, c->pid, c->ppid,
+        s->ids[0], s->ids[1], s->ids[2], s->ids[1],
+        s->ids[3], s->ids[2], s->ids[0], s->ids[2],
+        (unsigned long long)(c->vsize >> 10),
+        (unsigned long long)(c->rsize >> 10),
+        c->nthreads);
+}
+
+static void
+cpu_printf(struct sbuf *sb, const struct sample *s)
+{
+    int cpu = (int)(s->id % 64);
+    sbuf_printf(sb, "cpu%d %llu %llu %llu %llu 0 0 0 0 0 0\n", cpu,
+        (unsigned long long)s->ticks[0], (unsigned long long)s->ticks[1],
+        (unsigned long long)s->ticks[2], (unsigned long long)s->ticks[3]);
+}
+
+static void
+loadavg_printf(struct sbuf *sb, const struct sample *s)
+{
+    sbuf_printf(sb, "%d.%02d %d.%02d %d.%02d %d/%d %d\n",
+        s->loads[0] / 100, s->loads[0] % 100,
+        s->loads[1] / 100, s->loads[1] % 100,
+        s->loads[2] / 100, s->loads[2] % 100,
+        1, s->pctx.nthreads, s->pctx.pid);
+}
+
+static void
+meminfo_printf(struct sbuf *sb, const struct sample *s)
+{
+    const uint64_t *m = s->mem;
+    sbuf_printf(sb,
+        "MemTotal: %9lu kB\n"
+        "MemFree:  %9lu kB\n"
+        "MemShared:%9lu kB\n"
+        "Buffers:  %9lu kB\n"
+        "Cached:   %9lu kB\n"
+        "SwapTotal:%9llu kB\n"
+        "SwapFree: %9llu kB\n",
+        (unsigned long)(m[0] >> 10), (unsigned long)(m[1] >> 10), 0UL,
+        (unsigned long)(m[3] >> 10), (unsigned long)(m[4] >> 10),
+        (unsigned long long)(m[5] >> 10), (unsigned long long)(m[6] >> 10));
+}
+
+static void
+sysctl_printf(struct sbuf *sb, const struct sample *s)
+{
+    const char *fmt = s->sysctl_fmt;
+    switch (s->sysctl_type) {
+    case CTLTYPE_STRING: {
+        size_t len = s->sysctl_len;
+        if (s->sysctl_raw[len - 1] == '\0') {
+            len--;
+        }
+        sbuf_printf(sb, "%.*s\n", (int)len, (const char *)s->sysctl_raw);
+        break;
+    }
+    case CTLTYPE_INT: {
+        int32_t v;
+        memcpy(&v, s->sysctl_raw, sizeof(v));
+        if (fmt[0] == 'I' && fmt[1] == 'U') {
+            sbuf_printf(sb, "%u\n", (uint32_t)v);
+        } else {
+            sbuf_printf(sb, "%d\n", v);
+        }
+        break;
+    }
+    case CTLTYPE_QUAD: {
+        int64_t v;
+        memcpy(&v, s->sysctl_raw, sizeof(v));
+        if (fmt[0] == 'Q' && fmt[1] == 'U') {
+            sbuf_printf(sb, "%llu\n", (unsigned long long)v);
+        } else {
+            sbuf_printf(sb, "%lld\n", (long long)v);
+        }
+        break;
+    }
+    }
+}
+
+#pragma mark -
+#pragma mark Rendering layer
+
+static void
+maps_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_maps_fmt_linux(sb, &s->region);
+}
+
+static void
+map_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_map_fmt_netbsd(sb, &s->region);
+}
+
+static void
+stat_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_render_stat_line(sb, s->id, s->pctx.comm, s->pctx.state, &s->pctx,
+        s->utime, s->stime, s->prio, s->rss, s->policy);
+}
+
+static void
+statm_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_render_statm(sb, s->pctx.vsize / 4096, s->rss);
+}
+
+static void
+status_render(struct sbuf *sb, const struct sample *s)
+{
+    const struct procfs_pctx *c = &s->pctx;
+    procfs_render_status_head(sb, c->comm, c->state, c->pid, c->pid, c->ppid);
+    sbuf_cat(sb, "TracerPid:\t0\n");
+    procfs_render_status_ids(sb, "Uid:", s->ids[0], s->ids[1], s->ids[2], s->ids[1]);
+    procfs_render_status_ids(sb, "Gid:", s->ids[3], s->ids[2], s->ids[0], s->ids[2]);
+    procfs_render_status_kb(sb, "VmSize:\t", c->vsize >> 10);
+    procfs_render_status_kb(sb, "VmRSS:\t", c->rsize >> 10);
+    procfs_render_status_tail(sb, c->nthreads);
+}
+
+static void
+cpu_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_render_stat_cpu(sb, (int)(s->id % 64), s->ticks[0], s->ticks[1], s->ticks[2], s->ticks[3]);
+}
+
+static void
+loadavg_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_render_loadavg(sb, s->loads[0], s->loads[1], s->loads[2], 1,
+        s->pctx.nthreads, s->pctx.pid);
+}
+
+static void
+meminfo_render(struct sbuf *sb, const struct sample *s)
+{
+    const uint64_t *m = s->mem;
+    procfs_render_meminfo(sb, m[0], m[1], 0, m[3], m[4], m[5], m[6]);
+}
+
+static void
+sysctl_render(struct sbuf *sb, const struct sample *s)
+{
+    procfs_render_sysctl_value(sb, s->sysctl_type, s->sysctl_fmt, s->sysctl_raw, s->sysctl_len);
+}
+
+#pragma mark -
+#pragma mark Driver
+
+typedef void (*render_fn)(struct sbuf *, const struct sample *);
+
+struct format {
+    const char *name;
+    render_fn   reference;
+    render_fn   render;
+};
+
+static void
+render_all(struct sbuf *sb, render_fn fn)
+{
+    sbuf_clear(sb);
+    for (int i = 0; i < LINES; i++) {
+        fn(sb, &samples[i]);
+    }
+    sbuf_finish(sb);
+}
+
+static double
+time_ns_per_line(struct sbuf *sb, render_fn fn)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < ROUNDS; i++) {
+        render_all(sb, fn);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ((double)ROUNDS * LINES);
+}
+
+int
+main(void)
+{
+    static const struct format formats[] = {
+        { "maps",    maps_printf,    maps_render },
+        { "map",     map_printf,     map_render },
+        { "stat",    stat_printf,    stat_render },
+        { "statm",   statm_printf,   statm_render },
+        { "status",  status_printf,  status_render },
+        { "cpu",     cpu_printf,     cpu_render },
+        { "loadavg", loadavg_printf, loadavg_render },
+        { "meminfo", meminfo_printf, meminfo_render },
+        { "sysctl",  sysctl_printf,  sysctl_render },
+    };
+    int failures = 0;
+
+    make_data();
+
+    struct sbuf ref, out;
+    sbuf_new(&ref, NULL, 1 << 20, SBUF_AUTOEXTEND | SBUF_GEOMETRIC);
+    sbuf_new(&out, NULL, 1 << 20, SBUF_AUTOEXTEND | SBUF_GEOMETRIC);
+
+    printf("%-8s %8s %10s %10s %12s %9s\n",
+           "format", "B/line", "ns/line", "MB/s", "printf ns/ln", "speedup");
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        const struct format *f = &formats[i];
+
+        render_all(&ref, f->reference);
+        render_all(&out, f->render);
+        if (sbuf_len(&ref) != sbuf_len(&out) ||
+            memcmp(sbuf_data(&ref), sbuf_data(&out), (size_t)sbuf_len(&ref)) != 0) {
+            printf("  FAIL: %s output differs from the printf form\n", f->name);
+            failures++;
+            continue;
+        }
+
+        double bytes_per_line = (double)sbuf_len(&out) / LINES;
+        double ref_ns = time_ns_per_line(&ref, f->reference);
+        double ns = time_ns_per_line(&out, f->render);
+        printf("%-8s %8.1f %10.1f %10.1f %12.1f %8.2fx\n", f->name, bytes_per_line,
+               ns, bytes_per_line / ns * 1e3, ref_ns, ref_ns / ns);
+    }
+
+    sbuf_delete(&ref);
+    sbuf_delete(&out);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * bench_sbuf.c
+ *
+ * Renders large procfs-shaped outputs into an auto-extending sbuf, built
+ * from the kext's own sbuf.c, with and without SBUF_GEOMETRIC, and reports
+ * the time per render together with the number of reallocations and the
+ * bytes allocated along the way. The two renders are:
+ *
+ *   maps     ~400 KB of Linux-format maps lines (a large JVM or browser)
+ *   cpuinfo  one ~1.5 KB x86 stanza per CPU, for 128 CPUs
+ *
+ * Both modes must produce identical output.
+ *
+ *   make -C test/host bench
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/malloc.h>
+
+#include <bsdcompat/sys/sbuf.h>
+
+#define MAPS_LINES      6200
+#define CPUINFO_CPUS    128
+#define ITERATIONS      50
+
+static const char *cpu_flags =
+    "fpu vme de pse tsc msr pae mce cx8 apic sep mtrr pge mca cmov pat pse36 "
+    "clflush dts acpi mmx fxsr sse sse2 ss ht tm pbe syscall nx pdpe1gb rdtscp "
+    "lm constant_tsc arch_perfmon pebs bts rep_good nopl xtopology nonstop_tsc "
+    "cpuid aperfmperf pni pclmulqdq dtes64 monitor ds_cpl vmx smx est tm2 ssse3 "
+    "sdbg fma cx16 xtpr pdcm pcid sse4_1 sse4_2 x2apic movbe popcnt aes xsave "
+    "avx f16c rdrand lahf_lm abm 3dnowprefetch cpuid_fault epb invpcid_single "
+    "ssbd ibrs ibpb stibp tpr_shadow vnmi flexpriority ept vpid ept_ad fsgsbase "
+    "tsc_adjust bmi1 avx2 smep bmi2 erms invpcid mpx rdseed adx smap clflushopt "
+    "intel_pt xsaveopt xsavec xgetbv1 xsaves dtherm ida arat pln pts hwp";
+
+static void
+render_maps(struct sbuf *sb)
+{
+    uint64_t addr = 0x0000000100000000ULL;
+    for (int i = 0; i < MAPS_LINES; i++) {
+        uint64_t size = (uint64_t)((i % 7) + 1) * 0x4000;
+        sbuf_printf(sb, "%016llx-%016llx %c%c%c%c %016llx 00:00 0 \n",
+            (unsigned long long)addr, (unsigned long long)(addr + size),
+            'r', (i & 1) ? 'w' : '-', (i % 3 == 0) ? 'x' : '-',
+            (i % 5 == 0) ? 's' : 'p', (unsigned long long)(i * 0x1000));
+        addr += size;
+    }
+}
+
+static void
+render_cpuinfo(struct sbuf *sb)
+{
+    for (int cpu = 0; cpu < CPUINFO_CPUS; cpu++) {
+        sbuf_printf(sb,
+            "processor\t\t: %u\n"
+            "vendor_id\t\t: %s\n"
+            "cpu family\t\t: %u\n"
+            "model\t\t\t: %u\n"
+            "model name\t\t: %s\n"
+            "microcode\t\t: 0x%07x\n"
+            "stepping\t\t: %u\n"
+            "cpu MHz\t\t\t: %d.%02d\n"
+            "cache size\t\t: %d KB\n"
+            "physical id\t\t: %u\n"
+            "siblings\t\t: %u\n"
+            "core id\t\t\t: %d\n"
+            "cpu cores\t\t: %u\n"
+            "apicid\t\t\t: %u\n"
+            "fpu\t\t\t: %s\n"
+            "flags\t\t\t: %s\n"
+            "bogomips\t\t: %d.%02d\n"
+            "clflush_size\t\t: %u\n"
+            "address sizes\t\t: %d bits physical, %d bits virtual\n"
+            "power management\t: %s\n\n",
+            cpu, "GenuineIntel", 6, 158,
+            "Intel(R) Core(TM) i9-9980HK CPU @ 2.40GHz", 0xf4, 13,
+            2400, 0, 16384, 0, CPUINFO_CPUS, cpu % 8, 8, cpu * 2,
+            "yes", cpu_flags, 4800, 0, 64, 39, 48, "");
+    }
+}
+
+struct result {
+    double          ns;
+    unsigned long   allocs;
+    unsigned long   bytes;
+    int             len;
+};
+
+static struct result
+run(void (*render)(struct sbuf *), int flags, char **outp)
+{
+    struct result res = { 0, 0, 0, 0 };
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < ITERATIONS; i++) {
+        unsigned long calls = shim_malloc_calls;
+        unsigned long bytes = shim_malloc_bytes;
+
+        struct sbuf sb;
+        if (sbuf_new(&sb, NULL, 4096, flags) == NULL) {
+            fprintf(stderr, "sbuf_new failed\n");
+            exit(1);
+        }
+        render(&sb);
+        sbuf_finish(&sb);
+
+        res.allocs = shim_malloc_calls - calls;
+        res.bytes = shim_malloc_bytes - bytes;
+        res.len = sbuf_len(&sb);
+        if (i == 0 && outp != NULL) {
+            *outp = strdup(sbuf_data(&sb));
+        }
+        sbuf_delete(&sb);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    res.ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ITERATIONS;
+    return res;
+}
+
+static int
+bench(const char *name, void (*render)(struct sbuf *))
+{
+    char *paged = NULL, *geometric = NULL;
+    struct result p = run(render, SBUF_AUTOEXTEND, &paged);
+    struct result g = run(render, SBUF_AUTOEXTEND | SBUF_GEOMETRIC, &geometric);
+
+    printf("%-8s %7d bytes  paged: %8.0f ns %4lu allocs %10lu B   "
+           "geometric: %8.0f ns %4lu allocs %10lu B\n",
+           name, p.len, p.ns, p.allocs, p.bytes, g.ns, g.allocs, g.bytes);
+
+    int same = paged != NULL && geometric != NULL && strcmp(paged, geometric) == 0;
+    if (!same) {
+        printf("  FAIL: %s output differs between growth modes\n", name);
+    }
+    free(paged);
+    free(geometric);
+    return same ? 0 : 1;
+}
+
+int
+main(void)
+{
+    int failures = 0;
+    failures += bench("maps", render_maps);
+    failures += bench("cpuinfo", render_cpuinfo);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
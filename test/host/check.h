@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * check.h
+ *
+ * The pass/fail bookkeeping the host tests share: check() counts one
+ * assertion and reports it if it failed, checkf() likewise with a printf
+ * format for tests that show what they got, and check_done() prints the
+ * tally and gives main() its exit status. The counters are updated atomically, so
+ * tests may check from several threads. Each test includes this once.
+ */
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static int failures;
+static int checks;
+
+static inline void
+check(int ok, const char *what)
+{
+    __atomic_fetch_add(&checks, 1, __ATOMIC_RELAXED);
+    if (!ok) {
+        printf("  FAIL: %s\n", what);
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void checkf(int ok, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static inline void
+checkf(int ok, const char *fmt, ...)
+{
+    __atomic_fetch_add(&checks, 1, __ATOMIC_RELAXED);
+    if (!ok) {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("  FAIL: ");
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* "<name>: N checks", then PASS or FAIL; returns main()'s exit status. */
+static inline int
+check_done(const char *name)
+{
+    printf("%s: %d checks\n", name, checks);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
+
+#endif /* CHECK_H */
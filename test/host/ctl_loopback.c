@@ -0,0 +1,788 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * ctl_loopback.c
+ *
+ * In-process procfsd control loopback (see ctl_loopback.h). lb_submit(),
+ * lb_wait() and the receiver mirror procfs_ctl_submit(), procfs_ctl_wait()
+ * and procfs_ctl_send() / procfs_ctl_disconnect() in kext/procfs_ctl.c line
+ * for line; only the locking and sleeping primitives differ. The daemon
+ * loop mirrors procfsd's, and queues requests for its workers through
+ * procfsd's own procfsd_serve_queue() and procfsd_serve_take(). Each daemon is a struct lb_daemon
+ * with its own socketpair, rings, workers and receiver, as each procfsd is
+ * a connection and a procfs_ctl_link of its own.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <fs/procfs/procfs_ctl_core.h>
+#include <fs/procfs/procfs_ring.h>
+
+#include "../../tools/procfsd_sched.h"
+#include "../../tools/procfsd_serve.h"
+#include "ctl_loopback.h"
+
+/* One procfsd and its link. */
+struct lb_daemon {
+    struct loopback       *lb;
+    int                    conn;        /* its core connection */
+    int                    kfd;         /* kext end */
+    int                    dfd;         /* daemon end */
+    pthread_t              daemon;
+    pthread_t              rx;
+    struct procfsd_sources src;
+    struct procfsd_sched   sched;       /* unless cfg.fifo */
+    uint8_t               *ringmap;     /* PROCFS_CTL_RINGMAP bytes, or NULL */
+    struct procfs_ring     dreqs;       /* daemon's views; daemon thread only */
+    struct procfs_ring     dresps;      /* ditto with cfg.fifo, else under reply_lock */
+    pthread_mutex_t        reply_lock;
+    int                    ringed;      /* kext side from here; guarded by lb->lock */
+    struct procfs_ring     kreqs;       /* kext's views */
+    struct procfs_ring     kresps;
+    int                    joined;
+    uint64_t               served;      /* atomic */
+    uint32_t               wedge_us;    /* atomic; lb_wedge_daemon() */
+};
+
+struct loopback {
+    struct lb_config       cfg;
+    struct lb_daemon      *daemons[LB_DAEMONS];     /* by lb_add_daemon() index */
+    int                    ndaemons;
+
+    pthread_mutex_t        lock;
+    pthread_cond_t         cv[PROCFS_CTL_SLOTS];
+    struct procfs_ctl_core core;        /* guarded by lock */
+    struct lb_daemon      *links[PROCFS_CTL_CONNS];  /* by core connection; ditto */
+    int                    sleepers;    /* waiters in pthread_cond_timedwait; ditto */
+    struct lb_counts       counts;
+};
+
+static uint64_t
+lb_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+lb_sleep_us(uint32_t us)
+{
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        /* retry */
+    }
+}
+
+#pragma mark -
+#pragma mark Daemon side
+
+static int
+lb_source(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    struct lb_daemon *d = ctx;
+    struct loopback *lb = d->lb;
+    uint32_t delay = lb->cfg.latency_us + __atomic_load_n(&d->wedge_us, __ATOMIC_RELAXED);
+    if (lb->cfg.jitter_us != 0) {
+        /* Spread by seq: the workers share no generator state. */
+        delay += (req->seq * 2654435761u) % (lb->cfg.jitter_us + 1);
+    }
+    if (req->type == PROCFS_REQ_REGS || req->type == PROCFS_REQ_FPREGS) {
+        delay += lb->cfg.debug_us;
+    }
+    if (delay != 0) {
+        lb_sleep_us(delay);
+    }
+    if (req->pid < 0) {
+        return ESRCH;
+    }
+
+    struct lb_echo echo = { .type = req->type, .pid = req->pid, .arg = req->arg };
+    uint32_t fill = (uint32_t)(req->arg % 64);
+    if (req->type == PROCFS_REQ_THREADS) {
+        fill = (uint32_t)(req->arg % (PROCFS_CTL_MAXPAYLOAD - sizeof(echo) + 1));
+    }
+    memcpy(payload, &echo, sizeof(echo));
+    memset((uint8_t *)payload + sizeof(echo), (int)(req->pid & 0xff), fill);
+    *len = (uint32_t)sizeof(echo) + fill;
+    return 0;
+}
+
+static int
+lb_doorbell(struct loopback *lb, int fd)
+{
+    static const struct procfs_ctl_doorbell bell = { .magic = PROCFS_CTL_RINGMAGIC };
+    __atomic_fetch_add(&lb->counts.doorbells, 1, __ATOMIC_RELAXED);
+    return (int)send(fd, &bell, sizeof(bell), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* Count a served request, for the daemon and in all. */
+static void
+lb_served(struct lb_daemon *d)
+{
+    __atomic_fetch_add(&d->served, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&d->lb->counts.served, 1, __ATOMIC_RELAXED);
+}
+
+/* procfsd_reply(). Any thread. */
+static void
+lb_reply(struct lb_daemon *d, const void *reply, size_t len)
+{
+    pthread_mutex_lock(&d->reply_lock);
+    int sent = 0, ring = 0;
+    if (d->ringmap != NULL && procfs_ring_put(&d->dresps, reply, (uint32_t)len) == 0) {
+        sent = 1;
+        ring = procfs_ring_wake_needed(&d->dresps);
+    }
+    pthread_mutex_unlock(&d->reply_lock);
+
+    if (!sent) {
+        (void)send(d->dfd, reply, len, MSG_NOSIGNAL);
+    }
+    if (ring) {
+        (void)lb_doorbell(d->lb, d->dfd);
+    }
+}
+
+/* procfsd_work(), on a worker. */
+static void
+lb_work(void *ctx, const struct procfs_ctl_req *req)
+{
+    struct lb_daemon *d = ctx;
+    uint8_t sbuf[PROCFSD_REPLY_MAX];
+    size_t len = procfsd_serve_one(&d->src, req, sizeof(*req), sbuf, NULL, NULL);
+    /* Count before sending: the caller may check as soon as the reply lands. */
+    lb_served(d);
+    lb_reply(d, sbuf, len);
+}
+
+/* procfsd_unqueued(): refuse what its full queue did not take. */
+static void
+lb_unqueued(void *ctx, int result, const void *reply, size_t len, uint32_t type)
+{
+    if (result == PROCFSD_REFUSED) {
+        lb_reply(ctx, reply, len);
+    }
+}
+
+/* procfsd_queue(), on procfsd's own code. */
+static void
+lb_queue(struct lb_daemon *d, const void *dgram, size_t n)
+{
+    uint8_t  sbuf[sizeof(struct procfs_ctl_resp)];
+    size_t   len  = 0;
+    uint32_t type = 0;
+    int result = procfsd_serve_queue(&d->sched, dgram, n, sbuf, &len, &type);
+    if (result != PROCFSD_QUEUED) {
+        lb_unqueued(d, result, sbuf, len, type);
+    }
+}
+
+/* procfsd_ring_take(), on procfsd's own code. */
+static void
+lb_daemon_take(struct lb_daemon *d)
+{
+    uint32_t n = procfsd_serve_take(&d->sched, &d->dreqs, lb_unqueued, d);
+    __atomic_fetch_add(&d->lb->counts.ringed, n, __ATOMIC_RELAXED);
+}
+
+/*
+ * With cfg.fifo: serve the oldest request in the ring `reqs` in place, as
+ * procfsd did before it had classes, building the reply in the ring `resps`
+ * or, if it does not fit there for now, in `spill` with *spilled its length
+ * for the caller to send over the socket. Returns 1 if a request was
+ * served, -1 if a record was not a request and was dropped, or 0 if `reqs`
+ * is empty.
+ */
+static int
+lb_serve_ring(const struct procfsd_sources *src, struct procfs_ring *reqs,
+    struct procfs_ring *resps, void *spill, size_t *spilled)
+{
+    uint32_t n;
+    const void *rec = procfs_ring_peek(reqs, &n);
+    *spilled = 0;
+    if (rec == NULL) {
+        return 0;
+    }
+
+    int rerr;
+    void *reply = procfs_ring_reserve(resps, (uint32_t)PROCFSD_REPLY_MAX, &rerr);
+    size_t len = procfsd_serve_one(src, rec, n, reply != NULL ? reply : spill, NULL, NULL);
+    procfs_ring_consume(reqs);
+
+    if (len == 0) {
+        return -1;      /* the reservation is simply not committed */
+    }
+    if (reply != NULL) {
+        procfs_ring_commit(resps, (uint32_t)len);
+    } else {
+        *spilled = len;
+    }
+    return 1;
+}
+
+/* With cfg.fifo: serve the request ring in place. Returns -1 once the socket is gone. */
+static int
+lb_daemon_ring(struct lb_daemon *d, const struct procfsd_sources *src)
+{
+    uint8_t spill[PROCFSD_REPLY_MAX];
+    uint32_t n;
+    while (procfs_ring_peek(&d->dreqs, &n) != NULL) {
+        size_t spilled;
+        lb_served(d);
+        __atomic_fetch_add(&d->lb->counts.ringed, 1, __ATOMIC_RELAXED);
+        if (lb_serve_ring(src, &d->dreqs, &d->dresps, spill, &spilled) < 0) {
+            continue;
+        }
+        if (spilled != 0 && send(d->dfd, spill, spilled, MSG_NOSIGNAL) < 0) {
+            return -1;
+        }
+        if (procfs_ring_wake_needed(&d->dresps)) {
+            (void)lb_doorbell(d->lb, d->dfd);
+        }
+    }
+    return 0;
+}
+
+/* procfsd's request loop, minus reconnecting and reporting. */
+static void *
+lb_daemon(void *arg)
+{
+    struct lb_daemon *d = arg;
+    struct loopback *lb = d->lb;
+    const struct procfsd_sources *src = &d->src;
+
+    for (;;) {
+        if (d->ringmap != NULL) {
+            if (!lb->cfg.fifo) {
+                lb_daemon_take(d);
+            } else if (lb_daemon_ring(d, src) < 0) {
+                break;
+            }
+            if (!procfs_ring_sleep_ok(&d->dreqs)) {
+                continue;
+            }
+        }
+        uint8_t rbuf[256];
+        ssize_t n = recv(d->dfd, rbuf, sizeof(rbuf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        uint32_t magic;
+        memcpy(&magic, rbuf, sizeof(magic));
+        if ((size_t)n >= sizeof(magic) && magic == PROCFS_CTL_RINGMAGIC) {
+            continue;       /* the ring is looked at on the way round */
+        }
+        if (!lb->cfg.fifo) {
+            lb_queue(d, rbuf, (size_t)n);
+            continue;
+        }
+        uint8_t sbuf[PROCFSD_REPLY_MAX];
+        size_t len = procfsd_serve_one(src, rbuf, (size_t)n, sbuf, NULL, NULL);
+        if (len == 0) {
+            continue;
+        }
+        /* Count before sending: the caller may check as soon as the reply lands. */
+        lb_served(d);
+        if (send(d->dfd, sbuf, len, MSG_NOSIGNAL) < 0) {
+            break;
+        }
+    }
+    if (!lb->cfg.fifo) {
+        procfsd_sched_stop(&d->sched);
+    }
+    return NULL;
+}
+
+#pragma mark -
+#pragma mark Kext side
+
+/* procfs_ctl_wake(). Called with lb->lock held. */
+static void
+lb_wake(struct loopback *lb, uint32_t mask)
+{
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        if (mask & (1u << i)) {
+            pthread_cond_signal(&lb->cv[i]);
+        }
+    }
+}
+
+/* procfs_ctl_ring_drain(). Called with lb->lock held. */
+static void
+lb_ring_drain(struct loopback *lb)
+{
+    const void *rec;
+    uint32_t len;
+
+    for (int c = 0; c < PROCFS_CTL_CONNS; c++) {
+        struct lb_daemon *d = lb->links[c];
+        if (d == NULL || !d->ringed) {
+            continue;
+        }
+        do {
+            while ((rec = procfs_ring_peek(&d->kresps, &len)) != NULL) {
+                int slot = procfs_ctl_core_reply(&lb->core, rec, len);
+                if (slot >= 0) {
+                    lb_wake(lb, procfs_ctl_core_wakes(&lb->core, slot));
+                } else {
+                    lb->counts.stale++;
+                }
+                procfs_ring_consume(&d->kresps);
+            }
+        } while (lb->sleepers > 0 && !procfs_ring_sleep_ok(&d->kresps));
+        if (procfs_ring_broken(&d->kresps)) {
+            d->ringed = 0;
+        }
+    }
+}
+
+/* procfs_ctl_send() and, at end of stream, procfs_ctl_disconnect(). */
+static void *
+lb_receiver(void *arg)
+{
+    struct lb_daemon *d = arg;
+    struct loopback *lb = d->lb;
+    for (;;) {
+        uint8_t buf[PROCFSD_REPLY_MAX];
+        ssize_t n = recv(d->kfd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        uint32_t magic;
+        memcpy(&magic, buf, sizeof(magic));
+        pthread_mutex_lock(&lb->lock);
+        if ((size_t)n >= sizeof(struct procfs_ctl_doorbell) && magic == PROCFS_CTL_RINGMAGIC) {
+            lb_ring_drain(lb);
+            pthread_mutex_unlock(&lb->lock);
+            continue;
+        }
+        int slot = procfs_ctl_core_reply(&lb->core, buf, (size_t)n);
+        if (slot >= 0) {
+            lb_wake(lb, procfs_ctl_core_wakes(&lb->core, slot));
+        } else {
+            lb->counts.stale++;
+        }
+        pthread_mutex_unlock(&lb->lock);
+    }
+
+    pthread_mutex_lock(&lb->lock);
+    lb_ring_drain(lb);
+    d->ringed = 0;
+    lb->links[d->conn] = NULL;
+    lb_wake(lb, procfs_ctl_core_detach(&lb->core, d->conn, ENOTCONN));
+    pthread_mutex_unlock(&lb->lock);
+    return NULL;
+}
+
+int
+lb_submit(struct loopback *lb, uint32_t type, int pid, uint64_t arg, void *out,
+    uint32_t outcap, uint64_t timeout_ns, struct lb_pending *pc)
+{
+    pc->slot      = -1;
+    pc->error     = 0;
+    pc->truncated = 0;
+    pc->type      = type;
+    pc->conn      = -1;
+    pc->admit     = PROCFS_CTL_BRK_REJECT;
+
+    struct procfs_ctl_req req;
+    pthread_mutex_lock(&lb->lock);
+    int slot = lb->cfg.coalesce ?
+        procfs_ctl_core_join(&lb->core, type, pid, arg, out, outcap) : -1;
+    if (slot >= 0) {
+        pthread_mutex_unlock(&lb->lock);
+        pc->deadline = lb_now_ns() + timeout_ns;
+        pc->slot     = slot;
+        return 0;
+    }
+    int conn = procfs_ctl_core_pick(&lb->core, lb_now_ns(), &pc->admit);
+    if (conn < 0) {
+        pthread_mutex_unlock(&lb->lock);
+        pc->error = pc->admit == PROCFS_CTL_BRK_REJECT ? EHOSTDOWN : ENOTCONN;
+        pc->admit = PROCFS_CTL_BRK_REJECT;
+        return pc->error;
+    }
+    pc->conn = conn;
+    slot = procfs_ctl_core_submit(&lb->core, conn, type, pid, arg, out, outcap, &req);
+    if (slot < 0) {
+        lb->counts.busy++;
+        procfs_ctl_core_judge(&lb->core, conn, type, lb_now_ns(), pc->admit, EBUSY);
+        pthread_mutex_unlock(&lb->lock);
+        pc->error = EBUSY;
+        return EBUSY;
+    }
+    lb->core.slots[slot].admit = pc->admit;
+    /* Daemons are only freed by lb_stop(), so d outlives the lock. */
+    struct lb_daemon *d = lb->links[conn];
+    pc->deadline = lb_now_ns() + timeout_ns;
+
+    if (d->ringed && procfs_ring_put(&d->kreqs, &req, sizeof(req)) == 0) {
+        int ring = procfs_ring_wake_needed(&d->kreqs);
+        pthread_mutex_unlock(&lb->lock);
+        if (ring) {
+            (void)lb_doorbell(lb, d->kfd);
+        }
+        pc->slot = slot;
+        return 0;
+    }
+    pthread_mutex_unlock(&lb->lock);
+
+    /* ctl_enqueuedata() does not block either: a full queue is ENOBUFS. */
+    if (send(d->kfd, &req, sizeof(req), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        int e = (errno == EAGAIN || errno == EWOULDBLOCK) ? ENOBUFS : errno;
+        pthread_mutex_lock(&lb->lock);
+        procfs_ctl_core_complete(&lb->core, slot, e, 0);
+        lb_wake(lb, procfs_ctl_core_wakes(&lb->core, slot));
+        procfs_ctl_core_release(&lb->core, slot);
+        procfs_ctl_core_judge(&lb->core, conn, type, lb_now_ns(), pc->admit, e);
+        pthread_mutex_unlock(&lb->lock);
+        pc->error = e;
+        return e;
+    }
+    pc->slot = slot;
+    return 0;
+}
+
+int
+lb_ready(struct loopback *lb, const struct lb_pending *pc)
+{
+    if (pc->slot < 0) {
+        return 1;
+    }
+    pthread_mutex_lock(&lb->lock);
+    lb_ring_drain(lb);
+    int done = lb->core.slots[pc->slot].done;
+    pthread_mutex_unlock(&lb->lock);
+    return done;
+}
+
+int
+lb_wait(struct loopback *lb, struct lb_pending *pc, uint32_t *outlen)
+{
+    int slot = pc->slot;
+    if (slot < 0) {
+        return pc->error;
+    }
+
+    struct timespec ts = {
+        .tv_sec  = (time_t)(pc->deadline / 1000000000ULL),
+        .tv_nsec = (long)(pc->deadline % 1000000000ULL),
+    };
+    int error;
+    pthread_mutex_lock(&lb->lock);
+    while (!lb->core.slots[slot].done) {
+        lb->sleepers++;
+        lb_ring_drain(lb);
+        if (lb->core.slots[slot].done) {
+            lb->sleepers--;
+            break;
+        }
+        int r = pthread_cond_timedwait(&lb->cv[slot], &lb->lock, &ts);
+        lb->sleepers--;
+        if (r == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (lb->core.slots[slot].done) {
+        boolean_t truncated = FALSE;
+        error = procfs_ctl_core_collect(&lb->core, slot, outlen, &truncated);
+        pc->truncated = truncated;
+    } else {
+        error = ETIMEDOUT;  /* no signals here, so past the deadline */
+    }
+    pc->conn = procfs_ctl_core_judged_by(&lb->core, slot, &pc->admit);
+    procfs_ctl_core_release(&lb->core, slot);
+    if (pc->admit != PROCFS_CTL_BRK_REJECT) {
+        procfs_ctl_core_judge(&lb->core, pc->conn, pc->type, lb_now_ns(), pc->admit, error);
+    }
+    pthread_mutex_unlock(&lb->lock);
+
+    pc->slot  = -1;
+    pc->error = error;
+    return error;
+}
+
+void
+lb_cancel(struct loopback *lb, struct lb_pending *pc)
+{
+    if (pc->slot < 0) {
+        return;
+    }
+    pthread_mutex_lock(&lb->lock);
+    pc->conn = procfs_ctl_core_judged_by(&lb->core, pc->slot, &pc->admit);
+    procfs_ctl_core_release(&lb->core, pc->slot);
+    if (pc->admit != PROCFS_CTL_BRK_REJECT) {
+        procfs_ctl_core_judge(&lb->core, pc->conn, pc->type, lb_now_ns(), pc->admit, ECANCELED);
+    }
+    pthread_mutex_unlock(&lb->lock);
+    pc->slot  = -1;
+    pc->error = ECANCELED;
+}
+
+int
+lb_request(struct loopback *lb, uint32_t type, int pid, uint64_t arg, void *out,
+    uint32_t outcap, uint32_t *outlen, uint64_t timeout_ns)
+{
+    struct lb_pending pc;
+    (void)lb_submit(lb, type, pid, arg, out, outcap, timeout_ns, &pc);
+    return lb_wait(lb, &pc, outlen);
+}
+
+#pragma mark -
+#pragma mark Setup
+
+static void
+lb_daemon_free(struct lb_daemon *d)
+{
+    close(d->kfd);
+    close(d->dfd);
+    pthread_mutex_destroy(&d->reply_lock);
+    free(d->ringmap);
+    free(d);
+}
+
+int
+lb_add_daemon(struct loopback *lb)
+{
+    if (lb->ndaemons == LB_DAEMONS) {
+        return -1;
+    }
+    struct lb_daemon *d = calloc(1, sizeof(*d));
+    if (d == NULL) {
+        return -1;
+    }
+    d->lb      = lb;
+    d->src.ctx = d;
+    for (int t = 1; t <= PROCFS_REQ_THREADS; t++) {
+        d->src.fn[t] = lb_source;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0) {
+        free(d);
+        return -1;
+    }
+    d->kfd = sv[0];
+    d->dfd = sv[1];
+    pthread_mutex_init(&d->reply_lock, NULL);
+
+    /* procfsd's mmap() and setsockopt(PROCFS_CTL_OPT_RING), both sides' procfs_ring_init(). */
+    if (lb->cfg.ring) {
+        uint32_t size = PROCFS_CTL_RINGSIZE;
+        void *map;
+        if (posix_memalign(&map, PROCFS_CTL_RINGHDR, PROCFS_CTL_RINGMAP(size)) != 0) {
+            lb_daemon_free(d);
+            return -1;
+        }
+        d->ringmap = map;
+        uint8_t *base = map;
+        struct procfs_ring_shared *rq = (void *)(base + PROCFS_CTL_RING_REQS);
+        struct procfs_ring_shared *rs = (void *)(base + PROCFS_CTL_RING_RESPS);
+        uint8_t *dq = base + PROCFS_CTL_RINGHDR;
+        uint8_t *ds = base + PROCFS_CTL_RINGHDR + size;
+        procfs_ring_init(&d->kreqs, rq, dq, size, 1);
+        procfs_ring_init(&d->kresps, rs, ds, size, 1);
+        procfs_ring_init(&d->dreqs, rq, dq, size, 0);
+        procfs_ring_init(&d->dresps, rs, ds, size, 0);
+        d->ringed = 1;
+    }
+
+    static const uint32_t workers[PROCFS_CTL_NPRIO] = {
+        [PROCFS_CTL_PRIO_FAST]  = PROCFSD_WORKERS_FAST,
+        [PROCFS_CTL_PRIO_BULK]  = PROCFSD_WORKERS_BULK,
+        [PROCFS_CTL_PRIO_DEBUG] = PROCFSD_WORKERS_DEBUG,
+    };
+    if (!lb->cfg.fifo && procfsd_sched_start(&d->sched, workers, lb_work, d) != 0) {
+        lb_daemon_free(d);
+        return -1;
+    }
+
+    /* procfs_ctl_connect(). */
+    pthread_mutex_lock(&lb->lock);
+    d->conn = procfs_ctl_core_attach(&lb->core);
+    if (d->conn >= 0) {
+        lb->links[d->conn] = d;
+    }
+    pthread_mutex_unlock(&lb->lock);
+    if (d->conn < 0) {
+        goto fail;
+    }
+
+    if (pthread_create(&d->daemon, NULL, lb_daemon, d) != 0) {
+        goto detach;
+    }
+    if (pthread_create(&d->rx, NULL, lb_receiver, d) != 0) {
+        shutdown(d->dfd, SHUT_RDWR);
+        pthread_join(d->daemon, NULL);
+        goto detach;
+    }
+    lb->daemons[lb->ndaemons] = d;
+    return lb->ndaemons++;
+
+detach:
+    pthread_mutex_lock(&lb->lock);
+    lb->links[d->conn] = NULL;
+    (void)procfs_ctl_core_detach(&lb->core, d->conn, ENOTCONN);
+    pthread_mutex_unlock(&lb->lock);
+fail:
+    if (!lb->cfg.fifo) {
+        procfsd_sched_stop(&d->sched);
+    }
+    lb_daemon_free(d);
+    return -1;
+}
+
+struct loopback *
+lb_start(const struct lb_config *cfg)
+{
+    struct loopback *lb = calloc(1, sizeof(*lb));
+    if (lb == NULL) {
+        return NULL;
+    }
+    lb->cfg = *cfg;
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_mutex_init(&lb->lock, NULL);
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        pthread_cond_init(&lb->cv[i], &ca);
+    }
+    pthread_condattr_destroy(&ca);
+    procfs_ctl_core_tune(&lb->core, cfg->brk_threshold, cfg->brk_backoff_ms);
+
+    if (lb_add_daemon(lb) < 0) {
+        lb_stop(lb);
+        return NULL;
+    }
+    return lb;
+}
+
+int
+lb_inflight(struct loopback *lb)
+{
+    int n = 0;
+    pthread_mutex_lock(&lb->lock);
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        n += lb->core.slots[i].in_use ? 1 : 0;
+    }
+    pthread_mutex_unlock(&lb->lock);
+    return n;
+}
+
+struct lb_counts
+lb_counts(struct loopback *lb)
+{
+    pthread_mutex_lock(&lb->lock);
+    struct lb_counts c = lb->counts;
+    c.coalesced = lb->core.counts.coalesced;
+    c.handoffs  = lb->core.counts.handoffs;
+    struct procfs_ctl_breaker_counts brk = procfs_ctl_core_brk_counts(&lb->core);
+    c.misses    = brk.misses;
+    c.opened    = brk.opened;
+    pthread_mutex_unlock(&lb->lock);
+    c.served    = __atomic_load_n(&lb->counts.served, __ATOMIC_RELAXED);
+    c.ringed    = __atomic_load_n(&lb->counts.ringed, __ATOMIC_RELAXED);
+    c.doorbells = __atomic_load_n(&lb->counts.doorbells, __ATOMIC_RELAXED);
+    return c;
+}
+
+uint64_t
+lb_daemon_served(struct loopback *lb, int daemon)
+{
+    return __atomic_load_n(&lb->daemons[daemon]->served, __ATOMIC_RELAXED);
+}
+
+uint32_t
+lb_outstanding(struct loopback *lb, int daemon)
+{
+    struct lb_daemon *d = lb->daemons[daemon];
+    pthread_mutex_lock(&lb->lock);
+    uint32_t n = d->joined ? 0 : procfs_ctl_core_outstanding(&lb->core, d->conn);
+    pthread_mutex_unlock(&lb->lock);
+    return n;
+}
+
+void
+lb_wedge_daemon(struct loopback *lb, int daemon, uint32_t delay_us)
+{
+    __atomic_store_n(&lb->daemons[daemon]->wedge_us, delay_us, __ATOMIC_RELAXED);
+}
+
+uint32_t
+lb_brk_state(struct loopback *lb, int daemon)
+{
+    pthread_mutex_lock(&lb->lock);
+    uint32_t state = lb->core.conns[lb->daemons[daemon]->conn].brk.state;
+    pthread_mutex_unlock(&lb->lock);
+    return state;
+}
+
+void
+lb_disconnect_daemon(struct loopback *lb, int daemon)
+{
+    struct lb_daemon *d = lb->daemons[daemon];
+    if (d->joined) {
+        return;
+    }
+    /* Shutting the daemon's end ends both its loop and the receiver's stream. */
+    shutdown(d->dfd, SHUT_RDWR);
+    pthread_join(d->daemon, NULL);
+    pthread_join(d->rx, NULL);
+    d->joined = 1;
+}
+
+int
+lb_drain(struct loopback *lb, int daemon, uint64_t timeout_ns)
+{
+    struct lb_daemon *d = lb->daemons[daemon];
+    if (d->joined) {
+        return 0;
+    }
+    /* procfsd_drain(): setsockopt(PROCFS_CTL_OPT_DRAIN), then getsockopt until 0. */
+    pthread_mutex_lock(&lb->lock);
+    procfs_ctl_core_drain(&lb->core, d->conn);
+    pthread_mutex_unlock(&lb->lock);
+
+    uint64_t until = lb_now_ns() + timeout_ns;
+    uint32_t left;
+    while ((left = lb_outstanding(lb, daemon)) != 0 && lb_now_ns() < until) {
+        lb_sleep_us(1000);
+    }
+    lb_disconnect_daemon(lb, daemon);
+    return left == 0 ? 0 : ETIMEDOUT;
+}
+
+void
+lb_disconnect(struct loopback *lb)
+{
+    for (int i = 0; i < lb->ndaemons; i++) {
+        lb_disconnect_daemon(lb, i);
+    }
+}
+
+void
+lb_stop(struct loopback *lb)
+{
+    lb_disconnect(lb);
+    for (int i = 0; i < lb->ndaemons; i++) {
+        lb_daemon_free(lb->daemons[i]);
+    }
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        pthread_cond_destroy(&lb->cv[i]);
+    }
+    pthread_mutex_destroy(&lb->lock);
+    free(lb);
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * ctl_loopback.h
+ *
+ * The procfsd control protocol end to end in one process. The kext side is
+ * kext/procfs_ctl_core.c driven the way procfs_ctl.c drives it, with a mutex
+ * and per-slot condition variables standing in for lck_mtx and msleep; the
+ * daemon side is tools/procfsd_serve.c with synthetic data sources. The two
+ * talk over an AF_UNIX SOCK_SEQPACKET socketpair, which like the kernel
+ * control keeps datagram boundaries and reports the peer going away. With
+ * `ring` set they exchange requests and replies through a pair of
+ * procfs_ring.h rings laid out as PROCFS_CTL_OPT_RING has them, and the
+ * socketpair only carries doorbells.
+ *
+ * More daemons can be connected with lb_add_daemon(), each on a socketpair
+ * (and rings) of its own, as several procfsd connect to the kext; requests
+ * are spread over them by procfs_ctl_core_pick(). A daemon can then crash
+ * (lb_disconnect_daemon), drain and exit as procfsd does on SIGTERM
+ * (lb_drain), or wedge (lb_wedge_daemon). Every request is judged by its
+ * connection's breaker as procfs_ctl_wait() and _cancel() judge it; the
+ * breakers only open with `brk_threshold` set.
+ *
+ * With `coalesce` set, lb_submit() first tries procfs_ctl_core_join() as
+ * procfs_ctl_submit() does by default, so identical requests in flight
+ * share one answer; it is off otherwise, so tests that fill the slots with
+ * the same request still fill them.
+ *
+ * Like procfsd, the daemon queues requests by priority class for
+ * tools/procfsd_sched.c's workers, as many per class as procfsd runs. With
+ * `fifo` set it serves them one at a time in arrival order instead, as
+ * procfsd did before it had classes, to measure what the classes buy.
+ *
+ * The synthetic sources answer every request type with an echo of the
+ * request (struct lb_echo) followed by `arg % 64` filler bytes - for
+ * PROCFS_REQ_THREADS `arg` bytes, up to a full payload - after the
+ * configured delay. A negative pid answers ESRCH.
+ */
+#ifndef CTL_LOOPBACK_H
+#define CTL_LOOPBACK_H
+
+#include <stdint.h>
+
+#define LB_DAEMONS  8       /* lb_add_daemon() calls, over a loopback's life */
+
+struct lb_config {
+    uint32_t latency_us;    /* delay before each answer */
+    uint32_t jitter_us;     /* plus up to this much more, uniformly */
+    uint32_t debug_us;      /* plus this for PROCFS_REQ_REGS and _FPREGS */
+    int      ring;          /* use the shared-memory rings */
+    int      fifo;          /* one daemon thread, no priority classes */
+    int      coalesce;      /* identical requests in flight share one */
+    uint32_t brk_threshold; /* procfs_ctl_core_tune()'s; 0 never opens */
+    uint32_t brk_backoff_ms;
+};
+
+struct lb_echo {
+    uint32_t type;
+    int32_t  pid;
+    uint64_t arg;
+};
+
+struct lb_counts {
+    uint64_t served;        /* requests the daemon answered */
+    uint64_t stale;         /* replies nobody was waiting for any more */
+    uint64_t busy;          /* requests refused with EBUSY: every slot taken */
+    uint64_t coalesced;     /* requests that rode on an identical one */
+    uint64_t handoffs;      /* riders that took over from a leader giving up */
+    uint64_t ringed;        /* requests the daemon took from the request ring */
+    uint64_t doorbells;     /* doorbells sent, either way */
+    uint64_t misses;        /* deadlines the breakers counted missed */
+    uint64_t opened;        /* breakers opened */
+};
+
+/* A request in flight, as procfs_ctl_pending_t. */
+struct lb_pending {
+    int      slot;          /* -1 once finished, or if the submit failed */
+    int      error;         /* the result, once slot is -1 */
+    int      truncated;     /* the reply had more than the buffer took */
+    uint64_t deadline;      /* CLOCK_MONOTONIC ns */
+    uint32_t type;
+    int      conn;          /* the core connection it went to, or its leader's */
+    int      admit;         /* PROCFS_CTL_BRK_REJECT if nothing to judge */
+};
+
+struct loopback;
+
+/* Start the daemon (number 0) and its reply receiver. Returns NULL on failure. */
+struct loopback *lb_start(const struct lb_config *cfg);
+
+/*
+ * Connect one more daemon. Returns its number, or -1 if it could not start
+ * or the kext refused it (PROCFS_CTL_CONNS are connected).
+ */
+int lb_add_daemon(struct loopback *lb);
+
+/*
+ * procfs_ctl_request() over the loopback, waiting at most `timeout_ns` for
+ * the reply. Same results: 0, ENOTCONN, EBUSY, ETIMEDOUT, ENOBUFS (the
+ * request queue is full) or the daemon's errno.
+ */
+int lb_request(struct loopback *lb, uint32_t type, int pid, uint64_t arg, void *out,
+    uint32_t outcap, uint32_t *outlen, uint64_t timeout_ns);
+
+/*
+ * procfs_ctl_submit(), _ready(), _wait() and _cancel() over the loopback;
+ * the reply deadline is `timeout_ns` after the submit, and its payload is
+ * delivered to `out` from the receiver thread.
+ */
+int lb_submit(struct loopback *lb, uint32_t type, int pid, uint64_t arg, void *out,
+    uint32_t outcap, uint64_t timeout_ns, struct lb_pending *pc);
+int lb_ready(struct loopback *lb, const struct lb_pending *pc);
+int lb_wait(struct loopback *lb, struct lb_pending *pc, uint32_t *outlen);
+void lb_cancel(struct loopback *lb, struct lb_pending *pc);
+
+/* Requests currently holding a slot. */
+int lb_inflight(struct loopback *lb);
+
+struct lb_counts lb_counts(struct loopback *lb);
+
+/* Requests daemon `daemon` answered. */
+uint64_t lb_daemon_served(struct loopback *lb, int daemon);
+
+/* Requests sent to daemon `daemon` and not yet completed, as PROCFS_CTL_OPT_DRAIN reads. */
+uint32_t lb_outstanding(struct loopback *lb, int daemon);
+
+/* Daemon `daemon` takes `delay_us` more over every answer from now on, 0 to recover. */
+void lb_wedge_daemon(struct loopback *lb, int daemon, uint32_t delay_us);
+
+/* Daemon `daemon`'s breaker state, a PROCFS_CTL_BRK_ value. */
+uint32_t lb_brk_state(struct loopback *lb, int daemon);
+
+/* Daemon `daemon` goes away at once, as ctl_disconnect reports a procfsd crash. */
+void lb_disconnect_daemon(struct loopback *lb, int daemon);
+
+/*
+ * Daemon `daemon` drains and exits, as procfsd on SIGTERM: it gets no new
+ * requests, and goes once it owes none or after `timeout_ns`. Returns 0, or
+ * ETIMEDOUT if it went with requests outstanding.
+ */
+int lb_drain(struct loopback *lb, int daemon, uint64_t timeout_ns);
+
+/* Every daemon goes away. */
+void lb_disconnect(struct loopback *lb);
+
+/* Disconnect if still connected, then free everything. */
+void lb_stop(struct loopback *lb);
+
+#endif /* CTL_LOOPBACK_H */
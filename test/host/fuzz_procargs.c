@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * fuzz_procargs.c
+ *
+ * Fuzz target for the argument-area parser (kext/procfs_procargs.c). Each
+ * input is a 2-byte little-endian signed argc followed by the area itself;
+ * the parser must agree with the byte-at-a-time reference (procargs_ref.h),
+ * keep its offsets ordered and in bounds, and never read outside the input.
+ *
+ * Built normally, main() drives it over generated areas - well-formed ones
+ * with random argc, truncation and byte mutations, and raw byte soup - under
+ * AddressSanitizer, which is what `make check` runs. Given file arguments it
+ * replays them instead. With libFuzzer (clang, -DPROCFS_LIBFUZZER):
+ *
+ *   make -C test/host fuzz && ./fuzz_procargs_lf -max_len=70000
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fs/procfs/procfs_procargs.h>
+
+#include "procargs_ref.h"
+
+static int failures;
+
+static void
+fail(const char *what, size_t len, int argc)
+{
+    if (failures++ < 10) {
+        printf("  FAIL: %s (len %zu, argc %d)\n", what, len, argc);
+    }
+#ifdef PROCFS_LIBFUZZER
+    abort();                                    /* let libFuzzer save the input */
+#endif
+}
+
+static void
+check_area(const uint8_t *area, size_t len, int argc)
+{
+    struct procfs_procargs got, want;
+
+    procfs_procargs_parse(area, len, argc, &got);
+    ref_procargs_parse(area, len, argc, &want);
+
+    if (got.argv_off != want.argv_off || got.env_off != want.env_off ||
+        got.apple_off != want.apple_off) {
+        fail("offsets differ from reference", len, argc);
+    }
+    if (!(got.argv_off <= got.env_off && got.env_off <= got.apple_off &&
+          got.apple_off <= len)) {
+        fail("offsets out of order or bounds", len, argc);
+    }
+
+    /* The scanner alone, from every start in the first and last words. */
+    for (size_t i = 0; i < len; i++) {
+        if (i == 16 && len > 32) {
+            i = len - 16;
+        }
+        if (procfs_procargs_strnlen(area + i, len - i) != ref_strnlen(area + i, len - i)) {
+            fail("strnlen differs from reference", len, argc);
+            break;
+        }
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 2) {
+        return 0;
+    }
+    int argc = (int16_t)(data[0] | (data[1] << 8));
+    check_area(data + 2, size - 2, argc);
+    return 0;
+}
+
+#ifndef PROCFS_LIBFUZZER
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rnd(uint32_t bound)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return bound != 0 ? (uint32_t)(rng % bound) : 0;
+}
+
+/* Append a random string from a small alphabet rich in NUL-adjacent bytes. */
+static size_t
+put_string(uint8_t *p, size_t room, size_t maxlen)
+{
+    static const char alpha[] = "abcdefghijklmnopqrstuvwxyz=/_.\x01\x80\xff";
+    size_t n = rnd((uint32_t)maxlen + 1);
+
+    if (n + 1 > room) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (uint8_t)alpha[rnd(sizeof(alpha) - 1)];
+    }
+    p[n] = '\0';
+    return n + 1;
+}
+
+/* A well-formed area: path, padding, argv, env and an apple[] section. */
+static size_t
+gen_area(uint8_t *p, size_t room, int *argcp)
+{
+    size_t len = 0, n;
+    int argc = (int)rnd(12);
+    int envc = (int)rnd(20);
+    size_t maxlen = rnd(4) == 0 ? 300 : 24;
+
+    len += put_string(p + len, room - len, maxlen);
+    for (uint32_t pad = rnd(12); pad > 0 && len < room; pad--) {
+        p[len++] = '\0';
+    }
+    for (int i = 0; i < argc; i++) {
+        len += put_string(p + len, room - len, maxlen);
+    }
+    for (int i = 0; i < envc; i++) {
+        len += put_string(p + len, room - len, maxlen);
+    }
+    if (rnd(4) != 0) {
+        static const char key[] = PROCFS_EXEC_KEY;
+        n = rnd(3) == 0 ? rnd(sizeof(key) - 1) : sizeof(key) - 1;   /* maybe short */
+        if (len + n < room) {
+            memcpy(p + len, key, n);
+            len += n;
+            len += put_string(p + len, room - len, maxlen);
+        }
+        for (uint32_t i = rnd(8); i > 0; i--) {
+            len += put_string(p + len, room - len, maxlen);
+        }
+    }
+
+    *argcp = argc;
+    return len;
+}
+
+static void
+run_one(const uint8_t *src, size_t len, int argc)
+{
+    /* An exact-size copy, so ASan catches any read past the end. */
+    uint8_t *area = malloc(len != 0 ? len : 1);
+    memcpy(area, src, len);
+    check_area(area, len, argc);
+    free(area);
+}
+
+static int
+replay(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        static uint8_t in[1 << 20];
+        size_t n = fread(in, 1, sizeof(in), f);
+        fclose(f);
+        uint8_t *copy = malloc(n != 0 ? n : 1);
+        memcpy(copy, in, n);
+        LLVMFuzzerTestOneInput(copy, n);
+        free(copy);
+    }
+    printf("procargs fuzz: replayed %d inputs\n", argc - 1);
+    return failures == 0 ? 0 : 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    static uint8_t work[16384];
+    long runs = 0;
+
+    if (argc > 1) {
+        return replay(argc, argv);
+    }
+
+    for (int iter = 0; iter < 40000; iter++) {
+        int nargs;
+        size_t len = gen_area(work, sizeof(work), &nargs);
+
+        switch (rnd(7)) {
+        case 0:                                 /* argc off by a little */
+            nargs += (int)rnd(5) - 2;
+            break;
+        case 1:                                 /* nonsense argc */
+            nargs = rnd(2) ? -(int)rnd(1000) : (int)rnd(100000);
+            break;
+        case 2:                                 /* truncated mid-string */
+            len = rnd((uint32_t)len + 1);
+            break;
+        case 3:                                 /* terminators flipped */
+            for (uint32_t m = rnd(8) + 1; m > 0 && len > 0; m--) {
+                size_t at = rnd((uint32_t)len);
+                work[at] = work[at] == '\0' ? 'x' : '\0';
+            }
+            break;
+        case 4:                                 /* byte soup */
+            len = rnd(600);
+            for (size_t i = 0; i < len; i++) {
+                work[i] = rnd(3) == 0 ? 0 : (uint8_t)rnd(256);
+            }
+            break;
+        case 5:                                 /* key planted anywhere */
+            for (uint32_t m = rnd(3) + 1; m > 0 && len > 16; m--) {
+                memcpy(work + rnd((uint32_t)len - 15), PROCFS_EXEC_KEY, rnd(2) ? 16 : 2);
+            }
+            break;
+        default:
+            break;
+        }
+        run_one(work, len, nargs);
+        runs++;
+    }
+
+    /* No terminator anywhere, at every length around the word size. */
+    memset(work, 'a', sizeof(work));
+    for (size_t len = 0; len < 64; len++, runs++) {
+        run_one(work, len, 1);
+    }
+    run_one(work, sizeof(work), 3);
+    runs++;
+
+    printf("procargs fuzz: %ld areas\n", runs);
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    return failures == 0 ? 0 : 1;
+}
+
+#endif /* !PROCFS_LIBFUZZER */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * kpi_shim.c
+ *
+ * Userspace stand-ins for the handful of kernel KPIs that the host-built
+ * kext sources use (memory tags, BSD malloc and mutexes). See shim/ for the
+ * headers.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <kern/locks.h>
+#include <libkern/OSMalloc.h>
+#include <sys/malloc.h>
+
+struct __OSMallocTag__ {
+    const char *name;
+};
+
+struct lck_grp {
+    const char *name;
+};
+
+static struct __OSMallocTag__ shim_tag = { "shim" };
+static struct lck_grp shim_grp = { "shim" };
+
+OSMallocTag
+OSMalloc_Tagalloc(const char *name, __attribute__((unused)) uint32_t flags)
+{
+    shim_tag.name = name;
+    return &shim_tag;
+}
+
+void
+OSMalloc_Tagfree(__attribute__((unused)) OSMallocTag tag)
+{
+}
+
+void *
+OSMalloc(uint32_t size, __attribute__((unused)) OSMallocTag tag)
+{
+    return malloc(size);
+}
+
+void
+OSFree(void *addr, __attribute__((unused)) uint32_t size, __attribute__((unused)) OSMallocTag tag)
+{
+    free(addr);
+}
+
+unsigned long shim_malloc_calls;
+unsigned long shim_malloc_bytes;
+
+void *
+_MALLOC(size_t size, __attribute__((unused)) int type, int flags)
+{
+    shim_malloc_calls++;
+    shim_malloc_bytes += size;
+    void *addr = malloc(size);
+    if (addr != NULL && (flags & M_ZERO)) {
+        memset(addr, 0, size);
+    }
+    return addr;
+}
+
+void
+_FREE(void *addr, __attribute__((unused)) int type)
+{
+    free(addr);
+}
+
+lck_grp_t *
+lck_grp_alloc_init(const char *name, __attribute__((unused)) lck_grp_attr_t *attr)
+{
+    shim_grp.name = name;
+    return &shim_grp;
+}
+
+void
+lck_grp_free(__attribute__((unused)) lck_grp_t *grp)
+{
+}
+
+lck_mtx_t *
+lck_mtx_alloc_init(__attribute__((unused)) lck_grp_t *grp, __attribute__((unused)) lck_attr_t *attr)
+{
+    lck_mtx_t *mtx = malloc(sizeof(*mtx));
+    if (mtx != NULL) {
+        pthread_mutex_init(&mtx->m, NULL);
+    }
+    return mtx;
+}
+
+void
+lck_mtx_free(lck_mtx_t *mtx, __attribute__((unused)) lck_grp_t *grp)
+{
+    pthread_mutex_destroy(&mtx->m);
+    free(mtx);
+}
+
+void
+lck_mtx_lock(lck_mtx_t *mtx)
+{
+    pthread_mutex_lock(&mtx->m);
+}
+
+void
+lck_mtx_unlock(lck_mtx_t *mtx)
+{
+    pthread_mutex_unlock(&mtx->m);
+}
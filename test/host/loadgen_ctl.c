@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * loadgen_ctl.c
+ *
+ * Load generator for the procfsd control protocol over the in-process
+ * loopback (ctl_loopback.h): `-c` threads issue `-n` requests in total as
+ * fast as they can, against a daemon that takes `-l` microseconds (plus up
+ * to `-j` of jitter) per answer, each request waiting at most `-t`
+ * milliseconds. It reports throughput, the latency distribution of the
+ * requests (from the attempt that got a slot), how many attempts were
+ * refused with EBUSY because all slots were in flight - those are retried
+ * here, where the kext would fall back - and how many requests timed out,
+ * found the daemon's queue full (ENOBUFS) or failed otherwise. `-r` carries
+ * the requests through the shared-memory rings instead of the socket.
+ *
+ * With no options it runs a small sweep of concurrency and daemon latency
+ * over each transport, which is what `make bench` shows.
+ *
+ *   make -C test/host loadgen_ctl
+ *   ./loadgen_ctl -c 32 -n 50000 -l 100 -j 50 -t 2000 -r
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fs/procfs/procfs_ctl.h>
+
+#include "ctl_loopback.h"
+
+struct run {
+    int              conc;
+    uint64_t         total;
+    uint32_t         latency_us;
+    uint32_t         jitter_us;
+    uint64_t         timeout_ns;
+    int              ring;
+};
+
+struct loader {
+    struct loopback *lb;
+    const struct run *run;
+    uint64_t         next;      /* shared request counter */
+    uint64_t        *lat;       /* ns per request */
+    uint64_t         nlat;
+    uint64_t         ok, busy, timedout, nobufs, other;
+};
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void *
+loader(void *arg)
+{
+    struct loader *ld = arg;
+    static const uint32_t types[] = {
+        PROCFS_REQ_TASKINFO, PROCFS_REQ_THREADINFO, PROCFS_REQ_TASKINFO, PROCFS_REQ_LOADAVG,
+    };
+
+    for (;;) {
+        uint64_t i = __atomic_fetch_add(&ld->next, 1, __ATOMIC_RELAXED);
+        if (i >= ld->run->total) {
+            break;
+        }
+        uint8_t  out[PROCFS_CTL_MAXPAYLOAD];
+        uint32_t len;
+        uint64_t t0;
+        int e;
+        for (;;) {
+            t0 = now_ns();
+            e = lb_request(ld->lb, types[i % 4], (int)(i % 30000) + 1, i, out, sizeof(out),
+                &len, ld->run->timeout_ns);
+            if (e != EBUSY) {
+                break;
+            }
+            __atomic_fetch_add(&ld->busy, 1, __ATOMIC_RELAXED);
+            sched_yield();              /* a kext caller falls back; we try again */
+        }
+        uint64_t dt = now_ns() - t0;
+
+        switch (e) {
+        case 0:
+            __atomic_fetch_add(&ld->ok, 1, __ATOMIC_RELAXED);
+            break;
+        case ETIMEDOUT:
+            __atomic_fetch_add(&ld->timedout, 1, __ATOMIC_RELAXED);
+            break;
+        case ENOBUFS:
+            __atomic_fetch_add(&ld->nobufs, 1, __ATOMIC_RELAXED);
+            break;
+        default:
+            __atomic_fetch_add(&ld->other, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        ld->lat[__atomic_fetch_add(&ld->nlat, 1, __ATOMIC_RELAXED)] = dt;
+    }
+    return NULL;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double
+pct_us(const uint64_t *v, uint64_t n, double p)
+{
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t i = (uint64_t)(p * (double)(n - 1) + 0.5);
+    return (double)v[i] / 1000.0;
+}
+
+static int
+run_one(const struct run *run)
+{
+    struct lb_config cfg = {
+        .latency_us = run->latency_us,
+        .jitter_us  = run->jitter_us,
+        .ring       = run->ring,
+    };
+    struct loader ld = { .run = run };
+    ld.lat = malloc(run->total * sizeof(*ld.lat));
+    pthread_t *th = calloc((size_t)run->conc, sizeof(*th));
+    ld.lb = lb_start(&cfg);
+    if (ld.lat == NULL || th == NULL || ld.lb == NULL) {
+        fprintf(stderr, "loadgen_ctl: setup failed\n");
+        return 1;
+    }
+
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < run->conc; i++) {
+        pthread_create(&th[i], NULL, loader, &ld);
+    }
+    for (int i = 0; i < run->conc; i++) {
+        pthread_join(th[i], NULL);
+    }
+    double secs = (double)(now_ns() - t0) / 1e9;
+    struct lb_counts c = lb_counts(ld.lb);
+    lb_stop(ld.lb);
+
+    qsort(ld.lat, ld.nlat, sizeof(*ld.lat), cmp_u64);
+    printf("%-6s  conc %3d  daemon %5uus +%-4uus  %7llu req  %9.0f req/s  "
+        "p50 %8.1fus  p99 %8.1fus  p99.9 %8.1fus  max %8.1fus  "
+        "ok %llu  ebusy %llu  timeout %llu  nobufs %llu  other %llu  stale %llu  doorbells %llu\n",
+        run->ring ? "ring" : "socket", run->conc, run->latency_us, run->jitter_us, (unsigned long long)run->total,
+        (double)ld.ok / secs,
+        pct_us(ld.lat, ld.nlat, 0.50), pct_us(ld.lat, ld.nlat, 0.99),
+        pct_us(ld.lat, ld.nlat, 0.999), ld.nlat ? (double)ld.lat[ld.nlat - 1] / 1000.0 : 0.0,
+        (unsigned long long)ld.ok, (unsigned long long)ld.busy,
+        (unsigned long long)ld.timedout, (unsigned long long)ld.nobufs,
+        (unsigned long long)ld.other,
+        (unsigned long long)c.stale, (unsigned long long)c.doorbells);
+
+    free(th);
+    free(ld.lat);
+    return 0;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: loadgen_ctl [-c threads] [-n requests] [-l daemon_us] "
+        "[-j jitter_us] [-t timeout_ms] [-r]\n");
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct run run = {
+        .conc       = 8,
+        .total      = 20000,
+        .latency_us = 0,
+        .jitter_us  = 0,
+        .timeout_ns = 2000 * 1000000ULL,
+    };
+    int custom = 0;
+    int ch;
+    while ((ch = getopt(argc, argv, "c:n:l:j:t:r")) != -1) {
+        if (ch == 'r') {
+            run.ring = 1;
+            custom   = 1;
+            continue;
+        }
+        long v = strtol(optarg, NULL, 10);
+        if (v < 0 || (v == 0 && (ch == 'c' || ch == 'n' || ch == 't'))) {
+            usage();
+        }
+        switch (ch) {
+        case 'c': run.conc       = (int)v; break;
+        case 'n': run.total      = (uint64_t)v; break;
+        case 'l': run.latency_us = (uint32_t)v; break;
+        case 'j': run.jitter_us  = (uint32_t)v; break;
+        case 't': run.timeout_ns = (uint64_t)v * 1000000ULL; break;
+        default:  usage();
+        }
+        custom = 1;
+    }
+    if (custom) {
+        return run_one(&run);
+    }
+
+    /*
+     * The daemon answers one request at a time, so with any latency the
+     * slots fill: past PROCFS_CTL_INFLIGHT callers the rest are refused, and a
+     * deadline shorter than the queueing delay times requests out while
+     * their datagrams still fill the daemon's queue. Each row runs over the
+     * socket, then over the rings.
+     */
+    static const struct { int conc; uint32_t lat, jit; uint64_t n, timeout_ms; } sweep[] = {
+        {  1,   0,  0, 20000, 2000 },
+        {  8,   0,  0, 40000, 2000 },
+        { 32,   0,  0, 40000, 2000 },
+        {  8,  50, 25,  4000, 2000 },
+        { 32,  50, 25,  4000, 2000 },
+        { 32,  50, 25,  4000,    1 },
+    };
+    for (size_t i = 0; i < sizeof(sweep) / sizeof(sweep[0]); i++) {
+        run.conc       = sweep[i].conc;
+        run.total      = sweep[i].n;
+        run.latency_us = sweep[i].lat;
+        run.jitter_us  = sweep[i].jit;
+        run.timeout_ns = sweep[i].timeout_ms * 1000000ULL;
+        for (run.ring = 0; run.ring <= 1; run.ring++) {
+            if (run_one(&run) != 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procargs_ref.h
+ *
+ * The byte-at-a-time argument-area parser procfs_read_procargs() used before
+ * kext/procfs_procargs.c, kept as the oracle for fuzz_procargs and the
+ * baseline for bench_procargs. ref_strnlen() is the plain C loop the kernel's
+ * generic strnlen() is, not the host libc's vectorised one.
+ */
+#ifndef _TEST_HOST_PROCARGS_REF_H_
+#define _TEST_HOST_PROCARGS_REF_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fs/procfs/procfs_procargs.h>
+
+static size_t
+ref_strnlen(const uint8_t *s, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && s[i] != '\0') {
+        i++;
+    }
+    return i;
+}
+
+static void
+ref_procargs_parse(const uint8_t *buf, size_t n, int argc, struct procfs_procargs *pa)
+{
+    size_t pos = ref_strnlen(buf, n);
+    if (pos < n) {
+        pos++;
+        while (pos < n && buf[pos] == '\0') {
+            pos++;
+        }
+    }
+    pa->argv_off = pos;
+
+    for (int got = 0; got < argc && pos < n; got++) {
+        size_t remaining = n - pos;
+        size_t arglen = ref_strnlen(buf + pos, remaining);
+        if (arglen < remaining) {
+            arglen++;
+        }
+        pos += arglen;
+    }
+    pa->env_off = pos;
+
+    const size_t keylen = sizeof(PROCFS_EXEC_KEY) - 1;
+    size_t apple = n;
+    for (size_t scan = pos; scan < n; ) {
+        size_t remaining = n - scan;
+        if (remaining >= keylen && memcmp(buf + scan, PROCFS_EXEC_KEY, keylen) == 0) {
+            apple = scan;
+            break;
+        }
+        size_t slen = ref_strnlen(buf + scan, remaining);
+        if (slen == remaining) {
+            break;
+        }
+        scan += slen + 1;
+    }
+    pa->apple_off = apple;
+}
+
+#endif /* _TEST_HOST_PROCARGS_REF_H_ */
@@ -0,0 +1,5 @@
+/* Host shim: <kern/assert.h> */
+#ifndef SHIM_KERN_ASSERT_H
+#define SHIM_KERN_ASSERT_H
+#include <assert.h>
+#endif
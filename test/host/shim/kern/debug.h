@@ -0,0 +1,7 @@
+/* Host shim: <kern/debug.h> */
+#ifndef SHIM_KERN_DEBUG_H
+#define SHIM_KERN_DEBUG_H
+#include <stdio.h>
+#include <stdlib.h>
+#define panic(...)  do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); abort(); } while (0)
+#endif
@@ -0,0 +1,22 @@
+/* Host shim: <kern/locks.h> */
+#ifndef SHIM_KERN_LOCKS_H
+#define SHIM_KERN_LOCKS_H
+#include <pthread.h>
+
+typedef struct lck_grp      lck_grp_t;
+typedef struct lck_grp_attr lck_grp_attr_t;
+typedef struct lck_attr     lck_attr_t;
+typedef struct lck_mtx {
+    pthread_mutex_t         m;
+} lck_mtx_t;
+
+#define LCK_GRP_ATTR_NULL   ((lck_grp_attr_t *)0)
+#define LCK_ATTR_NULL       ((lck_attr_t *)0)
+
+lck_grp_t *lck_grp_alloc_init(const char *name, lck_grp_attr_t *attr);
+void       lck_grp_free(lck_grp_t *grp);
+lck_mtx_t *lck_mtx_alloc_init(lck_grp_t *grp, lck_attr_t *attr);
+void       lck_mtx_free(lck_mtx_t *mtx, lck_grp_t *grp);
+void       lck_mtx_lock(lck_mtx_t *mtx);
+void       lck_mtx_unlock(lck_mtx_t *mtx);
+#endif
@@ -0,0 +1,14 @@
+/* Host shim: <libkern/OSMalloc.h> */
+#ifndef SHIM_LIBKERN_OSMALLOC_H
+#define SHIM_LIBKERN_OSMALLOC_H
+#include <stdint.h>
+
+typedef struct __OSMallocTag__ *OSMallocTag;
+
+#define OSMT_DEFAULT    0
+
+OSMallocTag OSMalloc_Tagalloc(const char *name, uint32_t flags);
+void        OSMalloc_Tagfree(OSMallocTag tag);
+void       *OSMalloc(uint32_t size, OSMallocTag tag);
+void        OSFree(void *addr, uint32_t size, OSMallocTag tag);
+#endif
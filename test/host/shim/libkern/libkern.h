@@ -0,0 +1,29 @@
+/* Host shim: <libkern/libkern.h> */
+#ifndef SHIM_LIBKERN_LIBKERN_H
+#define SHIM_LIBKERN_LIBKERN_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifndef min
+#define min(a, b)   ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)   ((a) > (b) ? (a) : (b))
+#endif
+
+/* BSD string helpers that older C libraries lack. */
+static inline size_t
+shim_strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size != 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#define strlcpy shim_strlcpy
+#endif
@@ -0,0 +1,9 @@
+/* Host shim: <libkext/libkext.h> */
+#ifndef SHIM_LIBKEXT_H
+#define SHIM_LIBKEXT_H
+#include <libkern/libkern.h>
+
+#define STATIC          static
+#define BUNDLEID_S      "com.beako.filesystems.procfs"
+#define ARRAY_SIZE(a)   (sizeof(a) / sizeof(*(a)))
+#endif
@@ -0,0 +1,52 @@
+/* Host shim: <mach-o/loader.h> - the 64-bit header and the load commands procfs_ksyms reads. */
+#ifndef SHIM_MACH_O_LOADER_H
+#define SHIM_MACH_O_LOADER_H
+#include <stdint.h>
+
+struct mach_header_64 {
+    uint32_t magic;
+    int32_t  cputype;
+    int32_t  cpusubtype;
+    uint32_t filetype;
+    uint32_t ncmds;
+    uint32_t sizeofcmds;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+#define MH_MAGIC_64         0xfeedfacf
+#define MH_EXECUTE          0x2
+#define MH_FILESET          0xc
+
+struct load_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+};
+
+#define LC_REQ_DYLD         0x80000000
+#define LC_SYMTAB           0x2
+#define LC_SEGMENT_64       0x19
+#define LC_FILESET_ENTRY    (0x35 | LC_REQ_DYLD)
+
+union lc_str {
+    uint32_t offset;
+};
+
+struct symtab_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+    uint32_t symoff;
+    uint32_t nsyms;
+    uint32_t stroff;
+    uint32_t strsize;
+};
+
+struct fileset_entry_command {
+    uint32_t     cmd;
+    uint32_t     cmdsize;
+    uint64_t     vmaddr;
+    uint64_t     fileoff;
+    union lc_str entry_id;
+    uint32_t     reserved;
+};
+#endif
@@ -0,0 +1,18 @@
+/* Host shim: <mach-o/nlist.h> */
+#ifndef SHIM_MACH_O_NLIST_H
+#define SHIM_MACH_O_NLIST_H
+#include <stdint.h>
+
+struct nlist_64 {
+    union {
+        uint32_t n_strx;
+    } n_un;
+    uint8_t  n_type;
+    uint8_t  n_sect;
+    uint16_t n_desc;
+    uint64_t n_value;
+};
+
+#define N_EXT   0x01
+#define N_SECT  0xe
+#endif
@@ -0,0 +1,11 @@
+/* Host shim: <mach/boolean.h> */
+#ifndef SHIM_MACH_BOOLEAN_H
+#define SHIM_MACH_BOOLEAN_H
+typedef int boolean_t;
+#ifndef TRUE
+#define TRUE    1
+#endif
+#ifndef FALSE
+#define FALSE   0
+#endif
+#endif
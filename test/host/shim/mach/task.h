@@ -0,0 +1,8 @@
+/* Host shim: <mach/task.h> */
+#ifndef SHIM_MACH_TASK_H
+#define SHIM_MACH_TASK_H
+#include <mach/boolean.h>
+typedef int kern_return_t;
+#define KERN_SUCCESS    0
+#define KERN_FAILURE    5
+#endif
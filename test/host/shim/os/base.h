@@ -0,0 +1,5 @@
+/* Host shim: <os/base.h> */
+#ifndef SHIM_OS_BASE_H
+#define SHIM_OS_BASE_H
+#define OS_WARN_RESULT  __attribute__((__warn_unused_result__))
+#endif
@@ -0,0 +1,7 @@
+/* Host shim: <os/overflow.h> */
+#ifndef SHIM_OS_OVERFLOW_H
+#define SHIM_OS_OVERFLOW_H
+#define os_add_overflow(a, b, res)  __builtin_add_overflow((a), (b), (res))
+#define os_sub_overflow(a, b, res)  __builtin_sub_overflow((a), (b), (res))
+#define os_mul_overflow(a, b, res)  __builtin_mul_overflow((a), (b), (res))
+#endif
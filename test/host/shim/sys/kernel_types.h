@@ -0,0 +1,21 @@
+/* Host shim: <sys/kernel_types.h> */
+#ifndef SHIM_SYS_KERNEL_TYPES_H
+#define SHIM_SYS_KERNEL_TYPES_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <mach/boolean.h>
+
+typedef struct vnode       *vnode_t;
+typedef struct mount       *mount_t;
+typedef struct proc        *proc_t;
+typedef struct uio         *uio_t;
+typedef struct ucred       *kauth_cred_t;
+typedef struct vfs_context *vfs_context_t;
+
+#ifndef __unused
+#define __unused    __attribute__((unused))
+#endif
+
+#define NULLVP      ((vnode_t)0)
+#define PROC_NULL   ((proc_t)0)
+#endif
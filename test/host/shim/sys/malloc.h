@@ -0,0 +1,19 @@
+/* Host shim: <sys/malloc.h> */
+#ifndef SHIM_SYS_MALLOC_H
+#define SHIM_SYS_MALLOC_H
+/* Declare the C library allocator before <bsdcompat/sys/malloc.h> redefines malloc/free. */
+#include <stdlib.h>
+#include <stddef.h>
+
+#define M_TEMP      80
+#define M_WAITOK    0x0000
+#define M_NOWAIT    0x0001
+#define M_ZERO      0x0004
+
+void *_MALLOC(size_t size, int type, int flags);
+void  _FREE(void *addr, int type);
+
+/* Allocation counters kept by kpi_shim.c, for tests and benchmarks. */
+extern unsigned long shim_malloc_calls;
+extern unsigned long shim_malloc_bytes;
+#endif
@@ -0,0 +1,8 @@
+/* Host shim: <sys/mount.h> */
+#ifndef SHIM_SYS_MOUNT_H
+#define SHIM_SYS_MOUNT_H
+#include <sys/kernel_types.h>
+
+struct mount;
+void *vfs_fsprivate(mount_t mp);
+#endif
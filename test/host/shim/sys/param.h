@@ -0,0 +1,16 @@
+/* Host shim: <sys/param.h>, plus the kernel page-size constants */
+#ifndef SHIM_SYS_PARAM_H
+#define SHIM_SYS_PARAM_H
+#include_next <sys/param.h>
+#include <limits.h>
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE   4096
+#endif
+#ifndef MAXCOMLEN
+#define MAXCOMLEN   16
+#endif
+#ifndef PAGE_MASK
+#define PAGE_MASK   (PAGE_SIZE - 1)
+#endif
+#endif
@@ -0,0 +1,13 @@
+/* Host shim: <sys/proc_info.h>. Only the sizes of these records matter to
+ * the code under test, so they are opaque placeholders. */
+#ifndef SHIM_SYS_PROC_INFO_H
+#define SHIM_SYS_PROC_INFO_H
+#include <stdint.h>
+
+struct proc_bsdshortinfo       { uint8_t opaque[64]; };
+struct proc_taskinfo           { uint8_t opaque[96]; };
+struct proc_threadinfo         { uint8_t opaque[104]; };
+struct vnode_fdinfowithpath    { uint8_t opaque[1200]; };
+struct socket_fdinfo           { uint8_t opaque[792]; };
+struct proc_fdinfo             { int32_t proc_fd; uint32_t proc_fdtype; };
+#endif
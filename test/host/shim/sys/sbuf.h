@@ -0,0 +1,40 @@
+/* Host shim: <sys/sbuf.h> (layout and flags as in XNU) */
+#ifndef SHIM_SYS_SBUF_H
+#define SHIM_SYS_SBUF_H
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct sbuf {
+    char    *s_buf;
+    void    *s_unused;
+    int      s_size;
+    int      s_len;
+    int      s_flags;
+#define SBUF_FIXEDLEN   0x00000000
+#define SBUF_AUTOEXTEND 0x00000001
+#define SBUF_USRFLAGMSK 0x0000ffff
+#define SBUF_DYNAMIC    0x00010000
+#define SBUF_FINISHED   0x00020000
+#define SBUF_OVERFLOWED 0x00040000
+#define SBUF_DYNSTRUCT  0x00080000
+};
+
+struct sbuf *sbuf_new(struct sbuf *, char *, int, int);
+void         sbuf_clear(struct sbuf *);
+int          sbuf_setpos(struct sbuf *, int);
+int          sbuf_bcat(struct sbuf *, const void *, size_t);
+int          sbuf_bcpy(struct sbuf *, const void *, size_t);
+int          sbuf_cat(struct sbuf *, const char *);
+int          sbuf_cpy(struct sbuf *, const char *);
+int          sbuf_printf(struct sbuf *, const char *, ...) __attribute__((format(printf, 2, 3)));
+int          sbuf_vprintf(struct sbuf *, const char *, va_list) __attribute__((format(printf, 2, 0)));
+int          sbuf_putc(struct sbuf *, int);
+int          sbuf_trim(struct sbuf *);
+int          sbuf_overflowed(struct sbuf *);
+void         sbuf_finish(struct sbuf *);
+char        *sbuf_data(struct sbuf *);
+int          sbuf_len(struct sbuf *);
+int          sbuf_done(struct sbuf *);
+void         sbuf_delete(struct sbuf *);
+#endif
@@ -0,0 +1,11 @@
+/* Host shim: <sys/sysctl.h> (oid kinds only) */
+#ifndef SHIM_SYS_SYSCTL_H
+#define SHIM_SYS_SYSCTL_H
+#define CTLTYPE         0xf
+#define CTLTYPE_NODE    1
+#define CTLTYPE_INT     2
+#define CTLTYPE_STRING  3
+#define CTLTYPE_QUAD    4
+#define CTLTYPE_OPAQUE  5
+#define CTLTYPE_STRUCT  CTLTYPE_OPAQUE
+#endif
@@ -0,0 +1,9 @@
+/* Host shim: <sys/vnode.h> */
+#ifndef SHIM_SYS_VNODE_H
+#define SHIM_SYS_VNODE_H
+#include <sys/kernel_types.h>
+
+enum vtype { VNON, VREG, VDIR, VBLK, VCHR, VLNK, VSOCK, VFIFO, VBAD, VSTR, VCPLX };
+
+void *vnode_fsnode(vnode_t vp);
+#endif
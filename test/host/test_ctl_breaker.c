@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_ctl_breaker.c
+ *
+ * Tests for the procfsd bridge's circuit breaker (kext/procfs_ctl_breaker.c):
+ * it opens after the configured misses in a row and not before, fails fast
+ * while open, lets exactly one probe through once the backoff is over,
+ * closes when the probe is answered and backs off twice as long when it is
+ * not, and ignores results that say nothing about the daemon.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fs/procfs/procfs_ctl_breaker.h>
+
+#include "check.h"
+
+#define MS  1000000ULL
+
+/* One request through the breaker at `now`: admitted, it finishes with `error`. */
+static int
+request(struct procfs_ctl_breaker *b, uint64_t now, int error)
+{
+    int admit = procfs_ctl_breaker_admit(b, now);
+    if (admit != PROCFS_CTL_BRK_REJECT) {
+        procfs_ctl_breaker_done(b, now, admit, error);
+    }
+    return admit;
+}
+
+static void
+test_open(void)
+{
+    struct procfs_ctl_breaker b;
+    procfs_ctl_breaker_init(&b, 3, 100);
+    check(b.state == PROCFS_CTL_BRK_CLOSED, "starts closed");
+
+    /* Misses must be in a row: an answer in between starts the count over. */
+    check(request(&b, 0, ETIMEDOUT) == PROCFS_CTL_BRK_PASS, "closed passes");
+    request(&b, 0, ETIMEDOUT);
+    request(&b, 0, ESRCH);
+    check(b.state == PROCFS_CTL_BRK_CLOSED && b.missed == 0, "a daemon errno is an answer");
+    request(&b, 0, ETIMEDOUT);
+    request(&b, 0, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_CLOSED, "two misses stay closed");
+
+    /* Results that never reached the daemon neither count nor reset. */
+    request(&b, 0, EBUSY);
+    request(&b, 0, ENOTCONN);
+    request(&b, 0, ECANCELED);
+    request(&b, 0, EINTR);
+    check(b.state == PROCFS_CTL_BRK_CLOSED && b.missed == 2, "moot results ignored");
+
+    request(&b, 10 * MS, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_OPEN && b.counts.opened == 1 && b.counts.misses == 5,
+        "third miss in a row opens");
+    check(b.until == 110 * MS, "open for the backoff");
+
+    /* Open: everything fails fast until the backoff is over. */
+    check(procfs_ctl_breaker_admit(&b, 10 * MS) == PROCFS_CTL_BRK_REJECT &&
+        procfs_ctl_breaker_admit(&b, 109 * MS) == PROCFS_CTL_BRK_REJECT &&
+        b.counts.rejected == 2, "open rejects");
+
+    /* Requests admitted before it opened change nothing now. */
+    procfs_ctl_breaker_done(&b, 20 * MS, PROCFS_CTL_BRK_PASS, 0);
+    procfs_ctl_breaker_done(&b, 20 * MS, PROCFS_CTL_BRK_PASS, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_OPEN && b.until == 110 * MS, "stragglers ignored while open");
+}
+
+static void
+test_probe(void)
+{
+    struct procfs_ctl_breaker b;
+    procfs_ctl_breaker_init(&b, 1, 100);
+    request(&b, 0, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_OPEN, "threshold 1 opens at once");
+
+    /* One probe, and nothing else while it is out. */
+    int probe = procfs_ctl_breaker_admit(&b, 100 * MS);
+    check(probe == PROCFS_CTL_BRK_PROBE && b.state == PROCFS_CTL_BRK_HALFOPEN &&
+        b.counts.probes == 1, "probe after the backoff");
+    check(procfs_ctl_breaker_admit(&b, 100 * MS) == PROCFS_CTL_BRK_REJECT, "one probe at a time");
+
+    /* A missed probe doubles the wait, up to the cap. */
+    procfs_ctl_breaker_done(&b, 200 * MS, probe, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_OPEN && b.counts.reopened == 1 && b.until == 400 * MS,
+        "missed probe reopens for twice as long");
+    uint64_t now = 400 * MS, last = 0;
+    for (int i = 0; i < PROCFS_CTL_BRK_SHIFT_MAX + 3; i++) {
+        probe = procfs_ctl_breaker_admit(&b, now);
+        procfs_ctl_breaker_done(&b, now, probe, ETIMEDOUT);
+        last = now;
+        now  = b.until;
+    }
+    check(b.shift == PROCFS_CTL_BRK_SHIFT_MAX &&
+        b.until - last == (100ULL << PROCFS_CTL_BRK_SHIFT_MAX) * MS, "backoff capped");
+
+    /* A probe that never reached the daemon hands over to the next request. */
+    probe = procfs_ctl_breaker_admit(&b, now);
+    procfs_ctl_breaker_done(&b, now, probe, EBUSY);
+    check(b.state == PROCFS_CTL_BRK_OPEN && b.until == now, "moot probe reopens for no time");
+    probe = procfs_ctl_breaker_admit(&b, now);
+    check(probe == PROCFS_CTL_BRK_PROBE, "next request probes");
+
+    /* Answered: closed, and the backoff starts over. */
+    uint64_t closed = b.counts.closed;
+    procfs_ctl_breaker_done(&b, now, probe, 0);
+    check(b.state == PROCFS_CTL_BRK_CLOSED && b.counts.closed == closed + 1 && b.shift == 0,
+        "answered probe closes");
+    check(request(&b, now, 0) == PROCFS_CTL_BRK_PASS, "closed passes again");
+    request(&b, now, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_OPEN && b.until == now + 100 * MS, "backoff starts over");
+}
+
+static void
+test_reset(void)
+{
+    struct procfs_ctl_breaker b;
+    procfs_ctl_breaker_init(&b, 2, 100);
+    request(&b, 0, ETIMEDOUT);
+    procfs_ctl_breaker_reset(&b);
+    check(b.counts.closed == 0 && b.missed == 0, "reset while closed counts nothing");
+    request(&b, 0, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_CLOSED, "reset cleared the misses");
+    request(&b, 0, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_OPEN, "open");
+
+    int probe = procfs_ctl_breaker_admit(&b, 100 * MS);
+    procfs_ctl_breaker_reset(&b);       /* a new daemon connected */
+    check(b.state == PROCFS_CTL_BRK_CLOSED && b.counts.closed == 1, "reset closes");
+    procfs_ctl_breaker_done(&b, 5000 * MS, probe, ETIMEDOUT);
+    check(b.state == PROCFS_CTL_BRK_CLOSED && b.counts.reopened == 0,
+        "a probe from before the reset is ignored");
+
+    /* Threshold 0 never opens. */
+    procfs_ctl_breaker_init(&b, 0, 100);
+    for (int i = 0; i < 100; i++) {
+        request(&b, 0, ETIMEDOUT);
+    }
+    check(b.state == PROCFS_CTL_BRK_CLOSED && b.counts.misses == 100, "threshold 0 disables");
+}
+
+int
+main(void)
+{
+    test_open();
+    test_probe();
+    test_reset();
+
+    return check_done("ctl breaker");
+}
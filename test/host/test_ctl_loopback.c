@@ -0,0 +1,1262 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_ctl_loopback.c
+ *
+ * Tests for the procfsd control protocol: the kext's slot table and reply
+ * matching (kext/procfs_ctl_core.c) and procfsd's dispatch
+ * (tools/procfsd_serve.c) on their own, then both together over the
+ * socketpair loopback - replies reach the right waiter under concurrency,
+ * daemon errors pass through, the EBUSY, timeout, stale-reply and
+ * disconnect paths behave as the kext relies on, and several requests can
+ * be in flight from one caller through the submit/wait calls, a burst of
+ * slow register reads does not delay loadavg, and identical requests from
+ * many readers at once are sent once. The loopback tests run
+ * twice: over the socket, then over the shared-memory rings.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fs/procfs/procfs_ctl_core.h>
+#include <fs/procfs/procfs_ring.h>
+
+#include "../../tools/procfsd_serve.h"
+#include "ctl_loopback.h"
+#include "check.h"
+
+static int ring;        /* the transport the loopback tests run over */
+
+#define MS  1000000ULL
+#define SEC 1000000000ULL
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * SEC + (uint64_t)ts.tv_nsec;
+}
+
+static void
+wait_inflight(struct loopback *lb, int n)
+{
+    for (int i = 0; i < 2000 && lb_inflight(lb) < n; i++) {
+        usleep(1000);
+    }
+}
+
+/* A reply datagram: header, then `plen` bytes of `fill`, claiming `claim` bytes. */
+static size_t
+make_reply(uint8_t *buf, uint32_t seq, int error, uint32_t claim, uint32_t plen, int fill)
+{
+    struct procfs_ctl_resp resp = { .magic = PROCFS_CTL_MAGIC, .seq = seq, .error = error, .len = claim };
+    memcpy(buf, &resp, sizeof(resp));
+    memset(buf + sizeof(resp), fill, plen);
+    return sizeof(resp) + plen;
+}
+
+#pragma mark -
+#pragma mark Slot table
+
+static void
+test_core(void)
+{
+    static struct procfs_ctl_core core;
+    struct procfs_ctl_req req;
+    uint8_t buf[PROCFSD_REPLY_MAX], out[64];
+    uint32_t len;
+    boolean_t trunc;
+
+    memset(out, 0, sizeof(out));
+    int c = procfs_ctl_core_attach(&core);
+    check(c == 0, "first connection");
+    int s = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 42, 7, out, 4, &req);
+    check(s == 0, "first submit takes slot 0");
+    check(req.magic == PROCFS_CTL_MAGIC && req.seq == 1 && req.type == PROCFS_REQ_TASKINFO &&
+        req.pid == 42 && req.arg == 7, "request datagram");
+
+    /* Wrong seq, seq 0 and bad magic are all dropped. */
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, 2, 0, 4, 4, 'x')) == -1, "unknown seq dropped");
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, 0, 0, 4, 4, 'x')) == -1, "seq 0 dropped");
+    make_reply(buf, 1, 0, 4, 4, 'x');
+    buf[0] ^= 1;
+    check(procfs_ctl_core_reply(&core, buf, sizeof(struct procfs_ctl_resp) + 4) == -1, "bad magic dropped");
+    check(procfs_ctl_core_reply(&core, buf, sizeof(struct procfs_ctl_resp) - 1) == -1, "short datagram dropped");
+    check(!core.slots[0].done, "slot still waiting");
+
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, 1, 0, 10, 10, 'a')) == 0, "reply matched");
+    check(core.slots[0].done, "slot done");
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, 1, 0, 10, 10, 'b')) == -1, "duplicate reply dropped");
+    len   = 0;
+    trunc = FALSE;
+    check(procfs_ctl_core_collect(&core, 0, &len, &trunc) == 0 && len == 4 && trunc &&
+        memcmp(out, "aaaa", 4) == 0, "reply cut to the caller's buffer, and flagged");
+    check(out[4] == 0, "nothing written past the caller's buffer");
+    procfs_ctl_core_release(&core, 0);
+
+    /* The payload lands in the buffer registered at submit; a late reply does not. */
+    s = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 42, 7, out, sizeof(out), &req);
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, req.seq, 0, 10, 10, 'e')) == s &&
+        procfs_ctl_core_collect(&core, s, &len, &trunc) == 0 && len == 10 && !trunc &&
+        out[0] == 'e' && out[9] == 'e' && out[10] == 0, "whole reply delivered in place");
+    procfs_ctl_core_release(&core, s);
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, req.seq, 0, 10, 10, 'f')) == -1 &&
+        out[0] == 'e', "released buffer not written");
+    s = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 42, 7, NULL, 64, &req);
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, req.seq, 0, 10, 10, 'g')) == s &&
+        procfs_ctl_core_collect(&core, s, &len, &trunc) == 0 && len == 0 && trunc,
+        "no buffer takes nothing");
+    procfs_ctl_core_release(&core, s);
+
+    /* A reply shorter than its header claims completes with EIO. */
+    s = procfs_ctl_core_submit(&core, c, PROCFS_REQ_LOADAVG, 1, 0, out, sizeof(out), &req);
+    check(s == 0 && req.seq == 4, "released slot reused with a new seq");
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, 4, 0, 12, 8, 'c')) == 0, "short reply matched");
+    check(procfs_ctl_core_collect(&core, 0, &len, NULL) == EIO && core.slots[0].len == 0,
+        "short reply is EIO");
+    procfs_ctl_core_release(&core, 0);
+
+    /* A claimed length past the maximum is clamped, and an error has no payload. */
+    static uint8_t big[PROCFS_CTL_MAXPAYLOAD];
+    s = procfs_ctl_core_submit(&core, c, PROCFS_REQ_LOADAVG, 1, 0, big, sizeof(big), &req);
+    make_reply(buf, req.seq, 0, 0xffffffffu, PROCFS_CTL_MAXPAYLOAD, 'd');
+    check(procfs_ctl_core_reply(&core, buf, PROCFSD_REPLY_MAX) == s &&
+        core.slots[s].len == PROCFS_CTL_MAXPAYLOAD && !core.slots[s].truncated,
+        "oversized length clamped");
+    procfs_ctl_core_release(&core, s);
+    s = procfs_ctl_core_submit(&core, c, PROCFS_REQ_LOADAVG, 1, 0, out, sizeof(out), &req);
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, req.seq, ESRCH, 0, 0, 0)) == s, "error reply matched");
+    len = 12345;
+    check(procfs_ctl_core_collect(&core, s, &len, NULL) == ESRCH && len == 12345,
+        "error leaves outlen alone");
+    procfs_ctl_core_release(&core, s);
+
+    /* As many in flight as may be: the next submit fails. */
+    for (int i = 0; i < PROCFS_CTL_INFLIGHT; i++) {
+        check(procfs_ctl_core_submit(&core, c, 1, i, 0, out, sizeof(out), &req) == i, "fill slots");
+    }
+    check(procfs_ctl_core_submit(&core, c, 1, 99, 0, out, sizeof(out), &req) == -1, "full table refuses");
+
+    /* Failing all completes just the ones still waiting. */
+    uint32_t seq3 = core.slots[3].seq;
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, seq3, 0, 0, 0, 0)) == 3, "slot 3 answered");
+    uint32_t mask = procfs_ctl_core_fail_all(&core, ENOTCONN);
+    check(mask == (((1u << PROCFS_CTL_INFLIGHT) - 1) & ~(1u << 3)), "fail_all mask skips answered slots");
+    check(procfs_ctl_core_collect(&core, 5, &len, NULL) == ENOTCONN, "failed slot reports ENOTCONN");
+    check(procfs_ctl_core_collect(&core, 3, &len, NULL) == 0, "answered slot keeps its result");
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        procfs_ctl_core_release(&core, i);
+    }
+
+    /* Sequence numbers skip 0 when they wrap. */
+    core.seq = 0xffffffffu;
+    s = procfs_ctl_core_submit(&core, c, 1, 1, 0, out, sizeof(out), &req);
+    check(req.seq == 1, "seq wraps past 0");
+    procfs_ctl_core_release(&core, s);
+
+    /* Each class holds at most its quota of slots; the fast class still gets in. */
+    check(procfs_ctl_core_prio(PROCFS_REQ_LOADAVG) == PROCFS_CTL_PRIO_FAST &&
+        procfs_ctl_core_prio(PROCFS_REQ_TASKINFOS) == PROCFS_CTL_PRIO_BULK &&
+        procfs_ctl_core_prio(PROCFS_REQ_IOINFOS) == PROCFS_CTL_PRIO_BULK &&
+        procfs_ctl_core_prio(PROCFS_REQ_FPREGS) == PROCFS_CTL_PRIO_DEBUG &&
+        procfs_ctl_core_prio(1000) == PROCFS_CTL_PRIO_DEBUG, "request classes");
+    int debug[PROCFS_CTL_QUOTA_DEBUG];
+    for (int i = 0; i < PROCFS_CTL_QUOTA_DEBUG; i++) {
+        debug[i] = procfs_ctl_core_submit(&core, c, PROCFS_REQ_REGS, i, 0, out, sizeof(out), &req);
+        check(debug[i] >= 0 && req.prio == PROCFS_CTL_PRIO_DEBUG, "debug request within quota");
+    }
+    check(procfs_ctl_core_submit(&core, c, PROCFS_REQ_FPREGS, 9, 0, out, sizeof(out), &req) == -1,
+        "debug quota refuses");
+    int bulk = procfs_ctl_core_submit(&core, c, PROCFS_REQ_THREADS, 1, 0, out, sizeof(out), &req);
+    check(bulk >= 0 && req.prio == PROCFS_CTL_PRIO_BULK, "bulk unaffected by debug quota");
+    int fast = procfs_ctl_core_submit(&core, c, PROCFS_REQ_LOADAVG, 1, 0, out, sizeof(out), &req);
+    check(fast >= 0 && req.prio == PROCFS_CTL_PRIO_FAST && req.reserved == 0,
+        "fast unaffected by debug quota");
+    procfs_ctl_core_release(&core, debug[0]);
+    procfs_ctl_core_release(&core, debug[0]);
+    check(core.held[PROCFS_CTL_PRIO_DEBUG] == PROCFS_CTL_QUOTA_DEBUG - 1, "double release counted once");
+    debug[0] = procfs_ctl_core_submit(&core, c, PROCFS_REQ_REGS, 0, 0, out, sizeof(out), &req);
+    check(debug[0] >= 0, "released debug slot reusable");
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        procfs_ctl_core_release(&core, i);
+    }
+    check(core.held[PROCFS_CTL_PRIO_FAST] == 0 && core.held[PROCFS_CTL_PRIO_BULK] == 0 &&
+        core.held[PROCFS_CTL_PRIO_DEBUG] == 0, "quotas back to zero");
+}
+
+/* Several daemons: spreading, draining, and a disconnect failing only its own. */
+static void
+test_core_conns(void)
+{
+    static struct procfs_ctl_core core;
+    struct procfs_ctl_req req;
+    uint8_t buf[PROCFSD_REPLY_MAX], out[64];
+    uint32_t len;
+    int admit;
+
+    check(procfs_ctl_core_pick(&core, 0, &admit) == -1 && admit == PROCFS_CTL_BRK_PASS,
+        "no connection, nothing to pick");
+    int a = procfs_ctl_core_attach(&core);
+    int b = procfs_ctl_core_attach(&core);
+    check(a == 0 && b == 1, "two connections");
+
+    /* Equal loads take turns; otherwise the emptier one gets it. */
+    int first  = procfs_ctl_core_pick(&core, 0, &admit);
+    int second = procfs_ctl_core_pick(&core, 0, &admit);
+    check(first != second, "equals take turns");
+    int sa = procfs_ctl_core_submit(&core, a, PROCFS_REQ_LOADAVG, 1, 0, out, sizeof(out), &req);
+    uint32_t seqa = req.seq;
+    check(procfs_ctl_core_outstanding(&core, a) == 1 && core.conns[a].sent == 1,
+        "submit counts against its connection");
+    check(procfs_ctl_core_pick(&core, 0, &admit) == b && procfs_ctl_core_pick(&core, 0, &admit) == b,
+        "the emptier connection is picked");
+    int sb = procfs_ctl_core_submit(&core, b, PROCFS_REQ_LOADAVG, 2, 0, out, sizeof(out), &req);
+    uint32_t seqb = req.seq;
+
+    /* A draining connection gets nothing new but still completes what it has. */
+    procfs_ctl_core_drain(&core, a);
+    check(procfs_ctl_core_pick(&core, 0, &admit) == b && procfs_ctl_core_pick(&core, 0, &admit) == b,
+        "draining connection not picked");
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, seqa, 0, 0, 0, 0)) == sa &&
+        procfs_ctl_core_outstanding(&core, a) == 0, "drained once answered");
+    procfs_ctl_core_release(&core, sa);
+    check(procfs_ctl_core_outstanding(&core, a) == 0, "release after completion not counted twice");
+    check(procfs_ctl_core_detach(&core, a, ENOTCONN) == 0, "drained detach fails nothing");
+    check(!core.slots[sb].done && procfs_ctl_core_outstanding(&core, b) == 1,
+        "other connection's request untouched");
+
+    /* A cancelled request no longer counts. */
+    int sc = procfs_ctl_core_submit(&core, b, PROCFS_REQ_LOADAVG, 3, 0, out, sizeof(out), &req);
+    check(procfs_ctl_core_outstanding(&core, b) == 2, "two outstanding");
+    procfs_ctl_core_release(&core, sc);
+    check(procfs_ctl_core_outstanding(&core, b) == 1, "cancel counted");
+
+    /* A disconnect fails only its own requests. */
+    a = procfs_ctl_core_attach(&core);
+    check(a == 0 && core.conns[a].sent == 0, "free connection reused, counts reset");
+    sa = procfs_ctl_core_submit(&core, a, PROCFS_REQ_LOADAVG, 4, 0, out, sizeof(out), &req);
+    check(procfs_ctl_core_detach(&core, b, ENOTCONN) == (1u << sb), "detach fails its own only");
+    check(procfs_ctl_core_collect(&core, sb, &len, NULL) == ENOTCONN && !core.slots[sa].done,
+        "survivor's request still waiting");
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, seqb, 0, 0, 0, 0)) == -1,
+        "late reply from the dead connection dropped");
+    check(procfs_ctl_core_pick(&core, 0, &admit) == a, "only the survivor left");
+    procfs_ctl_core_release(&core, sb);
+    procfs_ctl_core_release(&core, sa);
+
+    /* Full house. */
+    for (int i = 1; i < PROCFS_CTL_CONNS; i++) {
+        check(procfs_ctl_core_attach(&core) == i, "attach up to the limit");
+    }
+    check(procfs_ctl_core_attach(&core) == -1, "one too many refused");
+}
+
+/* A breaker per daemon: one wedged daemon fails fast, the rest carry on. */
+static void
+test_core_breakers(void)
+{
+    static struct procfs_ctl_core core;
+    procfs_ctl_core_tune(&core, 3, 10);
+    int a = procfs_ctl_core_attach(&core);
+    int b = procfs_ctl_core_attach(&core);
+    int admit;
+    uint64_t now = 1 * SEC;
+
+    /* Slow register reads and lists say nothing about a daemon's health. */
+    for (int i = 0; i < 5; i++) {
+        procfs_ctl_core_judge(&core, a, PROCFS_REQ_REGS, now, PROCFS_CTL_BRK_PASS, ETIMEDOUT);
+        procfs_ctl_core_judge(&core, a, PROCFS_REQ_THREADS, now, PROCFS_CTL_BRK_PASS, ETIMEDOUT);
+    }
+    check(core.conns[a].brk.state == PROCFS_CTL_BRK_CLOSED &&
+        procfs_ctl_core_brk_counts(&core).misses == 0, "debug and bulk misses do not count");
+
+    for (int i = 0; i < 3; i++) {
+        procfs_ctl_core_judge(&core, a, PROCFS_REQ_LOADAVG, now, PROCFS_CTL_BRK_PASS, ETIMEDOUT);
+    }
+    check(core.conns[a].brk.state == PROCFS_CTL_BRK_OPEN &&
+        core.conns[b].brk.state == PROCFS_CTL_BRK_CLOSED, "fast misses open only that daemon's");
+    check(procfs_ctl_core_brk_state(&core) == PROCFS_CTL_BRK_OPEN, "reported open");
+    int picked = 1;
+    for (int i = 0; i < 4; i++) {
+        picked &= procfs_ctl_core_pick(&core, now, &admit) == b && admit == PROCFS_CTL_BRK_PASS;
+    }
+    check(picked, "the healthy daemon takes every request meanwhile");
+
+    for (int i = 0; i < 3; i++) {
+        procfs_ctl_core_judge(&core, b, PROCFS_REQ_TASKINFO, now, PROCFS_CTL_BRK_PASS, ETIMEDOUT);
+    }
+    check(procfs_ctl_core_pick(&core, now, &admit) == -1 && admit == PROCFS_CTL_BRK_REJECT,
+        "every breaker open: fail fast");
+    check(procfs_ctl_core_brk_counts(&core).rejected == 1, "counted once");
+
+    /* After the backoff, one request probes; the others still fail fast. */
+    now += 10 * MS;
+    int p = procfs_ctl_core_pick(&core, now, &admit);
+    check((p == a || p == b) && admit == PROCFS_CTL_BRK_PROBE, "probe after the backoff");
+    int q = procfs_ctl_core_pick(&core, now, &admit);
+    check(q == (p == a ? b : a) && admit == PROCFS_CTL_BRK_PROBE, "the other daemon probed too");
+    check(procfs_ctl_core_pick(&core, now, &admit) == -1 && admit == PROCFS_CTL_BRK_REJECT,
+        "both probing: fail fast");
+    check(procfs_ctl_core_brk_state(&core) == PROCFS_CTL_BRK_HALFOPEN, "reported probing");
+    procfs_ctl_core_judge(&core, p, PROCFS_REQ_LOADAVG, now, PROCFS_CTL_BRK_PROBE, 0);
+    procfs_ctl_core_judge(&core, q, PROCFS_REQ_REGS, now, PROCFS_CTL_BRK_PROBE, ETIMEDOUT);
+    check(core.conns[p].brk.state == PROCFS_CTL_BRK_CLOSED, "answered probe closes it");
+    check(procfs_ctl_core_pick(&core, now, &admit) == q && admit == PROCFS_CTL_BRK_PROBE,
+        "a slow register read proves nothing: the next request probes instead");
+
+    /* A new daemon in a slot starts closed, with the tunables and counters kept. */
+    (void)procfs_ctl_core_detach(&core, q, ENOTCONN);
+    check(procfs_ctl_core_attach(&core) == q && core.conns[q].brk.state == PROCFS_CTL_BRK_CLOSED &&
+        core.conns[q].brk.threshold == 3 && procfs_ctl_core_brk_counts(&core).opened == 2,
+        "reattached closed");
+    check(procfs_ctl_core_brk_state(&core) == PROCFS_CTL_BRK_CLOSED, "all closed again");
+}
+
+/* Which daemons send events, and when subscribers must hear that some were missed. */
+static void
+test_core_evsources(void)
+{
+    static struct procfs_ctl_core core;
+    int a = procfs_ctl_core_attach(&core);
+    int b = procfs_ctl_core_attach(&core);
+    check(!procfs_ctl_core_evlast(&core, a), "a daemon that sent no events leaves none missing");
+    check(procfs_ctl_core_evbatch(&core, a, 1) == 1, "the first daemon's first batch counts its start");
+    check(procfs_ctl_core_evbatch(&core, a, 2) == 2, "its later drops count");
+    check(procfs_ctl_core_evbatch(&core, b, 1) == 0, "a second daemon's start is covered by the first");
+    check(procfs_ctl_core_evbatch(&core, b, 3) == 3, "but not its later drops");
+
+    /* An upgrade: the old daemon drains and goes while the new one carries on. */
+    procfs_ctl_core_drain(&core, a);
+    check(!procfs_ctl_core_evlast(&core, a), "not the last source");
+    (void)procfs_ctl_core_detach(&core, a, ENOTCONN);
+    check(procfs_ctl_core_evlast(&core, b), "the last source");
+    (void)procfs_ctl_core_detach(&core, b, ENOTCONN);
+    a = procfs_ctl_core_attach(&core);
+    check(procfs_ctl_core_evbatch(&core, a, 1) == 1, "a daemon starting alone counts its start");
+}
+
+/* Identical requests in flight: riders, their copies, and handing over. */
+static void
+test_core_join(void)
+{
+    static struct procfs_ctl_core core;
+    struct procfs_ctl_req req;
+    uint8_t buf[PROCFSD_REPLY_MAX], out[64], small[16], mid[32];
+    uint32_t len;
+    boolean_t trunc;
+
+    int c = procfs_ctl_core_attach(&core);
+    check(procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 0, out, sizeof(out)) == -1,
+        "nothing in flight to join");
+    int lead = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 7, 0, out, sizeof(out), &req);
+    check(procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 8, 0, out, sizeof(out)) == -1 &&
+        procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 1, out, sizeof(out)) == -1 &&
+        procfs_ctl_core_join(&core, PROCFS_REQ_THREADINFO, 7, 0, out, sizeof(out)) == -1,
+        "only the same type, pid and arg join");
+    check(procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 0, buf, sizeof(buf)) == -1,
+        "a bigger buffer than the leader's does not join");
+    int r1 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 0, small, sizeof(small));
+    int r2 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 0, NULL, 0);
+    check(r1 >= 0 && r2 >= 0 && r1 != lead && r2 != r1, "riders get slots of their own");
+    int r3 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 0, NULL, 0);
+    check(r3 >= 0 && core.slots[r3].lead == lead && core.riding == 3, "riders ride on the leader");
+    procfs_ctl_core_release(&core, r3);
+    check(core.riding == 2 && core.slots[lead].riders == (1u << r1 | 1u << r2),
+        "a released rider leaves its leader");
+    check(core.counts.sent == 1 && core.counts.coalesced == 3 && core.held[PROCFS_CTL_PRIO_FAST] == 1 &&
+        procfs_ctl_core_outstanding(&core, c) == 1, "riders send nothing and hold no quota");
+
+    /* The answer goes to every waiter, each getting what fits. */
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, req.seq, 0, 24, 24, 'q')) == lead,
+        "the leader's reply matched");
+    check(procfs_ctl_core_wakes(&core, lead) == (1u << lead | 1u << r1 | 1u << r2),
+        "leader and riders woken");
+    check(procfs_ctl_core_collect(&core, lead, &len, &trunc) == 0 && len == 24 && !trunc,
+        "leader has the whole payload");
+    check(procfs_ctl_core_collect(&core, r1, &len, &trunc) == 0 && len == sizeof(small) && trunc &&
+        small[0] == 'q' && small[sizeof(small) - 1] == 'q', "rider has what fits");
+    check(procfs_ctl_core_collect(&core, r2, &len, &trunc) == 0 && len == 0 && trunc,
+        "rider without a buffer has the result only");
+    check(procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 7, 0, NULL, 0) == -1,
+        "an answered request takes no riders");
+    procfs_ctl_core_release(&core, r1);
+    procfs_ctl_core_release(&core, lead);
+    procfs_ctl_core_release(&core, r2);
+    check(core.riding == 0 && core.held[PROCFS_CTL_PRIO_FAST] == 0, "all released");
+
+    /* The leader gives up: the rider with the most room takes over. */
+    lead = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 9, 0, out, sizeof(out), &req);
+    r1 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 9, 0, small, sizeof(small));
+    r2 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 9, 0, mid, sizeof(mid));
+    procfs_ctl_core_release(&core, lead);
+    check(core.counts.handoffs == 1 && core.slots[r2].lead == -1 && core.slots[r2].seq == req.seq &&
+        core.slots[r1].lead == r2 && core.riding == 1, "the roomiest rider leads");
+    check(procfs_ctl_core_outstanding(&core, c) == 1 && core.held[PROCFS_CTL_PRIO_FAST] == 1,
+        "the request still counts once");
+    check(procfs_ctl_core_reply(&core, buf, make_reply(buf, req.seq, 0, 24, 24, 'h')) == r2 &&
+        procfs_ctl_core_collect(&core, r2, &len, NULL) == 0 && len == 24 && mid[23] == 'h' &&
+        procfs_ctl_core_collect(&core, r1, &len, NULL) == 0 && len == sizeof(small) && small[0] == 'h',
+        "the reply reaches the riders left");
+    procfs_ctl_core_release(&core, r1);
+    procfs_ctl_core_release(&core, r2);
+
+    /* Riders fail with their leader. */
+    lead = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 10, 0, out, sizeof(out), &req);
+    r1 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 10, 0, small, sizeof(small));
+    check(procfs_ctl_core_fail_all(&core, ECANCELED) == (1u << lead | 1u << r1) &&
+        procfs_ctl_core_collect(&core, r1, &len, NULL) == ECANCELED, "fail_all fails riders");
+    procfs_ctl_core_release(&core, r1);
+    procfs_ctl_core_release(&core, lead);
+    lead = procfs_ctl_core_submit(&core, c, PROCFS_REQ_TASKINFO, 11, 0, out, sizeof(out), &req);
+    r1 = procfs_ctl_core_join(&core, PROCFS_REQ_TASKINFO, 11, 0, small, sizeof(small));
+    check(procfs_ctl_core_detach(&core, c, ENOTCONN) == (1u << lead | 1u << r1) &&
+        procfs_ctl_core_collect(&core, r1, &len, NULL) == ENOTCONN, "detach fails riders");
+    procfs_ctl_core_release(&core, r1);
+    procfs_ctl_core_release(&core, lead);
+
+    /* Riders may only take the slots sent requests cannot. */
+    c = procfs_ctl_core_attach(&core);
+    lead = procfs_ctl_core_submit(&core, c, PROCFS_REQ_LOADAVG, 1, 0, out, sizeof(out), &req);
+    int joined = 0;
+    while (procfs_ctl_core_join(&core, PROCFS_REQ_LOADAVG, 1, 0, NULL, 0) >= 0) {
+        joined++;
+    }
+    check(joined == PROCFS_CTL_SLOTS - PROCFS_CTL_INFLIGHT, "riders capped");
+    int sent = 1;
+    while (procfs_ctl_core_submit(&core, c, PROCFS_REQ_LOADAVG, 100 + sent, 0, NULL, 0, &req) >= 0) {
+        sent++;
+    }
+    check(sent == PROCFS_CTL_INFLIGHT, "riders leave room for every request in flight");
+    for (int i = 0; i < PROCFS_CTL_SLOTS; i++) {
+        procfs_ctl_core_release(&core, i);
+    }
+    check(core.riding == 0 && core.held[PROCFS_CTL_PRIO_FAST] == 0 &&
+        procfs_ctl_core_outstanding(&core, c) == 0, "everything back");
+}
+
+#pragma mark -
+#pragma mark Dispatch
+
+static int
+src_fixed(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    if (req->pid == 0) {
+        return EPERM;
+    }
+    memcpy(payload, "abc", 3);
+    *len = 3;
+    return 0;
+}
+
+static int
+src_huge(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    *len = PROCFS_CTL_MAXPAYLOAD + 100;
+    return 0;
+}
+
+static void
+test_serve(void)
+{
+    struct procfsd_sources src = { .ctx = NULL };
+    src.fn[PROCFS_REQ_TASKINFO] = src_fixed;
+    src.fn[PROCFS_REQ_VMSTAT]   = src_huge;
+
+    struct procfs_ctl_req req = { .magic = PROCFS_CTL_MAGIC, .seq = 9, .type = PROCFS_REQ_TASKINFO, .pid = 5 };
+    uint8_t reply[PROCFSD_REPLY_MAX];
+    struct procfs_ctl_resp resp;
+    uint32_t type = 0;
+    int error = -1;
+
+    size_t n = procfsd_serve_one(&src, &req, sizeof(req), reply, &type, &error);
+    memcpy(&resp, reply, sizeof(resp));
+    check(n == sizeof(resp) + 3 && resp.magic == PROCFS_CTL_MAGIC && resp.seq == 9 &&
+        resp.error == 0 && resp.len == 3 && memcmp(reply + sizeof(resp), "abc", 3) == 0,
+        "served reply");
+    check(type == PROCFS_REQ_TASKINFO && error == 0, "served type and error");
+
+    /* A kext from before the classes sends no prio or reserved. */
+    uint8_t old[sizeof(req) + 8];
+    memset(old, 0xff, sizeof(old));
+    memcpy(old, &req, PROCFS_CTL_REQMIN);
+    n = procfsd_serve_one(&src, old, PROCFS_CTL_REQMIN, reply, &type, &error);
+    memcpy(&resp, reply, sizeof(resp));
+    check(n == sizeof(resp) + 3 && resp.seq == 9 && error == 0, "short-form request served");
+
+    req.pid = 0;
+    n = procfsd_serve_one(&src, &req, sizeof(req), reply, &type, &error);
+    memcpy(&resp, reply, sizeof(resp));
+    check(n == sizeof(resp) && resp.error == EPERM && resp.len == 0 && error == EPERM,
+        "source error has no payload");
+
+    req.type = PROCFS_REQ_LOADAVG;
+    n = procfsd_serve_one(&src, &req, sizeof(req), reply, NULL, &error);
+    check(n == sizeof(resp) && error == EINVAL, "no source is EINVAL");
+    req.type = 1000;
+    n = procfsd_serve_one(&src, &req, sizeof(req), reply, &type, &error);
+    check(n == sizeof(resp) && error == EINVAL && type == 1000, "unknown type is EINVAL");
+
+    req.type = PROCFS_REQ_VMSTAT;
+    n = procfsd_serve_one(&src, &req, sizeof(req), reply, NULL, NULL);
+    check(n == PROCFSD_REPLY_MAX, "oversized payload clamped");
+
+    req.type = PROCFS_REQ_REGS;
+    n = procfsd_serve_error(&req, EBUSY, reply);
+    memcpy(&resp, reply, sizeof(resp));
+    check(n == sizeof(resp) && resp.magic == PROCFS_CTL_MAGIC && resp.seq == 9 &&
+        resp.error == EBUSY && resp.len == 0, "refusal reply");
+
+    check(procfsd_serve_one(&src, &req, PROCFS_CTL_REQMIN - 1, reply, NULL, NULL) == 0,
+        "short request ignored");
+    req.magic = 0;
+    check(procfsd_serve_one(&src, &req, sizeof(req), reply, NULL, NULL) == 0, "bad magic ignored");
+}
+
+/* A worker that holds every request until the gate opens. */
+struct gate {
+    pthread_mutex_t lock;
+    pthread_cond_t  cv;
+    int             open;
+};
+
+static void
+serve_gated(void *ctx, const struct procfs_ctl_req *req)
+{
+    struct gate *g = ctx;
+    (void)req;
+    pthread_mutex_lock(&g->lock);
+    while (!g->open) {
+        pthread_cond_wait(&g->cv, &g->lock);
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+struct unqueued {
+    int      malformed, refused;
+    uint32_t seq;       /* of the last refusal */
+};
+
+static void
+note_unqueued(void *ctx, int result, const void *reply, size_t len, uint32_t type)
+{
+    struct unqueued *u = ctx;
+    struct procfs_ctl_resp resp;
+    if (result == PROCFSD_MALFORMED) {
+        u->malformed++;
+    } else if (len == sizeof(resp) && type == PROCFS_REQ_TASKINFO &&
+        memcpy(&resp, reply, sizeof(resp)) != NULL && resp.error == EBUSY) {
+        u->refused++;
+        u->seq = resp.seq;
+    }
+}
+
+/* Queueing for the workers, from a datagram and from the request ring, and refusing once full. */
+static void
+test_serve_queue(void)
+{
+    struct gate g = { .open = 0 };
+    pthread_mutex_init(&g.lock, NULL);
+    pthread_cond_init(&g.cv, NULL);
+    struct procfsd_sched s;
+    const uint32_t one_each[PROCFS_CTL_NPRIO] = { 1, 1, 1 };
+    check(procfsd_sched_start(&s, one_each, serve_gated, &g) == 0, "sched started");
+
+    uint8_t reply[sizeof(struct procfs_ctl_resp)];
+    size_t len = 0;
+    uint32_t type = 0;
+    struct procfs_ctl_req req = { .magic = PROCFS_CTL_MAGIC, .seq = 1, .type = PROCFS_REQ_TASKINFO,
+        .pid = 5, .prio = PROCFS_CTL_PRIO_FAST };
+    check(procfsd_serve_queue(&s, &req, PROCFS_CTL_REQMIN - 1, reply, &len, &type) == PROCFSD_MALFORMED,
+        "short datagram malformed");
+    req.magic = 0;
+    check(procfsd_serve_queue(&s, &req, sizeof(req), reply, &len, &type) == PROCFSD_MALFORMED,
+        "bad magic malformed");
+    req.magic = PROCFS_CTL_MAGIC;
+    check(procfsd_serve_queue(&s, &req, sizeof(req), reply, &len, &type) == PROCFSD_QUEUED,
+        "request queued");
+    struct procfs_ctl_req bulk = { .magic = PROCFS_CTL_MAGIC, .seq = 50, .type = PROCFS_REQ_THREADS,
+        .pid = 5, .prio = PROCFS_CTL_PRIO_FAST };
+    check(procfsd_serve_queue(&s, &bulk, sizeof(bulk), reply, &len, &type) == PROCFSD_QUEUED &&
+        procfsd_serve_queue(&s, &bulk, PROCFS_CTL_REQMIN, reply, &len, &type) == PROCFSD_QUEUED &&
+        procfsd_sched_counts(&s, PROCFS_CTL_PRIO_BULK).queued == 2 &&
+        procfsd_sched_counts(&s, PROCFS_CTL_PRIO_FAST).queued == 1,
+        "bulk requests queued as bulk, whatever their prio, and in the short form");
+
+    enum { SIZE = PROCFS_CTL_RINGMIN };
+    static uint8_t map[PROCFS_CTL_RINGMAP(SIZE)];
+    struct procfs_ring reqs, kreqs;
+    struct procfs_ring_shared *rq = (void *)(map + PROCFS_CTL_RING_REQS);
+    procfs_ring_init(&kreqs, rq, map + PROCFS_CTL_RINGHDR, SIZE, 1);
+    procfs_ring_init(&reqs, rq, map + PROCFS_CTL_RINGHDR, SIZE, 0);
+
+    struct unqueued u = { 0 };
+    check(procfsd_serve_take(&s, &reqs, note_unqueued, &u) == 0, "empty request ring");
+    uint32_t junk = 0x12345678;
+    procfs_ring_put(&kreqs, &junk, sizeof(junk));
+    req.seq = 2;
+    procfs_ring_put(&kreqs, &req, sizeof(req));
+    check(procfsd_serve_take(&s, &reqs, note_unqueued, &u) == 2 && u.malformed == 1 && u.refused == 0,
+        "ring taken, the non-request reported");
+    check(procfs_ring_peek(&reqs, &type) == NULL, "request ring drained");
+
+    /* The fast workers are held: the queue fills, then refuses with EBUSY. */
+    uint32_t seq = 3;
+    int result = PROCFSD_QUEUED;
+    for (; seq < 3 + 2 * PROCFSD_SCHED_DEPTH && result == PROCFSD_QUEUED; seq++) {
+        req.seq = seq;
+        result = procfsd_serve_queue(&s, &req, sizeof(req), reply, &len, &type);
+    }
+    struct procfs_ctl_resp resp;
+    memcpy(&resp, reply, sizeof(resp));
+    check(result == PROCFSD_REFUSED && len == sizeof(resp) && type == PROCFS_REQ_TASKINFO &&
+        resp.seq == seq - 1 && resp.error == EBUSY && resp.len == 0, "full queue refuses");
+    req.seq = 99;
+    procfs_ring_put(&kreqs, &req, sizeof(req));
+    check(procfsd_serve_take(&s, &reqs, note_unqueued, &u) == 1 && u.refused == 1 && u.seq == 99,
+        "refusal from the ring reported");
+
+    pthread_mutex_lock(&g.lock);
+    g.open = 1;
+    pthread_cond_broadcast(&g.cv);
+    pthread_mutex_unlock(&g.lock);
+    procfsd_sched_stop(&s);
+    pthread_cond_destroy(&g.cv);
+    pthread_mutex_destroy(&g.lock);
+}
+
+#pragma mark -
+#pragma mark Loopback
+
+struct worker {
+    struct loopback *lb;
+    int              id;
+    int              count;
+    int              bad;
+    int              result;     /* for single requests */
+    uint64_t         elapsed;
+};
+
+/* Many threads at once: every reply must be the echo of the caller's own request. */
+static void *
+echo_worker(void *arg)
+{
+    struct worker *w = arg;
+    for (int i = 0; i < w->count; i++) {
+        uint32_t type = 1 + (uint32_t)(i % PROCFS_REQ_FPREGS);
+        int      pid  = w->id * 100000 + i;
+        uint64_t targ = (uint64_t)w->id << 32 | (uint64_t)i;
+        uint8_t  out[256];
+        uint32_t len = 0;
+        int e;
+        while ((e = lb_request(w->lb, type, pid, targ, out, sizeof(out), &len, 5 * SEC)) == EBUSY ||
+            e == ENOBUFS) {
+            usleep(20);     /* its class's slots are taken; let them drain */
+        }
+
+        struct lb_echo echo;
+        memcpy(&echo, out, sizeof(echo));
+        if (e != 0 || len != sizeof(echo) + targ % 64 ||
+            echo.type != type || echo.pid != pid || echo.arg != targ ||
+            (len > sizeof(echo) && out[len - 1] != (uint8_t)(pid & 0xff))) {
+            w->bad++;
+        }
+    }
+    return NULL;
+}
+
+static void
+test_concurrent(void)
+{
+    struct lb_config cfg = { .latency_us = 0, .jitter_us = 20, .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    check(lb != NULL, "loopback starts");
+    if (lb == NULL) {
+        return;
+    }
+
+    enum { NTHREADS = 24, PER = 400 };       /* more threads than slots */
+    pthread_t th[NTHREADS];
+    struct worker w[NTHREADS];
+    for (int i = 0; i < NTHREADS; i++) {
+        w[i] = (struct worker){ .lb = lb, .id = i + 1, .count = PER };
+        pthread_create(&th[i], NULL, echo_worker, &w[i]);
+    }
+    int bad = 0;
+    for (int i = 0; i < NTHREADS; i++) {
+        pthread_join(th[i], NULL);
+        bad += w[i].bad;
+    }
+    check(bad == 0, "every concurrent reply reached its own caller");
+    struct lb_counts c = lb_counts(lb);
+    check(c.served == (uint64_t)NTHREADS * PER, "daemon answered each request once");
+    check(c.stale == 0, "no stale replies without timeouts");
+    check(ring ? c.ringed == c.served : c.ringed == 0, "requests took the configured transport");
+    check(lb_inflight(lb) == 0, "all slots released");
+    lb_stop(lb);
+}
+
+static void
+test_errors(void)
+{
+    struct lb_config cfg = { .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    uint8_t out[256];
+    uint32_t len = 777;
+    check(lb_request(lb, PROCFS_REQ_TASKINFO, -1, 0, out, sizeof(out), &len, SEC) == ESRCH && len == 777,
+        "daemon errno passes through");
+    check(lb_request(lb, PROCFSD_NREQ, 1, 0, out, sizeof(out), &len, SEC) == EINVAL,
+        "unknown type is EINVAL");
+    check(lb_request(lb, PROCFS_REQ_LOADAVG, 1, 63, out, 8, &len, SEC) == 0 && len == 8,
+        "payload truncated to the caller's buffer");
+
+    /* A whole-process thread list fills most of a payload. */
+    static uint8_t big[PROCFS_CTL_MAXPAYLOAD];
+    uint64_t want = PROCFS_CTL_MAXPAYLOAD - sizeof(struct lb_echo);
+    struct lb_echo echo;
+    check(lb_request(lb, PROCFS_REQ_THREADS, 0x5a, want, big, sizeof(big), &len, SEC) == 0 &&
+        len == PROCFS_CTL_MAXPAYLOAD && memcpy(&echo, big, sizeof(echo)) != NULL &&
+        echo.arg == want && big[len - 1] == 0x5a,
+        "full-size payload round-trips");
+    lb_stop(lb);
+}
+
+static void *
+one_request(void *arg)
+{
+    struct worker *w = arg;
+    uint8_t out[256];
+    uint32_t len;
+    uint64_t t0 = now_ns();
+    w->result  = lb_request(w->lb, PROCFS_REQ_TASKINFO, w->id, 0, out, sizeof(out), &len, 5 * SEC);
+    w->elapsed = now_ns() - t0;
+    return NULL;
+}
+
+static void
+test_busy(void)
+{
+    struct lb_config cfg = { .latency_us = 20000, .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    pthread_t th[PROCFS_CTL_INFLIGHT];
+    struct worker w[PROCFS_CTL_INFLIGHT];
+    for (int i = 0; i < PROCFS_CTL_INFLIGHT; i++) {
+        w[i] = (struct worker){ .lb = lb, .id = i + 1 };
+        pthread_create(&th[i], NULL, one_request, &w[i]);
+    }
+    wait_inflight(lb, PROCFS_CTL_INFLIGHT);
+
+    uint8_t out[64];
+    uint32_t len;
+    check(lb_request(lb, PROCFS_REQ_TASKINFO, 1, 0, out, sizeof(out), &len, SEC) == EBUSY,
+        "EBUSY with every slot in flight");
+    check(lb_counts(lb).busy == 1, "EBUSY counted");
+    int ok = 0;
+    for (int i = 0; i < PROCFS_CTL_INFLIGHT; i++) {
+        pthread_join(th[i], NULL);
+        ok += w[i].result == 0;
+    }
+    check(ok == PROCFS_CTL_INFLIGHT, "queued requests all answered");
+    lb_stop(lb);
+}
+
+/*
+ * A request that times out frees its slot; the late reply that follows must
+ * not complete the next request to take the same slot.
+ */
+static void
+test_timeout(void)
+{
+    struct lb_config cfg = { .latency_us = 30000, .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    uint8_t out[256];
+    uint32_t len = 0;
+    uint64_t t0 = now_ns();
+    check(lb_request(lb, PROCFS_REQ_TASKINFO, 1, 0, out, sizeof(out), &len, 5 * MS) == ETIMEDOUT,
+        "slow reply times out");
+    check(now_ns() - t0 < 25 * MS, "timeout honoured");
+    check(lb_inflight(lb) == 0, "timed-out slot released");
+
+    int e = lb_request(lb, PROCFS_REQ_TASKINFO, 2, 0, out, sizeof(out), &len, 5 * SEC);
+    struct lb_echo echo;
+    memcpy(&echo, out, sizeof(echo));
+    check(e == 0 && echo.pid == 2, "slot reuse gets its own reply, not the late one");
+    check(lb_counts(lb).stale == 1, "late reply dropped as stale");
+    lb_stop(lb);
+}
+
+static void
+test_disconnect(void)
+{
+    struct lb_config cfg = { .latency_us = 500000, .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    pthread_t th;
+    struct worker w = { .lb = lb, .id = 1 };
+    pthread_create(&th, NULL, one_request, &w);
+    wait_inflight(lb, 1);
+    lb_disconnect(lb);
+    pthread_join(th, NULL);
+    check(w.result == ENOTCONN, "waiter fails with ENOTCONN on disconnect");
+    check(w.elapsed < 2 * SEC, "waiter woken before its timeout");
+
+    uint8_t out[64];
+    uint32_t len;
+    check(lb_request(lb, PROCFS_REQ_TASKINFO, 1, 0, out, sizeof(out), &len, SEC) == ENOTCONN,
+        "no daemon is ENOTCONN");
+    lb_stop(lb);
+}
+
+/* Echo workers in the background, for a daemon to come or go under load. */
+struct load {
+    pthread_t     th[8];
+    struct worker w[8];
+};
+
+static void
+load_start(struct load *l, struct loopback *lb, int per)
+{
+    for (int i = 0; i < 8; i++) {
+        l->w[i] = (struct worker){ .lb = lb, .id = i + 1, .count = per };
+        pthread_create(&l->th[i], NULL, echo_worker, &l->w[i]);
+    }
+}
+
+static int
+load_join(struct load *l)
+{
+    int bad = 0;
+    for (int i = 0; i < 8; i++) {
+        pthread_join(l->th[i], NULL);
+        bad += l->w[i].bad;
+    }
+    return bad;
+}
+
+/*
+ * Several daemons: the load is spread over all of them, one drains away
+ * mid-load without a single failed request, and one that crashes fails
+ * only the requests it held while the rest go on.
+ */
+static void
+test_daemons(void)
+{
+    struct lb_config cfg = { .jitter_us = 200, .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    for (int i = 1; i < PROCFS_CTL_CONNS; i++) {
+        check(lb_add_daemon(lb) == i, "another daemon connects");
+    }
+    check(lb_add_daemon(lb) == -1, "one daemon too many refused");
+
+    struct load l;
+    load_start(&l, lb, 300);
+    while (lb_counts(lb).served < 200) {
+        usleep(100);
+    }
+    check(lb_drain(lb, 0, 5 * SEC) == 0, "daemon drains mid-load");
+    uint64_t gone = lb_daemon_served(lb, 0);
+    check(load_join(&l) == 0, "no request failed while a daemon drained");
+    check(lb_daemon_served(lb, 0) == gone, "drained daemon got nothing more");
+    uint64_t total = 0;
+    int busy = 0;
+    for (int i = 0; i < PROCFS_CTL_CONNS; i++) {
+        total += lb_daemon_served(lb, i);
+        busy  += lb_daemon_served(lb, i) > 0;
+    }
+    check(busy == PROCFS_CTL_CONNS, "every daemon took a share");
+    check(total == 8 * 300 && lb_counts(lb).served == total, "each request answered once");
+    check(lb_add_daemon(lb) == PROCFS_CTL_CONNS, "the drained daemon's place is free again");
+    lb_stop(lb);
+
+    /* Two slow daemons, four requests each; one crashes. */
+    cfg = (struct lb_config){ .latency_us = 200000, .ring = ring };
+    lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    check(lb_add_daemon(lb) == 1, "second daemon connects");
+    struct lb_pending pc[8];
+    uint8_t out[8][64];
+    for (int i = 0; i < 8; i++) {
+        (void)lb_submit(lb, PROCFS_REQ_LOADAVG, i, 0, out[i], sizeof(out[i]), 5 * SEC, &pc[i]);
+    }
+    check(lb_outstanding(lb, 0) == 4 && lb_outstanding(lb, 1) == 4, "requests spread evenly");
+    lb_disconnect_daemon(lb, 1);
+    int ok = 0, lost = 0;
+    for (int i = 0; i < 8; i++) {
+        uint32_t len;
+        int e = lb_wait(lb, &pc[i], &len);
+        ok   += e == 0;
+        lost += e == ENOTCONN;
+    }
+    check(ok == 4 && lost == 4, "a crash fails only the crashed daemon's requests");
+    uint32_t len;
+    check(lb_request(lb, PROCFS_REQ_LOADAVG, 1, 0, out[0], sizeof(out[0]), &len, 5 * SEC) == 0 &&
+        lb_daemon_served(lb, 0) == 5, "later requests go to the survivor");
+    lb_stop(lb);
+}
+
+/*
+ * One of two daemons wedges: its fast requests miss their deadlines until
+ * its breaker opens, and from then on the other daemon serves everything.
+ */
+static void
+test_wedged(void)
+{
+    struct lb_config cfg = { .ring = ring, .brk_threshold = 3, .brk_backoff_ms = 60000 };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    check(lb_add_daemon(lb) == 1, "second daemon connects");
+    lb_wedge_daemon(lb, 0, 300000);
+
+    int missed = 0, ok = 0;
+    for (int i = 0; i < 12; i++) {
+        uint8_t out[64];
+        uint32_t len;
+        int e = lb_request(lb, PROCFS_REQ_LOADAVG, i, 0, out, sizeof(out), &len, 20 * MS);
+        missed += e == ETIMEDOUT;
+        ok     += e == 0;
+    }
+    struct lb_counts c = lb_counts(lb);
+    check(missed == 3 && ok == 9, "only the threshold's worth of requests missed");
+    check(lb_brk_state(lb, 0) == PROCFS_CTL_BRK_OPEN, "the wedged daemon's breaker opened");
+    check(lb_brk_state(lb, 1) == PROCFS_CTL_BRK_CLOSED, "the other daemon's stayed closed");
+    check(c.misses == 3 && c.opened == 1, "the breakers counted each miss");
+    check(lb_daemon_served(lb, 1) == 9, "the other daemon kept serving");
+    lb_stop(lb);
+}
+
+/* One reader of pid `id`'s taskinfo, checking it got that pid's answer. */
+static void *
+status_reader(void *arg)
+{
+    struct worker *w = arg;
+    uint8_t out[256];
+    uint32_t len = 0;
+    struct lb_echo echo;
+    w->result = lb_request(w->lb, PROCFS_REQ_TASKINFO, w->id, 5, out, sizeof(out), &len, 5 * SEC);
+    memcpy(&echo, out, sizeof(echo));
+    w->bad = w->result != 0 || len != sizeof(echo) + 5 || echo.type != PROCFS_REQ_TASKINFO ||
+        echo.pid != w->id || echo.arg != 5 || out[len - 1] != (uint8_t)(w->id & 0xff);
+    return NULL;
+}
+
+/*
+ * Many readers of the same two pids at once, as agents polling one status
+ * file: with coalescing each pid is asked once and every reader still gets
+ * its own pid's answer; without, each reader is a request of its own. A
+ * reader that gives up does not take the answer from the others.
+ */
+static void
+test_coalesce(void)
+{
+    enum { READERS = PROCFS_CTL_INFLIGHT };     /* all fit even uncoalesced */
+    for (int on = 0; on <= 1; on++) {
+        struct lb_config cfg = { .latency_us = 50000, .ring = ring, .coalesce = on };
+        struct loopback *lb = lb_start(&cfg);
+        if (lb == NULL) {
+            check(0, "loopback starts");
+            return;
+        }
+        pthread_t th[READERS];
+        struct worker w[READERS];
+        for (int i = 0; i < READERS; i++) {
+            w[i] = (struct worker){ .lb = lb, .id = 1234 + i % 2 };
+            pthread_create(&th[i], NULL, status_reader, &w[i]);
+        }
+        int bad = 0;
+        for (int i = 0; i < READERS; i++) {
+            pthread_join(th[i], NULL);
+            bad += w[i].bad;
+        }
+        struct lb_counts c = lb_counts(lb);
+        if (on) {
+            printf("  %d readers of 2 pids (%s): %llu sent, %llu coalesced\n", READERS,
+                ring ? "rings" : "socket", (unsigned long long)c.served,
+                (unsigned long long)c.coalesced);
+            check(bad == 0, "every coalesced reader got its own pid's answer");
+            check(c.served + c.coalesced == READERS && c.served < READERS / 2,
+                "identical requests sent once");
+        } else {
+            check(bad == 0, "every reader got its own pid's answer");
+            check(c.served == READERS && c.coalesced == 0, "uncoalesced, each reader sent");
+        }
+        check(c.stale == 0 && lb_inflight(lb) == 0, "nothing left over");
+
+        if (on) {
+            /* The first reader gives up; the others still get the answer. */
+            uint64_t served = c.served;
+            struct lb_pending pc[4];
+            uint8_t out[4][64];
+            for (int i = 0; i < 4; i++) {
+                (void)lb_submit(lb, PROCFS_REQ_TASKINFO, 99, 5, out[i], sizeof(out[i]), 5 * SEC, &pc[i]);
+            }
+            lb_cancel(lb, &pc[0]);
+            int ok = 0;
+            for (int i = 1; i < 4; i++) {
+                uint32_t len;
+                struct lb_echo echo;
+                ok += lb_wait(lb, &pc[i], &len) == 0 && memcpy(&echo, out[i], sizeof(echo)) != NULL &&
+                    echo.pid == 99;
+            }
+            c = lb_counts(lb);
+            check(ok == 3 && c.handoffs == 1, "riders outlive a leader that gave up");
+            check(c.served == served + 1 && c.stale == 0, "still asked once, and nothing stale");
+        }
+        lb_stop(lb);
+    }
+
+    /* A wedged daemon's miss still counts when the rider that took over times out. */
+    struct lb_config cfg = { .latency_us = 300000, .ring = ring, .coalesce = 1,
+                             .brk_threshold = 1, .brk_backoff_ms = 60000 };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    struct lb_pending lead, heir;
+    uint8_t out[2][64];
+    (void)lb_submit(lb, PROCFS_REQ_TASKINFO, 77, 5, out[0], sizeof(out[0]), 5 * SEC, &lead);
+    (void)lb_submit(lb, PROCFS_REQ_TASKINFO, 77, 5, out[1], sizeof(out[1]), 20 * MS, &heir);
+    lb_cancel(lb, &lead);
+    uint32_t len;
+    check(lb_wait(lb, &heir, &len) == ETIMEDOUT, "the heir times out");
+    struct lb_counts c = lb_counts(lb);
+    check(c.handoffs == 1 && c.misses == 1, "the breaker counted the heir's miss");
+    check(lb_brk_state(lb, 0) == PROCFS_CTL_BRK_OPEN, "and opened on it");
+    lb_stop(lb);
+}
+
+/*
+ * Several requests in flight from one caller, collected out of order while
+ * it works; a failed submit surfaces at the wait, and a cancelled request's
+ * reply is dropped.
+ */
+static void
+test_async(void)
+{
+    struct lb_config cfg = { .latency_us = 30000, .ring = ring };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return;
+    }
+    uint8_t out[256];
+    uint32_t len;
+    struct lb_echo echo;
+
+    /* The daemon's 30ms overlaps the caller's 30ms of local work. */
+    struct lb_pending one;
+    uint64_t t0 = now_ns();
+    check(lb_submit(lb, PROCFS_REQ_TASKINFO, 11, 0, out, sizeof(out), 5 * SEC, &one) == 0, "submit");
+    check(!lb_ready(lb, &one), "not ready before the daemon answers");
+    usleep(30000);
+    check(lb_wait(lb, &one, &len) == 0 && !one.truncated, "wait");
+    memcpy(&echo, out, sizeof(echo));
+    check(echo.pid == 11, "wait returns the submitted request's reply");
+    check(now_ns() - t0 < 55 * MS, "daemon latency overlapped with local work");
+    check(lb_wait(lb, &one, &len) == 0, "second wait repeats the result");
+
+    /* Each request's reply goes straight to its own buffer. */
+    enum { N = 4 };
+    struct lb_pending pc[N];
+    uint8_t outs[N][256];
+    for (int i = 0; i < N; i++) {
+        check(lb_submit(lb, PROCFS_REQ_THREADINFO, 20 + i, (uint64_t)i, outs[i], sizeof(outs[i]),
+            5 * SEC, &pc[i]) == 0, "submit several");
+    }
+    check(lb_inflight(lb) == N, "all in flight at once");
+    int ok = 1;
+    for (int i = N - 1; i >= 0; i--) {
+        len = 0;
+        int e = lb_wait(lb, &pc[i], &len);
+        memcpy(&echo, outs[i], sizeof(echo));
+        ok &= e == 0 && echo.pid == 20 + i && echo.arg == (uint64_t)i && len == sizeof(echo) + i;
+        check(lb_ready(lb, &pc[i]), "finished request is ready");
+    }
+    check(ok, "out-of-order waits each get their own reply");
+
+    /* Cancelled: the slot is free at once and the reply is dropped. */
+    struct lb_pending c;
+    check(lb_submit(lb, PROCFS_REQ_TASKINFO, 30, 0, outs[0], sizeof(outs[0]), 5 * SEC, &c) == 0,
+        "submit to cancel");
+    lb_cancel(lb, &c);
+    memset(outs[0], 0x77, sizeof(outs[0]));
+    check(lb_inflight(lb) == 0, "cancel frees the slot");
+    check(lb_wait(lb, &c, &len) == ECANCELED, "wait after cancel");
+    check(lb_request(lb, PROCFS_REQ_TASKINFO, 31, 0, out, sizeof(out), &len, 5 * SEC) == 0,
+        "request after cancel");
+    memcpy(&echo, out, sizeof(echo));
+    /* Two fast workers serve them side by side: the cancelled one may land second. */
+    for (int i = 0; i < 1000 && lb_counts(lb).stale == 0; i++) {
+        usleep(1000);
+    }
+    check(echo.pid == 31 && lb_counts(lb).stale == 1, "cancelled reply dropped as stale");
+    check(outs[0][0] == 0x77 && outs[0][sizeof(outs[0]) - 1] == 0x77,
+        "cancelled reply not written to its buffer");
+
+    /* A reply larger than the buffer is cut short and flagged. */
+    struct lb_pending t;
+    uint8_t small[sizeof(echo) + 4];
+    check(lb_submit(lb, PROCFS_REQ_LOADAVG, 40, 63, small, sizeof(small), 5 * SEC, &t) == 0 &&
+        lb_wait(lb, &t, &len) == 0 && len == sizeof(small) && t.truncated,
+        "oversized reply truncated and flagged");
+
+    /* A submit that fails reports the error at the wait, without blocking. */
+    lb_disconnect(lb);
+    struct lb_pending d;
+    check(lb_submit(lb, PROCFS_REQ_TASKINFO, 1, 0, out, sizeof(out), 5 * SEC, &d) == ENOTCONN,
+        "submit without daemon");
+    check(lb_ready(lb, &d), "failed submit is ready");
+    check(lb_wait(lb, &d, &len) == ENOTCONN, "wait returns the submit error");
+    lb_cancel(lb, &d);
+    lb_stop(lb);
+}
+
+/* A debugger: register reads back to back, retrying whenever the debug class is full. */
+struct burst {
+    struct loopback *lb;
+    int              stop;
+    uint64_t         reads;
+};
+
+static void *
+debug_burst(void *arg)
+{
+    struct burst *b = arg;
+    while (!__atomic_load_n(&b->stop, __ATOMIC_RELAXED)) {
+        uint8_t out[256];
+        uint32_t len;
+        int e = lb_request(b->lb, PROCFS_REQ_REGS, 1, 0, out, sizeof(out), &len, 5 * SEC);
+        if (e == EBUSY || e == ENOBUFS) {
+            usleep(100);
+        } else {
+            __atomic_fetch_add(&b->reads, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+enum { DEBUG_US = 2000 };
+
+/* The p99 of loadavg requests made while debuggers keep register reads in flight. */
+static uint64_t
+loadavg_p99(int fifo)
+{
+    struct lb_config cfg = { .debug_us = DEBUG_US, .ring = ring, .fifo = fifo };
+    struct loopback *lb = lb_start(&cfg);
+    if (lb == NULL) {
+        check(0, "loopback starts");
+        return 0;
+    }
+
+    enum { NDEBUG = 8, N = 200 };
+    pthread_t th[NDEBUG];
+    struct burst b = { .lb = lb };
+    for (int i = 0; i < NDEBUG; i++) {
+        pthread_create(&th[i], NULL, debug_burst, &b);
+    }
+    wait_inflight(lb, PROCFS_CTL_QUOTA_DEBUG);
+
+    uint64_t lat[N];
+    int bad = 0;
+    for (int i = 0; i < N; i++) {
+        uint8_t out[64];
+        uint32_t len;
+        uint64_t t0 = now_ns();
+        bad += lb_request(lb, PROCFS_REQ_LOADAVG, 1, 0, out, sizeof(out), &len, 5 * SEC) != 0;
+        lat[i] = now_ns() - t0;
+    }
+    __atomic_store_n(&b.stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < NDEBUG; i++) {
+        pthread_join(th[i], NULL);
+    }
+    check(bad == 0, "every loadavg answered during the burst");
+    check(b.reads > 0, "register reads served during the burst");
+    if (!fifo) {
+        check(lb_counts(lb).busy > 0, "the debug quota turned surplus register reads away");
+    }
+    lb_stop(lb);
+
+    qsort(lat, N, sizeof(lat[0]), cmp_u64);
+    return lat[N * 99 / 100];
+}
+
+/*
+ * Cross-class interference. Served in arrival order, as procfsd did, a
+ * loadavg waits behind every register read ahead of it; with the classes
+ * it goes to a fast worker at once and the register reads wait for theirs.
+ */
+static void
+test_classes(void)
+{
+    uint64_t classes = loadavg_p99(0);
+    uint64_t fifo    = loadavg_p99(1);
+    printf("  loadavg p99 during a register-read burst (%s): %.2f ms with classes, %.2f ms in one queue\n",
+        ring ? "rings" : "socket", classes / 1e6, fifo / 1e6);
+    check(classes < DEBUG_US * 1000ULL, "loadavg p99 under one register read with classes");
+    check(fifo >= DEBUG_US * 1000ULL, "loadavg p99 waits on register reads in one queue");
+}
+
+int
+main(void)
+{
+    test_core();
+    test_core_conns();
+    test_core_breakers();
+    test_core_evsources();
+    test_core_join();
+    test_serve();
+    test_serve_queue();
+    for (ring = 0; ring <= 1; ring++) {
+        test_concurrent();
+        test_errors();
+        test_busy();
+        test_timeout();
+        test_disconnect();
+        test_daemons();
+        test_wedged();
+        test_coalesce();
+        test_async();
+        test_classes();
+    }
+
+    return check_done("ctl loopback");
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_getattr_cost.c
+ *
+ * Builds the real procfs structure tree and asks for the size attribute of
+ * every node in it, as procfs_vnop_getattr() does, while counting the calls
+ * made into the expensive process-enumeration primitives. Sizing a node -
+ * in particular the root, a process directory or its fd/threads/task
+ * directories - must not enumerate processes, threads or open files.
+ *
+ *   make -C test/host check
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/proc_info.h>
+
+#include <fs/procfs/procfs.h>
+
+#include "check.h"
+
+OSMallocTag procfs_osmalloc_tag = NULL;
+
+#pragma mark -
+#pragma mark Counted primitives
+
+static int n_proc_find;
+static int n_get_pids;
+static int n_get_fd_list;
+static int n_get_thread_ids;
+static int n_access_checks;
+
+proc_t
+proc_find(__unused int pid)
+{
+    n_proc_find++;
+    return PROC_NULL;
+}
+
+void
+procfs_get_pids(pid_t **pidpp, int *pid_count, uint32_t *sizep, __unused kauth_cred_t creds)
+{
+    n_get_pids++;
+    *pidpp = NULL;
+    *pid_count = 0;
+    *sizep = 0;
+}
+
+int
+procfs_get_fd_list(__unused proc_t p, struct proc_fdinfo **fdlist, size_t *count)
+{
+    n_get_fd_list++;
+    *fdlist = NULL;
+    *count = 0;
+    return 0;
+}
+
+int
+procfs_get_thread_ids_for_task(__unused proc_t p, uint64_t **thread_ids, int *thread_count)
+{
+    n_get_thread_ids++;
+    *thread_ids = NULL;
+    *thread_count = 0;
+    return 0;
+}
+
+int
+procfs_check_can_access_proc_pid(__unused kauth_cred_t creds, __unused pid_t pid)
+{
+    n_access_checks++;
+    return 0;
+}
+
+static int
+expensive_calls(void)
+{
+    return n_proc_find + n_get_pids + n_get_fd_list + n_get_thread_ids + n_access_checks;
+}
+
+#pragma mark -
+#pragma mark Read functions referenced by the structure
+
+#define STUB_READ(fn) \
+    int fn(__unused pfsnode_t *pnp, __unused uio_t uio, __unused vfs_context_t ctx) { return 0; }
+
+STUB_READ(procfs_doauxv)
+STUB_READ(procfs_docomm)
+STUB_READ(procfs_docpuinfo)
+STUB_READ(procfs_doenviron)
+STUB_READ(procfs_dofilesystems)
+STUB_READ(procfs_dofpregs)
+STUB_READ(procfs_doio)
+STUB_READ(procfs_dolimit)
+STUB_READ(procfs_doloadavg)
+STUB_READ(procfs_domap)
+STUB_READ(procfs_domaps)
+STUB_READ(procfs_domem)
+STUB_READ(procfs_domeminfo)
+STUB_READ(procfs_domtab)
+STUB_READ(procfs_donote)
+STUB_READ(procfs_dopartitions)
+STUB_READ(procfs_doprocargs)
+STUB_READ(procfs_doprocstat)
+STUB_READ(procfs_doregs)
+STUB_READ(procfs_dostat)
+STUB_READ(procfs_dostatm)
+STUB_READ(procfs_dostats)
+STUB_READ(procfs_dostatus)
+STUB_READ(procfs_doswaps)
+STUB_READ(procfs_dothreadcomm)
+STUB_READ(procfs_dothreadsched)
+STUB_READ(procfs_dothreadstat)
+STUB_READ(procfs_dothreadstatus)
+STUB_READ(procfs_douptime)
+STUB_READ(procfs_doversion)
+STUB_READ(procfs_dovmstat)
+STUB_READ(procfs_read_fd_data)
+STUB_READ(procfs_read_pgid_data)
+STUB_READ(procfs_read_pid_data)
+STUB_READ(procfs_read_ppid_data)
+STUB_READ(procfs_read_sid_data)
+STUB_READ(procfs_read_socket_data)
+STUB_READ(procfs_read_task_info)
+STUB_READ(procfs_read_thread_info)
+STUB_READ(procfs_read_tty_data)
+
+#pragma mark -
+#pragma mark Tests
+
+static int nodes_checked;
+
+/* Size attribute of a structure node, as getattr would compute it. */
+static size_t
+size_of(pfssnode_t *snode)
+{
+    pfsnode_t node;
+    memset(&node, 0, sizeof(node));
+    node.node_structure_node = snode;
+    node.node_id.nodeid_base_id = snode->psn_base_node_id;
+    node.node_id.nodeid_pid = (snode->psn_flags & PSN_FLAG_PROCESS) ? 123 : PRNODE_NO_PID;
+    node.node_id.nodeid_objectid = (snode->psn_flags & PSN_FLAG_THREAD) ? 456 : PRNODE_NO_OBJECTID;
+    return procfs_get_node_size_attr(&node, NULL);
+}
+
+/* Finds a named child of a structure node. */
+static pfssnode_t *
+child(pfssnode_t *dir, const char *name)
+{
+    pfssnode_t *snode;
+    TAILQ_FOREACH(snode, &dir->psn_children, psn_next) {
+        if (strcmp(snode->psn_name, name) == 0) {
+            return snode;
+        }
+    }
+    return NULL;
+}
+
+/* Sizes every node below (and including) snode, checking each is free. */
+static void
+walk(pfssnode_t *snode, const char *path)
+{
+    int before = expensive_calls();
+    (void)size_of(snode);
+    int calls = expensive_calls() - before;
+    checkf(calls == 0, "%s: %d expensive calls for one getattr", path, calls);
+    if (procfs_is_directory_type(snode->psn_node_type)) {
+        checkf(snode->psn_getsize_fn == NULL, "%s: directory has a size hook", path);
+    }
+    nodes_checked++;
+
+    pfssnode_t *next;
+    TAILQ_FOREACH(next, &snode->psn_children, psn_next) {
+        if (next->psn_node_type == PFSdirthis || next->psn_node_type == PFSdirparent) {
+            continue;
+        }
+        char sub[256];
+        snprintf(sub, sizeof(sub), "%s/%s", strcmp(path, "/") == 0 ? "" : path, next->psn_name);
+        walk(next, sub);
+    }
+}
+
+int
+main(void)
+{
+    procfs_structure_init();
+    pfssnode_t *root = procfs_structure_root_node();
+    checkf(root != NULL, "no structure root");
+    if (root == NULL) {
+        return 1;
+    }
+
+    walk(root, "/");
+    printf("getattr size: %d nodes, %d expensive calls\n", nodes_checked, expensive_calls());
+
+    // Directory sizes count the static entries only.
+    pfssnode_t *proc_dir = child(root, "__Process__");
+    checkf(proc_dir != NULL, "no process directory");
+    if (proc_dir != NULL) {
+        size_t root_entries = 0;
+        pfssnode_t *snode;
+        TAILQ_FOREACH(snode, &root->psn_children, psn_next) {
+            root_entries++;
+        }
+        checkf(size_of(root) == root_entries - 1, "root size %zu, expected %zu",
+               size_of(root), root_entries - 1);
+
+        pfssnode_t *fd_dir = child(proc_dir, "fd");
+        pfssnode_t *task_dir = child(proc_dir, "task");
+        checkf(fd_dir != NULL && size_of(fd_dir) == 2, "fd directory size is not 2");
+        checkf(task_dir != NULL && size_of(task_dir) == 2, "task directory size is not 2");
+
+        // "." inside a process directory reports the process directory's size.
+        pfssnode_t *dot = child(proc_dir, ".");
+        checkf(dot != NULL && size_of(dot) == size_of(proc_dir), "\".\" size differs from its directory");
+    }
+
+    // Fixed-size files keep their declared size.
+    pfssnode_t *taskinfo = proc_dir != NULL ? child(proc_dir, "taskinfo") : NULL;
+    checkf(taskinfo != NULL && size_of(taskinfo) == sizeof(struct proc_taskinfo),
+           "taskinfo size is not sizeof(struct proc_taskinfo)");
+
+    procfs_structure_free();
+
+    return check_done("getattr size");
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_klsymtab.c
+ *
+ * Tests for libklookup's staged-symbol table (lib/libklookup/kl_symtab.c):
+ * synthetic procfs_ksyms files, well-formed and malformed, parsed once and
+ * then looked up. Lookups must return what the line-by-line scan klookup
+ * used before (ref_line_value() below, copied from it) returned for the
+ * same text, including for randomly generated files.
+ *
+ *   make -C test/host check
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libklookup/kl_symtab.h>
+
+#include "check.h"
+
+/* klookup.c's former per-name scan of the staged text. */
+static uint64_t
+ref_line_value(const char *buf, size_t len, const char *name)
+{
+    size_t nl = strlen(name);
+    const char *p = buf;
+    const char *end = buf + len;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        const char *lend = eol ? eol : end;
+        if ((size_t)(lend - p) > nl + 1 &&
+            strncmp(p, name, nl) == 0 && p[nl] == ' ') {
+            const char *h = p + nl + 1;
+            if (h + 2 <= lend && h[0] == '0' && (h[1] == 'x' || h[1] == 'X')) {
+                h += 2;
+            }
+            uint64_t v = 0;
+            while (h < lend) {
+                char c = *h++;
+                int d;
+                if (c >= '0' && c <= '9') {
+                    d = c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    d = c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    d = c - 'A' + 10;
+                } else {
+                    break;
+                }
+                v = (v << 4) | (uint64_t)d;
+            }
+            return v;
+        }
+        p = eol ? eol + 1 : end;
+    }
+    return 0;
+}
+
+struct table {
+    char          *text;
+    struct kl_sym *syms;
+    int            n;
+};
+
+static void
+table_parse(struct table *t, const char *file, size_t len)
+{
+    t->text = malloc(len + 1);
+    memcpy(t->text, file, len);
+    t->text[len] = '\0';
+    int cap = kl_symtab_capacity(t->text, len);
+    t->syms = malloc((size_t)cap * sizeof(t->syms[0]));
+    t->n = kl_symtab_parse(t->text, len, t->syms, cap);
+    checkf(t->n <= cap, "parse produced %d entries for capacity %d", t->n, cap);
+}
+
+static void
+table_free(struct table *t)
+{
+    free(t->syms);
+    free(t->text);
+}
+
+static uint64_t
+table_value(const struct table *t, const char *name)
+{
+    const struct kl_sym *sym = kl_symtab_find(t->syms, t->n, name);
+    return sym != NULL ? sym->value : 0;
+}
+
+static void
+expect_value(const struct table *t, const char *name, uint64_t want, const char *what)
+{
+    uint64_t got = table_value(t, name);
+
+    checkf(got == want, "%s: %s = 0x%llx, want 0x%llx", what, name,
+        (unsigned long long)got, (unsigned long long)want);
+}
+
+/* Every name in `names` resolves exactly as the old scan did on `file`. */
+static void
+expect_same_as_scan(const char *file, size_t len, const char *const *names, int count,
+    const char *what)
+{
+    struct table t;
+
+    table_parse(&t, file, len);
+    for (int i = 0; i < count; i++) {
+        expect_value(&t, names[i], ref_line_value(file, len, names[i]), what);
+    }
+    table_free(&t);
+}
+
+static void
+test_wellformed(void)
+{
+    static const char file[] =
+        "_version 0xfffffe0007004000\n"
+        "_kernel_pmap 0xfffffe0007a1c0b8\n"
+        "_proc_gettty 0xfffffe0007b12340\n"
+        "_cpu_to_processor 0xFFFFFE0007C00000\n"
+        "_vm_page_wire_count 0xfffffe0007d00010\n"
+        "_get_task_map 0xfffffe0007e00020\n"
+        "_mach_vm_region fffffe0007f00030\n";
+    struct table t;
+
+    table_parse(&t, file, sizeof(file) - 1);
+    checkf(t.n == 7, "parsed %d entries, want 7", t.n);
+    for (int i = 1; i < t.n; i++) {
+        checkf(strcmp(t.syms[i - 1].name, t.syms[i].name) <= 0, "table not sorted at %d", i);
+    }
+    expect_value(&t, "_version", 0xfffffe0007004000ULL, "well-formed");
+    expect_value(&t, "_kernel_pmap", 0xfffffe0007a1c0b8ULL, "well-formed");
+    expect_value(&t, "_cpu_to_processor", 0xfffffe0007c00000ULL, "upper-case hex");
+    expect_value(&t, "_mach_vm_region", 0xfffffe0007f00030ULL, "no 0x prefix");
+    expect_value(&t, "_version_", 0, "longer name");
+    expect_value(&t, "_versio", 0, "prefix of a name");
+    expect_value(&t, "_absent", 0, "absent name");
+    expect_value(&t, "", 0, "empty name");
+    table_free(&t);
+
+    /* No trailing newline, CRLF line ends, and an empty file. */
+    static const char crlf[] = "_a 0x10\r\n_b 0x20\r\n_c 0x30";
+    const char *names[] = { "_a", "_b", "_c", "_d" };
+    expect_same_as_scan(crlf, sizeof(crlf) - 1, names, 4, "CRLF / no final newline");
+    expect_same_as_scan("", 0, names, 4, "empty file");
+}
+
+static void
+test_malformed(void)
+{
+    static const char file[] =
+        "\n"
+        "_nospace\n"
+        " 0x1234\n"                     /* empty name */
+        "_novalue \n"
+        "_prefixonly 0x\n"
+        "_junk 0xzz12\n"
+        "_partial 0x12zz34\n"
+        "_twospaces  0x55\n"
+        "_tab\t0x66\n"
+        "_dup 0x1\n"
+        "_dup 0x2\n"
+        "_zero 0x0\n"
+        "_zero 0x77\n"
+        "_long 0x123456789abcdef0123\n"  /* more than 64 bits of digits */
+        "_good 0xabc\n";
+    const char *names[] = {
+        "_nospace", "_novalue", "_prefixonly", "_junk", "_partial", "_twospaces",
+        "_tab", "_tab\t0x66", "_dup", "_zero", "_long", "_good",
+    };
+
+    expect_same_as_scan(file, sizeof(file) - 1, names, sizeof(names) / sizeof(names[0]),
+        "malformed");
+
+    struct table t;
+    table_parse(&t, file, sizeof(file) - 1);
+    expect_value(&t, "_dup", 0x1, "duplicate keeps first");
+    expect_value(&t, "_zero", 0, "zero first line hides later");
+    expect_value(&t, "_partial", 0x12, "value stops at non-hex");
+    expect_value(&t, "_good", 0xabc, "good line after malformed ones");
+    table_free(&t);
+
+    /* A NUL inside a name must not let it match the part before the NUL. */
+    static const char nul[] = "_ab\0cd 0x10\n_ab 0x20\n";
+    const char *nulnames[] = { "_ab", "_ab\0cd" };
+    expect_same_as_scan(nul, sizeof(nul) - 1, nulnames, 2, "NUL in name");
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rnd(uint32_t bound)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng % bound);
+}
+
+/* Random files of short names over a tiny alphabet, so names collide often. */
+static void
+test_random(void)
+{
+    static const char alpha[] = "_ab x0\n\tF";
+    char file[512];
+    char names[64][6];
+
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t len = rnd(sizeof(file));
+        for (size_t i = 0; i < len; i++) {
+            file[i] = alpha[rnd(sizeof(alpha) - 1)];
+        }
+
+        const char *ptrs[64];
+        for (int i = 0; i < 64; i++) {
+            size_t nl = 1 + rnd(sizeof(names[0]) - 1);
+            for (size_t k = 0; k < nl; k++) {
+                names[i][k] = "_abF0"[rnd(5)];
+            }
+            names[i][nl] = '\0';
+            ptrs[i] = names[i];
+        }
+        expect_same_as_scan(file, len, ptrs, 64, "random file");
+        if (failures > 10) {
+            return;
+        }
+    }
+}
+
+int
+main(void)
+{
+    test_wellformed();
+    test_malformed();
+    test_random();
+
+    return check_done("klookup symtab");
+}
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_ksyms.c
+ *
+ * Tests for procfs_ksyms' streaming symbol extraction (tools/ksyms_scan.c)
+ * on small synthetic Mach-O fileset images: a fileset header with a few
+ * entries, a com.apple.kernel slice with an LC_SYMTAB, a version string and
+ * a __LINKEDIT-style tail of nlist and string tables. Each image is fed
+ * whole and in random chunk sizes, and the result compared with a plain
+ * strcmp scan of the symbol table; malformed images must fail with the
+ * documented errors, and memory retained must stay near the table sizes.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#include "../../tools/ksyms_scan.h"
+#include "check.h"
+
+#pragma mark -
+#pragma mark Fixture images
+
+#define VERSION_STRING  "Darwin Kernel Version 23.4.0: Fri Mar 15 00:12:49 PDT 2024; " \
+                        "root:xnu-10063.101.17~1/RELEASE_ARM64_T6000"
+
+struct image {
+    uint8_t *buf;
+    size_t   len;
+};
+
+static void
+put(struct image *im, size_t off, const void *p, size_t n)
+{
+    if (off + n > im->len) {
+        im->buf = realloc(im->buf, off + n);
+        memset(im->buf + im->len, 0, off + n - im->len);
+        im->len = off + n;
+    }
+    memcpy(im->buf + off, p, n);
+}
+
+struct fixture {
+    int      nfiller;       /* filler symbols around the wanted ones */
+    size_t   gap;           /* bytes of padding before the linkedit tail */
+    int      strs_first;    /* string table before the nlist table */
+    int      no_kernel;     /* leave out the com.apple.kernel entry */
+    uint32_t magic;
+    uint32_t filetype;
+    uint32_t entry_name_off;    /* override entry_id.offset (0 = normal) */
+    uint32_t bad_cmdsize;       /* nonzero: cmdsize of the first fileset entry */
+    uint64_t symoff_override;
+    uint32_t nsyms_override;
+};
+
+/* The symbols every fixture carries, with their link-time addresses. */
+static const char *const fixed_names[] = {
+    "_version", "_kernel_pmap", "_proc_gettty", "_cpu_to_processor",
+    "_vm_page_wire_count", "_get_task_map", "_mach_vm_region",
+};
+#define NFIXED  (sizeof(fixed_names) / sizeof(fixed_names[0]))
+
+static uint64_t
+fixed_value(size_t i)
+{
+    return 0xfffffe0007004000ULL + 0x1000 * i;
+}
+
+static struct image
+make_image(const struct fixture *fx)
+{
+    struct image im = { NULL, 0 };
+    const uint64_t kfo = 0x4000;
+    static const char *entries[] = { "com.apple.driver.Example", "com.apple.kernel",
+                                     "com.apple.kec.corecrypto" };
+    int nentries = 3;
+
+    /* Fileset header and entries. */
+    size_t off = sizeof(struct mach_header_64);
+    uint32_t ncmds = 0;
+    for (int e = 0; e < nentries; e++) {
+        if (fx->no_kernel && e == 1) {
+            continue;
+        }
+        size_t namelen = strlen(entries[e]) + 1;
+        struct fileset_entry_command fe = { 0 };
+        fe.cmd = LC_FILESET_ENTRY;
+        fe.cmdsize = (uint32_t)((sizeof(fe) + namelen + 7) & ~(size_t)7);
+        fe.fileoff = e == 1 ? kfo : 0x100000 + (uint64_t)e * 0x1000;
+        fe.entry_id.offset = (uint32_t)sizeof(fe);
+        if (fx->entry_name_off != 0) {
+            fe.entry_id.offset = fx->entry_name_off;
+        }
+        uint32_t cmdsize = fe.cmdsize;
+        if (fx->bad_cmdsize != 0 && ncmds == 0) {
+            fe.cmdsize = fx->bad_cmdsize;
+        }
+        put(&im, off, &fe, sizeof(fe));
+        put(&im, off + sizeof(fe), entries[e], namelen);
+        off += cmdsize;
+        ncmds++;
+    }
+    struct mach_header_64 mh = {
+        .magic = fx->magic ? fx->magic : MH_MAGIC_64,
+        .filetype = fx->filetype ? fx->filetype : MH_FILESET,
+        .ncmds = ncmds,
+        .sizeofcmds = (uint32_t)(off - sizeof(mh)),
+    };
+    put(&im, 0, &mh, sizeof(mh));
+
+    /* The symbol and string tables. */
+    int nsyms = fx->nfiller + (int)NFIXED + 5;
+    struct nlist_64 *syms = calloc((size_t)nsyms, sizeof(*syms));
+    size_t strcap = 64 + (size_t)nsyms * 32;
+    char *strs = calloc(1, strcap);
+    size_t strsize = 1;                     /* index 0 is the empty string */
+    int s = 0;
+
+#define ADD_SYM(name, value) do {                                   \
+        syms[s].n_un.n_strx = (uint32_t)strsize;                    \
+        syms[s].n_type = N_SECT | N_EXT;                            \
+        syms[s].n_value = (value);                                  \
+        strsize += (size_t)sprintf(strs + strsize, "%s", (name)) + 1; \
+        s++;                                                        \
+    } while (0)
+
+    char name[32];
+    ADD_SYM("_version", 0);                 /* undefined first: skipped */
+    for (int i = 0; i < fx->nfiller / 2; i++) {
+        snprintf(name, sizeof(name), "_filler_%d", i);
+        ADD_SYM(name, 0xfffffe0009000000ULL + (uint64_t)i * 16);
+    }
+    for (size_t i = 0; i < NFIXED; i++) {
+        ADD_SYM(fixed_names[i], fixed_value(i));
+    }
+    ADD_SYM("_version", 0xdead);            /* duplicate: the first defined wins */
+    ADD_SYM("_version_", 0xbeef);           /* near miss */
+    for (int i = fx->nfiller / 2; i < fx->nfiller; i++) {
+        snprintf(name, sizeof(name), "_filler_%d", i);
+        ADD_SYM(name, 0xfffffe0009000000ULL + (uint64_t)i * 16);
+    }
+    syms[s].n_un.n_strx = 0;                /* no name */
+    syms[s++].n_value = 1;
+    syms[s].n_un.n_strx = (uint32_t)(strcap * 4);   /* name past the table */
+    syms[s++].n_value = 2;
+#undef ADD_SYM
+
+    /* Kernel slice: a segment command, then LC_SYMTAB; the version string after. */
+    size_t linkedit = kfo + 0x4000 + fx->gap;
+    size_t symlen = (size_t)s * sizeof(struct nlist_64);
+    struct symtab_command sc = {
+        .cmd = LC_SYMTAB, .cmdsize = sizeof(sc),
+        .nsyms = fx->nsyms_override ? fx->nsyms_override : (uint32_t)s,
+        .symoff = (uint32_t)(fx->strs_first ? linkedit + strsize : linkedit),
+        .stroff = (uint32_t)(fx->strs_first ? linkedit : linkedit + symlen),
+        .strsize = (uint32_t)strsize,
+    };
+    if (fx->symoff_override != 0) {
+        sc.symoff = (uint32_t)fx->symoff_override;
+    }
+    struct load_command seg = { .cmd = LC_SEGMENT_64, .cmdsize = 72 };
+    struct mach_header_64 km = {
+        .magic = MH_MAGIC_64, .filetype = MH_EXECUTE, .ncmds = 2,
+        .sizeofcmds = 72 + sizeof(sc),
+    };
+    put(&im, kfo, &km, sizeof(km));
+    put(&im, kfo + sizeof(km), &seg, sizeof(seg));
+    put(&im, kfo + sizeof(km) + 72, &sc, sizeof(sc));
+    put(&im, kfo + 0x1000, VERSION_STRING, sizeof(VERSION_STRING));
+
+    put(&im, sc.symoff, syms, symlen);
+    put(&im, sc.stroff, strs, strsize);
+
+    free(syms);
+    free(strs);
+    return im;
+}
+
+#pragma mark -
+#pragma mark Reference
+
+/* The old extraction: strcmp every defined symbol against every name. */
+static void
+ref_extract(const struct image *im, const char *const *names, size_t n, uint64_t *addr)
+{
+    struct mach_header_64 mh;
+    uint64_t kfo = 0;
+    size_t off = sizeof(mh);
+
+    memset(addr, 0, n * sizeof(*addr));
+    memcpy(&mh, im->buf, sizeof(mh));
+    for (uint32_t i = 0; i < mh.ncmds; i++) {
+        struct fileset_entry_command fe;
+        memcpy(&fe, im->buf + off, sizeof(fe));
+        if (fe.cmd == LC_FILESET_ENTRY &&
+            strcmp((const char *)im->buf + off + fe.entry_id.offset, "com.apple.kernel") == 0) {
+            kfo = fe.fileoff;
+        }
+        off += fe.cmdsize;
+    }
+    struct symtab_command sc;
+    memcpy(&sc, im->buf + kfo + sizeof(mh) + 72, sizeof(sc));
+    for (uint32_t i = 0; i < sc.nsyms; i++) {
+        struct nlist_64 nl;
+        memcpy(&nl, im->buf + sc.symoff + i * sizeof(nl), sizeof(nl));
+        uint32_t sx = nl.n_un.n_strx;
+        if (sx == 0 || sx >= sc.strsize || nl.n_value == 0) {
+            continue;
+        }
+        for (size_t w = 0; w < n; w++) {
+            if (addr[w] == 0 && strcmp((const char *)im->buf + sc.stroff + sx, names[w]) == 0) {
+                addr[w] = nl.n_value;
+            }
+        }
+    }
+}
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static size_t
+rnd(size_t bound)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (size_t)(rng % bound);
+}
+
+/* Feed `im` in chunks of up to `maxchunk` (0: all at once). Returns the feed error. */
+static int
+scan(struct ksyms_scan *ks, const struct image *im, size_t maxchunk)
+{
+    size_t off = 0;
+
+    while (off < im->len) {
+        size_t n = maxchunk == 0 ? im->len - off : 1 + rnd(maxchunk);
+        if (n > im->len - off) {
+            n = im->len - off;
+        }
+        int error = ksyms_scan_feed(ks, im->buf + off, n);
+        if (error != 0) {
+            return error;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+/* Scan and finish; returns the finish error and fills addr. */
+static int
+extract(const struct image *im, const char *const *names, size_t n, uint64_t *addr,
+    size_t maxchunk, size_t mem_cap, size_t *retained)
+{
+    struct ksyms_scan *ks = ksyms_scan_new(names, n, mem_cap);
+    if (ks == NULL) {
+        return ENOMEM;
+    }
+    scan(ks, im, maxchunk);
+    int error = ksyms_scan_finish(ks, addr);
+    if (error == 0) {
+        check(ksyms_scan_complete(ks), "complete after a full scan");
+        check(ksyms_scan_version(ks) != NULL &&
+              strcmp(ksyms_scan_version(ks), VERSION_STRING) == 0, "version string");
+    }
+    if (retained != NULL) {
+        *retained = ksyms_scan_retained(ks);
+    }
+    ksyms_scan_free(ks);
+    return error;
+}
+
+#pragma mark -
+#pragma mark Tests
+
+static void
+test_extract(void)
+{
+    static const size_t chunks[] = { 0, 1, 7, 64, 4096, 100000 };
+    struct fixture fx = { .nfiller = 2000 };
+
+    for (int order = 0; order < 2; order++) {
+        fx.strs_first = order;
+        struct image im = make_image(&fx);
+
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            uint64_t addr[NFIXED], want[NFIXED];
+            ref_extract(&im, fixed_names, NFIXED, want);
+            int error = extract(&im, fixed_names, NFIXED, addr, chunks[c], 1 << 20, NULL);
+            check(error == 0, "extract succeeds");
+            check(memcmp(addr, want, sizeof(addr)) == 0, "same addresses as the strcmp scan");
+            for (size_t i = 0; i < NFIXED; i++) {
+                check(addr[i] == fixed_value(i), "fixture address");
+            }
+        }
+        free(im.buf);
+    }
+}
+
+/* Random name lists, including fillers, absent names and duplicates. */
+static void
+test_random_names(void)
+{
+    struct fixture fx = { .nfiller = 500 };
+    struct image im = make_image(&fx);
+    char pool[64][32];
+    const char *names[64];
+
+    for (int iter = 0; iter < 300; iter++) {
+        size_t n = 1 + rnd(64);
+        for (size_t i = 0; i < n; i++) {
+            switch (rnd(4)) {
+            case 0:
+                snprintf(pool[i], sizeof(pool[i]), "%s", fixed_names[rnd(NFIXED)]);
+                break;
+            case 1:
+                snprintf(pool[i], sizeof(pool[i]), "_filler_%zu", rnd(600));
+                break;
+            case 2:
+                snprintf(pool[i], sizeof(pool[i]), "_absent_%zu", rnd(10));
+                break;
+            default:
+                snprintf(pool[i], sizeof(pool[i]), "%s", i > 0 ? names[rnd(i)] : "_version");
+                break;
+            }
+            names[i] = pool[i];
+        }
+
+        uint64_t addr[64], want[64];
+        ref_extract(&im, names, n, want);
+        int error = extract(&im, names, n, addr, 1 + rnd(5000), 1 << 20, NULL);
+        check(error == 0 && memcmp(addr, want, n * sizeof(addr[0])) == 0,
+              "random names match the strcmp scan");
+        if (failures > 10) {
+            break;
+        }
+    }
+    free(im.buf);
+}
+
+/* Retained memory tracks the headers and tables, not the image. */
+static void
+test_memory(void)
+{
+    struct fixture fx = { .nfiller = 1000, .gap = 8 << 20 };
+    struct image im = make_image(&fx);
+    uint64_t addr[NFIXED];
+    size_t retained = 0;
+
+    int error = extract(&im, fixed_names, NFIXED, addr, 1 << 16, 1 << 20, &retained);
+    check(error == 0, "large image extracts");
+    check(retained < 64 * 1024, "retained memory bounded by the tables");
+    check(im.len > (8 << 20), "image is large");
+
+    error = extract(&im, fixed_names, NFIXED, addr, 1 << 16, 16 * 1024, NULL);
+    check(error == EFBIG, "tables over the cap fail with EFBIG");
+    free(im.buf);
+
+    struct fixture huge = { .nsyms_override = 0x10000000 };
+    im = make_image(&huge);
+    error = extract(&im, fixed_names, NFIXED, addr, 0, 64 << 20, NULL);
+    check(error == EFBIG, "huge nsyms fails with EFBIG");
+    free(im.buf);
+}
+
+static void
+test_malformed(void)
+{
+    static const struct {
+        struct fixture fx;
+        int            error;
+        const char    *what;
+    } cases[] = {
+        { { .magic = 0xfeedface },              ENOEXEC, "32-bit magic" },
+        { { .filetype = MH_EXECUTE },           ENOEXEC, "not a fileset" },
+        { { .no_kernel = 1 },                   ENOENT,  "no kernel entry" },
+        { { .bad_cmdsize = 4 },                 ENOEXEC, "cmdsize below a load command" },
+        { { .bad_cmdsize = 0x100000 },          ENOEXEC, "cmdsize past sizeofcmds" },
+        { { .entry_name_off = 0x1000 },         ENOEXEC, "entry name outside the command" },
+        { { .symoff_override = 0x2000 },         ERANGE,  "symbol table before the kernel header" },
+    };
+    uint64_t addr[NFIXED];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        struct image im = make_image(&cases[i].fx);
+        /* Streamed: fed whole, a table behind the header would still be in reach. */
+        for (size_t chunk = 1; chunk < 64; chunk += 31) {
+            int error = extract(&im, fixed_names, NFIXED, addr, chunk, 1 << 20, NULL);
+            char what[128];
+            snprintf(what, sizeof(what), "%s: error %d, want %d", cases[i].what, error, cases[i].error);
+            check(error == cases[i].error, what);
+            check(addr[0] == 0, "no addresses on failure");
+        }
+        free(im.buf);
+    }
+
+    /* Truncated images: finish reports ENOENT, never reads past what was fed. */
+    struct fixture fx = { .nfiller = 100 };
+    struct image im = make_image(&fx);
+    for (size_t cut = 0; cut < im.len; cut += 1 + rnd(997)) {
+        struct image part = { im.buf, cut };
+        int error = extract(&part, fixed_names, NFIXED, addr, 257, 1 << 20, NULL);
+        if (error != ENOENT) {
+            check(0, "truncated image fails with ENOENT");
+            break;
+        }
+    }
+    checks++;
+
+    /* Random byte corruption: any outcome but a crash, and errors are documented ones. */
+    for (int iter = 0; iter < 2000; iter++) {
+        uint8_t *copy = malloc(im.len);
+        memcpy(copy, im.buf, im.len);
+        for (int k = 0; k < 4; k++) {
+            size_t at = rnd(0x4200 < im.len ? 0x4200 : im.len);   /* the headers */
+            copy[at] = (uint8_t)rnd(256);
+        }
+        struct image bad = { copy, im.len };
+        int error = extract(&bad, fixed_names, NFIXED, addr, 1 + rnd(300), 1 << 20, NULL);
+        check(error == 0 || error == ENOEXEC || error == ENOENT || error == ERANGE ||
+              error == EFBIG, "corrupted header fails cleanly");
+        free(copy);
+    }
+    free(im.buf);
+}
+
+static void
+test_staged(void)
+{
+    const uint64_t fp = 0x0123456789abcdefULL;
+    static const char good[] =
+        "# procfs kernel symbols (auto-generated; do not edit)\n"
+        "# build xnu-10063.101.17~1/RELEASE_ARM64_T6000\n"
+        KSYMS_FP_PREFIX "0x0123456789abcdef\n"
+        "_version 0xfffffe0007004000\n"
+        "_kernel_pmap 0xfffffe0007005000\n"
+        "_proc_gettty 0xfffffe0007006000\n";
+    static const char no_pmap[] =
+        KSYMS_FP_PREFIX "0x0123456789abcdef\n"
+        "_version 0xfffffe0007004000\n";
+    static const char short_fp[] =
+        KSYMS_FP_PREFIX "0x123456789abcdef\n"
+        "_version 0x1\n_kernel_pmap 0x2\n";
+    static const char trailing[] =
+        KSYMS_FP_PREFIX "0x0123456789abcdefzz\n"
+        "_version 0x1\n_kernel_pmap 0x2\n";
+    static const char old_format[] =
+        "# build xnu-10063.101.17~1/RELEASE_ARM64_T6000\n"
+        "_version 0x1\n_kernel_pmap 0x2\n";
+
+    check(ksyms_staged_current(good, sizeof(good) - 1, fp), "staged file is current");
+    check(!ksyms_staged_current(good, sizeof(good) - 1, fp + 1), "different fingerprint");
+    check(!ksyms_staged_current(no_pmap, sizeof(no_pmap) - 1, fp), "missing anchor");
+    check(!ksyms_staged_current(short_fp, sizeof(short_fp) - 1, 0x123456789abcdefULL),
+          "short fingerprint");
+    check(!ksyms_staged_current(trailing, sizeof(trailing) - 1, fp), "fingerprint with junk");
+    check(!ksyms_staged_current(old_format, sizeof(old_format) - 1, fp), "no fingerprint line");
+    check(!ksyms_staged_current("", 0, fp), "empty file");
+
+    check(ksyms_fnv1a(KSYMS_FNV_INIT, "a", 1) == 0xaf63dc4c8601ec8cULL, "FNV-1a of \"a\"");
+}
+
+int
+main(void)
+{
+    test_extract();
+    test_random_names();
+    test_memory();
+    test_malformed();
+    test_staged();
+
+    return check_done("ksyms scan");
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_procfs_ring.c
+ *
+ * Tests for the shared-memory record ring (kext/procfs_ring.c): records
+ * round-trip in order across wraps, a full ring refuses rather than
+ * overwrites, a peer that scribbles on the shared indices or headers breaks
+ * the ring instead of sending the other side out of bounds, and - with a
+ * producer and a consumer thread that sleep on a pipe the way procfsd and
+ * the kext sleep on the control socket - no record and no wakeup is lost.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fs/procfs/procfs_ring.h>
+
+#include "check.h"
+
+/* A ring's shared page and data area, and a view from each side. */
+struct pair {
+    struct procfs_ring_shared sh;
+    uint8_t                  *data;
+    struct procfs_ring        prod;
+    struct procfs_ring        cons;
+};
+
+static int
+pair_init(struct pair *p, uint32_t size)
+{
+    p->data = malloc(size);
+    if (p->data == NULL ||
+        procfs_ring_init(&p->prod, &p->sh, p->data, size, 1) != 0 ||
+        procfs_ring_init(&p->cons, &p->sh, p->data, size, 0) != 0) {
+        free(p->data);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+pair_fini(struct pair *p)
+{
+    free(p->data);
+}
+
+#pragma mark -
+#pragma mark Single thread
+
+static void
+test_init(void)
+{
+    struct procfs_ring_shared sh;
+    struct procfs_ring r;
+    uint8_t data[256];
+    check(procfs_ring_init(&r, &sh, data, 100, 1) == EINVAL, "size must be a power of two");
+    check(procfs_ring_init(&r, &sh, data, 32, 1) == EINVAL, "size must be at least the minimum");
+    check(procfs_ring_init(&r, &sh, data, 256, 1) == 0 && sh.head == 0 && sh.tail == 0,
+        "reset zeroes the indices");
+    check(sizeof(struct procfs_ring_shared) == 192, "shared indices on separate cache lines");
+}
+
+static void
+test_basic(void)
+{
+    struct pair p;
+    if (pair_init(&p, 256) != 0) {
+        check(0, "ring setup");
+        return;
+    }
+    uint32_t len;
+    check(procfs_ring_peek(&p.cons, &len) == NULL, "empty ring has nothing to peek");
+
+    check(procfs_ring_put(&p.prod, "hello", 5) == 0, "put");
+    check(procfs_ring_put(&p.prod, "", 0) == 0, "put empty record");
+    check(procfs_ring_put(&p.prod, "world!!!", 8) == 0, "put aligned record");
+    check(p.sh.head == PROCFS_RING_RECSIZE(5) + PROCFS_RING_RECSIZE(0) + PROCFS_RING_RECSIZE(8),
+        "records padded to 8");
+
+    const char *rec = procfs_ring_peek(&p.cons, &len);
+    check(rec != NULL && len == 5 && memcmp(rec, "hello", 5) == 0, "first record");
+    check(procfs_ring_peek(&p.cons, &len) == rec, "peek again without consuming");
+    procfs_ring_consume(&p.cons);
+    rec = procfs_ring_peek(&p.cons, &len);
+    check(rec != NULL && len == 0, "empty record");
+    procfs_ring_consume(&p.cons);
+    rec = procfs_ring_peek(&p.cons, &len);
+    check(rec != NULL && len == 8 && memcmp(rec, "world!!!", 8) == 0, "third record");
+    procfs_ring_consume(&p.cons);
+    check(procfs_ring_peek(&p.cons, &len) == NULL && p.sh.tail == p.sh.head, "drained");
+    procfs_ring_consume(&p.cons);
+    check(p.sh.tail == p.sh.head, "consume with nothing peeked is a no-op");
+
+    /* Reserve, build in place, commit less than reserved. */
+    int error = 0;
+    char *w = procfs_ring_reserve(&p.prod, 64, &error);
+    check(w != NULL, "reserve");
+    memcpy(w, "in place", 8);
+    check(procfs_ring_peek(&p.cons, &len) == NULL, "reserved record not visible before commit");
+    procfs_ring_commit(&p.prod, 8);
+    rec = procfs_ring_peek(&p.cons, &len);
+    check(rec != NULL && len == 8 && memcmp(rec, "in place", 8) == 0, "committed record");
+    procfs_ring_consume(&p.cons);
+    uint64_t head = p.sh.head;
+    procfs_ring_commit(&p.prod, 8);
+    check(p.sh.head == head, "commit without a reservation is a no-op");
+
+    check(procfs_ring_reserve(&p.prod, PROCFS_RING_MAXREC(256) + 1, &error) == NULL &&
+        error == EMSGSIZE, "oversized record refused");
+    pair_fini(&p);
+}
+
+static void
+test_full_and_wrap(void)
+{
+    struct pair p;
+    if (pair_init(&p, 256) != 0) {
+        check(0, "ring setup");
+        return;
+    }
+    uint8_t rec[56], got[56];
+    uint32_t len;
+
+    /* 64-byte records: four fill the ring, a fifth does not fit. */
+    for (int i = 0; i < 4; i++) {
+        memset(rec, i, sizeof(rec));
+        check(procfs_ring_put(&p.prod, rec, sizeof(rec)) == 0, "fill");
+    }
+    int error = 0;
+    check(procfs_ring_reserve(&p.prod, 0, &error) == NULL && error == ENOBUFS, "full ring refuses");
+    check(procfs_ring_put(&p.prod, rec, 1) == ENOBUFS, "full ring put is ENOBUFS");
+
+    /* Free one and write a bigger record: it must not wrap, so it waits for more room. */
+    memcpy(got, procfs_ring_peek(&p.cons, &len), sizeof(got));
+    procfs_ring_consume(&p.cons);
+    check(got[0] == 0 && got[55] == 0, "oldest record first");
+    check(procfs_ring_put(&p.prod, rec, 100) == ENOBUFS, "a record that would wrap waits");
+    check(procfs_ring_put(&p.prod, rec, 40) == 0, "a record that fits the gap goes in");
+
+    /* Consume the rest; each comes out whole and in order. */
+    for (int i = 1; i < 4; i++) {
+        const uint8_t *r = procfs_ring_peek(&p.cons, &len);
+        check(r != NULL && len == 56 && r[0] == i && r[55] == i, "records in order");
+        procfs_ring_consume(&p.cons);
+    }
+    check(procfs_ring_peek(&p.cons, &len) != NULL && len == 40, "wrapped record");
+    procfs_ring_consume(&p.cons);
+
+    /* One record at a time, of lengths that keep padding out the end and wrapping. */
+    for (int round = 0; round < 50; round++) {
+        uint32_t n = 1 + (uint32_t)(round * 37) % PROCFS_RING_MAXREC(256);
+        memset(rec, round, sizeof(rec));
+        uint8_t *w = procfs_ring_reserve(&p.prod, n, &error);
+        if (w == NULL) {
+            check(0, "reserve after drain");
+            break;
+        }
+        for (uint32_t k = 0; k < n; k++) {
+            w[k] = (uint8_t)(round + k);
+        }
+        procfs_ring_commit(&p.prod, n);
+        const uint8_t *r = procfs_ring_peek(&p.cons, &len);
+        int ok = r != NULL && len == n;
+        for (uint32_t k = 0; ok && k < n; k++) {
+            ok = r[k] == (uint8_t)(round + k);
+        }
+        check(ok, "record survives the wrap");
+        procfs_ring_consume(&p.cons);
+    }
+    check(p.sh.head == p.sh.tail && !procfs_ring_broken(&p.cons) && !procfs_ring_broken(&p.prod),
+        "ring healthy after wrapping");
+    pair_fini(&p);
+}
+
+/* A peer writing nonsense into the shared page breaks the ring, nothing worse. */
+static void
+test_corrupt(void)
+{
+    struct pair p;
+    uint32_t len;
+    int error;
+
+    if (pair_init(&p, 256) != 0) {
+        check(0, "ring setup");
+        return;
+    }
+    p.sh.head = 100000;
+    check(procfs_ring_peek(&p.cons, &len) == NULL && procfs_ring_broken(&p.cons),
+        "head far past tail breaks the consumer");
+    check(procfs_ring_sleep_ok(&p.cons) == 1, "a broken consumer may sleep");
+    pair_fini(&p);
+
+    pair_init(&p, 256);
+    procfs_ring_put(&p.prod, "abc", 3);
+    struct { uint32_t len, kind; } hdr = { .len = 200, .kind = 0 };
+    memcpy(p.data, &hdr, sizeof(hdr));
+    check(procfs_ring_peek(&p.cons, &len) == NULL && procfs_ring_broken(&p.cons),
+        "record longer than what was committed breaks the consumer");
+    pair_fini(&p);
+
+    pair_init(&p, 256);
+    procfs_ring_put(&p.prod, "abc", 3);
+    hdr.len = 3;
+    hdr.kind = 7;
+    memcpy(p.data, &hdr, sizeof(hdr));
+    check(procfs_ring_peek(&p.cons, &len) == NULL && procfs_ring_broken(&p.cons),
+        "unknown record kind breaks the consumer");
+    pair_fini(&p);
+
+    pair_init(&p, 256);
+    procfs_ring_put(&p.prod, "abc", 3);
+    p.sh.tail = 1000;
+    check(procfs_ring_put(&p.prod, "d", 1) == EIO && procfs_ring_broken(&p.prod),
+        "tail past head breaks the producer");
+    check(procfs_ring_reserve(&p.prod, 1, &error) == NULL && error == EIO,
+        "a broken producer stays broken");
+    pair_fini(&p);
+}
+
+static void
+test_wake_flag(void)
+{
+    struct pair p;
+    uint32_t len;
+    if (pair_init(&p, 256) != 0) {
+        check(0, "ring setup");
+        return;
+    }
+    check(procfs_ring_wake_needed(&p.prod) == 0, "no wakeup while the consumer is awake");
+    check(procfs_ring_sleep_ok(&p.cons) == 1, "empty ring: consumer may sleep");
+    procfs_ring_put(&p.prod, "x", 1);
+    check(procfs_ring_wake_needed(&p.prod) == 1, "sleeping consumer needs a wakeup");
+    check(procfs_ring_wake_needed(&p.prod) == 0, "one wakeup per sleep");
+
+    procfs_ring_put(&p.prod, "y", 1);
+    check(procfs_ring_sleep_ok(&p.cons) == 0, "records waiting: consumer must not sleep");
+    check(procfs_ring_wake_needed(&p.prod) == 0, "flag withdrawn when it did not sleep");
+    procfs_ring_peek(&p.cons, &len);
+    procfs_ring_consume(&p.cons);
+    procfs_ring_peek(&p.cons, &len);
+    procfs_ring_consume(&p.cons);
+    check(procfs_ring_sleep_ok(&p.cons) == 1, "drained: may sleep again");
+    pair_fini(&p);
+}
+
+#pragma mark -
+#pragma mark Two threads
+
+/*
+ * The producer sends `count` records of varying length, each filled from its
+ * sequence number, and writes a byte to `wake` whenever the ring asks for a
+ * wakeup; when the ring is full it waits for `room` the same way. The
+ * consumer checks every record and sleeps in poll() when allowed to.
+ */
+struct stress {
+    struct pair p;
+    int         wake[2];        /* producer -> consumer */
+    int         room[2];        /* consumer -> producer */
+    uint32_t    count;
+    uint32_t    bad;
+    uint32_t    received;
+    uint64_t    wakeups;
+    int         room_wanted;
+};
+
+static uint32_t
+rec_len(uint32_t i, uint32_t max)
+{
+    return (i * 2654435761u) % (max + 1);
+}
+
+static void
+fill(uint8_t *buf, uint32_t i, uint32_t len)
+{
+    for (uint32_t k = 0; k < len; k++) {
+        buf[k] = (uint8_t)(i * 31 + k);
+    }
+}
+
+/* Sleep until the fd is readable, and drain it; fail the test after 5 s. */
+static int
+sleep_on(int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pfd, 1, 5000) != 1) {
+        return -1;
+    }
+    char buf[64];
+    (void)read(fd, buf, sizeof(buf));
+    return 0;
+}
+
+static void *
+producer(void *arg)
+{
+    struct stress *s = arg;
+    uint32_t max = PROCFS_RING_MAXREC(s->p.prod.size);
+    for (uint32_t i = 0; i < s->count; i++) {
+        uint32_t len = rec_len(i, max);
+        int error;
+        uint8_t *w;
+        while ((w = procfs_ring_reserve(&s->p.prod, len, &error)) == NULL) {
+            if (error != ENOBUFS) {
+                return NULL;
+            }
+            /* Full: wait for the consumer, with the same flag protocol turned round. */
+            __atomic_store_n(&s->room_wanted, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if ((w = procfs_ring_reserve(&s->p.prod, len, &error)) != NULL) {
+                __atomic_store_n(&s->room_wanted, 0, __ATOMIC_SEQ_CST);
+                break;
+            }
+            if (sleep_on(s->room[0]) != 0) {
+                return NULL;
+            }
+        }
+        fill(w, i, len);
+        memcpy(w, &i, len < sizeof(i) ? len : sizeof(i));
+        procfs_ring_commit(&s->p.prod, len);
+        if (procfs_ring_wake_needed(&s->p.prod)) {
+            __atomic_fetch_add(&s->wakeups, 1, __ATOMIC_RELAXED);
+            (void)write(s->wake[1], "w", 1);
+        }
+    }
+    return NULL;
+}
+
+static void *
+consumer(void *arg)
+{
+    struct stress *s = arg;
+    uint32_t max = PROCFS_RING_MAXREC(s->p.cons.size);
+    uint8_t  want[PROCFS_RING_MAXREC(4096)];
+    while (s->received < s->count) {
+        uint32_t len;
+        const uint8_t *r = procfs_ring_peek(&s->p.cons, &len);
+        if (r == NULL) {
+            if (procfs_ring_broken(&s->p.cons)) {
+                s->bad++;
+                return NULL;
+            }
+            if (procfs_ring_sleep_ok(&s->p.cons) && sleep_on(s->wake[0]) != 0) {
+                s->bad++;           /* lost wakeup */
+                return NULL;
+            }
+            continue;
+        }
+        uint32_t i = s->received;
+        uint32_t n = rec_len(i, max);
+        fill(want, i, n);
+        memcpy(want, &i, n < sizeof(i) ? n : sizeof(i));
+        if (len != n || memcmp(r, want, n) != 0) {
+            s->bad++;
+        }
+        procfs_ring_consume(&s->p.cons);
+        s->received++;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&s->room_wanted, 0, __ATOMIC_SEQ_CST)) {
+            (void)write(s->room[1], "r", 1);
+        }
+    }
+    return NULL;
+}
+
+static void
+test_threads(uint32_t size, uint32_t count)
+{
+    struct stress s = { .count = count };
+    if (pair_init(&s.p, size) != 0 || pipe(s.wake) != 0 || pipe(s.room) != 0) {
+        check(0, "stress setup");
+        return;
+    }
+    pthread_t pt, ct;
+    pthread_create(&ct, NULL, consumer, &s);
+    pthread_create(&pt, NULL, producer, &s);
+    pthread_join(pt, NULL);
+    pthread_join(ct, NULL);
+
+    char what[96];
+    snprintf(what, sizeof(what), "%u records through a %u-byte ring, in order and intact",
+        count, size);
+    check(s.received == count && s.bad == 0, what);
+    check(s.wakeups <= count, "at most one wakeup per record");
+    close(s.wake[0]);
+    close(s.wake[1]);
+    close(s.room[0]);
+    close(s.room[1]);
+    pair_fini(&s.p);
+}
+
+int
+main(void)
+{
+    test_init();
+    test_basic();
+    test_full_and_wrap();
+    test_corrupt();
+    test_wake_flag();
+    test_threads(256, 200000);
+    test_threads(4096, 200000);
+
+    return check_done("procfs ring");
+}
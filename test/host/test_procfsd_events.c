@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_procfsd_events.c
+ *
+ * Tests for procfsd's lifecycle tracking (tools/procfsd_events.c) and the
+ * kext's check of the batches it sends (procfs_ctl_core_events). The main
+ * test replays traces/lifecycle.trace - see its header for the format -
+ * against a synthetic process table and kqueue; the rest build batches too
+ * large for one datagram and malformed ones.
+ *
+ *   make -C test/host check
+ *   ./test_procfsd_events [trace...]
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fs/procfs/procfs_ctl_core.h>
+
+#include "../../tools/procfsd_events.h"
+#include "check.h"
+
+#pragma mark -
+#pragma mark Synthetic processes and kqueue
+
+#define NPIDS   4096
+
+struct world {
+    int      alive[NPIDS];
+    pid_t    ppid[NPIDS];
+    int      watched[NPIDS];
+    uint32_t notes[NPIDS];          /* pending, or'd together */
+    pid_t    queue[NPIDS];          /* pids with notes pending, oldest first */
+    int      nqueue;
+};
+
+static int
+w_watch(void *ctx, pid_t pid)
+{
+    struct world *w = ctx;
+    if (pid <= 0 || pid >= NPIDS || !w->alive[pid]) {
+        return ESRCH;
+    }
+    w->watched[pid] = 1;
+    return 0;
+}
+
+static int
+w_list_all(void *ctx, pid_t *pids, int max)
+{
+    struct world *w = ctx;
+    int n = 0;
+    for (pid_t p = 1; p < NPIDS && n < max; p++) {
+        if (w->alive[p]) {
+            pids[n++] = p;
+        }
+    }
+    return n;
+}
+
+static int
+w_list_children(void *ctx, pid_t ppid, pid_t *pids, int max)
+{
+    struct world *w = ctx;
+    int n = 0;
+    for (pid_t p = 1; p < NPIDS && n < max; p++) {
+        if (w->alive[p] && w->ppid[p] == ppid) {
+            pids[n++] = p;
+        }
+    }
+    return n;
+}
+
+static int
+w_next(void *ctx, pid_t *pid, uint32_t *notes)
+{
+    struct world *w = ctx;
+    if (w->nqueue == 0) {
+        return 0;
+    }
+    *pid = w->queue[0];
+    memmove(&w->queue[0], &w->queue[1], (size_t)--w->nqueue * sizeof(w->queue[0]));
+    *notes = w->notes[*pid];
+    w->notes[*pid] = 0;
+    return 1;
+}
+
+static const struct procfsd_events_ops w_ops = {
+    .watch         = w_watch,
+    .list_all      = w_list_all,
+    .list_children = w_list_children,
+    .next          = w_next,
+};
+
+static void
+w_note(struct world *w, pid_t pid, uint32_t note)
+{
+    if (!w->watched[pid]) {
+        return;
+    }
+    if (w->notes[pid] == 0) {
+        w->queue[w->nqueue++] = pid;
+    }
+    w->notes[pid] |= note;
+    if (note == PROCFSD_NOTE_EXIT) {
+        w->watched[pid] = 0;        /* the knote goes with the process */
+    }
+}
+
+static void
+w_fork(struct world *w, pid_t ppid, pid_t pid)
+{
+    w->alive[pid] = 1;
+    w->ppid[pid]  = ppid;
+    w_note(w, ppid, PROCFSD_NOTE_FORK);
+}
+
+static void
+w_exit(struct world *w, pid_t pid)
+{
+    w->alive[pid] = 0;
+    for (pid_t p = 1; p < NPIDS; p++) {
+        if (w->alive[p] && w->ppid[p] == pid) {
+            w->ppid[p] = 1;
+        }
+    }
+    w_note(w, pid, PROCFSD_NOTE_EXIT);
+}
+
+#pragma mark -
+#pragma mark The kext side
+
+/* What the kext received: the events of every batch in order, and any loss. */
+struct kext {
+    struct procfs_ctl_event ev[8192];
+    int                     head, tail;
+    uint32_t                dropped;
+    int                     bad;        /* batches procfs_ctl_core_events refused */
+    int                     batches;
+};
+
+static void
+kext_receive(struct kext *k, const uint8_t *dgram, size_t len)
+{
+    struct procfs_ctl_evhdr hdr;
+    memcpy(&hdr, dgram, sizeof(hdr));
+    int n = procfs_ctl_core_events(&hdr, len - sizeof(hdr));
+    if (n < 0) {
+        k->bad++;
+        return;
+    }
+    k->batches++;
+    k->dropped += hdr.dropped;
+    memcpy(&k->ev[k->tail], dgram + sizeof(hdr), (size_t)n * sizeof(k->ev[0]));
+    k->tail += n;
+}
+
+/* procfsd's procfsd_events_send(), with the kext as the socket. */
+static void
+sync_events(struct procfsd_events *evs, struct kext *k)
+{
+    static uint8_t dgram[PROCFSD_EVENTS_MAX];
+    for (;;) {
+        (void)procfsd_events_poll(evs);
+        size_t len = procfsd_events_flush(evs, dgram);
+        if (len == 0) {
+            break;
+        }
+        kext_receive(k, dgram, len);
+    }
+}
+
+#pragma mark -
+#pragma mark Trace replay
+
+static uint32_t
+kind_of(const char *s)
+{
+    return strcmp(s, "fork") == 0 ? PROCFS_EV_FORK :
+           strcmp(s, "exec") == 0 ? PROCFS_EV_EXEC :
+           strcmp(s, "exit") == 0 ? PROCFS_EV_EXIT : 0;
+}
+
+static void
+replay(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("  %s: %s\n", path, strerror(errno));
+        check(0, "trace opens");
+        return;
+    }
+    static struct world w;
+    static struct procfsd_events evs;
+    static struct kext k;
+    memset(&w, 0, sizeof(w));
+    memset(&k, 0, sizeof(k));
+
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        char cmd[32] = "", a[32] = "";
+        int x = -1, y = -1;
+        int nf = sscanf(line, "%31s", cmd);
+        if (nf != 1 || cmd[0] == '#') {
+            continue;
+        }
+
+        char what[320];
+        snprintf(what, sizeof(what), "%s:%d: %.*s", path, lineno,
+            (int)strcspn(line, "\n"), line);
+        if (strcmp(cmd, "proc") == 0 && sscanf(line, "%*s %d %d", &x, &y) == 2) {
+            w.alive[x] = 1;
+            w.ppid[x]  = y;
+        } else if (strcmp(cmd, "start") == 0) {
+            procfsd_events_init(&evs, &w_ops, &w);
+        } else if (strcmp(cmd, "fork") == 0 && sscanf(line, "%*s %d %d", &x, &y) == 2) {
+            w_fork(&w, x, y);
+        } else if (strcmp(cmd, "exec") == 0 && sscanf(line, "%*s %d", &x) == 1) {
+            w_note(&w, x, PROCFSD_NOTE_EXEC);
+        } else if (strcmp(cmd, "exit") == 0 && sscanf(line, "%*s %d", &x) == 1) {
+            w_exit(&w, x);
+        } else if (strcmp(cmd, "resync") == 0) {
+            procfsd_events_resync(&evs);
+        } else if (strcmp(cmd, "sync") == 0) {
+            sync_events(&evs, &k);
+        } else if (strcmp(cmd, "expect") == 0 && sscanf(line, "%*s %31s", a) == 1) {
+            if (strcmp(a, "dropped") == 0) {
+                check(k.dropped != 0, what);
+                k.dropped = 0;
+            } else if (strcmp(a, "none") == 0) {
+                check(k.head == k.tail && k.dropped == 0, what);
+            } else {
+                int n = sscanf(line, "%*s %*s %d %d", &x, &y);
+                const struct procfs_ctl_event *e = &k.ev[k.head];
+                check(k.head < k.tail && n >= 1 && e->kind == kind_of(a) && e->pid == x &&
+                    e->ppid == (n == 2 ? y : 0), what);
+                if (k.head < k.tail) {
+                    k.head++;
+                }
+            }
+        } else {
+            check(0, what);         /* unknown command */
+        }
+    }
+    fclose(fp);
+    check(k.bad == 0, "every batch well-formed");
+}
+
+#pragma mark -
+#pragma mark Batching
+
+/* More events than fit in one datagram: they go out in several, none lost. */
+static void
+test_split(void)
+{
+    static struct world w;
+    static struct procfsd_events evs;
+    static struct kext k;
+    memset(&w, 0, sizeof(w));
+    memset(&k, 0, sizeof(k));
+
+    enum { N = 1200 };
+    w.alive[1] = 1;
+    for (pid_t p = 2; p < 2 + N; p++) {
+        w.alive[p] = 1;
+        w.ppid[p]  = 1;
+    }
+    procfsd_events_init(&evs, &w_ops, &w);
+    sync_events(&evs, &k);
+    k.dropped = 0;
+    k.batches = 0;
+
+    for (pid_t p = 2; p < 2 + N; p++) {
+        w_note(&w, p, PROCFSD_NOTE_EXEC);
+    }
+    sync_events(&evs, &k);
+    check(k.batches == (N + PROCFS_CTL_MAXEVENTS - 1) / PROCFS_CTL_MAXEVENTS,
+        "split into full datagrams");
+    check(k.tail == N && k.dropped == 0, "every event delivered");
+    int ordered = 1;
+    for (int i = 0; i < N; i++) {
+        ordered &= k.ev[i].kind == PROCFS_EV_EXEC && k.ev[i].pid == 2 + i;
+    }
+    check(ordered, "in order");
+    check(evs.counts.execs == N, "exec count");
+}
+
+/* One notification that alone overflows a batch: the rest is reported lost. */
+static void
+test_overflow(void)
+{
+    static struct world w;
+    static struct procfsd_events evs;
+    static struct kext k;
+    memset(&w, 0, sizeof(w));
+    memset(&k, 0, sizeof(k));
+
+    enum { N = PROCFS_CTL_MAXEVENTS + 100 };
+    w.alive[1] = 1;
+    procfsd_events_init(&evs, &w_ops, &w);
+    sync_events(&evs, &k);
+    k.dropped = 0;
+
+    for (pid_t p = 2; p < 2 + N; p++) {
+        w_fork(&w, 1, p);
+    }
+    sync_events(&evs, &k);
+    check(k.tail == (int)PROCFS_CTL_MAXEVENTS && k.dropped == 100, "overflow reported as dropped");
+    check(evs.counts.forks == PROCFS_CTL_MAXEVENTS && evs.counts.dropped == 100, "overflow counts");
+
+    /* The children did get watched, so what they do next is seen. */
+    k.head = k.tail;
+    k.dropped = 0;
+    w_exit(&w, 2 + N - 1);
+    sync_events(&evs, &k);
+    check(k.tail - k.head == 1 && k.ev[k.head].kind == PROCFS_EV_EXIT &&
+        k.ev[k.head].pid == 2 + N - 1, "dropped child still tracked");
+}
+
+static void
+test_check(void)
+{
+    struct procfs_ctl_evhdr hdr = { .magic = PROCFS_CTL_EVMAGIC, .count = 2 };
+    size_t rec = sizeof(struct procfs_ctl_event);
+    check(procfs_ctl_core_events(&hdr, 2 * rec) == 2, "well-formed batch");
+    check(procfs_ctl_core_events(&hdr, 2 * rec + 5) == 2, "trailing bytes ignored");
+    check(procfs_ctl_core_events(&hdr, 2 * rec - 1) == -1, "short batch refused");
+    hdr.count = PROCFS_CTL_MAXEVENTS + 1;
+    check(procfs_ctl_core_events(&hdr, 1 << 20) == -1, "oversized batch refused");
+    hdr.count = 0;
+    check(procfs_ctl_core_events(&hdr, 0) == 0, "empty batch");
+    hdr.magic = PROCFS_CTL_MAGIC;
+    check(procfs_ctl_core_events(&hdr, 0) == -1, "reply magic refused");
+}
+
+static void
+test_print(void)
+{
+    static struct world w;
+    static struct procfsd_events evs;
+    memset(&w, 0, sizeof(w));
+    w.alive[1] = 1;
+    procfsd_events_init(&evs, &w_ops, &w);
+    w_fork(&w, 1, 2);
+    check(procfsd_events_poll(&evs) == 1, "poll adds the fork");
+    w_note(&w, 2, PROCFSD_NOTE_EXEC);
+    check(procfsd_events_poll(&evs) == 1, "poll adds the exec");
+    uint8_t dgram[PROCFSD_EVENTS_MAX];
+    check(procfsd_events_flush(&evs, dgram) ==
+        sizeof(struct procfs_ctl_evhdr) + 2 * sizeof(struct procfs_ctl_event), "flush length");
+
+    char buf[256] = { 0 };
+    FILE *fp = fmemopen(buf, sizeof(buf) - 1, "w");
+    check(procfsd_events_print(&evs, fp) == 0, "print");
+    fclose(fp);
+    check(strcmp(buf, "events forks 1 execs 1 exits 0 dropped 0 batches 1\n") == 0, "print text");
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            replay(argv[i]);
+        }
+    } else {
+        replay("traces/lifecycle.trace");
+    }
+    test_split();
+    test_overflow();
+    test_check();
+    test_print();
+
+    return check_done("procfsd events");
+}
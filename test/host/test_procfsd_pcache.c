@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_procfsd_pcache.c
+ *
+ * Tests for procfsd's task-port cache (tools/procfsd_pcache.c) against a
+ * synthetic port and exit-event source standing in for Mach and the kqueue:
+ * hits and misses, thread-list refresh, exits reported before and after
+ * caching, pid reuse, LRU eviction at the size bound, and that every port
+ * taken is given back exactly once.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../tools/procfsd_pcache.h"
+#include "check.h"
+
+#define NS_PER_S    1000000000ULL
+#define NPIDS       256
+
+/*
+ * The synthetic world: processes that are alive or not, each with a
+ * generation bumped on pid reuse, task ports that encode pid and generation,
+ * and a queue of reported exits.
+ */
+struct world {
+    int      alive[NPIDS];
+    uint32_t gen[NPIDS];
+    int      watched[NPIDS];
+    int      deny[NPIDS];           /* task_open fails with EPERM */
+    uint32_t nthreads[NPIDS];
+    pid_t    exits[64];
+    int      nexits;
+    int      tasks_open;            /* outstanding task ports */
+    int      lists_open;            /* outstanding thread lists */
+    int      task_opens;
+    int      thread_gets;
+    int      unwatches;
+};
+
+static uint32_t
+task_port(pid_t pid, uint32_t gen)
+{
+    return (uint32_t)pid << 16 | gen;
+}
+
+static int
+w_task_open(void *ctx, pid_t pid, uint32_t *task)
+{
+    struct world *w = ctx;
+    if (!w->alive[pid]) {
+        return ESRCH;
+    }
+    if (w->deny[pid]) {
+        return EPERM;
+    }
+    w->tasks_open++;
+    w->task_opens++;
+    *task = task_port(pid, w->gen[pid]);
+    return 0;
+}
+
+static void
+w_task_close(void *ctx, uint32_t task)
+{
+    struct world *w = ctx;
+    w->tasks_open--;
+}
+
+static int
+w_threads_get(void *ctx, uint32_t task, uint32_t **threads, uint32_t *count)
+{
+    struct world *w = ctx;
+    pid_t pid = (pid_t)(task >> 16);
+    if (!w->alive[pid] || w->gen[pid] != (task & 0xffff)) {
+        return ESRCH;                   /* the task port is dead */
+    }
+    uint32_t n = w->nthreads[pid];
+    uint32_t *list = malloc((n ? n : 1) * sizeof(*list));
+    for (uint32_t i = 0; i < n; i++) {
+        list[i] = task + i;
+    }
+    w->lists_open++;
+    w->thread_gets++;
+    *threads = list;
+    *count   = n;
+    return 0;
+}
+
+static void
+w_threads_put(void *ctx, uint32_t *threads, uint32_t count)
+{
+    struct world *w = ctx;
+    w->lists_open--;
+    free(threads);
+}
+
+static int
+w_watch(void *ctx, pid_t pid)
+{
+    struct world *w = ctx;
+    if (!w->alive[pid]) {
+        return ESRCH;
+    }
+    w->watched[pid] = 1;
+    return 0;
+}
+
+static void
+w_unwatch(void *ctx, pid_t pid)
+{
+    struct world *w = ctx;
+    w->watched[pid] = 0;
+    w->unwatches++;
+}
+
+static int
+w_next_exit(void *ctx, pid_t *pid)
+{
+    struct world *w = ctx;
+    if (w->nexits == 0) {
+        return 0;
+    }
+    *pid = w->exits[0];
+    memmove(&w->exits[0], &w->exits[1], (size_t)--w->nexits * sizeof(w->exits[0]));
+    return 1;
+}
+
+static const struct procfsd_pcache_ops w_ops = {
+    .task_open   = w_task_open,
+    .task_close  = w_task_close,
+    .threads_get = w_threads_get,
+    .threads_put = w_threads_put,
+    .watch       = w_watch,
+    .unwatch     = w_unwatch,
+    .next_exit   = w_next_exit,
+};
+
+static void
+spawn(struct world *w, pid_t pid, uint32_t nthreads)
+{
+    w->alive[pid] = 1;
+    w->gen[pid]++;
+    w->nthreads[pid] = nthreads;
+}
+
+/* The process exits; the exit is reported only if it was watched, as NOTE_EXIT. */
+static void
+reap(struct world *w, pid_t pid)
+{
+    w->alive[pid] = 0;
+    if (w->watched[pid]) {
+        w->watched[pid] = 0;
+        w->exits[w->nexits++] = pid;
+    }
+}
+
+static void
+test_hit_miss(void)
+{
+    struct world w = { 0 };
+    struct procfsd_pcache pc;
+    struct procfsd_pcache_ent *e = NULL;
+    procfsd_pcache_init(&pc, &w_ops, &w, 8);
+    spawn(&w, 10, 3);
+
+    check(procfsd_pcache_get(&pc, 10, 0, &e) == 0 && e->pid == 10 &&
+        e->task == task_port(10, 1) && e->nthreads == 3 && e->threads[2] == task_port(10, 1) + 2,
+        "miss takes the ports");
+    check(w.watched[10], "miss watches for the exit");
+    check(procfsd_pcache_get(&pc, 10, NS_PER_S / 2, &e) == 0 && e->task == task_port(10, 1),
+        "second get hits");
+    check(w.task_opens == 1 && w.thread_gets == 1, "hit takes no ports");
+    check(pc.counts.hits == 1 && pc.counts.misses == 1 && pc.counts.refreshes == 1, "hit/miss counts");
+
+    w.nthreads[10] = 5;
+    check(procfsd_pcache_get(&pc, 10, NS_PER_S, &e) == 0 && e->nthreads == 5,
+        "thread list retaken after its ttl");
+    check(w.task_opens == 1 && w.thread_gets == 2 && w.lists_open == 1,
+        "refresh keeps the task port and gives back the old list");
+
+    check(procfsd_pcache_get(&pc, 11, 0, &e) == ESRCH, "no such process");
+    w.deny[12] = 1;
+    spawn(&w, 12, 1);
+    check(procfsd_pcache_get(&pc, 12, 0, &e) == EPERM, "task_open error passes through");
+    check(procfsd_pcache_size(&pc) == 1, "failures are not cached");
+
+    procfsd_pcache_flush(&pc);
+    check(procfsd_pcache_size(&pc) == 0 && w.tasks_open == 0 && w.lists_open == 0,
+        "flush gives back every port");
+    check(!w.watched[10], "flush cancels the watches");
+}
+
+static void
+test_exit(void)
+{
+    struct world w = { 0 };
+    struct procfsd_pcache pc;
+    struct procfsd_pcache_ent *e = NULL;
+    procfsd_pcache_init(&pc, &w_ops, &w, 8);
+    spawn(&w, 20, 2);
+    spawn(&w, 21, 2);
+
+    check(procfsd_pcache_get(&pc, 20, 0, &e) == 0, "cache 20");
+    check(procfsd_pcache_get(&pc, 21, 0, &e) == 0, "cache 21");
+    reap(&w, 20);
+    procfsd_pcache_drain(&pc);
+    check(procfsd_pcache_size(&pc) == 1 && pc.counts.exits == 1, "exit drops the entry");
+    check(w.tasks_open == 1 && w.lists_open == 1, "exit gives back its ports");
+    check(w.unwatches == 0, "a reported exit is not unwatched");
+
+    /* The pid is reused before the next request: the exit is drained first. */
+    check(procfsd_pcache_get(&pc, 21, 0, &e) == 0, "touch 21");
+    reap(&w, 21);
+    spawn(&w, 21, 4);
+    check(procfsd_pcache_get(&pc, 21, 0, &e) == 0 && e->task == task_port(21, 2) &&
+        e->nthreads == 4, "reused pid gets the new process's ports");
+    check(w.tasks_open == 1, "old process's port given back");
+
+    /* An exit for a pid not cached, or reported twice, is ignored. */
+    w.exits[w.nexits++] = 99;
+    w.exits[w.nexits++] = 20;
+    procfsd_pcache_drain(&pc);
+    check(procfsd_pcache_size(&pc) == 1 && pc.counts.exits == 2, "unknown exits ignored");
+
+    procfsd_pcache_flush(&pc);
+    check(w.tasks_open == 0 && w.lists_open == 0, "no ports leaked");
+}
+
+/* The watch is the guard against pid reuse: a process gone before it is set is not cached. */
+static int
+w_task_open_then_exit(void *ctx, pid_t pid, uint32_t *task)
+{
+    struct world *w = ctx;
+    int error = w_task_open(ctx, pid, task);
+    if (error == 0) {
+        w->alive[pid] = 0;
+    }
+    return error;
+}
+
+static void
+test_watch_race(void)
+{
+    struct world w = { 0 };
+    struct procfsd_pcache_ops ops = w_ops;
+    ops.task_open = w_task_open_then_exit;
+    struct procfsd_pcache pc;
+    struct procfsd_pcache_ent *e = NULL;
+    procfsd_pcache_init(&pc, &ops, &w, 8);
+    spawn(&w, 30, 1);
+
+    check(procfsd_pcache_get(&pc, 30, 0, &e) == ESRCH, "exit before the watch is ESRCH");
+    check(procfsd_pcache_size(&pc) == 0 && w.tasks_open == 0, "and not cached");
+    check(pc.counts.watch_errors == 1 && pc.counts.misses == 0, "watch error counted");
+}
+
+static void
+test_stale(void)
+{
+    struct world w = { 0 };
+    struct procfsd_pcache pc;
+    struct procfsd_pcache_ent *e = NULL;
+    procfsd_pcache_init(&pc, &w_ops, &w, 8);
+    spawn(&w, 40, 1);
+
+    check(procfsd_pcache_get(&pc, 40, 0, &e) == 0, "cache 40");
+    procfsd_pcache_invalidate(&pc, 40);
+    check(procfsd_pcache_size(&pc) == 0 && !w.watched[40] && w.tasks_open == 0,
+        "invalidate drops and unwatches");
+    procfsd_pcache_invalidate(&pc, 40);
+    check(pc.counts.invalidations == 1, "invalidating a missing pid is a no-op");
+
+    /* The process dies unreported; retaking its thread list finds the port dead. */
+    check(procfsd_pcache_get(&pc, 40, 0, &e) == 0, "cache 40 again");
+    w.alive[40] = 0;
+    check(procfsd_pcache_get(&pc, 40, 2 * NS_PER_S, &e) == ESRCH, "dead port on refresh");
+    check(procfsd_pcache_size(&pc) == 0 && w.tasks_open == 0 && w.lists_open == 0,
+        "dead entry dropped");
+}
+
+static void
+test_bound(void)
+{
+    struct world w = { 0 };
+    struct procfsd_pcache pc;
+    struct procfsd_pcache_ent *e = NULL;
+    procfsd_pcache_init(&pc, &w_ops, &w, 4);
+    for (pid_t p = 50; p < 60; p++) {
+        spawn(&w, p, 1);
+    }
+
+    for (pid_t p = 50; p < 54; p++) {
+        (void)procfsd_pcache_get(&pc, p, 0, &e);
+    }
+    (void)procfsd_pcache_get(&pc, 50, 0, &e);          /* 51 is now the oldest */
+    check(procfsd_pcache_get(&pc, 54, 0, &e) == 0 && procfsd_pcache_size(&pc) == 4,
+        "full cache stays at its bound");
+    check(pc.counts.evictions == 1 && !w.watched[51] && w.watched[50],
+        "least recently used entry evicted and unwatched");
+    check(w.tasks_open == 4 && w.lists_open == 4, "evicted ports given back");
+
+    for (pid_t p = 50; p < 60; p++) {
+        (void)procfsd_pcache_get(&pc, p, 0, &e);
+    }
+    check(procfsd_pcache_size(&pc) == 4 && w.tasks_open == 4, "bound holds under churn");
+
+    struct procfsd_pcache big;
+    procfsd_pcache_init(&big, &w_ops, &w, 100000);
+    check(big.cap == PROCFSD_PCACHE_MAX, "cap clamped to the table");
+    procfsd_pcache_init(&big, &w_ops, &w, 0);
+    check(big.cap == 1, "cap at least 1");
+
+    procfsd_pcache_flush(&pc);
+    check(w.tasks_open == 0 && w.lists_open == 0, "no ports leaked");
+}
+
+static void
+test_print(void)
+{
+    struct world w = { 0 };
+    struct procfsd_pcache pc;
+    struct procfsd_pcache_ent *e = NULL;
+    procfsd_pcache_init(&pc, &w_ops, &w, 8);
+    spawn(&w, 60, 1);
+    (void)procfsd_pcache_get(&pc, 60, 0, &e);
+    (void)procfsd_pcache_get(&pc, 60, 0, &e);
+
+    char buf[512] = { 0 };
+    FILE *fp = fmemopen(buf, sizeof(buf) - 1, "w");
+    check(procfsd_pcache_print(&pc, fp) == 0, "print");
+    fclose(fp);
+    check(strcmp(buf, "port_cache size 1 cap 8 hits 1 misses 1 refreshes 1 exits 0 "
+        "evictions 0 invalidations 0 watch_errors 0\n") == 0, "print text");
+    procfsd_pcache_flush(&pc);
+}
+
+int
+main(void)
+{
+    test_hit_miss();
+    test_exit();
+    test_watch_race();
+    test_stale();
+    test_bound();
+    test_print();
+
+    return check_done("procfsd port cache");
+}
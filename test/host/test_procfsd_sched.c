@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_procfsd_sched.c
+ *
+ * Tests for procfsd's per-class queues and workers (tools/procfsd_sched.c):
+ * arrival order within a class, each class's concurrency limit, a class
+ * whose workers are stuck not holding up another, a full queue refusing,
+ * and flush and stop leaving nothing in flight. The serve callback records
+ * what it was handed; a gate holds chosen requests until the test opens it.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../include/fs/procfs/procfs_ctl.h"
+#include "../../tools/procfsd_sched.h"
+#include "check.h"
+
+#define GATED   1u          /* req.arg: wait at the gate */
+#define SLOW    2u          /* req.arg: take 5ms */
+#define MAXLOG  256
+
+struct rec {
+    pthread_mutex_t lock;
+    pthread_cond_t  cv;
+    int             open;                   /* the gate */
+    int             waiting;                /* requests at the gate */
+    uint32_t        active[PROCFS_CTL_NPRIO];
+    uint32_t        peak[PROCFS_CTL_NPRIO];
+    uint32_t        log[MAXLOG];            /* seqs in the order served */
+    int             nlog;
+};
+
+static void
+serve(void *ctx, const struct procfs_ctl_req *req)
+{
+    struct rec *r = ctx;
+    uint32_t p = procfsd_sched_prio(req);
+
+    pthread_mutex_lock(&r->lock);
+    if (++r->active[p] > r->peak[p]) {
+        r->peak[p] = r->active[p];
+    }
+    if (req->arg == GATED) {
+        r->waiting++;
+        pthread_cond_broadcast(&r->cv);
+        while (!r->open) {
+            pthread_cond_wait(&r->cv, &r->lock);
+        }
+        r->waiting--;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    if (req->arg == SLOW) {
+        usleep(5000);
+    }
+
+    pthread_mutex_lock(&r->lock);
+    r->active[p]--;
+    if (r->nlog < MAXLOG) {
+        r->log[r->nlog++] = req->seq;
+    }
+    pthread_cond_broadcast(&r->cv);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void
+rec_init(struct rec *r)
+{
+    memset(r, 0, sizeof(*r));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cv, NULL);
+}
+
+static void
+rec_fini(struct rec *r)
+{
+    pthread_cond_destroy(&r->cv);
+    pthread_mutex_destroy(&r->lock);
+}
+
+/* Wait (up to 5s) until `n` requests have been served. */
+static int
+wait_served(struct rec *r, int n)
+{
+    for (int i = 0; i < 5000; i++) {
+        pthread_mutex_lock(&r->lock);
+        int done = r->nlog >= n;
+        pthread_mutex_unlock(&r->lock);
+        if (done) {
+            return 1;
+        }
+        usleep(1000);
+    }
+    return 0;
+}
+
+/* Wait (up to 5s) until `n` requests are held at the gate. */
+static int
+wait_gated(struct rec *r, int n)
+{
+    for (int i = 0; i < 5000; i++) {
+        pthread_mutex_lock(&r->lock);
+        int done = r->waiting >= n;
+        pthread_mutex_unlock(&r->lock);
+        if (done) {
+            return 1;
+        }
+        usleep(1000);
+    }
+    return 0;
+}
+
+static void
+open_gate(struct rec *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->open = 1;
+    pthread_cond_broadcast(&r->cv);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* A request of class `prio`, or of an unknown type if there is no such class. */
+static int
+push(struct procfsd_sched *s, uint32_t prio, uint32_t seq, uint64_t arg)
+{
+    static const uint32_t types[PROCFS_CTL_NPRIO] = {
+        PROCFS_REQ_LOADAVG, PROCFS_REQ_THREADS, PROCFS_REQ_REGS,
+    };
+    struct procfs_ctl_req req = {
+        .magic = PROCFS_CTL_MAGIC, .seq = seq, .type = prio < PROCFS_CTL_NPRIO ? types[prio] : 1000,
+        .arg = arg, .prio = prio,
+    };
+    return procfsd_sched_push(s, &req);
+}
+
+static const uint32_t one_each[PROCFS_CTL_NPRIO] = { 1, 1, 1 };
+
+static void
+test_start(void)
+{
+    struct procfsd_sched s;
+    struct rec r;
+    rec_init(&r);
+
+    const uint32_t none[PROCFS_CTL_NPRIO] = { 1, 0, 1 };
+    const uint32_t many[PROCFS_CTL_NPRIO] = { 1, PROCFSD_SCHED_WORKERS + 1, 1 };
+    check(procfsd_sched_start(&s, none, serve, &r) == EINVAL, "a class without workers is refused");
+    check(procfsd_sched_start(&s, many, serve, &r) == EINVAL, "too many workers refused");
+
+    struct procfs_ctl_req req = { .type = PROCFS_REQ_TASKINFOS, .prio = PROCFS_CTL_PRIO_BULK };
+    check(procfsd_sched_prio(&req) == PROCFS_CTL_PRIO_BULK, "class taken from the type");
+    req.type = PROCFS_REQ_THREADS;
+    req.prio = PROCFS_CTL_PRIO_FAST;
+    check(procfsd_sched_prio(&req) == PROCFS_CTL_PRIO_BULK, "a bulk request claiming fast is bulk");
+    req.type = 1000;
+    check(procfsd_sched_prio(&req) == PROCFS_CTL_PRIO_DEBUG, "unknown type is debug");
+
+    check(procfsd_sched_start(&s, one_each, serve, &r) == 0, "start");
+    check(push(&s, 77, 1, 0) == 0 && wait_served(&r, 1), "unknown type served");
+    check(procfsd_sched_counts(&s, PROCFS_CTL_PRIO_DEBUG).served == 1, "in the debug class");
+    req = (struct procfs_ctl_req){ .magic = PROCFS_CTL_MAGIC, .seq = 2, .type = PROCFS_REQ_THREADS,
+        .prio = PROCFS_CTL_PRIO_FAST };
+    check(procfsd_sched_push(&s, &req) == 0 && wait_served(&r, 2) &&
+        procfsd_sched_counts(&s, PROCFS_CTL_PRIO_BULK).served == 1 &&
+        procfsd_sched_counts(&s, PROCFS_CTL_PRIO_FAST).served == 0, "and it is served by the bulk worker");
+    procfsd_sched_stop(&s);
+    rec_fini(&r);
+}
+
+/* One worker serves its class in arrival order. */
+static void
+test_order(void)
+{
+    struct procfsd_sched s;
+    struct rec r;
+    rec_init(&r);
+    procfsd_sched_start(&s, one_each, serve, &r);
+
+    check(push(&s, PROCFS_CTL_PRIO_BULK, 100, GATED) == 0 && wait_gated(&r, 1), "worker held");
+    for (uint32_t i = 1; i <= 10; i++) {
+        check(push(&s, PROCFS_CTL_PRIO_BULK, 100 + i, 0) == 0, "queue behind it");
+    }
+    check(procfsd_sched_counts(&s, PROCFS_CTL_PRIO_BULK).maxdepth == 10, "queue depth recorded");
+    open_gate(&r);
+    check(wait_served(&r, 11), "all served");
+    int ordered = 1;
+    for (int i = 0; i < 11; i++) {
+        ordered &= r.log[i] == 100u + (uint32_t)i;
+    }
+    check(ordered, "served in arrival order");
+    procfsd_sched_stop(&s);
+    rec_fini(&r);
+}
+
+/* A class never serves more at once than it has workers. */
+static void
+test_limits(void)
+{
+    struct procfsd_sched s;
+    struct rec r;
+    rec_init(&r);
+    const uint32_t workers[PROCFS_CTL_NPRIO] = { 3, 1, 2 };
+    procfsd_sched_start(&s, workers, serve, &r);
+
+    int n = 0;
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        for (int i = 0; i < 12; i++) {
+            n += push(&s, p, (uint32_t)n + 1, SLOW) == 0;
+        }
+    }
+    check(n == 36 && wait_served(&r, n), "slow requests served");
+    check(r.peak[PROCFS_CTL_PRIO_FAST] == 3, "fast class runs its three workers");
+    check(r.peak[PROCFS_CTL_PRIO_BULK] == 1, "bulk class runs one at a time");
+    check(r.peak[PROCFS_CTL_PRIO_DEBUG] == 2, "debug class runs two at a time");
+    procfsd_sched_stop(&s);
+    rec_fini(&r);
+}
+
+/*
+ * Debug workers stuck: fast requests still go through, the debug queue
+ * fills and then refuses, and the other classes are unaffected.
+ */
+static void
+test_isolation(void)
+{
+    struct procfsd_sched s;
+    struct rec r;
+    rec_init(&r);
+    procfsd_sched_start(&s, one_each, serve, &r);
+
+    check(push(&s, PROCFS_CTL_PRIO_DEBUG, 1, GATED) == 0 && wait_gated(&r, 1), "debug worker stuck");
+    int queued = 0;
+    for (uint32_t i = 0; i < PROCFSD_SCHED_DEPTH; i++) {
+        queued += push(&s, PROCFS_CTL_PRIO_DEBUG, 10 + i, 0) == 0;
+    }
+    check(queued == PROCFSD_SCHED_DEPTH, "debug queue takes its depth");
+    check(push(&s, PROCFS_CTL_PRIO_DEBUG, 99, 0) == EBUSY, "full debug queue refuses");
+    for (uint32_t i = 0; i < 20; i++) {
+        check(push(&s, PROCFS_CTL_PRIO_FAST, 1000 + i, 0) == 0, "fast request queued");
+    }
+    check(wait_served(&r, 20), "fast requests served past the stuck debug worker");
+    int fast_only = 1;
+    for (int i = 0; i < 20; i++) {
+        fast_only &= r.log[i] >= 1000;
+    }
+    check(fast_only, "no debug request served meanwhile");
+
+    struct procfsd_sched_counts c = procfsd_sched_counts(&s, PROCFS_CTL_PRIO_DEBUG);
+    check(c.queued == PROCFSD_SCHED_DEPTH + 1 && c.refused == 1 && c.served == 0 &&
+        c.maxdepth == PROCFSD_SCHED_DEPTH, "debug counts");
+    c = procfsd_sched_counts(&s, PROCFS_CTL_PRIO_FAST);
+    check(c.queued == 20 && c.served == 20 && c.refused == 0, "fast counts");
+
+    open_gate(&r);
+    check(wait_served(&r, 20 + 1 + PROCFSD_SCHED_DEPTH), "debug queue drains once unstuck");
+    procfsd_sched_stop(&s);
+    rec_fini(&r);
+}
+
+/* Flush drops what is queued and returns once nothing is being served. */
+static void
+test_flush(void)
+{
+    struct procfsd_sched s;
+    struct rec r;
+    rec_init(&r);
+    procfsd_sched_start(&s, one_each, serve, &r);
+
+    push(&s, PROCFS_CTL_PRIO_FAST, 1, SLOW);
+    push(&s, PROCFS_CTL_PRIO_BULK, 2, SLOW);
+    for (uint32_t i = 0; i < 5; i++) {
+        push(&s, PROCFS_CTL_PRIO_FAST, 10 + i, SLOW);
+        push(&s, PROCFS_CTL_PRIO_BULK, 20 + i, SLOW);
+    }
+    usleep(1000);
+    uint32_t dropped = procfsd_sched_flush(&s);
+    pthread_mutex_lock(&r.lock);
+    int served = r.nlog;
+    int idle   = r.active[0] + r.active[1] + r.active[2] == 0;
+    pthread_mutex_unlock(&r.lock);
+    check(idle, "nothing being served after a flush");
+    check(dropped + (uint32_t)served == 12, "every request either served or dropped");
+    check(dropped >= 8, "queued requests dropped");
+    check(procfsd_sched_counts(&s, PROCFS_CTL_PRIO_FAST).dropped +
+        procfsd_sched_counts(&s, PROCFS_CTL_PRIO_BULK).dropped == dropped, "drops counted");
+
+    check(push(&s, PROCFS_CTL_PRIO_FAST, 50, 0) == 0 && wait_served(&r, served + 1),
+        "queues usable after a flush");
+
+    char buf[1024];
+    FILE *fp = fmemopen(buf, sizeof(buf), "w");
+    check(procfsd_sched_print(&s, fp) == 0, "print");
+    fclose(fp);
+    check(strncmp(buf, "queue fast workers 1 queued 7 served ", 37) == 0 &&
+        strstr(buf, "\nqueue bulk workers 1 queued 6 ") != NULL &&
+        strstr(buf, "\nqueue debug workers 1 queued 0 served 0 refused 0 dropped 0 maxdepth 0\n") != NULL,
+        "dump text");
+
+    /* Stop with requests queued and one being served: it drops the rest and joins. */
+    pthread_mutex_lock(&r.lock);
+    r.open = 0;
+    pthread_mutex_unlock(&r.lock);
+    push(&s, PROCFS_CTL_PRIO_DEBUG, 60, GATED);
+    push(&s, PROCFS_CTL_PRIO_DEBUG, 61, 0);
+    wait_gated(&r, 1);
+    open_gate(&r);
+    procfsd_sched_stop(&s);
+    check(r.active[PROCFS_CTL_PRIO_DEBUG] == 0, "stop waits for the worker");
+    rec_fini(&r);
+}
+
+int
+main(void)
+{
+    test_start();
+    test_order();
+    test_limits();
+    test_isolation();
+    test_flush();
+
+    return check_done("procfsd sched");
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_procfsd_stats.c
+ *
+ * Tests for procfsd's request accounting (tools/procfsd_stats.c): bucket
+ * edges, request-type and call bookkeeping, the exact dump text, and that
+ * the stats file is replaced whole.
+ *
+ *   make -C test/host check
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../../include/fs/procfs/procfs_ctl.h"
+#include "../../tools/procfsd_stats.h"
+#include "check.h"
+
+#define NS_PER_S    1000000000ULL
+
+static void
+test_buckets(void)
+{
+    check(procfsd_stats_bucket(0) == 0, "bucket 0ns");
+    check(procfsd_stats_bucket(999) == 0, "bucket 999ns");
+    check(procfsd_stats_bucket(1000) == 1, "bucket 1us");
+    check(procfsd_stats_bucket(1999) == 1, "bucket 1.999us");
+    check(procfsd_stats_bucket(2000) == 2, "bucket 2us");
+    check(procfsd_stats_bucket(16383999) == PROCFSD_HIST - 2, "bucket just under the last");
+    check(procfsd_stats_bucket(16384000) == PROCFSD_HIST - 1, "bucket last");
+    check(procfsd_stats_bucket(UINT64_MAX) == PROCFSD_HIST - 1, "bucket max");
+}
+
+static void
+test_record(void)
+{
+    struct procfsd_stats st;
+    procfsd_stats_init(&st, 5);
+    check(st.start_ns == 5 && st.connects == 0 && st.req[1].count == 0, "init");
+
+    procfsd_stats_request(&st, PROCFS_REQ_TASKINFO, 1500, 0);
+    procfsd_stats_request(&st, PROCFS_REQ_TASKINFO, 500, ESRCH);
+    procfsd_stats_request(&st, PROCFS_REQ_TASKINFO, 40000, 0);
+    const struct procfsd_hist *h = &st.req[PROCFS_REQ_TASKINFO];
+    check(h->count == 3 && h->errors == 1, "request count and errors");
+    check(h->total_ns == 42000 && h->max_ns == 40000, "request total and max");
+    check(h->bucket[0] == 1 && h->bucket[1] == 1 && h->bucket[6] == 1, "request buckets");
+
+    /* Unknown types, including ones past the table and 0, land in "other". */
+    procfsd_stats_request(&st, 0, 1, 0);
+    procfsd_stats_request(&st, PROCFSD_NREQ, 1, EINVAL);
+    procfsd_stats_request(&st, 0xffffffffu, 1, EINVAL);
+    check(st.req[0].count == 3 && st.req[0].errors == 2, "unknown requests");
+    check(st.req[PROCFS_REQ_THREADS].count == 0, "named types keep their own slot");
+
+    procfsd_stats_call(&st, PROCFSD_CALL_TASK_FOR_PID, 7000, 1);
+    procfsd_stats_call(&st, PROCFSD_CALL_TASK_FOR_PID, 3000, 0);
+    procfsd_stats_call(&st, PROCFSD_NCALLS, 1, 1);          /* ignored */
+    h = &st.call[PROCFSD_CALL_TASK_FOR_PID];
+    check(h->count == 2 && h->errors == 1 && h->max_ns == 7000, "call bookkeeping");
+    check(h->bucket[2] == 1 && h->bucket[3] == 1, "call buckets");
+}
+
+static char *
+dump(const struct procfsd_stats *st, uint64_t now)
+{
+    char *text = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&text, &len);
+    check(fp != NULL && procfsd_stats_print(st, now, fp) == 0, "print");
+    fclose(fp);
+    return text;
+}
+
+#define HIST_HEAD   " count errors total_ns max_ns <1us <2us <4us <8us <16us <32us " \
+                    "<64us <128us <256us <512us <1024us <2048us <4096us <8192us "   \
+                    "<16384us >=16384us\n"
+#define ZERO_ROW    " 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+
+static void
+test_print(void)
+{
+    struct procfsd_stats st;
+    procfsd_stats_init(&st, 10 * NS_PER_S);
+    st.connects = 2;
+    st.disconnects = 1;
+    st.malformed = 3;
+    st.send_errors = 4;
+    procfsd_stats_request(&st, PROCFS_REQ_REGS, 2500, EPERM);
+    procfsd_stats_request(&st, 99, 20000000, EINVAL);
+    procfsd_stats_call(&st, PROCFSD_CALL_GETLOADAVG, 999, 0);
+
+    char *text = dump(&st, 72 * NS_PER_S + 999999999ULL);
+    const char *want =
+        "uptime_s 62\nconnects 2\ndisconnects 1\nmalformed 3\nsend_errors 4\n"
+        "request" HIST_HEAD
+        "taskinfo" ZERO_ROW
+        "threadinfo" ZERO_ROW
+        "vmstat" ZERO_ROW
+        "loadavg" ZERO_ROW
+        "regs 1 1 2500 2500 0 0 1 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+        "fpregs" ZERO_ROW
+        "threads" ZERO_ROW
+        "taskinfos" ZERO_ROW
+        "ioinfos" ZERO_ROW
+        "other 1 1 20000000 20000000 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 1\n"
+        "call" HIST_HEAD
+        "proc_pidinfo" ZERO_ROW
+        "task_for_pid" ZERO_ROW
+        "task_threads" ZERO_ROW
+        "thread_get_state" ZERO_ROW
+        "host_statistics64" ZERO_ROW
+        "getloadavg 1 0 999 999 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+        "proc_pid_rusage" ZERO_ROW;
+    check(text != NULL && strcmp(text, want) == 0, "dump text");
+    if (text != NULL && strcmp(text, want) != 0) {
+        printf("    got:\n%s", text);
+    }
+    free(text);
+
+    /* A clock that went backwards reports zero uptime rather than wrapping. */
+    text = dump(&st, 0);
+    check(text != NULL && strncmp(text, "uptime_s 0\n", 11) == 0, "uptime before start");
+    free(text);
+}
+
+static void
+test_write(void)
+{
+    char dir[] = "/tmp/procfsd_stats.XXXXXX";
+    check(mkdtemp(dir) != NULL, "mkdtemp");
+    char path[sizeof(dir) + 16];
+    snprintf(path, sizeof(path), "%s/stats", dir);
+
+    struct procfsd_stats st;
+    procfsd_stats_init(&st, 0);
+    for (int round = 0; round < 3; round++) {
+        st.connects = (uint64_t)round + 1;
+        check(procfsd_stats_write(&st, 0, path) == 0, "write");
+
+        FILE *fp = fopen(path, "r");
+        char first[64] = "", second[64] = "";
+        check(fp != NULL && fgets(first, sizeof(first), fp) && fgets(second, sizeof(second), fp),
+              "read back");
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        char want[64];
+        snprintf(want, sizeof(want), "connects %d\n", round + 1);
+        check(strcmp(second, want) == 0, "file holds the latest dump");
+
+        struct stat sb;
+        check(stat(path, &sb) == 0 && (sb.st_mode & 0777) == 0644, "file mode");
+    }
+
+    /* Only the stats file is left behind: no temporaries. */
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "test \"$(ls -A %s)\" = stats", dir);
+    check(system(cmd) == 0, "no temporary files left");
+
+    /* A missing directory fails cleanly with errno set. */
+    char bad[sizeof(dir) + 32];
+    snprintf(bad, sizeof(bad), "%s/missing/stats", dir);
+    errno = 0;
+    check(procfsd_stats_write(&st, 0, bad) == -1 && errno == ENOENT, "write to a missing directory");
+
+    unlink(path);
+    rmdir(dir);
+}
+
+int
+main(void)
+{
+    test_buckets();
+    test_record();
+    test_print();
+    test_write();
+
+    return check_done("procfsd stats");
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_render.c
+ *
+ * Golden-text tests for the rendering layer (kext/procfs_render.c): fixed
+ * inputs, including the edge values each format has to get right, against
+ * the exact text the nodes are expected to produce.
+ *
+ *   make -C test/host check
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/malloc.h>
+#include <sys/sysctl.h>
+#include <mach/vm_prot.h>
+
+#include <bsdcompat/sys/sbuf.h>
+#include <fs/procfs/procfs_render.h>
+
+#include "check.h"
+
+static struct sbuf sb;
+
+static void
+expect(const char *want, const char *what)
+{
+    sbuf_finish(&sb);
+    checkf(sbuf_len(&sb) == (int)strlen(want) && strcmp(sbuf_data(&sb), want) == 0,
+        "%s:\n    got  \"%s\"\n    want \"%s\"", what, sbuf_data(&sb), want);
+    sbuf_clear(&sb);
+}
+
+static void
+test_maps(void)
+{
+    struct procfs_region r = {
+        .start = 0x100000000ULL, .end = 0x100004000ULL, .offset = 0x1000,
+        .prot = VM_PROT_READ | VM_PROT_EXECUTE, .max_prot = VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE,
+        .shared = 0, .wired = 3,
+    };
+    procfs_maps_fmt_linux(&sb, &r);
+    expect("0000000100000000-0000000100004000 r-xp 0000000000001000 00:00 0 \n", "maps");
+    procfs_map_fmt_netbsd(&sb, &r);
+    expect("0x0000000100000000 0x0000000100004000 r-x rwx priv 3\n", "map");
+
+    struct procfs_region zero = { .start = 0, .end = 0x100000000ULL, .shared = 1 };
+    procfs_maps_fmt_linux(&sb, &zero);
+    expect("0000000000000000-0000000100000000 ---s 0000000000000000 00:00 0 \n", "maps at zero");
+    procfs_map_fmt_netbsd(&sb, &zero);
+    expect("000000000000000000 0x0000000100000000 --- --- share 0\n", "map at zero");
+
+    struct procfs_region top = { .start = 0xfffffffffffff000ULL, .end = UINT64_MAX, .offset = UINT64_MAX };
+    procfs_maps_fmt_linux(&sb, &top);
+    expect("fffffffffffff000-ffffffffffffffff ---p ffffffffffffffff 00:00 0 \n", "maps at top");
+}
+
+static void
+test_process(void)
+{
+    struct procfs_pctx c = {
+        .pid = 412, .ppid = 1, .pgid = 412, .sid = 412, .nthreads = 7,
+        .vsize = 0x2000000000ULL, .rsize = 0x3200000, .comm = "launchd", .state = 'S',
+    };
+
+    procfs_render_stat_line(&sb, 412, c.comm, c.state, &c, 1234, 56, 20, 12800, 0);
+    expect("412 (launchd) S 1 412 412 0 -1 0 0 0 0 0 1234 56 0 0 20 0 7 0 0 137438953472 12800 "
+           "18446744073709551615 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n", "stat");
+
+    procfs_render_stat_line(&sb, UINT64_MAX, "t", 'R', &c, 0, 0, -1, 0, 2);
+    expect("18446744073709551615 (t) R 1 412 412 0 -1 0 0 0 0 0 0 0 0 0 -1 0 7 0 0 137438953472 0 "
+           "18446744073709551615 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 2 0 0 0 0 0 0 0 0 0 0 0\n", "thread stat");
+
+    procfs_render_statm(&sb, 33554432, 12800);
+    expect("33554432 12800 0 0 0 0 0\n", "statm");
+
+    procfs_render_io(&sb, 4096, 18446744073709551615ULL, 4096, 0);
+    expect("rchar: 4096\n"
+           "wchar: 18446744073709551615\n"
+           "syscr: 0\n"
+           "syscw: 0\n"
+           "read_bytes: 4096\n"
+           "write_bytes: 0\n"
+           "cancelled_write_bytes: 0\n", "io");
+
+    procfs_render_status_head(&sb, c.comm, 'Z', c.pid, c.pid, c.ppid);
+    sbuf_cat(&sb, "TracerPid:\t0\n");
+    procfs_render_status_ids(&sb, "Uid:", 501, 0, 501, 0);
+    procfs_render_status_kb(&sb, "VmSize:\t", 123);
+    procfs_render_status_kb(&sb, "VmRSS:\t", 123456789);
+    procfs_render_status_tail(&sb, 7);
+    expect("Name:\tlaunchd\n"
+           "State:\tZ (zombie)\n"
+           "Tgid:\t412\n"
+           "Pid:\t412\n"
+           "PPid:\t1\n"
+           "TracerPid:\t0\n"
+           "Uid:\t501\t0\t501\t0\n"
+           "VmSize:\t     123 kB\n"
+           "VmRSS:\t123456789 kB\n"
+           "Threads:\t7\n"
+           "voluntary_ctxt_switches:\t0\n"
+           "nonvoluntary_ctxt_switches:\t0\n", "status");
+}
+
+static void
+test_system(void)
+{
+    procfs_render_stat_cpu(&sb, -1, 10, 0, 30, 4000000000ULL);
+    procfs_render_stat_cpu(&sb, 11, 1, 2, 3, 4);
+    expect("cpu  10 0 30 4000000000 0 0 0 0 0 0\n"
+           "cpu11 1 2 3 4 0 0 0 0 0 0\n", "stat cpu");
+
+    procfs_render_loadavg(&sb, 0, 5, 1234, 1, 530, 0);
+    expect("0.00 0.05 12.34 1/530 0\n", "loadavg");
+    procfs_render_loadavg(&sb, -5, 100, 99, 1, 1, 1);
+    expect("0.-5 1.00 0.99 1/1 1\n", "loadavg negative");
+
+    procfs_render_meminfo(&sb, 17179869184ULL, 1023, 0, 1024, 1ULL << 50, 0, 4096);
+    expect("MemTotal:  16777216 kB\n"
+           "MemFree:          0 kB\n"
+           "MemShared:        0 kB\n"
+           "Buffers:          1 kB\n"
+           "Cached:   1099511627776 kB\n"
+           "SwapTotal:        0 kB\n"
+           "SwapFree:         4 kB\n", "meminfo");
+}
+
+static void
+test_sysctl(void)
+{
+    int32_t i = -7;
+    procfs_render_sysctl_value(&sb, CTLTYPE_INT, "I", &i, sizeof(i));
+    expect("-7\n", "sysctl int");
+    procfs_render_sysctl_value(&sb, CTLTYPE_INT, "IU", &i, sizeof(i));
+    expect("4294967289\n", "sysctl unsigned int");
+    procfs_render_sysctl_value(&sb, CTLTYPE_INT, "I", &i, 2);
+    expect("", "sysctl short int");
+
+    int64_t q = INT64_MIN;
+    procfs_render_sysctl_value(&sb, CTLTYPE_QUAD, "Q", &q, sizeof(q));
+    expect("-9223372036854775808\n", "sysctl quad");
+    procfs_render_sysctl_value(&sb, CTLTYPE_QUAD, "QU", &q, sizeof(q));
+    expect("9223372036854775808\n", "sysctl unsigned quad");
+
+    procfs_render_sysctl_value(&sb, CTLTYPE_STRING, "A", "Darwin", 7);
+    expect("Darwin\n", "sysctl string");
+    procfs_render_sysctl_value(&sb, CTLTYPE_STRING, "A", "ab\0cd", 5);
+    expect("ab\n", "sysctl string with embedded NUL");
+    procfs_render_sysctl_value(&sb, CTLTYPE_STRING, NULL, "xyz", 3);
+    expect("xyz\n", "sysctl unterminated string");
+
+    procfs_render_sysctl_value(&sb, CTLTYPE_OPAQUE, "S,timeval", &q, sizeof(q));
+    expect("", "sysctl opaque");
+}
+
+#define CHECK_BUCKET(ns, want)                                          \
+    checkf(procfs_stats_bucket(ns) == (want), "bucket(%llu) = %d, want %d", \
+        (unsigned long long)(ns), procfs_stats_bucket(ns), (want))
+
+static void
+test_stats(void)
+{
+    CHECK_BUCKET(0, 0);
+    CHECK_BUCKET(999, 0);
+    CHECK_BUCKET(1000, 1);
+    CHECK_BUCKET(1999, 1);
+    CHECK_BUCKET(2000, 2);
+    CHECK_BUCKET(3999, 2);
+    CHECK_BUCKET(4000, 3);
+    CHECK_BUCKET(16383999, 14);
+    CHECK_BUCKET(16384000, 15);
+    CHECK_BUCKET(UINT64_MAX, 15);
+
+    static const char *const names[] = { "root", NULL, "loadavg" };
+    struct procfs_node_stats st[3];
+    memset(st, 0, sizeof(st));
+    st[0].lookups = 3;
+    st[1].reads = 99;                       /* unnamed: not listed */
+    st[2].lookups = 1;
+    st[2].opens = 2;
+    st[2].reads = 4;
+    st[2].bytes = UINT64_MAX;
+    st[2].daemon = 4;
+    st[2].fallbacks = 1;
+    st[2].render_ns = 12345;
+    st[2].render_hist[0] = 1;
+    st[2].render_hist[3] = 2;
+    st[2].render_hist[PROCFS_STATS_HIST - 1] = 1;
+    procfs_render_stats(&sb, names, st, 3);
+    expect("type lookups opens reads bytes daemon fallbacks render_ns <1us <2us <4us "
+           "<8us <16us <32us <64us <128us <256us <512us <1024us <2048us <4096us "
+           "<8192us <16384us >=16384us\n"
+           "root 3 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+           "loadavg 1 2 4 18446744073709551615 4 1 12345 1 0 0 2 0 0 0 0 0 0 0 0 0 0 0 1\n",
+           "stats");
+}
+
+int
+main(void)
+{
+    if (sbuf_new(&sb, NULL, 256, SBUF_AUTOEXTEND) == NULL) {
+        return 1;
+    }
+
+    test_maps();
+    test_process();
+    test_system();
+    test_sysctl();
+    test_stats();
+
+    sbuf_delete(&sb);
+    return check_done("render");
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * test_sbuf_emit.c
+ *
+ * Checks that the sbuf numeric emitters in kext/lib/sbuf.c append exactly
+ * what the printf conversions they replace would: "%llu", "%*llu", "%lld"
+ * and "%0*llx", over boundary values and a run of pseudo-random ones, and
+ * that they honour SBUF_FIXEDLEN overflow like sbuf_bcat().
+ *
+ *   make -C test/host check
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/malloc.h>
+
+#include <bsdcompat/sys/sbuf.h>
+
+#include "check.h"
+
+static void
+expect(struct sbuf *sb, const char *want, const char *what)
+{
+    sbuf_finish(sb);
+    checkf(sbuf_len(sb) == (int)strlen(want) && strcmp(sbuf_data(sb), want) == 0,
+        "%s: got \"%s\", want \"%s\"", what, sbuf_data(sb), want);
+    sbuf_clear(sb);
+}
+
+static void
+check_value(struct sbuf *sb, uint64_t v)
+{
+    char want[64];
+
+    sbuf_putu64(sb, v);
+    snprintf(want, sizeof(want), "%llu", (unsigned long long)v);
+    expect(sb, want, "sbuf_putu64");
+
+    sbuf_puti64(sb, (int64_t)v);
+    snprintf(want, sizeof(want), "%lld", (long long)v);
+    expect(sb, want, "sbuf_puti64");
+
+    static const int widths[] = { 0, 1, 8, 16, 20, 24 };
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        int w = widths[i];
+
+        sbuf_putu64_pad(sb, v, w);
+        snprintf(want, sizeof(want), "%*llu", w, (unsigned long long)v);
+        expect(sb, want, "sbuf_putu64_pad");
+
+        sbuf_puthex(sb, v, w);
+        snprintf(want, sizeof(want), "%0*llx", w, (unsigned long long)v);
+        expect(sb, want, "sbuf_puthex");
+    }
+}
+
+int
+main(void)
+{
+    struct sbuf sb;
+    if (sbuf_new(&sb, NULL, 16, SBUF_AUTOEXTEND) == NULL) {
+        return 1;
+    }
+
+    static const uint64_t edges[] = {
+        0, 1, 9, 10, 99, 100, 101, 999, 1000, 4095, 4096, 65535,
+        0x7fffffffULL, 0x80000000ULL, 0xffffffffULL, 0x100000000ULL,
+        9999999999999999999ULL, 10000000000000000000ULL,
+        (uint64_t)INT64_MAX, (uint64_t)INT64_MIN, UINT64_MAX - 1, UINT64_MAX,
+    };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check_value(&sb, edges[i]);
+        check_value(&sb, 0 - edges[i]);
+    }
+
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 20000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        check_value(&sb, x >> (i % 64));
+    }
+
+    // Emitters append to what is already there.
+    sbuf_cat(&sb, "cpu");
+    sbuf_puti64(&sb, 7);
+    sbuf_putc(&sb, ' ');
+    sbuf_putu64_pad(&sb, 42, 8);
+    sbuf_puthex(&sb, 0xbeef, 6);
+    expect(&sb, "cpu7       4200beef", "mixed append");
+    sbuf_delete(&sb);
+
+    // A fixed-length sbuf overflows instead of writing past its end.
+    char small[8];
+    sbuf_new(&sb, small, sizeof(small), SBUF_FIXEDLEN);
+    check(sbuf_puthex(&sb, 0x1234, 4) == 0 && sbuf_putu64(&sb, 123456) == -1 &&
+        sbuf_overflowed(&sb) && sbuf_putu64(&sb, 1) == -1, "fixed-length overflow reported");
+    sbuf_delete(&sb);
+
+    return check_done("sbuf emitters");
+}
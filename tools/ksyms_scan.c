@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * ksyms_scan.c
+ *
+ * Streaming symbol extraction for procfs_ksyms (see ksyms_scan.h).
+ *
+ * A booted kernel collection decompresses to a few hundred megabytes, but
+ * staging needs only four pieces of it: the fileset header and its load
+ * commands, the com.apple.kernel slice's header and load commands, and that
+ * slice's nlist and string tables. The image is fed in order, so each piece
+ * is captured as the stream passes it; once a header is complete it says
+ * where the next pieces are. In a fileset the slices' headers come first and
+ * the shared __LINKEDIT with the symbol tables last, so this works in one
+ * pass. Nothing here is macOS-specific, which keeps it testable on any host
+ * (test/host/test_ksyms.c).
+ *
+ * Matching is a hash-set probe per symbol rather than a strcmp against every
+ * wanted name, and every offset and size from the image is bounds-checked
+ * before use.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+#include "ksyms_scan.h"
+
+#define KS_KERNEL_ID        "com.apple.kernel"
+#define KS_VERSION_KEY      "Darwin Kernel Version"
+#define KS_VERSION_KEYLEN   (sizeof(KS_VERSION_KEY) - 1)
+#define KS_VERSION_MAX      256
+
+/* The pieces of the image the scan captures, in stream order. */
+enum { KS_HDR, KS_KHDR, KS_SYMS, KS_STRS, KS_NRANGES };
+
+struct ks_range {
+    uint64_t off;           /* image offset */
+    size_t   len;
+    size_t   got;           /* bytes captured so far, from off */
+    uint8_t *buf;
+    int      active;
+    int      stage;         /* headers: 0 = mach header only, 1 = with load commands */
+};
+
+struct ks_slot {
+    uint32_t hash;
+    int      idx;           /* index into names, -1 if empty */
+};
+
+struct ksyms_scan {
+    const char *const *names;
+    size_t             nnames;
+    struct ks_slot    *set;
+    uint32_t           setmask;
+
+    size_t             mem_cap;
+    size_t             retained;
+    size_t             peak;
+    uint64_t           pos;         /* image offset of the next byte fed */
+    int                error;
+
+    struct ks_range    r[KS_NRANGES];
+
+    enum { KS_V_SEARCH, KS_V_CAPTURE, KS_V_DONE } vstate;
+    char               version[KS_VERSION_MAX];
+    size_t             vlen;
+    uint8_t            carry[KS_VERSION_KEYLEN - 1];
+    size_t             ncarry;
+};
+
+#pragma mark -
+#pragma mark Hashing
+
+uint64_t
+ksyms_fnv1a(uint64_t h, const void *p, size_t len)
+{
+    const uint8_t *s = p;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ s[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * 32-bit FNV-1a of the NUL-terminated string at s, reading at most max bytes.
+ * Sets *ok to 0 if there is no terminator within them.
+ */
+static uint32_t
+ks_hash_str(const char *s, size_t max, int *ok)
+{
+    uint32_t h = 0x811c9dc5u;
+    size_t i;
+
+    for (i = 0; i < max && s[i] != '\0'; i++) {
+        h = (h ^ (uint8_t)s[i]) * 0x01000193u;
+    }
+    *ok = i < max;
+    return h;
+}
+
+static int
+ks_set_build(struct ksyms_scan *ks)
+{
+    uint32_t size = 8;
+
+    while (size < 2 * ks->nnames) {
+        size <<= 1;
+    }
+    ks->set = malloc(size * sizeof(ks->set[0]));
+    if (ks->set == NULL) {
+        return ENOMEM;
+    }
+    ks->setmask = size - 1;
+    for (uint32_t i = 0; i < size; i++) {
+        ks->set[i].idx = -1;
+    }
+    for (size_t n = 0; n < ks->nnames; n++) {
+        int ok;
+        uint32_t h = ks_hash_str(ks->names[n], SIZE_MAX, &ok);
+        uint32_t j = h & ks->setmask;
+        while (ks->set[j].idx >= 0) {
+            j = (j + 1) & ks->setmask;
+        }
+        ks->set[j].hash = h;
+        ks->set[j].idx = (int)n;
+    }
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Capture
+
+static int
+ks_fail(struct ksyms_scan *ks, int error)
+{
+    if (ks->error == 0) {
+        ks->error = error;
+    }
+    return ks->error;
+}
+
+/* Make room for `len` bytes of range r, within the memory cap. */
+static int
+ks_range_size(struct ksyms_scan *ks, struct ks_range *r, uint64_t len)
+{
+    if (len > ks->mem_cap || ks->retained - r->len > ks->mem_cap - len) {
+        return ks_fail(ks, EFBIG);
+    }
+    uint8_t *buf = realloc(r->buf, len != 0 ? (size_t)len : 1);
+    if (buf == NULL) {
+        return ks_fail(ks, ENOMEM);
+    }
+    ks->retained = ks->retained - r->len + (size_t)len;
+    if (ks->retained > ks->peak) {
+        ks->peak = ks->retained;
+    }
+    r->buf = buf;
+    r->len = (size_t)len;
+    return 0;
+}
+
+/* Start capturing `len` bytes at image offset `off`. */
+static int
+ks_range_open(struct ksyms_scan *ks, int which, uint64_t off, uint64_t len)
+{
+    struct ks_range *r = &ks->r[which];
+
+    if (off < ks->pos) {
+        return ks_fail(ks, ERANGE);         /* already streamed past it */
+    }
+    r->off = off;
+    r->active = 1;
+    return ks_range_size(ks, r, len);
+}
+
+/*
+ * A complete mach_header_64 at the start of r: check it and extend r to take
+ * in the load commands that follow.
+ */
+static int
+ks_header_extend(struct ksyms_scan *ks, struct ks_range *r, uint32_t filetype)
+{
+    struct mach_header_64 mh;
+
+    memcpy(&mh, r->buf, sizeof(mh));
+    if (mh.magic != MH_MAGIC_64 || (filetype != 0 && mh.filetype != filetype)) {
+        return ks_fail(ks, ENOEXEC);
+    }
+    r->stage = 1;
+    return ks_range_size(ks, r, (uint64_t)sizeof(mh) + mh.sizeofcmds);
+}
+
+/*
+ * Walk the load commands captured in r, calling fn on each. Stops with
+ * ENOEXEC at the first one that does not fit.
+ */
+static int
+ks_each_command(struct ksyms_scan *ks, const struct ks_range *r,
+    int (*fn)(struct ksyms_scan *, const uint8_t *, uint32_t))
+{
+    struct mach_header_64 mh;
+    size_t off = sizeof(mh);
+
+    memcpy(&mh, r->buf, sizeof(mh));
+    for (uint32_t i = 0; i < mh.ncmds; i++) {
+        struct load_command lc;
+        if (r->len - off < sizeof(lc)) {
+            return ks_fail(ks, ENOEXEC);
+        }
+        memcpy(&lc, r->buf + off, sizeof(lc));
+        if (lc.cmdsize < sizeof(lc) || lc.cmdsize > r->len - off) {
+            return ks_fail(ks, ENOEXEC);
+        }
+        int error = fn(ks, r->buf + off, lc.cmdsize);
+        if (error != 0) {
+            return error;
+        }
+        off += lc.cmdsize;
+    }
+    return 0;
+}
+
+/* Fileset load command: open the kernel slice's header if this is its entry. */
+static int
+ks_fileset_command(struct ksyms_scan *ks, const uint8_t *cmd, uint32_t size)
+{
+    struct fileset_entry_command fe;
+
+    memcpy(&fe, cmd, sizeof(struct load_command));
+    if (fe.cmd != LC_FILESET_ENTRY || ks->r[KS_KHDR].active) {
+        return 0;
+    }
+    if (size < sizeof(fe)) {
+        return ks_fail(ks, ENOEXEC);
+    }
+    memcpy(&fe, cmd, sizeof(fe));
+    uint32_t at = fe.entry_id.offset;
+    if (at >= size || memchr(cmd + at, '\0', size - at) == NULL) {
+        return ks_fail(ks, ENOEXEC);
+    }
+    if (strcmp((const char *)cmd + at, KS_KERNEL_ID) != 0) {
+        return 0;
+    }
+    return ks_range_open(ks, KS_KHDR, fe.fileoff, sizeof(struct mach_header_64));
+}
+
+/* Kernel-slice load command: open the symbol and string tables at LC_SYMTAB. */
+static int
+ks_kernel_command(struct ksyms_scan *ks, const uint8_t *cmd, uint32_t size)
+{
+    struct symtab_command sc;
+
+    memcpy(&sc, cmd, sizeof(struct load_command));
+    if (sc.cmd != LC_SYMTAB || ks->r[KS_SYMS].active) {
+        return 0;
+    }
+    if (size < sizeof(sc)) {
+        return ks_fail(ks, ENOEXEC);
+    }
+    memcpy(&sc, cmd, sizeof(sc));
+
+    /* Both tables are captured, so take them in whichever order they come. */
+    uint64_t symlen = (uint64_t)sc.nsyms * sizeof(struct nlist_64);
+    int first = sc.symoff <= sc.stroff ? KS_SYMS : KS_STRS;
+    int error = first == KS_SYMS ?
+        ks_range_open(ks, KS_SYMS, sc.symoff, symlen) :
+        ks_range_open(ks, KS_STRS, sc.stroff, sc.strsize);
+    if (error == 0) {
+        error = first == KS_SYMS ?
+            ks_range_open(ks, KS_STRS, sc.stroff, sc.strsize) :
+            ks_range_open(ks, KS_SYMS, sc.symoff, symlen);
+    }
+    return error;
+}
+
+/* Range r has everything it asked for: act on it. */
+static int
+ks_range_done(struct ksyms_scan *ks, int which)
+{
+    struct ks_range *r = &ks->r[which];
+
+    switch (which) {
+    case KS_HDR:
+        if (r->stage == 0) {
+            return ks_header_extend(ks, r, MH_FILESET);
+        }
+        if (ks_each_command(ks, r, ks_fileset_command) == 0 && !ks->r[KS_KHDR].active) {
+            return ks_fail(ks, ENOENT);     /* no kernel slice */
+        }
+        break;
+    case KS_KHDR:
+        if (r->stage == 0) {
+            return ks_header_extend(ks, r, 0);
+        }
+        if (ks_each_command(ks, r, ks_kernel_command) == 0 && !ks->r[KS_SYMS].active) {
+            return ks_fail(ks, ENOENT);     /* no LC_SYMTAB */
+        }
+        break;
+    }
+    return ks->error;
+}
+
+static int
+ks_range_complete(const struct ks_range *r)
+{
+    return r->active && r->got == r->len;
+}
+
+#pragma mark -
+#pragma mark Version string
+
+static long
+ks_find_version(const uint8_t *p, size_t len)
+{
+    const uint8_t *s = p;
+    const uint8_t *end = p + len;
+
+    while ((size_t)(end - s) >= KS_VERSION_KEYLEN &&
+           (s = memchr(s, KS_VERSION_KEY[0], (size_t)(end - s) - KS_VERSION_KEYLEN + 1)) != NULL) {
+        if (memcmp(s, KS_VERSION_KEY, KS_VERSION_KEYLEN) == 0) {
+            return (long)(s - p);
+        }
+        s++;
+    }
+    return -1;
+}
+
+/* Append up to the terminating NUL; the string ends there or at the cap. */
+static size_t
+ks_version_capture(struct ksyms_scan *ks, const uint8_t *p, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && p[i] != '\0' && ks->vlen < sizeof(ks->version) - 1) {
+        ks->version[ks->vlen++] = (char)p[i++];
+    }
+    if (i < len || ks->vlen == sizeof(ks->version) - 1) {
+        ks->version[ks->vlen] = '\0';
+        ks->vstate = KS_V_DONE;
+    }
+    return i;
+}
+
+/*
+ * Find the first "Darwin Kernel Version" string in the stream, including one
+ * split across chunks: the last KEYLEN - 1 bytes of each chunk are carried
+ * over and searched together with the start of the next.
+ */
+static void
+ks_version_feed(struct ksyms_scan *ks, const uint8_t *p, size_t len)
+{
+    if (ks->vstate == KS_V_SEARCH && ks->ncarry > 0) {
+        uint8_t seam[2 * (KS_VERSION_KEYLEN - 1)];
+        size_t take = len < KS_VERSION_KEYLEN - 1 ? len : KS_VERSION_KEYLEN - 1;
+
+        memcpy(seam, ks->carry, ks->ncarry);
+        memcpy(seam + ks->ncarry, p, take);
+        long at = ks_find_version(seam, ks->ncarry + take);
+        if (at >= 0 && (size_t)at < ks->ncarry) {
+            ks->vstate = KS_V_CAPTURE;
+            ks_version_capture(ks, ks->carry + at, ks->ncarry - (size_t)at);
+            if (ks->vstate == KS_V_CAPTURE) {
+                ks_version_capture(ks, p, len);
+            }
+            return;
+        }
+    }
+
+    if (ks->vstate == KS_V_SEARCH) {
+        long at = ks_find_version(p, len);
+        if (at >= 0) {
+            ks->vstate = KS_V_CAPTURE;
+            ks_version_capture(ks, p + at, len - (size_t)at);
+            return;
+        }
+
+        /* Keep the tail for the seam with the next chunk. */
+        const size_t keep = KS_VERSION_KEYLEN - 1;
+        if (len >= keep) {
+            memcpy(ks->carry, p + len - keep, keep);
+            ks->ncarry = keep;
+        } else {
+            size_t drop = ks->ncarry + len > keep ? ks->ncarry + len - keep : 0;
+            memmove(ks->carry, ks->carry + drop, ks->ncarry - drop);
+            memcpy(ks->carry + ks->ncarry - drop, p, len);
+            ks->ncarry = ks->ncarry - drop + len;
+        }
+        return;
+    }
+
+    if (ks->vstate == KS_V_CAPTURE) {
+        ks_version_capture(ks, p, len);
+    }
+}
+
+#pragma mark -
+#pragma mark Interface
+
+struct ksyms_scan *
+ksyms_scan_new(const char *const *names, size_t nnames, size_t mem_cap)
+{
+    struct ksyms_scan *ks = calloc(1, sizeof(*ks));
+
+    if (ks == NULL) {
+        return NULL;
+    }
+    ks->names = names;
+    ks->nnames = nnames;
+    ks->mem_cap = mem_cap;
+    if (ks_set_build(ks) != 0 ||
+        ks_range_open(ks, KS_HDR, 0, sizeof(struct mach_header_64)) != 0) {
+        ksyms_scan_free(ks);
+        return NULL;
+    }
+    return ks;
+}
+
+int
+ksyms_scan_feed(struct ksyms_scan *ks, const void *chunk, size_t len)
+{
+    const uint8_t *p = chunk;
+    uint64_t start = ks->pos;
+    uint64_t end = start + len;
+    int progressed;
+
+    if (ks->error != 0) {
+        return ks->error;
+    }
+    ks_version_feed(ks, p, len);
+
+    /* A piece completed here can open the next, which may start in this chunk. */
+    do {
+        progressed = 0;
+        for (int i = 0; i < KS_NRANGES; i++) {
+            struct ks_range *r = &ks->r[i];
+            if (!r->active || r->got == r->len) {
+                continue;
+            }
+            uint64_t need = r->off + r->got;
+            if (need >= start && need < end) {
+                size_t n = (size_t)(end - need) < r->len - r->got ?
+                           (size_t)(end - need) : r->len - r->got;
+                memcpy(r->buf + r->got, p + (need - start), n);
+                r->got += n;
+            }
+            if (r->got == r->len) {
+                if (ks_range_done(ks, i) != 0) {
+                    return ks->error;
+                }
+                progressed = 1;
+            }
+        }
+    } while (progressed);
+
+    ks->pos = end;
+    return 0;
+}
+
+int
+ksyms_scan_complete(const struct ksyms_scan *ks)
+{
+    return ks->error != 0 ||
+           (ks_range_complete(&ks->r[KS_SYMS]) && ks_range_complete(&ks->r[KS_STRS]) &&
+            ks->vstate == KS_V_DONE);
+}
+
+const char *
+ksyms_scan_version(const struct ksyms_scan *ks)
+{
+    return ks->vstate == KS_V_DONE ? ks->version : NULL;
+}
+
+int
+ksyms_scan_finish(struct ksyms_scan *ks, uint64_t *addr)
+{
+    for (size_t w = 0; w < ks->nnames; w++) {
+        addr[w] = 0;
+    }
+    if (ks->error != 0) {
+        return ks->error;
+    }
+    if (!ks_range_complete(&ks->r[KS_SYMS]) || !ks_range_complete(&ks->r[KS_STRS])) {
+        return ENOENT;
+    }
+
+    const uint8_t *syms = ks->r[KS_SYMS].buf;
+    const char *strs = (const char *)ks->r[KS_STRS].buf;
+    size_t strsize = ks->r[KS_STRS].len;
+    size_t nsyms = ks->r[KS_SYMS].len / sizeof(struct nlist_64);
+
+    for (size_t i = 0; i < nsyms; i++) {
+        struct nlist_64 nl;
+        memcpy(&nl, syms + i * sizeof(nl), sizeof(nl));
+        uint32_t sx = nl.n_un.n_strx;
+        if (sx == 0 || sx >= strsize || nl.n_value == 0) {
+            continue;
+        }
+
+        int ok;
+        const char *nm = strs + sx;
+        uint32_t h = ks_hash_str(nm, strsize - sx, &ok);
+        if (!ok) {
+            continue;                       /* runs off the string table */
+        }
+        for (uint32_t j = h & ks->setmask; ks->set[j].idx >= 0; j = (j + 1) & ks->setmask) {
+            int w = ks->set[j].idx;
+            if (ks->set[j].hash == h && addr[w] == 0 && strcmp(nm, ks->names[w]) == 0) {
+                addr[w] = nl.n_value;
+            }
+        }
+    }
+    return 0;
+}
+
+size_t
+ksyms_scan_retained(const struct ksyms_scan *ks)
+{
+    return ks->peak;
+}
+
+void
+ksyms_scan_free(struct ksyms_scan *ks)
+{
+    if (ks == NULL) {
+        return;
+    }
+    for (int i = 0; i < KS_NRANGES; i++) {
+        free(ks->r[i].buf);
+    }
+    free(ks->set);
+    free(ks);
+}
+
+#pragma mark -
+#pragma mark Staged file
+
+int
+ksyms_staged_current(const char *text, size_t len, uint64_t fp)
+{
+    const size_t plen = sizeof(KSYMS_FP_PREFIX) - 1;
+    const char *p = text;
+    const char *end = text + len;
+    int have_fp = 0, have_version = 0, have_pmap = 0;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        const char *lend = eol ? eol : end;
+        size_t n = (size_t)(lend - p);
+
+        if (n > plen && memcmp(p, KSYMS_FP_PREFIX, plen) == 0) {
+            uint64_t v = 0;
+            size_t i = plen;
+            if (n - i > 2 && p[i] == '0' && p[i + 1] == 'x') {
+                i += 2;
+            }
+            size_t digits = 0;
+            for (; i < n; i++, digits++) {
+                char c = p[i];
+                int d = (c >= '0' && c <= '9') ? c - '0' :
+                        (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+                if (d < 0) {
+                    break;
+                }
+                v = (v << 4) | (uint64_t)d;
+            }
+            have_fp = i == n && digits == 16 && v == fp;
+        } else if (n > 9 && memcmp(p, "_version ", 9) == 0) {
+            have_version = 1;
+        } else if (n > 13 && memcmp(p, "_kernel_pmap ", 13) == 0) {
+            have_pmap = 1;
+        }
+        p = eol ? eol + 1 : end;
+    }
+    return have_fp && have_version && have_pmap;
+}
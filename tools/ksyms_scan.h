@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * ksyms_scan.h
+ *
+ * Streaming symbol extraction from a decompressed kernel collection, for
+ * procfs_ksyms. The decoder hands over the collection a chunk at a time, in
+ * order; the scanner keeps only the pieces it needs and never holds the
+ * whole image.
+ */
+#ifndef KSYMS_SCAN_H
+#define KSYMS_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ksyms_scan;
+
+/*
+ * Start a scan for `names` (Mach-O symbol names, e.g. "_version"). At most
+ * `mem_cap` bytes of the image are retained. NULL on allocation failure.
+ */
+struct ksyms_scan *ksyms_scan_new(const char *const *names, size_t nnames, size_t mem_cap);
+
+/*
+ * Feed the next `len` bytes of the image. Returns 0, or an errno once the
+ * image is known to be unusable: ENOEXEC (not a well-formed 64-bit fileset),
+ * EFBIG (the pieces would exceed the memory cap), ERANGE (a piece lies
+ * before data already consumed). Later calls return the same error.
+ */
+int ksyms_scan_feed(struct ksyms_scan *ks, const void *chunk, size_t len);
+
+/* Non-zero once everything needed has been seen, so decoding can stop. */
+int ksyms_scan_complete(const struct ksyms_scan *ks);
+
+/*
+ * The "Darwin Kernel Version ..." string found in the image, or NULL if it
+ * has not been seen (yet).
+ */
+const char *ksyms_scan_version(const struct ksyms_scan *ks);
+
+/*
+ * Resolve the names against the com.apple.kernel slice's LC_SYMTAB: addr[i]
+ * is the link-time address of names[i], or 0. Returns 0, or an errno: the
+ * feed error if there was one, else ENOENT when the kernel slice or its
+ * symbol table was not (fully) seen.
+ */
+int ksyms_scan_finish(struct ksyms_scan *ks, uint64_t *addr);
+
+/* Bytes of image the scanner retained at its peak. */
+size_t ksyms_scan_retained(const struct ksyms_scan *ks);
+
+void ksyms_scan_free(struct ksyms_scan *ks);
+
+/* 64-bit FNV-1a, continued from `h` (start with KSYMS_FNV_INIT). */
+#define KSYMS_FNV_INIT  0xcbf29ce484222325ULL
+uint64_t ksyms_fnv1a(uint64_t h, const void *p, size_t len);
+
+/*
+ * Non-zero if the staged-file text records kernelcache fingerprint `fp` and
+ * stages both anchor symbols (_version and _kernel_pmap), i.e. re-extracting
+ * would produce the same file.
+ */
+int ksyms_staged_current(const char *text, size_t len, uint64_t fp);
+
+/* The staged-file line that records a fingerprint. */
+#define KSYMS_FP_PREFIX "# kernelcache "
+
+#endif /* KSYMS_SCAN_H */
@@ -14,8 +14,14 @@
  * applies the running KASLR slide (derived from `version`), validates it
  * against `kernel_pmap`, and uses the resolved addresses.
  *
- * Re-run after every kernel change (OS update); the kext's kernel_pmap check
- * safely ignores a stale file.
+ * procfsd runs it at every boot. The staged file records a fingerprint of the
+ * kernelcache files it was built from (paths, identity, size, mtime) and of the
+ * running build, and when those are unchanged the run ends there, without
+ * decompressing anything; -f forces a fresh extraction. Otherwise the
+ * kernelcache is mapped rather than read and decoded as a stream, handing each
+ * chunk to ksyms_scan.c, which keeps only the header and symbol-table pieces
+ * it needs (bounded by KSYMS_MEM_CAP) and stops the decode as soon as it has
+ * them. The kext's kernel_pmap check still ignores a stale file.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,17 +30,23 @@
 #include <unistd.h>
 #include <errno.h>
 #include <glob.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <compression.h>
-#include <mach-o/loader.h>
-#include <mach-o/nlist.h>
+
+#include "ksyms_scan.h"
 
 #ifndef STAGED_PATH
 #define STAGED_PATH   "/var/db/procfs.ksyms"
 #endif
 #define KC_GLOB       "/System/Volumes/Preboot/*/boot/*/System/Library/Caches/com.apple.kernelcaches/kernelcache"
 
+/* Decode granularity, and the most of the decoded image the scan may retain
+ * (the kernel's symbol and string tables are a few MB). */
+#define KSYMS_CHUNK   (1024 * 1024)
+#define KSYMS_MEM_CAP (64 * 1024 * 1024)
+
 /* Private kernel symbols the kext wants. version + kernel_pmap are the slide
  * anchor and validation anchor; the rest unlock walled features. */
 static const char *const WANTED[] = {
@@ -65,9 +77,133 @@ xnu_token(const char *s, char *out, size_t outsz)
     return 0;
 }
 
+/*
+ * Fingerprint of what extraction would read: the running build and, for each
+ * candidate kernelcache, its path, identity, size and mtime. glob() sorts the
+ * paths, so the order is stable.
+ */
+static uint64_t
+kc_fingerprint(const glob_t *g, const char *xnu)
+{
+    uint64_t h = ksyms_fnv1a(KSYMS_FNV_INIT, xnu, strlen(xnu) + 1);
+
+    for (size_t c = 0; c < g->gl_pathc; c++) {
+        struct stat st;
+        if (stat(g->gl_pathv[c], &st) != 0) {
+            continue;
+        }
+        uint64_t id[5] = {
+            (uint64_t)st.st_dev, (uint64_t)st.st_ino, (uint64_t)st.st_size,
+            (uint64_t)st.st_mtimespec.tv_sec, (uint64_t)st.st_mtimespec.tv_nsec,
+        };
+        h = ksyms_fnv1a(h, g->gl_pathv[c], strlen(g->gl_pathv[c]) + 1);
+        h = ksyms_fnv1a(h, id, sizeof(id));
+    }
+    return h;
+}
+
+/* Non-zero if the staged file was built from fingerprint `fp`. */
+static int
+staged_is_current(uint64_t fp)
+{
+    char text[8192];
+    int fd = open(STAGED_PATH, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t n = read(fd, text, sizeof(text));
+    close(fd);
+    return n > 0 && ksyms_staged_current(text, (size_t)n, fp);
+}
+
+/*
+ * Stream-decode the LZFSE payload of one kernelcache into `ks`. Returns 0 if
+ * the scan completed, stopping the decode there; the running build is checked
+ * as soon as the image's version string has gone by.
+ */
+static int
+kc_scan(const char *path, const char *want_xnu, struct ksyms_scan *ks)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return EINVAL;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t *raw = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (raw == MAP_FAILED) {
+        return errno;
+    }
+
+    /* IMG4 payload is LZFSE ("bvx2"); decode from there. */
+    uint8_t *bvx = memmem(raw, size, "bvx2", 4);
+    uint8_t *dst = malloc(KSYMS_CHUNK);
+    compression_stream cs;
+    int error = EINVAL;
+    if (bvx == NULL || dst == NULL ||
+        compression_stream_init(&cs, COMPRESSION_STREAM_DECODE, COMPRESSION_LZFSE) != COMPRESSION_STATUS_OK) {
+        free(dst);
+        munmap(raw, size);
+        return bvx == NULL ? EINVAL : ENOMEM;
+    }
+    cs.src_ptr = bvx;
+    cs.src_size = (size_t)((raw + size) - bvx);
+
+    for (;;) {
+        cs.dst_ptr = dst;
+        cs.dst_size = KSYMS_CHUNK;
+        compression_status status = compression_stream_process(&cs, COMPRESSION_STREAM_FINALIZE);
+        if (status == COMPRESSION_STATUS_ERROR) {
+            error = EIO;
+            break;
+        }
+        error = ksyms_scan_feed(ks, dst, KSYMS_CHUNK - cs.dst_size);
+        if (error != 0) {
+            break;
+        }
+
+        /* Confirm this kernelcache's kernel build matches the running one. */
+        const char *vs = ksyms_scan_version(ks);
+        char this_xnu[64];
+        if (vs != NULL && (xnu_token(vs, this_xnu, sizeof(this_xnu)) != 0 ||
+                           strcmp(this_xnu, want_xnu) != 0)) {
+            error = ESRCH;                  /* wrong build */
+            break;
+        }
+        if (ksyms_scan_complete(ks)) {
+            error = 0;
+            break;
+        }
+        if (status == COMPRESSION_STATUS_END) {
+            error = ENOENT;                 /* ran out before finding it all */
+            break;
+        }
+    }
+
+    compression_stream_destroy(&cs);
+    free(dst);
+    munmap(raw, size);
+    return error;
+}
+
 int
-main(void)
+main(int argc, char **argv)
 {
+    int force = 0;
+    int ch;
+    while ((ch = getopt(argc, argv, "f")) != -1) {
+        if (ch != 'f') {
+            fprintf(stderr, "usage: procfs_ksyms [-f]\n");
+            return 2;
+        }
+        force = 1;
+    }
+
     /* Running kernel build token, to confirm we stage the right kernelcache. */
     char uname_v[512] = { 0 };
     size_t un = sizeof(uname_v);
@@ -87,108 +223,46 @@ main(void)
         return 1;
     }
 
-    uint8_t *out = NULL;
+    uint64_t fp = kc_fingerprint(&g, want_xnu);
+    if (!force && staged_is_current(fp)) {
+        printf("procfs_ksyms: %s is current for %s\n", STAGED_PATH, want_xnu);
+        globfree(&g);
+        return 0;
+    }
+
+    uint64_t addr[NWANTED] = { 0 };
     const char *used = NULL;
-    char kc_ver[256] = { 0 };
+    size_t retained = 0;
+    int error = ENOENT;
 
     for (size_t c = 0; c < g.gl_pathc && used == NULL; c++) {
-        int fd = open(g.gl_pathv[c], O_RDONLY);
-        if (fd < 0) {
-            continue;
+        struct ksyms_scan *ks = ksyms_scan_new(WANTED, NWANTED, KSYMS_MEM_CAP);
+        if (ks == NULL) {
+            error = ENOMEM;
+            break;
         }
-        struct stat st;
-        if (fstat(fd, &st) != 0) { close(fd); continue; }
-        uint8_t *raw = malloc(st.st_size);
-        if (raw == NULL) { close(fd); continue; }
-        ssize_t rd = read(fd, raw, st.st_size);
-        close(fd);
-        if (rd != st.st_size) { free(raw); continue; }
-
-        /* IMG4 payload is LZFSE ("bvx2"); decode from there. */
-        uint8_t *bvx = memmem(raw, st.st_size, "bvx2", 4);
-        if (bvx == NULL) { free(raw); continue; }
-
-        size_t cap = 512ull * 1024 * 1024;
-        uint8_t *dec = malloc(cap);
-        if (dec == NULL) { free(raw); continue; }
-        size_t n = compression_decode_buffer(dec, cap, bvx,
-            (size_t)((raw + st.st_size) - bvx), NULL, COMPRESSION_LZFSE);
-        free(raw);
-        if (n == 0) { free(dec); continue; }
-
-        /* Confirm this kernelcache's kernel build matches the running one. */
-        uint8_t *vs = memmem(dec, n, "Darwin Kernel Version", 21);
-        char this_xnu[64] = { 0 };
-        if (vs != NULL) {
-            size_t i = 0;
-            while (vs[i] != '\0' && i < sizeof(kc_ver) - 1) { kc_ver[i] = vs[i]; i++; }
-            kc_ver[i] = '\0';
+        error = kc_scan(g.gl_pathv[c], want_xnu, ks);
+        if (error == 0) {
+            error = ksyms_scan_finish(ks, addr);
         }
-        if (vs == NULL || xnu_token(kc_ver, this_xnu, sizeof(this_xnu)) != 0 ||
-            strcmp(this_xnu, want_xnu) != 0) {
-            free(dec);
-            continue;       /* wrong build - keep looking */
+        if (error == 0) {
+            used = g.gl_pathv[c];
+            retained = ksyms_scan_retained(ks);
+        } else if (error != ESRCH) {
+            fprintf(stderr, "procfs_ksyms: %s: %s\n", g.gl_pathv[c], strerror(error));
         }
-
-        out = dec;
-        used = g.gl_pathv[c];
+        ksyms_scan_free(ks);
     }
 
-    if (out == NULL) {
+    if (used == NULL) {
         fprintf(stderr, "procfs_ksyms: no matching kernelcache (running %s)\n", want_xnu);
         globfree(&g);
         return 1;
     }
 
-    /* Parse fileset -> com.apple.kernel slice -> LC_SYMTAB. */
-    struct mach_header_64 *mh = (struct mach_header_64 *)out;
-    uint64_t kfo = 0;
-    size_t off = sizeof(*mh);
-    for (uint32_t i = 0; i < mh->ncmds; i++) {
-        struct load_command *lc = (struct load_command *)(out + off);
-        if (lc->cmd == LC_FILESET_ENTRY) {
-            struct fileset_entry_command *fe = (struct fileset_entry_command *)lc;
-            const char *nm = (const char *)lc + fe->entry_id.offset;
-            if (strcmp(nm, "com.apple.kernel") == 0) { kfo = fe->fileoff; }
-        }
-        off += lc->cmdsize;
-    }
-    if (kfo == 0) {
-        fprintf(stderr, "procfs_ksyms: no com.apple.kernel slice\n");
-        return 1;
-    }
-
-    struct mach_header_64 *km = (struct mach_header_64 *)(out + kfo);
-    struct symtab_command *sc = NULL;
-    off = kfo + sizeof(*km);
-    for (uint32_t i = 0; i < km->ncmds; i++) {
-        struct load_command *lc = (struct load_command *)(out + off);
-        if (lc->cmd == LC_SYMTAB) { sc = (struct symtab_command *)lc; break; }
-        off += lc->cmdsize;
-    }
-    if (sc == NULL) {
-        fprintf(stderr, "procfs_ksyms: no LC_SYMTAB\n");
-        return 1;
-    }
-
-    struct nlist_64 *syms = (struct nlist_64 *)(out + sc->symoff);
-    const char *strs = (const char *)(out + sc->stroff);
-    uint64_t addr[NWANTED] = { 0 };
-    for (uint32_t i = 0; i < sc->nsyms; i++) {
-        uint32_t sx = syms[i].n_un.n_strx;
-        if (sx == 0 || sx >= sc->strsize || syms[i].n_value == 0) {
-            continue;
-        }
-        const char *nm = strs + sx;
-        for (size_t w = 0; w < NWANTED; w++) {
-            if (addr[w] == 0 && strcmp(nm, WANTED[w]) == 0) {
-                addr[w] = syms[i].n_value;
-            }
-        }
-    }
-
     if (addr[0] == 0 || addr[1] == 0) {   /* version + kernel_pmap are required */
         fprintf(stderr, "procfs_ksyms: missing required anchor symbols\n");
+        globfree(&g);
         return 1;
     }
 
@@ -197,11 +271,13 @@ main(void)
     int tfd = mkstemp(tmp);
     if (tfd < 0) {
         fprintf(stderr, "procfs_ksyms: mkstemp %s: %s\n", tmp, strerror(errno));
+        globfree(&g);
         return 1;
     }
     FILE *f = fdopen(tfd, "w");
     fprintf(f, "# procfs kernel symbols (auto-generated; do not edit)\n");
     fprintf(f, "# build %s\n", want_xnu);
+    fprintf(f, KSYMS_FP_PREFIX "0x%016llx\n", (unsigned long long)fp);
     int staged = 0;
     for (size_t w = 0; w < NWANTED; w++) {
         if (addr[w] != 0) {
@@ -214,10 +290,12 @@ main(void)
     if (rename(tmp, STAGED_PATH) != 0) {
         fprintf(stderr, "procfs_ksyms: rename to %s: %s\n", STAGED_PATH, strerror(errno));
         unlink(tmp);
+        globfree(&g);
         return 1;
     }
 
-    printf("procfs_ksyms: staged %d/%zu symbols from %s to %s\n",
-           staged, NWANTED, used, STAGED_PATH);
+    printf("procfs_ksyms: staged %d/%zu symbols from %s to %s (%zu KB retained)\n",
+           staged, NWANTED, used, STAGED_PATH, retained / 1024);
+    globfree(&g);
     return 0;
 }
@@ -9,7 +9,30 @@
  * Run as root via a LaunchDaemon; it reconnects automatically across kext
  * load/unload.
  *
- *   cc -O2 -Wall -o procfsd tools/procfsd.c
+ * It also tells the kext when processes fork, exec and exit, in unsolicited
+ * batches on the same socket (see procfsd_events.h).
+ *
+ * It counts the requests it serves and times them and the system calls behind
+ * them (see procfsd_stats.h). SIGUSR1 dumps the counters to stderr; with -s,
+ * they are also written to a file every -i seconds (default 60).
+ *
+ * With -r it exchanges requests and replies with the kext through shared-
+ * memory rings rather than one datagram each (PROCFS_CTL_OPT_RING), and
+ * keeps the socket for wakeups and events.
+ *
+ * The request thread does not serve requests itself: it queues each by its
+ * priority class for that class's workers (see procfsd_sched.h), so slow
+ * register reads never hold up a loadavg behind them. Anything the workers
+ * share - the counters, the port cache, the reply ring - has its own lock.
+ *
+ * The kext takes several procfsd connections at once and spreads requests
+ * over them. On SIGTERM procfsd drains (PROCFS_CTL_OPT_DRAIN): it takes no
+ * new requests, answers the ones it has, and exits once the kext says none
+ * are left - so a new procfsd started first takes over without one failed
+ * read.
+ *
+ *   procfsd [-r] [-s statsfile] [-i seconds]
+ *   make -C tools procfsd
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,15 +40,20 @@
 #include <unistd.h>
 #include <errno.h>
 #include <stdint.h>
+#include <signal.h>
 #include <spawn.h>
 #include <pthread.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <sys/event.h>
 #include <sys/socket.h>
 #include <sys/sys_domain.h>
 #include <sys/kern_control.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
+#include <sys/mman.h>
 #include <libproc.h>
 #include <sys/proc_info.h>
 #include <mach/mach.h>
@@ -38,9 +66,109 @@
 #endif
 
 #include "../include/fs/procfs/procfs_ctl.h"
+#include "procfsd_events.h"
+#include "procfsd_pcache.h"
+#include "procfsd_sched.h"
+#include "procfsd_serve.h"
+#include "procfsd_stats.h"
 
 extern char **environ;
 
+#pragma mark -
+#pragma mark Request accounting
+
+#define PROCFSD_STATS_INTERVAL  60      /* default -i: seconds between stats file writes */
+
+static struct procfsd_stats   g_stats;          /* guarded by g_stats_lock */
+static pthread_mutex_t        g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t  g_dump_stats;     /* set by SIGUSR1 */
+static volatile sig_atomic_t  g_drain;          /* set by SIGTERM */
+static const char            *g_stats_path;     /* -s, or NULL */
+static uint64_t               g_stats_interval_ns = PROCFSD_STATS_INTERVAL * 1000000000ULL;
+static uint64_t               g_stats_due;
+static struct procfsd_pcache  g_pcache;         /* task ports; see "Task ports" */
+static pthread_mutex_t        g_pcache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int                    g_pcache_kq = -1; /* its exit notifications */
+static struct procfsd_events  g_events;         /* lifecycle tracking; see "Lifecycle events" */
+static int                    g_events_kq = -1; /* its notifications */
+static struct procfsd_sched   g_sched;          /* the workers; see "Request loop" */
+
+static uint64_t
+procfsd_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+procfsd_sigusr1(int sig)
+{
+    (void)sig;
+    g_dump_stats = 1;
+}
+
+static void
+procfsd_sigterm(int sig)
+{
+    (void)sig;
+    g_drain = 1;
+}
+
+/*
+ * Runs on the request thread whenever it wakes: dumps the counters if SIGUSR1
+ * arrived, and rewrites the stats file when it is due. Doing it here rather
+ * than in the signal handler keeps stdio out of signal context; the workers
+ * only ever hold the locks for a counter update.
+ */
+static void
+procfsd_report(void)
+{
+    uint64_t now = procfsd_now_ns();
+
+    if (g_dump_stats) {
+        g_dump_stats = 0;
+        fprintf(stderr, "procfsd: stats\n");
+        pthread_mutex_lock(&g_stats_lock);
+        (void)procfsd_stats_print(&g_stats, now, stderr);
+        pthread_mutex_unlock(&g_stats_lock);
+        pthread_mutex_lock(&g_pcache_lock);
+        (void)procfsd_pcache_print(&g_pcache, stderr);
+        pthread_mutex_unlock(&g_pcache_lock);
+        (void)procfsd_events_print(&g_events, stderr);
+        (void)procfsd_sched_print(&g_sched, stderr);
+    }
+    if (g_stats_path != NULL && now >= g_stats_due) {
+        pthread_mutex_lock(&g_stats_lock);
+        int r = procfsd_stats_write(&g_stats, now, g_stats_path);
+        pthread_mutex_unlock(&g_stats_lock);
+        if (r != 0) {
+            fprintf(stderr, "procfsd: writing %s: %s\n", g_stats_path, strerror(errno));
+        }
+        g_stats_due = now + g_stats_interval_ns;
+    }
+}
+
+/* Time one system call: `expr` is evaluated, `failed` decides its outcome. */
+#define PROCFSD_TIMED(call, expr, failed) do {                          \
+    uint64_t t0_ = procfsd_now_ns();                                    \
+    expr;                                                               \
+    uint64_t ns_ = procfsd_now_ns() - t0_;                              \
+    pthread_mutex_lock(&g_stats_lock);                                  \
+    procfsd_stats_call(&g_stats, (call), ns_, (failed));                \
+    pthread_mutex_unlock(&g_stats_lock);                                \
+} while (0)
+
+/* Bump one of the daemon-wide counters in g_stats. */
+#define PROCFSD_COUNT(field) do {                                       \
+    pthread_mutex_lock(&g_stats_lock);                                  \
+    g_stats.field++;                                                    \
+    pthread_mutex_unlock(&g_stats_lock);                                \
+} while (0)
+
+#pragma mark -
+#pragma mark Boot and mount
+
 /* Boot orchestration paths. */
 #define PROCFS_BUNDLE_ID  "com.beako.filesystems.procfs"
 #define PROCFS_KEXT_PATH  "/Library/Extensions/procfs.kext"  /* load by path at boot */
@@ -188,38 +316,443 @@ wait_connect(void)
     for (;;) {
         int fd = connect_ctl();
         if (fd >= 0) {
+            PROCFSD_COUNT(connects);
+            if (g_stats_path != NULL) {
+                /* Wake from recv() at least once per interval for the stats file. */
+                struct timeval tv = {
+                    .tv_sec  = (time_t)(g_stats_interval_ns / 1000000000ULL),
+                    .tv_usec = 0,
+                };
+                (void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            }
             return fd;
         }
+        if (g_drain) {
+            exit(0);    /* nothing to drain */
+        }
         sleep(1);       /* wait for the kext to register the control */
+        procfsd_report();
+    }
+}
+
+#pragma mark -
+#pragma mark Data sources
+
+/* PROCFS_REQ_TASKINFO: struct proc_taskinfo. */
+static int
+procfsd_src_taskinfo(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    struct proc_taskinfo ti;
+    int r;
+    PROCFSD_TIMED(PROCFSD_CALL_PROC_PIDINFO,
+        r = proc_pidinfo(req->pid, PROC_PIDTASKINFO, 0, &ti, sizeof(ti)),
+        r != (int)sizeof(ti));
+    if (r != (int)sizeof(ti)) {
+        return (r < 0) ? errno : ESRCH;
+    }
+    memcpy(payload, &ti, sizeof(ti));
+    *len = sizeof(ti);
+    return 0;
+}
+
+/*
+ * PROCFS_REQ_THREADINFO: struct proc_threadinfo. arg is the kext's tid
+ * (== thread_id). PROC_PIDTHREADID64INFO keys on thread_id, so the tid is
+ * the handle directly - no mapping.
+ */
+static int
+procfsd_src_threadinfo(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    struct proc_threadinfo thi;
+    int r;
+    PROCFSD_TIMED(PROCFSD_CALL_PROC_PIDINFO,
+        r = proc_pidinfo(req->pid, PROC_PIDTHREADID64INFO, req->arg, &thi, sizeof(thi)),
+        r != (int)sizeof(thi));
+    if (r != (int)sizeof(thi)) {
+        return (r < 0) ? errno : ESRCH;
+    }
+    memcpy(payload, &thi, sizeof(thi));
+    *len = sizeof(thi);
+    return 0;
+}
+
+#ifndef PROC_PIDLISTTHREADIDS
+#define PROC_PIDLISTTHREADIDS   28      /* uint64_t thread_ids; in libproc since macOS 10.15 */
+#endif
+
+/*
+ * PROCFS_REQ_THREADS: the ids and proc_threadinfo of every thread of a
+ * process, from index arg on, as many as fit (struct procfs_ctl_threads).
+ * The id list is read afresh for each page, so a page never mixes lists.
+ * The list buffer is kept between calls: the bulk class has one worker.
+ */
+static int
+procfsd_src_threads(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    static uint64_t *tids;      /* grows to the largest process seen */
+    static size_t    cap;
+    int r;
+
+    for (;;) {
+        if (tids == NULL) {
+            tids = malloc(256 * sizeof(*tids));
+            if (tids == NULL) {
+                return ENOMEM;
+            }
+            cap = 256;
+        }
+        PROCFSD_TIMED(PROCFSD_CALL_PROC_PIDINFO,
+            r = proc_pidinfo(req->pid, PROC_PIDLISTTHREADIDS, 0, tids,
+                (int)(cap * sizeof(*tids))),
+            r <= 0);
+        if (r <= 0) {
+            return (r < 0) ? errno : ESRCH;
+        }
+        if ((size_t)r < cap * sizeof(*tids)) {
+            break;
+        }
+        /* A full buffer may have cut the list short: grow and ask again. */
+        uint64_t *bigger = realloc(tids, 2 * cap * sizeof(*tids));
+        if (bigger == NULL) {
+            return ENOMEM;
+        }
+        tids = bigger;
+        cap *= 2;
+    }
+
+    struct procfs_ctl_threads hdr = { .total = (uint32_t)((size_t)r / sizeof(*tids)) };
+    struct procfs_ctl_thread *rec = (struct procfs_ctl_thread *)((uint8_t *)payload + sizeof(hdr));
+    uint32_t room = (uint32_t)((PROCFS_CTL_MAXPAYLOAD - sizeof(hdr)) / sizeof(*rec));
+    uint32_t i = req->arg < hdr.total ? (uint32_t)req->arg : hdr.total;
+
+    for (; i < hdr.total && hdr.count < room; i++) {
+        struct proc_threadinfo thi;
+        PROCFSD_TIMED(PROCFSD_CALL_PROC_PIDINFO,
+            r = proc_pidinfo(req->pid, PROC_PIDTHREADID64INFO, tids[i], &thi, sizeof(thi)),
+            r != (int)sizeof(thi));
+        if (r != (int)sizeof(thi)) {
+            continue;               /* exited since the list was taken */
+        }
+        rec[hdr.count].tid = tids[i];
+        memcpy(&rec[hdr.count].info, &thi, sizeof(thi));
+        hdr.count++;
+    }
+    hdr.next = i;
+    memcpy(payload, &hdr, sizeof(hdr));
+    *len = (uint32_t)(sizeof(hdr) + hdr.count * sizeof(*rec));
+    return 0;
+}
+
+static int
+procfsd_pid_cmp(const void *a, const void *b)
+{
+    pid_t x = *(const pid_t *)a, y = *(const pid_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Every pid on the system, ascending, into *pids (*n of them). The list
+ * grows to the most processes seen and is reused, so, like the thread list,
+ * it is for the bulk class's one worker only. Returns 0 or an errno.
+ */
+static int
+procfsd_sorted_pids(pid_t **pids, int *n)
+{
+    static pid_t *list;
+    static int    cap;
+
+    for (;;) {
+        if (list == NULL) {
+            list = malloc(1024 * sizeof(*list));
+            if (list == NULL) {
+                return ENOMEM;
+            }
+            cap = 1024;
+        }
+        *n = proc_listallpids(list, cap * (int)sizeof(*list));
+        if (*n < 0) {
+            return errno;
+        }
+        if (*n < cap) {
+            break;
+        }
+        /* A full buffer may have cut the list short: grow and ask again. */
+        pid_t *bigger = realloc(list, 2 * (size_t)cap * sizeof(*list));
+        if (bigger == NULL) {
+            return ENOMEM;
+        }
+        list = bigger;
+        cap *= 2;
+    }
+    qsort(list, (size_t)*n, sizeof(*list), procfsd_pid_cmp);
+    *pids = list;
+    return 0;
+}
+
+/*
+ * PROCFS_REQ_TASKINFOS: the proc_taskinfo of every process with a pid in
+ * [pid, arg], as many as fit (struct procfs_ctl_taskinfos). The kext asks
+ * for the range a /proc readdir just listed, so the reads of each process's
+ * files that follow need no request of their own.
+ */
+static int
+procfsd_src_taskinfos(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    pid_t *pids;
+    int    n;
+    int    error = procfsd_sorted_pids(&pids, &n);
+    if (error != 0) {
+        return error;
     }
+
+    struct procfs_ctl_taskinfos hdr = { .next = req->pid };
+    struct procfs_ctl_taskinfo *rec = (struct procfs_ctl_taskinfo *)((uint8_t *)payload + sizeof(hdr));
+    uint32_t room = (uint32_t)((PROCFS_CTL_MAXPAYLOAD - sizeof(hdr)) / sizeof(*rec));
+    pid_t    last = req->arg < (uint64_t)INT32_MAX ? (pid_t)req->arg : INT32_MAX - 1;
+
+    for (int i = 0; i < n && pids[i] <= last && hdr.count < room; i++) {
+        if (pids[i] < req->pid) {
+            continue;
+        }
+        hdr.next = pids[i] + 1;
+        struct proc_taskinfo ti;
+        int r;
+        PROCFSD_TIMED(PROCFSD_CALL_PROC_PIDINFO,
+            r = proc_pidinfo(pids[i], PROC_PIDTASKINFO, 0, &ti, sizeof(ti)),
+            r != (int)sizeof(ti));
+        if (r != (int)sizeof(ti)) {
+            continue;               /* exited, or not ours to read */
+        }
+        rec[hdr.count].pid = pids[i];
+        rec[hdr.count].reserved = 0;
+        memcpy(&rec[hdr.count].info, &ti, sizeof(ti));
+        hdr.count++;
+    }
+    if (hdr.count < room) {
+        hdr.next = last + 1;        /* stopped at the end of the range */
+    }
+    memcpy(payload, &hdr, sizeof(hdr));
+    *len = (uint32_t)(sizeof(hdr) + hdr.count * sizeof(*rec));
+    return 0;
 }
 
 /*
- * Serve a PROCFS_REQ_REGS / PROCFS_REQ_FPREGS request. thread_get_state is
- * stripped from the arm64 kernelcache, so the kext cannot read register state;
- * we do it from userspace - get the target's task port, then read its
- * representative thread (threads[0]) machine state into the response payload.
- * task_for_pid is denied to root for Apple platform/hardened binaries (SIP/AMFI)
- * - those report EPERM, analogous to ptrace permissions on Linux.
+ * PROCFS_REQ_IOINFOS: the disk and logical I/O counters of every process
+ * with a pid in [pid, arg] (struct procfs_ctl_ioinfos), from
+ * proc_pid_rusage(). The kext asks for a whole readdir range at once when
+ * something sweeps /proc/<pid>/io, and for [pid, pid] otherwise, which
+ * needs no pid list.
  */
+static int
+procfsd_src_ioinfos(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    pid_t  one = req->pid;
+    pid_t *pids = &one;
+    int    n = 1;
+    if (req->arg != (uint64_t)req->pid) {
+        int error = procfsd_sorted_pids(&pids, &n);
+        if (error != 0) {
+            return error;
+        }
+    }
+
+    struct procfs_ctl_ioinfos hdr = { .next = req->pid };
+    struct procfs_ctl_ioinfo *rec = (struct procfs_ctl_ioinfo *)((uint8_t *)payload + sizeof(hdr));
+    uint32_t room = (uint32_t)((PROCFS_CTL_MAXPAYLOAD - sizeof(hdr)) / sizeof(*rec));
+    pid_t    last = req->arg < (uint64_t)INT32_MAX ? (pid_t)req->arg : INT32_MAX - 1;
+
+    for (int i = 0; i < n && pids[i] <= last && hdr.count < room; i++) {
+        if (pids[i] < req->pid) {
+            continue;
+        }
+        hdr.next = pids[i] + 1;
+        struct rusage_info_v4 ri;
+        int r;
+        PROCFSD_TIMED(PROCFSD_CALL_PROC_PID_RUSAGE,
+            r = proc_pid_rusage(pids[i], RUSAGE_INFO_V4, (rusage_info_t *)&ri),
+            r != 0);
+        if (r != 0) {
+            continue;               /* exited, or not ours to read */
+        }
+        rec[hdr.count].pid                 = pids[i];
+        rec[hdr.count].reserved            = 0;
+        rec[hdr.count].diskio_bytesread    = ri.ri_diskio_bytesread;
+        rec[hdr.count].diskio_byteswritten = ri.ri_diskio_byteswritten;
+        rec[hdr.count].logical_writes      = ri.ri_logical_writes;
+        hdr.count++;
+    }
+    if (hdr.count < room) {
+        hdr.next = last + 1;        /* stopped at the end of the range */
+    }
+    memcpy(payload, &hdr, sizeof(hdr));
+    *len = (uint32_t)(sizeof(hdr) + hdr.count * sizeof(*rec));
+    return 0;
+}
+
+/* PROCFS_REQ_VMSTAT: vm_statistics64_data_t. */
+static int
+procfsd_src_vmstat(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    (void)req;
+    vm_statistics64_data_t vm;
+    mach_msg_type_number_t cnt = HOST_VM_INFO64_COUNT;
+    kern_return_t kr;
+    PROCFSD_TIMED(PROCFSD_CALL_HOST_STATISTICS,
+        kr = host_statistics64(mach_host_self(), HOST_VM_INFO64,
+            (host_info64_t)&vm, &cnt), kr != KERN_SUCCESS);
+    if (kr != KERN_SUCCESS) {
+        return EIO;
+    }
+    size_t n = (size_t)cnt * sizeof(integer_t);
+    if (n > PROCFS_CTL_MAXPAYLOAD) {
+        n = PROCFS_CTL_MAXPAYLOAD;
+    }
+    memcpy(payload, &vm, n);
+    *len = (uint32_t)n;
+    return 0;
+}
+
+/* PROCFS_REQ_LOADAVG: uint32_t[3], scaled x100. */
+static int
+procfsd_src_loadavg(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
+    (void)req;
+    double la[3] = { 0, 0, 0 };
+    int r;
+    PROCFSD_TIMED(PROCFSD_CALL_GETLOADAVG, r = getloadavg(la, 3), r != 3);
+    uint32_t out[3];
+    for (int i = 0; i < 3; i++) {
+        out[i] = (uint32_t)(la[i] * 100.0 + 0.5);
+    }
+    memcpy(payload, out, sizeof(out));
+    *len = sizeof(out);
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Task ports
+
+/*
+ * The regs sources' task ports and thread lists, cached per pid (see
+ * procfsd_pcache.h). Exits are reported through a kqueue: each cached pid
+ * has an EVFILT_PROC/NOTE_EXIT registration, and the cache drains the queue
+ * without blocking before every lookup. The cache is used under
+ * g_pcache_lock, held across the whole register read so the ports it hands
+ * out stay valid.
+ */
+static int
+procfsd_pc_task_open(void *ctx, pid_t pid, uint32_t *task)
+{
+    (void)ctx;
+    task_t t = TASK_NULL;
+    kern_return_t kr;
+    PROCFSD_TIMED(PROCFSD_CALL_TASK_FOR_PID,
+        kr = task_for_pid(mach_task_self(), pid, &t), kr != KERN_SUCCESS);
+    if (kr != KERN_SUCCESS) {
+        return EPERM;
+    }
+    *task = t;
+    return 0;
+}
+
 static void
-procfsd_handle_regs(const struct procfs_ctl_req *req, struct procfs_ctl_resp *resp,
-    void *payload)
+procfsd_pc_task_close(void *ctx, uint32_t task)
 {
-    task_t task = TASK_NULL;
-    if (task_for_pid(mach_task_self(), req->pid, &task) != KERN_SUCCESS) {
-        resp->error = EPERM;
-        return;
+    (void)ctx;
+    mach_port_deallocate(mach_task_self(), task);
+}
+
+static int
+procfsd_pc_threads_get(void *ctx, uint32_t task, uint32_t **threads, uint32_t *count)
+{
+    (void)ctx;
+    thread_act_array_t     list = NULL;
+    mach_msg_type_number_t n    = 0;
+    kern_return_t kr;
+    PROCFSD_TIMED(PROCFSD_CALL_TASK_THREADS,
+        kr = task_threads(task, &list, &n), kr != KERN_SUCCESS);
+    if (kr != KERN_SUCCESS) {
+        return ESRCH;
     }
+    *threads = list;
+    *count   = n;
+    return 0;
+}
 
-    thread_act_array_t     threads = NULL;
-    mach_msg_type_number_t tcount  = 0;
-    if (task_threads(task, &threads, &tcount) != KERN_SUCCESS || tcount == 0) {
-        resp->error = ESRCH;
-        mach_port_deallocate(mach_task_self(), task);
-        return;
+static void
+procfsd_pc_threads_put(void *ctx, uint32_t *threads, uint32_t count)
+{
+    (void)ctx;
+    for (uint32_t i = 0; i < count; i++) {
+        mach_port_deallocate(mach_task_self(), threads[i]);
     }
+    vm_deallocate(mach_task_self(), (vm_address_t)threads, count * sizeof(thread_act_t));
+}
+
+static int
+procfsd_pc_watch(void *ctx, pid_t pid)
+{
+    (void)ctx;
+    struct kevent kev;
+    EV_SET(&kev, pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+    return kevent(g_pcache_kq, &kev, 1, NULL, 0, NULL) == 0 ? 0 : errno;
+}
 
+static void
+procfsd_pc_unwatch(void *ctx, pid_t pid)
+{
+    (void)ctx;
+    struct kevent kev;
+    EV_SET(&kev, pid, EVFILT_PROC, EV_DELETE, 0, 0, NULL);
+    (void)kevent(g_pcache_kq, &kev, 1, NULL, 0, NULL);
+}
+
+static int
+procfsd_pc_next_exit(void *ctx, pid_t *pid)
+{
+    (void)ctx;
+    static const struct timespec zero = { 0, 0 };
+    struct kevent kev;
+    if (kevent(g_pcache_kq, NULL, 0, &kev, 1, &zero) != 1) {
+        return 0;
+    }
+    *pid = (pid_t)kev.ident;
+    return 1;
+}
+
+static const struct procfsd_pcache_ops procfsd_pcache_ops = {
+    .task_open   = procfsd_pc_task_open,
+    .task_close  = procfsd_pc_task_close,
+    .threads_get = procfsd_pc_threads_get,
+    .threads_put = procfsd_pc_threads_put,
+    .watch       = procfsd_pc_watch,
+    .unwatch     = procfsd_pc_unwatch,
+    .next_exit   = procfsd_pc_next_exit,
+};
+
+/*
+ * PROCFS_REQ_REGS / PROCFS_REQ_FPREGS. thread_get_state is stripped from the
+ * arm64 kernelcache, so the kext cannot read register state; we do it from
+ * userspace - get the target's task port, then read its representative
+ * thread (threads[0]) machine state into the response payload. task_for_pid
+ * is denied to root for Apple platform/hardened binaries (SIP/AMFI) - those
+ * report EPERM, analogous to ptrace permissions on Linux.
+ *
+ * The ports come from the cache. A cached thread can have exited since its
+ * list was taken, so a failed thread_get_state drops the entry and tries
+ * once more with fresh ports.
+ */
+static int
+procfsd_src_regs(void *ctx, const struct procfs_ctl_req *req, void *payload, uint32_t *len)
+{
+    (void)ctx;
 #if defined(__arm64__) || defined(__aarch64__)
     int flavor = (req->type == PROCFS_REQ_REGS) ? ARM_THREAD_STATE64 : ARM_NEON_STATE64;
     mach_msg_type_number_t cnt = (req->type == PROCFS_REQ_REGS)
@@ -229,29 +762,369 @@ procfsd_handle_regs(const struct procfs_ctl_req *req, struct procfs_ctl_resp *re
     mach_msg_type_number_t cnt = (req->type == PROCFS_REQ_REGS)
         ? x86_THREAD_STATE64_COUNT : x86_FLOAT_STATE64_COUNT;
 #else
-    int flavor = 0;
-    mach_msg_type_number_t cnt = 0;
-    resp->error = ENOTSUP;
+    (void)req; (void)payload; (void)len;
+    return ENOTSUP;
 #endif
 
 #if defined(__arm64__) || defined(__aarch64__) || defined(__x86_64__)
-    if ((size_t)cnt * sizeof(natural_t) <= PROCFS_CTL_MAXPAYLOAD) {
+    if ((size_t)cnt * sizeof(natural_t) > PROCFS_CTL_MAXPAYLOAD) {
+        return EMSGSIZE;
+    }
+    int error = EIO;
+    pthread_mutex_lock(&g_pcache_lock);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        struct procfsd_pcache_ent *e;
+        error = procfsd_pcache_get(&g_pcache, req->pid, procfsd_now_ns(), &e);
+        if (error != 0) {
+            break;
+        }
+        if (e->nthreads == 0) {
+            error = ESRCH;
+            break;
+        }
+
         mach_msg_type_number_t got = cnt;
-        if (thread_get_state(threads[0], flavor, (thread_state_t)payload, &got) == KERN_SUCCESS) {
-            resp->len = (uint32_t)((size_t)got * sizeof(natural_t));
-        } else {
-            resp->error = EIO;
+        kern_return_t kr;
+        PROCFSD_TIMED(PROCFSD_CALL_THREAD_GET_STATE,
+            kr = thread_get_state(e->threads[0], flavor, (thread_state_t)payload, &got),
+            kr != KERN_SUCCESS);
+        if (kr == KERN_SUCCESS) {
+            *len = (uint32_t)((size_t)got * sizeof(natural_t));
+            break;
         }
-    } else {
-        resp->error = EMSGSIZE;
+        procfsd_pcache_invalidate(&g_pcache, req->pid);
+        error = EIO;
     }
+    pthread_mutex_unlock(&g_pcache_lock);
+    return error;
 #endif
+}
 
-    for (mach_msg_type_number_t i = 0; i < tcount; i++) {
-        mach_port_deallocate(mach_task_self(), threads[i]);
+static const struct procfsd_sources procfsd_sources = {
+    .ctx = NULL,
+    .fn  = {
+        [PROCFS_REQ_TASKINFO]   = procfsd_src_taskinfo,
+        [PROCFS_REQ_THREADINFO] = procfsd_src_threadinfo,
+        [PROCFS_REQ_VMSTAT]     = procfsd_src_vmstat,
+        [PROCFS_REQ_LOADAVG]    = procfsd_src_loadavg,
+        [PROCFS_REQ_REGS]       = procfsd_src_regs,
+        [PROCFS_REQ_FPREGS]     = procfsd_src_regs,
+        [PROCFS_REQ_THREADS]    = procfsd_src_threads,
+        [PROCFS_REQ_TASKINFOS]  = procfsd_src_taskinfos,
+        [PROCFS_REQ_IOINFOS]    = procfsd_src_ioinfos,
+    },
+};
+
+#pragma mark -
+#pragma mark Lifecycle events
+
+/*
+ * Fork, exec and exit notifications for the kext (see procfsd_events.h),
+ * from a kqueue with an EVFILT_PROC registration per process. The request
+ * loop polls the kqueue along with the control socket and sends what has
+ * piled up as one batch.
+ */
+static int
+procfsd_ev_watch(void *ctx, pid_t pid)
+{
+    (void)ctx;
+    struct kevent kev;
+    EV_SET(&kev, pid, EVFILT_PROC, EV_ADD, NOTE_FORK | NOTE_EXEC | NOTE_EXIT, 0, NULL);
+    return kevent(g_events_kq, &kev, 1, NULL, 0, NULL) == 0 ? 0 : errno;
+}
+
+static int
+procfsd_ev_list_all(void *ctx, pid_t *pids, int max)
+{
+    (void)ctx;
+    int n = proc_listallpids(pids, max * (int)sizeof(pid_t));
+    return n < 0 ? 0 : (n < max ? n : max);
+}
+
+static int
+procfsd_ev_list_children(void *ctx, pid_t ppid, pid_t *pids, int max)
+{
+    (void)ctx;
+    int n = proc_listchildpids(ppid, pids, max * (int)sizeof(pid_t));
+    return n < 0 ? 0 : (n < max ? n : max);
+}
+
+static int
+procfsd_ev_next(void *ctx, pid_t *pid, uint32_t *notes)
+{
+    (void)ctx;
+    static const struct timespec zero = { 0, 0 };
+    struct kevent kev;
+    for (;;) {
+        if (kevent(g_events_kq, NULL, 0, &kev, 1, &zero) != 1) {
+            return 0;
+        }
+        if (kev.flags & EV_ERROR) {
+            continue;
+        }
+        *pid   = (pid_t)kev.ident;
+        *notes = ((kev.fflags & NOTE_FORK) ? PROCFSD_NOTE_FORK : 0) |
+                 ((kev.fflags & NOTE_EXEC) ? PROCFSD_NOTE_EXEC : 0) |
+                 ((kev.fflags & NOTE_EXIT) ? PROCFSD_NOTE_EXIT : 0);
+        return 1;
+    }
+}
+
+static const struct procfsd_events_ops procfsd_events_ops = {
+    .watch         = procfsd_ev_watch,
+    .list_all      = procfsd_ev_list_all,
+    .list_children = procfsd_ev_list_children,
+    .next          = procfsd_ev_next,
+};
+
+/* Send every pending lifecycle event to the kext, in as many batches as it takes. */
+static void
+procfsd_events_send(int fd)
+{
+    static uint8_t dgram[PROCFSD_EVENTS_MAX];
+    for (;;) {
+        (void)procfsd_events_poll(&g_events);
+        size_t len = procfsd_events_flush(&g_events, dgram);
+        if (len == 0) {
+            break;
+        }
+        if (send(fd, dgram, len, 0) < 0) {
+            PROCFSD_COUNT(send_errors);
+            procfsd_events_resync(&g_events);
+            break;
+        }
+    }
+}
+
+#pragma mark -
+#pragma mark Shared-memory rings
+
+/*
+ * The region is ours: mapped once, shared rather than private so a fork of
+ * the mount thread's helpers cannot leave the kext's wired pages behind a
+ * copy-on-write, and handed to the kext again on each connect (which resets
+ * the indices). We produce replies and consume requests; the socket still
+ * carries doorbells, replies the ring had no room for, and events.
+ *
+ * The request thread is the only consumer of the request ring. Every worker
+ * produces replies, so the reply ring, and which socket replies go to, are
+ * behind g_reply_lock.
+ */
+static int                    g_ring_wanted;    /* -r */
+static uint8_t               *g_ring_map;
+static struct procfs_ring     g_ring_reqs;      /* request thread only */
+static pthread_mutex_t        g_reply_lock = PTHREAD_MUTEX_INITIALIZER;
+static int                    g_ctl_fd = -1;    /* the connection; guarded by g_reply_lock */
+static int                    g_ringed;         /* the kext took the rings; ditto */
+static struct procfs_ring     g_ring_resps;     /* ditto */
+
+static void
+procfsd_ring_attach(int fd)
+{
+    const uint32_t size = PROCFS_CTL_RINGSIZE;
+
+    if (!g_ring_wanted) {
+        return;
+    }
+    if (g_ring_map == NULL) {
+        void *map = mmap(NULL, PROCFS_CTL_RINGMAP(size), PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_SHARED, -1, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "procfsd: mmap rings: %s\n", strerror(errno));
+            return;
+        }
+        g_ring_map = map;
+    }
+
+    struct procfs_ctl_ringopt ro = { .addr = (uint64_t)(uintptr_t)g_ring_map, .size = size };
+    if (setsockopt(fd, SYSPROTO_CONTROL, PROCFS_CTL_OPT_RING, &ro, sizeof(ro)) != 0) {
+        fprintf(stderr, "procfsd: rings refused (%s); using the socket\n", strerror(errno));
+        return;
+    }
+    (void)procfs_ring_init(&g_ring_reqs,
+        (struct procfs_ring_shared *)(void *)(g_ring_map + PROCFS_CTL_RING_REQS),
+        g_ring_map + PROCFS_CTL_RINGHDR, size, 0);
+    pthread_mutex_lock(&g_reply_lock);
+    (void)procfs_ring_init(&g_ring_resps,
+        (struct procfs_ring_shared *)(void *)(g_ring_map + PROCFS_CTL_RING_RESPS),
+        g_ring_map + PROCFS_CTL_RINGHDR + size, size, 0);
+    g_ringed = 1;
+    pthread_mutex_unlock(&g_reply_lock);
+}
+
+static void
+procfsd_ring_doorbell(int fd)
+{
+    static const struct procfs_ctl_doorbell bell = { .magic = PROCFS_CTL_RINGMAGIC };
+    if (send(fd, &bell, sizeof(bell), 0) < 0) {
+        PROCFSD_COUNT(send_errors);
+    }
+}
+
+/*
+ * Send a reply: into the reply ring if it is in use and has room, ringing
+ * the kext if it sleeps on one, else over the socket. Any thread.
+ */
+static void
+procfsd_reply(const void *reply, size_t len)
+{
+    pthread_mutex_lock(&g_reply_lock);
+    int fd   = g_ctl_fd;
+    int sent = 0, ring = 0;
+    if (g_ringed && procfs_ring_put(&g_ring_resps, reply, (uint32_t)len) == 0) {
+        sent = 1;
+        ring = procfs_ring_wake_needed(&g_ring_resps);
+    }
+    pthread_mutex_unlock(&g_reply_lock);
+
+    if (!sent && send(fd, reply, len, 0) < 0) {
+        PROCFSD_COUNT(send_errors);
+    }
+    if (ring) {
+        procfsd_ring_doorbell(fd);
+    }
+}
+
+/* A request the workers did not get: count it, and refuse it at once if its queue was full. */
+static void
+procfsd_unqueued(void *ctx, int result, const void *reply, size_t len, uint32_t type)
+{
+    (void)ctx;
+    if (result == PROCFSD_MALFORMED) {
+        PROCFSD_COUNT(malformed);
+        return;
+    }
+    procfsd_reply(reply, len);
+    pthread_mutex_lock(&g_stats_lock);
+    procfsd_stats_request(&g_stats, type, 0, EBUSY);
+    pthread_mutex_unlock(&g_stats_lock);
+}
+
+/* Queue a request for its class's workers. */
+static void
+procfsd_queue(const void *dgram, size_t n)
+{
+    uint8_t  sbuf[sizeof(struct procfs_ctl_resp)];
+    size_t   len  = 0;
+    uint32_t type = 0;
+    int result = procfsd_serve_queue(&g_sched, dgram, n, sbuf, &len, &type);
+    if (result != PROCFSD_QUEUED) {
+        procfsd_unqueued(NULL, result, sbuf, len, type);
     }
-    vm_deallocate(mach_task_self(), (vm_address_t)threads, tcount * sizeof(thread_act_t));
-    mach_port_deallocate(mach_task_self(), task);
+}
+
+/* Queue every request in the request ring. */
+static void
+procfsd_ring_take(int fd)
+{
+    if (!g_ringed) {
+        return;
+    }
+    (void)procfsd_serve_take(&g_sched, &g_ring_reqs, procfsd_unqueued, NULL);
+
+    pthread_mutex_lock(&g_reply_lock);
+    int broken = procfs_ring_broken(&g_ring_reqs) || procfs_ring_broken(&g_ring_resps);
+    if (broken) {
+        g_ringed = 0;
+    }
+    pthread_mutex_unlock(&g_reply_lock);
+    if (broken) {
+        struct procfs_ctl_ringopt ro = { 0 };
+        fprintf(stderr, "procfsd: rings corrupt; back to the socket\n");
+        (void)setsockopt(fd, SYSPROTO_CONTROL, PROCFS_CTL_OPT_RING, &ro, sizeof(ro));
+    }
+}
+
+#pragma mark -
+#pragma mark Request loop
+
+/*
+ * Workers per priority class. The bulk and debug sources keep state between
+ * calls that is theirs alone (the thread and pid list buffers; the port
+ * cache is locked, but held across thread_get_state), so those classes run
+ * one worker each; the fast class runs two so a slow proc_pidinfo() cannot
+ * stall it either.
+ */
+static const uint32_t procfsd_workers[PROCFS_CTL_NPRIO] = {
+    [PROCFS_CTL_PRIO_FAST]  = PROCFSD_WORKERS_FAST,
+    [PROCFS_CTL_PRIO_BULK]  = PROCFSD_WORKERS_BULK,
+    [PROCFS_CTL_PRIO_DEBUG] = PROCFSD_WORKERS_DEBUG,
+};
+
+/* Serve one request on a worker. */
+static void
+procfsd_work(void *ctx, const struct procfs_ctl_req *req)
+{
+    (void)ctx;
+    uint64_t t_req = procfsd_now_ns();
+    uint8_t  sbuf[PROCFSD_REPLY_MAX];
+    uint32_t type;
+    int      error;
+    size_t   len = procfsd_serve_one(&procfsd_sources, req, sizeof(*req), sbuf, &type, &error);
+    procfsd_reply(sbuf, len);
+
+    uint64_t ns = procfsd_now_ns() - t_req;
+    pthread_mutex_lock(&g_stats_lock);
+    procfsd_stats_request(&g_stats, type, ns, error);
+    pthread_mutex_unlock(&g_stats_lock);
+}
+
+/* Take the connection: workers reply to it from now on. */
+static void
+procfsd_connected(int fd)
+{
+    pthread_mutex_lock(&g_reply_lock);
+    g_ctl_fd = fd;
+    pthread_mutex_unlock(&g_reply_lock);
+    procfsd_ring_attach(fd);
+}
+
+/* The connection is gone: let the workers finish, then drop it. */
+static void
+procfsd_disconnected(int fd)
+{
+    (void)procfsd_sched_flush(&g_sched);
+    pthread_mutex_lock(&g_reply_lock);
+    g_ctl_fd = -1;
+    g_ringed = 0;
+    pthread_mutex_unlock(&g_reply_lock);
+    close(fd);
+    PROCFSD_COUNT(disconnects);
+}
+
+#define PROCFSD_DRAIN_POLL_MS   10      /* how often a draining procfsd asks what is left */
+#define PROCFSD_DRAIN_MAX_S     30      /* past the kext's own deadlines; then just go */
+
+/*
+ * Runs on the request thread whenever it wakes once SIGTERM arrived. The
+ * first time it tells the kext to send no more; after that it returns the
+ * poll timeout to use, and exits when the kext has nothing outstanding with
+ * us (or when the kext is too old to drain, or it takes far too long).
+ */
+static int
+procfsd_drain(int fd, int timeout)
+{
+    static uint64_t until;
+
+    if (until == 0) {
+        if (setsockopt(fd, SYSPROTO_CONTROL, PROCFS_CTL_OPT_DRAIN, NULL, 0) != 0) {
+            fprintf(stderr, "procfsd: cannot drain (%s); exiting\n", strerror(errno));
+            exit(0);
+        }
+        fprintf(stderr, "procfsd: draining\n");
+        until = procfsd_now_ns() + PROCFSD_DRAIN_MAX_S * 1000000000ULL;
+    }
+
+    uint32_t  left = 1;
+    socklen_t len  = sizeof(left);
+    if (getsockopt(fd, SYSPROTO_CONTROL, PROCFS_CTL_OPT_DRAIN, &left, &len) != 0 ||
+        left == 0 || procfsd_now_ns() >= until) {
+        (void)procfsd_sched_flush(&g_sched);
+        fprintf(stderr, "procfsd: drained (%u left)\n", left);
+        close(fd);
+        exit(0);
+    }
+    return timeout < 0 || timeout > PROCFSD_DRAIN_POLL_MS ? PROCFSD_DRAIN_POLL_MS : timeout;
 }
 
 int
@@ -275,113 +1148,133 @@ main(int argc, char **argv)
         return 2;
     }
 
+    int ch;
+    while ((ch = getopt(argc, argv, "rs:i:")) != -1) {
+        switch (ch) {
+        case 'r':
+            g_ring_wanted = 1;
+            break;
+        case 's':
+            g_stats_path = optarg;
+            break;
+        case 'i': {
+            long secs = strtol(optarg, NULL, 10);
+            if (secs <= 0) {
+                fprintf(stderr, "procfsd: bad interval %s\n", optarg);
+                return 2;
+            }
+            g_stats_interval_ns = (uint64_t)secs * 1000000000ULL;
+            break;
+        }
+        default:
+            fprintf(stderr, "usage: procfsd [-r] [-s statsfile] [-i seconds]\n");
+            return 2;
+        }
+    }
+
+    /* No SA_RESTART: the signal interrupts recv(), so the dump happens promptly. */
+    procfsd_stats_init(&g_stats, procfsd_now_ns());
+    g_stats_due = g_stats.start_ns + g_stats_interval_ns;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = procfsd_sigusr1;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGUSR1, &sa, NULL);
+    sa.sa_handler = procfsd_sigterm;
+    (void)sigaction(SIGTERM, &sa, NULL);
+
     procfsd_bootstrap();        /* stage symbols, gated kext load */
 
+    g_pcache_kq = kqueue();
+    if (g_pcache_kq < 0) {
+        fprintf(stderr, "procfsd: kqueue: %s\n", strerror(errno));
+        return 1;
+    }
+    procfsd_pcache_init(&g_pcache, &procfsd_pcache_ops, NULL, PROCFSD_PCACHE_MAX);
+
+    g_events_kq = kqueue();
+    if (g_events_kq < 0) {
+        fprintf(stderr, "procfsd: kqueue: %s\n", strerror(errno));
+        return 1;
+    }
+    procfsd_events_init(&g_events, &procfsd_events_ops, NULL);
+
+    /* The other threads leave SIGUSR1 and SIGTERM to this one, so they interrupt poll() here. */
+    sigset_t sigs, old;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGUSR1);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old);
+    int error = procfsd_sched_start(&g_sched, procfsd_workers, procfsd_work, NULL);
+    if (error != 0) {
+        fprintf(stderr, "procfsd: workers: %s\n", strerror(error));
+        return 1;
+    }
+
     /* Keep the console user's ~/proc mounted (root; gated by the arm flag). */
     pthread_t mt;
     if (pthread_create(&mt, NULL, procfsd_mount_thread, NULL) == 0) {
         pthread_detach(mt);
     }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
 
     int fd = wait_connect();
     fprintf(stderr, "procfsd: connected to %s\n", PROCFS_CTL_NAME);
+    procfsd_connected(fd);
+    procfsd_events_send(fd);
 
     for (;;) {
-        uint8_t rbuf[256];
-        ssize_t n = recv(fd, rbuf, sizeof(rbuf), 0);
-        if (n < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            close(fd);                  /* kext unloaded / socket error */
-            fd = wait_connect();
-            fprintf(stderr, "procfsd: reconnected\n");
-            continue;
-        }
-        if (n < (ssize_t)sizeof(struct procfs_ctl_req)) {
-            continue;
-        }
+        procfsd_report();
 
-        struct procfs_ctl_req *req = (struct procfs_ctl_req *)rbuf;
-        if (req->magic != PROCFS_CTL_MAGIC) {
+        /* Only sleep once the request ring is empty and the kext knows to ring. */
+        procfsd_ring_take(fd);
+        if (g_ringed && !procfs_ring_sleep_ok(&g_ring_reqs)) {
             continue;
         }
 
-        uint8_t sbuf[sizeof(struct procfs_ctl_resp) + PROCFS_CTL_MAXPAYLOAD];
-        struct procfs_ctl_resp *resp = (struct procfs_ctl_resp *)sbuf;
-        resp->magic = PROCFS_CTL_MAGIC;
-        resp->seq   = req->seq;
-        resp->error = 0;
-        resp->len   = 0;
-        void *payload = sbuf + sizeof(*resp);
-
-        switch (req->type) {
-        case PROCFS_REQ_TASKINFO: {
-            struct proc_taskinfo ti;
-            int r = proc_pidinfo(req->pid, PROC_PIDTASKINFO, 0, &ti, sizeof(ti));
-            if (r == (int)sizeof(ti)) {
-                memcpy(payload, &ti, sizeof(ti));
-                resp->len = sizeof(ti);
-            } else {
-                resp->error = (r < 0) ? errno : ESRCH;
-            }
-            break;
+        /* Requests and lifecycle events; wake for the stats file when it is due. */
+        struct pollfd pfd[2] = {
+            { .fd = fd,          .events = POLLIN },
+            { .fd = g_events_kq, .events = POLLIN },
+        };
+        int timeout = g_stats_path != NULL ? (int)(g_stats_interval_ns / 1000000ULL) : -1;
+        if (g_drain) {
+            timeout = procfsd_drain(fd, timeout);
         }
-        case PROCFS_REQ_THREADINFO: {
-            /* arg is the kext's tid (== thread_id). PROC_PIDTHREADID64INFO keys
-             * on thread_id, so the tid is the handle directly - no mapping. */
-            struct proc_threadinfo thi;
-            int r = proc_pidinfo(req->pid, PROC_PIDTHREADID64INFO, req->arg, &thi, sizeof(thi));
-            if (r == (int)sizeof(thi)) {
-                memcpy(payload, &thi, sizeof(thi));
-                resp->len = sizeof(thi);
-            } else {
-                resp->error = (r < 0) ? errno : ESRCH;
-            }
-            break;
+        if (poll(pfd, 2, timeout) <= 0) {
+            continue;                   /* signal, or the stats-file timeout */
         }
-        case PROCFS_REQ_VMSTAT: {
-            vm_statistics64_data_t vm;
-            mach_msg_type_number_t cnt = HOST_VM_INFO64_COUNT;
-            if (host_statistics64(mach_host_self(), HOST_VM_INFO64,
-                    (host_info64_t)&vm, &cnt) == KERN_SUCCESS) {
-                size_t n = (size_t)cnt * sizeof(integer_t);
-                if (n > PROCFS_CTL_MAXPAYLOAD) {
-                    n = PROCFS_CTL_MAXPAYLOAD;
-                }
-                memcpy(payload, &vm, n);
-                resp->len = (uint32_t)n;
-            } else {
-                resp->error = EIO;
-            }
-            break;
+        if (pfd[1].revents & POLLIN) {
+            procfsd_events_send(fd);
         }
-        case PROCFS_REQ_LOADAVG: {
-            double la[3] = { 0, 0, 0 };
-            (void)getloadavg(la, 3);
-            uint32_t out[3];
-            for (int i = 0; i < 3; i++) {
-                out[i] = (uint32_t)(la[i] * 100.0 + 0.5);
-            }
-            memcpy(payload, out, sizeof(out));
-            resp->len = sizeof(out);
-            break;
+        if (pfd[0].revents == 0) {
+            continue;
         }
-        case PROCFS_REQ_REGS:
-        case PROCFS_REQ_FPREGS:
-            /* thread_get_state is stripped from the kernelcache, so the kext
-             * cannot read register state itself. We do it from userspace: get
-             * the target's task port and read its representative thread's state.
-             * task_for_pid is denied for Apple platform/hardened binaries even
-             * to root (SIP/AMFI) - those report EPERM, like ptrace on Linux. */
-            procfsd_handle_regs(req, resp, payload);
-            break;
-        default:
-            resp->error = EINVAL;
-            break;
+
+        uint8_t rbuf[256];
+        ssize_t n = recv(fd, rbuf, sizeof(rbuf), 0);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;               /* signal, or the stats-file timeout */
+            }
+            procfsd_disconnected(fd);   /* kext unloaded / socket error */
+            if (g_drain) {
+                return 0;
+            }
+            fd = wait_connect();
+            fprintf(stderr, "procfsd: reconnected\n");
+            procfsd_connected(fd);
+            procfsd_events_resync(&g_events);
+            procfsd_events_send(fd);
+            continue;
         }
 
-        (void)send(fd, sbuf, sizeof(*resp) + resp->len, 0);
+        struct procfs_ctl_doorbell bell;
+        if ((size_t)n >= sizeof(bell) && memcpy(&bell, rbuf, sizeof(bell)) != NULL &&
+            bell.magic == PROCFS_CTL_RINGMAGIC) {
+            continue;                   /* the ring is taken on the way round */
+        }
+        procfsd_queue(rbuf, (size_t)n);
     }
     return 0;
 }
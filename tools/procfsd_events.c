@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_events.c
+ *
+ * Process lifecycle tracking and batching for procfsd (see procfsd_events.h).
+ * The watched set is a bitmap over all possible pids.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "procfsd_events.h"
+
+static int
+procfsd_events_is_watched(const struct procfsd_events *evs, pid_t pid)
+{
+    return pid > 0 && pid < PROCFSD_EV_PIDMAX && (evs->watched[pid / 8] & (1u << (pid % 8)));
+}
+
+static void
+procfsd_events_mark(struct procfsd_events *evs, pid_t pid, int on)
+{
+    if (pid <= 0 || pid >= PROCFSD_EV_PIDMAX) {
+        return;
+    }
+    if (on) {
+        evs->watched[pid / 8] |= (uint8_t)(1u << (pid % 8));
+    } else {
+        evs->watched[pid / 8] &= (uint8_t)~(1u << (pid % 8));
+    }
+}
+
+/* Watch `pid` unless it is already. Returns 1 if it is newly watched. */
+static int
+procfsd_events_watch(struct procfsd_events *evs, pid_t pid)
+{
+    if (pid <= 0 || pid >= PROCFSD_EV_PIDMAX || procfsd_events_is_watched(evs, pid)) {
+        return 0;
+    }
+    if (evs->ops->watch(evs->ctx, pid) != 0) {
+        return 0;               /* gone already */
+    }
+    procfsd_events_mark(evs, pid, 1);
+    return 1;
+}
+
+static void
+procfsd_events_add(struct procfsd_events *evs, uint32_t kind, pid_t pid, pid_t ppid)
+{
+    if (evs->count >= PROCFS_CTL_MAXEVENTS) {
+        evs->dropped++;
+        evs->counts.dropped++;
+        return;
+    }
+    evs->ev[evs->count++] = (struct procfs_ctl_event){ .kind = kind, .pid = pid, .ppid = ppid };
+    switch (kind) {
+    case PROCFS_EV_FORK: evs->counts.forks++; break;
+    case PROCFS_EV_EXEC: evs->counts.execs++; break;
+    case PROCFS_EV_EXIT: evs->counts.exits++; break;
+    }
+}
+
+void
+procfsd_events_init(struct procfsd_events *evs, const struct procfsd_events_ops *ops,
+    void *ctx)
+{
+    memset(evs, 0, sizeof(*evs));
+    evs->ops = ops;
+    evs->ctx = ctx;
+    evs->dropped = 1;
+
+    /* proc_listallpids() style: a full buffer means there may be more. */
+    int max = 4096;
+    for (;;) {
+        pid_t *pids = malloc((size_t)max * sizeof(*pids));
+        if (pids == NULL) {
+            return;
+        }
+        int n = ops->list_all(ctx, pids, max);
+        if (n >= max && max < PROCFSD_EV_PIDMAX) {
+            free(pids);
+            max *= 2;
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            (void)procfsd_events_watch(evs, pids[i]);
+        }
+        free(pids);
+        return;
+    }
+}
+
+void
+procfsd_events_resync(struct procfsd_events *evs)
+{
+    if (evs->dropped == 0) {
+        evs->dropped = 1;
+    }
+}
+
+uint32_t
+procfsd_events_poll(struct procfsd_events *evs)
+{
+    uint32_t before = evs->count;
+    pid_t    pid;
+    uint32_t notes;
+
+    while (evs->count < PROCFS_CTL_MAXEVENTS && evs->ops->next(evs->ctx, &pid, &notes)) {
+        if (notes & PROCFSD_NOTE_FORK) {
+            int n = evs->ops->list_children(evs->ctx, pid, evs->kids, PROCFSD_EV_CHILDREN);
+            for (int i = 0; i < n; i++) {
+                if (procfsd_events_watch(evs, evs->kids[i])) {
+                    procfsd_events_add(evs, PROCFS_EV_FORK, evs->kids[i], pid);
+                }
+            }
+            if (n >= PROCFSD_EV_CHILDREN) {
+                evs->dropped++;         /* there may be more we cannot see */
+                evs->counts.dropped++;
+            }
+        }
+        if (notes & PROCFSD_NOTE_EXEC) {
+            procfsd_events_add(evs, PROCFS_EV_EXEC, pid, 0);
+        }
+        if (notes & PROCFSD_NOTE_EXIT) {
+            procfsd_events_mark(evs, pid, 0);
+            procfsd_events_add(evs, PROCFS_EV_EXIT, pid, 0);
+        }
+    }
+    return evs->count - before;
+}
+
+size_t
+procfsd_events_flush(struct procfsd_events *evs, void *dgram)
+{
+    if (evs->count == 0 && evs->dropped == 0) {
+        return 0;
+    }
+    struct procfs_ctl_evhdr hdr = {
+        .magic   = PROCFS_CTL_EVMAGIC,
+        .count   = evs->count,
+        .dropped = evs->dropped,
+    };
+    size_t body = (size_t)evs->count * sizeof(evs->ev[0]);
+    memcpy(dgram, &hdr, sizeof(hdr));
+    memcpy((uint8_t *)dgram + sizeof(hdr), evs->ev, body);
+
+    evs->count   = 0;
+    evs->dropped = 0;
+    evs->counts.batches++;
+    return sizeof(hdr) + body;
+}
+
+int
+procfsd_events_print(const struct procfsd_events *evs, FILE *fp)
+{
+    const struct procfsd_events_counts *c = &evs->counts;
+    return fprintf(fp, "events forks %llu execs %llu exits %llu dropped %llu batches %llu\n",
+        (unsigned long long)c->forks, (unsigned long long)c->execs,
+        (unsigned long long)c->exits, (unsigned long long)c->dropped,
+        (unsigned long long)c->batches) < 0 ? -1 : 0;
+}
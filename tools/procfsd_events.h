@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_events.h
+ *
+ * Process lifecycle tracking for procfsd: which processes fork, exec and
+ * exit, batched into PROCFS_CTL_EVMAGIC datagrams for the kext. Every known
+ * process is watched for NOTE_FORK, NOTE_EXEC and NOTE_EXIT. A fork is
+ * reported on the parent only, so its new children are found by listing the
+ * parent's children and watching the ones not yet known. The kqueue and
+ * libproc calls come in through procfsd_events_ops - procfsd's are real,
+ * test/host replays a recorded trace (test/host/traces/) - so the tracking
+ * builds and is tested on any host (test/host/test_procfsd_events.c).
+ *
+ * Only procfsd's request thread uses the tracker; it takes no locks.
+ */
+#ifndef PROCFSD_EVENTS_H
+#define PROCFSD_EVENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "../include/fs/procfs/procfs_ctl.h"
+
+#define PROCFSD_EV_PIDMAX   100000      /* pids watched are below this (macOS PID_MAX 99999) */
+#define PROCFSD_EV_CHILDREN 4096        /* children looked at per fork notification */
+
+/* What happened to a watched process, as kqueue's fflags. */
+#define PROCFSD_NOTE_FORK   0x1
+#define PROCFSD_NOTE_EXEC   0x2
+#define PROCFSD_NOTE_EXIT   0x4
+
+struct procfsd_events_ops {
+    /* Watch `pid` for fork, exec and exit; ESRCH if it has already gone. */
+    int (*watch)(void *ctx, pid_t pid);
+
+    /* Up to `max` pids: every process, or the children of `ppid`. Returns the count. */
+    int (*list_all)(void *ctx, pid_t *pids, int max);
+    int (*list_children)(void *ctx, pid_t ppid, pid_t *pids, int max);
+
+    /*
+     * Returns 1 with a pending notification - the pid and what happened to
+     * it, several things at once if they piled up - or 0 once none is.
+     * A reported exit ends the watch by itself.
+     */
+    int (*next)(void *ctx, pid_t *pid, uint32_t *notes);
+};
+
+struct procfsd_events_counts {
+    uint64_t forks;
+    uint64_t execs;
+    uint64_t exits;
+    uint64_t dropped;       /* events lost: a full batch, or too many children to list */
+    uint64_t batches;       /* datagrams built */
+};
+
+struct procfsd_events {
+    const struct procfsd_events_ops *ops;
+    void                            *ctx;
+    uint8_t                          watched[(PROCFSD_EV_PIDMAX + 7) / 8];
+    pid_t                            kids[PROCFSD_EV_CHILDREN];
+    uint32_t                         dropped;   /* for the pending batch */
+    uint32_t                         count;
+    struct procfs_ctl_event          ev[PROCFS_CTL_MAXEVENTS];
+    struct procfsd_events_counts     counts;
+};
+
+/* The largest batch datagram. */
+#define PROCFSD_EVENTS_MAX  (sizeof(struct procfs_ctl_evhdr) + \
+                             PROCFS_CTL_MAXEVENTS * sizeof(struct procfs_ctl_event))
+
+/*
+ * Start tracking: watch every process there is now. The first batch is
+ * marked as having dropped events, since nothing before it was seen.
+ */
+void procfsd_events_init(struct procfsd_events *evs, const struct procfsd_events_ops *ops,
+    void *ctx);
+
+/*
+ * Mark the next batch as having dropped events, without reporting anything
+ * yet - for a kext that has just (re)connected and missed what came before.
+ */
+void procfsd_events_resync(struct procfsd_events *evs);
+
+/*
+ * Turn pending notifications into events for the next batch, until none is
+ * pending or the batch is full. Returns the number of events added.
+ */
+uint32_t procfsd_events_poll(struct procfsd_events *evs);
+
+/*
+ * Build the pending batch into `dgram` (room for PROCFSD_EVENTS_MAX bytes)
+ * and start a new one. Returns the datagram length, or 0 if there is nothing
+ * to send.
+ */
+size_t procfsd_events_flush(struct procfsd_events *evs, void *dgram);
+
+/* Text dump of the counters. Returns 0, or -1 with errno set. */
+int procfsd_events_print(const struct procfsd_events *evs, FILE *fp);
+
+#endif /* PROCFSD_EVENTS_H */
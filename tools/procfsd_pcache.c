@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_pcache.c
+ *
+ * Task-port and thread-list cache for procfsd (see procfsd_pcache.h). The
+ * cache is small, so lookups and LRU eviction are linear scans.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "procfsd_pcache.h"
+
+void
+procfsd_pcache_init(struct procfsd_pcache *pc, const struct procfsd_pcache_ops *ops,
+    void *ctx, uint32_t cap)
+{
+    memset(pc, 0, sizeof(*pc));
+    pc->ops = ops;
+    pc->ctx = ctx;
+    pc->cap = cap == 0 ? 1 : (cap > PROCFSD_PCACHE_MAX ? PROCFSD_PCACHE_MAX : cap);
+}
+
+static struct procfsd_pcache_ent *
+procfsd_pcache_find(struct procfsd_pcache *pc, pid_t pid)
+{
+    for (uint32_t i = 0; i < pc->cap; i++) {
+        if (pc->ent[i].in_use && pc->ent[i].pid == pid) {
+            return &pc->ent[i];
+        }
+    }
+    return NULL;
+}
+
+static void
+procfsd_pcache_put_threads(struct procfsd_pcache *pc, struct procfsd_pcache_ent *e)
+{
+    if (e->threads != NULL) {
+        pc->ops->threads_put(pc->ctx, e->threads, e->nthreads);
+        e->threads  = NULL;
+        e->nthreads = 0;
+    }
+}
+
+/* Release `e`'s ports; `watched` if its exit watch is still registered. */
+static void
+procfsd_pcache_drop(struct procfsd_pcache *pc, struct procfsd_pcache_ent *e, int watched)
+{
+    procfsd_pcache_put_threads(pc, e);
+    pc->ops->task_close(pc->ctx, e->task);
+    if (watched) {
+        pc->ops->unwatch(pc->ctx, e->pid);
+    }
+    memset(e, 0, sizeof(*e));
+}
+
+void
+procfsd_pcache_drain(struct procfsd_pcache *pc)
+{
+    pid_t pid;
+    while (pc->ops->next_exit(pc->ctx, &pid)) {
+        struct procfsd_pcache_ent *e = procfsd_pcache_find(pc, pid);
+        if (e != NULL) {
+            procfsd_pcache_drop(pc, e, 0);
+            pc->counts.exits++;
+        }
+    }
+}
+
+/* A free entry, evicting the least recently used one if there is none. */
+static struct procfsd_pcache_ent *
+procfsd_pcache_slot(struct procfsd_pcache *pc)
+{
+    struct procfsd_pcache_ent *lru = &pc->ent[0];
+    for (uint32_t i = 0; i < pc->cap; i++) {
+        struct procfsd_pcache_ent *e = &pc->ent[i];
+        if (!e->in_use) {
+            return e;
+        }
+        if (e->used < lru->used) {
+            lru = e;
+        }
+    }
+    procfsd_pcache_drop(pc, lru, 1);
+    pc->counts.evictions++;
+    return lru;
+}
+
+int
+procfsd_pcache_get(struct procfsd_pcache *pc, pid_t pid, uint64_t now_ns,
+    struct procfsd_pcache_ent **ep)
+{
+    procfsd_pcache_drain(pc);
+
+    struct procfsd_pcache_ent *e = procfsd_pcache_find(pc, pid);
+    if (e != NULL) {
+        pc->counts.hits++;
+    } else {
+        uint32_t task;
+        int error = pc->ops->task_open(pc->ctx, pid, &task);
+        if (error != 0) {
+            return error;
+        }
+        /*
+         * Watch before caching: a process that exits after this is reported,
+         * and one that already has cannot be watched, so a pid reused by a
+         * new process never finds the old one's port.
+         */
+        error = pc->ops->watch(pc->ctx, pid);
+        if (error != 0) {
+            pc->ops->task_close(pc->ctx, task);
+            pc->counts.watch_errors++;
+            return error;
+        }
+        pc->counts.misses++;
+        e = procfsd_pcache_slot(pc);
+        e->in_use = 1;
+        e->pid    = pid;
+        e->task   = task;
+    }
+    e->used = ++pc->clock;
+
+    if (e->threads == NULL || now_ns - e->threads_ns >= PROCFSD_PCACHE_THREADS_NS) {
+        procfsd_pcache_put_threads(pc, e);
+        uint32_t *threads = NULL;
+        uint32_t  count   = 0;
+        int error = pc->ops->threads_get(pc->ctx, e->task, &threads, &count);
+        if (error != 0) {
+            procfsd_pcache_drop(pc, e, 1);
+            pc->counts.invalidations++;
+            return error;
+        }
+        e->threads    = threads;
+        e->nthreads   = count;
+        e->threads_ns = now_ns;
+        pc->counts.refreshes++;
+    }
+    *ep = e;
+    return 0;
+}
+
+void
+procfsd_pcache_invalidate(struct procfsd_pcache *pc, pid_t pid)
+{
+    struct procfsd_pcache_ent *e = procfsd_pcache_find(pc, pid);
+    if (e != NULL) {
+        procfsd_pcache_drop(pc, e, 1);
+        pc->counts.invalidations++;
+    }
+}
+
+void
+procfsd_pcache_flush(struct procfsd_pcache *pc)
+{
+    for (uint32_t i = 0; i < pc->cap; i++) {
+        if (pc->ent[i].in_use) {
+            procfsd_pcache_drop(pc, &pc->ent[i], 1);
+        }
+    }
+}
+
+uint32_t
+procfsd_pcache_size(const struct procfsd_pcache *pc)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < pc->cap; i++) {
+        n += pc->ent[i].in_use ? 1 : 0;
+    }
+    return n;
+}
+
+int
+procfsd_pcache_print(const struct procfsd_pcache *pc, FILE *fp)
+{
+    const struct procfsd_pcache_counts *c = &pc->counts;
+    return fprintf(fp, "port_cache size %u cap %u hits %llu misses %llu refreshes %llu "
+        "exits %llu evictions %llu invalidations %llu watch_errors %llu\n",
+        procfsd_pcache_size(pc), pc->cap,
+        (unsigned long long)c->hits, (unsigned long long)c->misses,
+        (unsigned long long)c->refreshes, (unsigned long long)c->exits,
+        (unsigned long long)c->evictions, (unsigned long long)c->invalidations,
+        (unsigned long long)c->watch_errors) < 0 ? -1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_pcache.h
+ *
+ * procfsd's cache of Mach task ports and thread lists, per pid. The regs and
+ * fpregs sources used to call task_for_pid() and task_threads() and drop the
+ * ports again on every request; with the cache a process's ports are taken
+ * once and kept until it exits. The port calls and the exit notifications
+ * come in through procfsd_pcache_ops - procfsd's use Mach and a kqueue
+ * EVFILT_PROC/NOTE_EXIT registration, test/host's are synthetic - so the
+ * bookkeeping builds and is tested on any host
+ * (test/host/test_procfsd_pcache.c).
+ *
+ * The cache takes no locks; procfsd holds its own around every use.
+ */
+#ifndef PROCFSD_PCACHE_H
+#define PROCFSD_PCACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define PROCFSD_PCACHE_MAX          64      /* processes cached at most */
+#define PROCFSD_PCACHE_THREADS_NS   1000000000ULL   /* thread lists are retaken after 1s */
+
+/*
+ * Where the ports come from and where exits are reported. Task and thread
+ * ports are opaque to the cache; every call that can fail returns 0 or an
+ * errno.
+ */
+struct procfsd_pcache_ops {
+    int  (*task_open)(void *ctx, pid_t pid, uint32_t *task);
+    void (*task_close)(void *ctx, uint32_t task);
+    int  (*threads_get)(void *ctx, uint32_t task, uint32_t **threads, uint32_t *count);
+    void (*threads_put)(void *ctx, uint32_t *threads, uint32_t count);
+
+    /*
+     * Ask for `pid`'s exit to be reported by next_exit(); ESRCH if it has
+     * already gone. A reported exit cancels the request by itself; unwatch()
+     * cancels one for a process that is still running.
+     */
+    int  (*watch)(void *ctx, pid_t pid);
+    void (*unwatch)(void *ctx, pid_t pid);
+
+    /* Returns 1 with the pid of a reported exit, 0 once none is pending. */
+    int  (*next_exit)(void *ctx, pid_t *pid);
+};
+
+struct procfsd_pcache_ent {
+    int       in_use;
+    pid_t     pid;
+    uint32_t  task;
+    uint32_t *threads;      /* NULL until first asked for */
+    uint32_t  nthreads;
+    uint64_t  threads_ns;   /* when the thread list was taken */
+    uint64_t  used;         /* LRU clock */
+};
+
+struct procfsd_pcache_counts {
+    uint64_t hits;          /* requests answered with a cached task port */
+    uint64_t misses;        /* task ports taken with task_open */
+    uint64_t refreshes;     /* thread lists (re)taken */
+    uint64_t exits;         /* entries dropped for a reported exit */
+    uint64_t evictions;     /* entries dropped to make room */
+    uint64_t invalidations; /* entries dropped because a port went stale */
+    uint64_t watch_errors;  /* processes not cached: the exit watch failed */
+};
+
+struct procfsd_pcache {
+    const struct procfsd_pcache_ops *ops;
+    void                            *ctx;
+    uint32_t                         cap;
+    uint64_t                         clock;
+    struct procfsd_pcache_counts     counts;
+    struct procfsd_pcache_ent        ent[PROCFSD_PCACHE_MAX];
+};
+
+/* An empty cache of at most `cap` (clamped to 1..PROCFSD_PCACHE_MAX) processes. */
+void procfsd_pcache_init(struct procfsd_pcache *pc, const struct procfsd_pcache_ops *ops,
+    void *ctx, uint32_t cap);
+
+/* Drop the entries of every process whose exit has been reported. */
+void procfsd_pcache_drain(struct procfsd_pcache *pc);
+
+/*
+ * The entry for `pid`, with its task port and a thread list no older than
+ * PROCFSD_PCACHE_THREADS_NS at `now_ns`. Reported exits are drained first.
+ * A miss takes the task port and watches for the exit, evicting the least
+ * recently used entry if the cache is full. Returns 0 with *ep set, or the
+ * errno of the failed call. The entry stays valid until the next call.
+ */
+int procfsd_pcache_get(struct procfsd_pcache *pc, pid_t pid, uint64_t now_ns,
+    struct procfsd_pcache_ent **ep);
+
+/* Drop `pid`'s entry, if any: one of its ports failed and may be stale. */
+void procfsd_pcache_invalidate(struct procfsd_pcache *pc, pid_t pid);
+
+/* Drop every entry. */
+void procfsd_pcache_flush(struct procfsd_pcache *pc);
+
+/* Entries in use. */
+uint32_t procfsd_pcache_size(const struct procfsd_pcache *pc);
+
+/* Text dump of the counters. Returns 0, or -1 with errno set. */
+int procfsd_pcache_print(const struct procfsd_pcache *pc, FILE *fp);
+
+#endif /* PROCFSD_PCACHE_H */
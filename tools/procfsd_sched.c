@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_sched.c
+ *
+ * Per-class request queues and worker pools for procfsd (see
+ * procfsd_sched.h). One mutex covers every queue; it is only held to move a
+ * request in or out, never while one is served.
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "procfsd_sched.h"
+
+static const char *const procfsd_sched_names[PROCFS_CTL_NPRIO] = {
+    [PROCFS_CTL_PRIO_FAST]  = "fast",
+    [PROCFS_CTL_PRIO_BULK]  = "bulk",
+    [PROCFS_CTL_PRIO_DEBUG] = "debug",
+};
+
+uint32_t
+procfsd_sched_prio(const struct procfs_ctl_req *req)
+{
+    return procfs_ctl_prio(req->type);
+}
+
+static void *
+procfsd_sched_worker(void *arg)
+{
+    struct procfsd_sched_worker *w = arg;
+    struct procfsd_sched       *s = w->s;
+    struct procfsd_sched_class *c = &s->cls[w->prio];
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (c->depth == 0 && !s->stopping) {
+            pthread_cond_wait(&s->work[w->prio], &s->lock);
+        }
+        if (c->depth == 0) {
+            break;
+        }
+        struct procfs_ctl_req req = c->q[c->head];
+        c->head = (c->head + 1) % PROCFSD_SCHED_DEPTH;
+        c->depth--;
+        c->busy++;
+        pthread_mutex_unlock(&s->lock);
+
+        s->fn(s->ctx, &req);
+
+        pthread_mutex_lock(&s->lock);
+        c->busy--;
+        c->counts.served++;
+        pthread_cond_broadcast(&s->idle);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/* Drop what is queued. Called with s->lock held. */
+static uint32_t
+procfsd_sched_drop(struct procfsd_sched *s)
+{
+    uint32_t n = 0;
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        struct procfsd_sched_class *c = &s->cls[p];
+        c->counts.dropped += c->depth;
+        n += c->depth;
+        c->head  = 0;
+        c->depth = 0;
+    }
+    return n;
+}
+
+static void
+procfsd_sched_join(struct procfsd_sched *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stopping = 1;
+    (void)procfsd_sched_drop(s);
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        pthread_cond_broadcast(&s->work[p]);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        struct procfsd_sched_class *c = &s->cls[p];
+        for (uint32_t i = 0; i < c->nworkers; i++) {
+            pthread_join(c->workers[i].thread, NULL);
+        }
+        c->nworkers = 0;
+    }
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        pthread_cond_destroy(&s->work[p]);
+    }
+    pthread_cond_destroy(&s->idle);
+    pthread_mutex_destroy(&s->lock);
+}
+
+int
+procfsd_sched_start(struct procfsd_sched *s, const uint32_t workers[PROCFS_CTL_NPRIO],
+    procfsd_sched_fn fn, void *ctx)
+{
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        if (workers[p] == 0 || workers[p] > PROCFSD_SCHED_WORKERS) {
+            return EINVAL;
+        }
+    }
+    memset(s, 0, sizeof(*s));
+    s->fn  = fn;
+    s->ctx = ctx;
+    pthread_mutex_init(&s->lock, NULL);
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        pthread_cond_init(&s->work[p], NULL);
+    }
+    pthread_cond_init(&s->idle, NULL);
+
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        struct procfsd_sched_class *c = &s->cls[p];
+        for (uint32_t i = 0; i < workers[p]; i++) {
+            struct procfsd_sched_worker *w = &c->workers[i];
+            w->s    = s;
+            w->prio = p;
+            int error = pthread_create(&w->thread, NULL, procfsd_sched_worker, w);
+            if (error != 0) {
+                procfsd_sched_join(s);
+                return error;
+            }
+            c->nworkers++;
+        }
+    }
+    return 0;
+}
+
+int
+procfsd_sched_push(struct procfsd_sched *s, const struct procfs_ctl_req *req)
+{
+    uint32_t prio = procfsd_sched_prio(req);
+    struct procfsd_sched_class *c = &s->cls[prio];
+
+    pthread_mutex_lock(&s->lock);
+    if (c->depth == PROCFSD_SCHED_DEPTH || s->stopping) {
+        c->counts.refused++;
+        pthread_mutex_unlock(&s->lock);
+        return EBUSY;
+    }
+    c->q[(c->head + c->depth) % PROCFSD_SCHED_DEPTH] = *req;
+    c->depth++;
+    c->counts.queued++;
+    if (c->depth > c->counts.maxdepth) {
+        c->counts.maxdepth = c->depth;
+    }
+    pthread_cond_signal(&s->work[prio]);
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+uint32_t
+procfsd_sched_flush(struct procfsd_sched *s)
+{
+    pthread_mutex_lock(&s->lock);
+    uint32_t n = procfsd_sched_drop(s);
+    for (;;) {
+        uint32_t busy = 0;
+        for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+            busy += s->cls[p].busy;
+        }
+        if (busy == 0) {
+            break;
+        }
+        pthread_cond_wait(&s->idle, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+void
+procfsd_sched_stop(struct procfsd_sched *s)
+{
+    procfsd_sched_join(s);
+}
+
+struct procfsd_sched_counts
+procfsd_sched_counts(struct procfsd_sched *s, uint32_t prio)
+{
+    pthread_mutex_lock(&s->lock);
+    struct procfsd_sched_counts c = s->cls[prio].counts;
+    pthread_mutex_unlock(&s->lock);
+    return c;
+}
+
+int
+procfsd_sched_print(struct procfsd_sched *s, FILE *fp)
+{
+    for (uint32_t p = 0; p < PROCFS_CTL_NPRIO; p++) {
+        struct procfsd_sched_counts c = procfsd_sched_counts(s, p);
+        if (fprintf(fp, "queue %s workers %u queued %llu served %llu refused %llu "
+            "dropped %llu maxdepth %u\n", procfsd_sched_names[p], s->cls[p].nworkers,
+            (unsigned long long)c.queued, (unsigned long long)c.served,
+            (unsigned long long)c.refused, (unsigned long long)c.dropped, c.maxdepth) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
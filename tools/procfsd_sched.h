@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_sched.h
+ *
+ * procfsd's request queues and workers, one set per priority class
+ * (PROCFS_CTL_PRIO_*). The receive loop only takes requests off the socket
+ * or the request ring and pushes them here; each class's workers take its
+ * requests in arrival order and serve them through a callback. A class
+ * serves at most as many requests at once as it has workers, so a burst of
+ * register reads stuck in thread_get_state() ties up the debug workers and
+ * nothing else, and loadavg is answered by a fast worker meanwhile.
+ *
+ * Portable pthreads: procfsd and test/host's loopback run the same queues
+ * (test/host/test_procfsd_sched.c).
+ */
+#ifndef PROCFSD_SCHED_H
+#define PROCFSD_SCHED_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../include/fs/procfs/procfs_ctl.h"
+
+#define PROCFSD_SCHED_DEPTH     32      /* requests queued per class; more than the kext's slots */
+#define PROCFSD_SCHED_WORKERS   8       /* workers per class at most */
+
+/* procfsd's workers per class (procfsd.c says why bulk and debug have one). */
+#define PROCFSD_WORKERS_FAST    2
+#define PROCFSD_WORKERS_BULK    1
+#define PROCFSD_WORKERS_DEBUG   1
+
+/* Serve one request; runs on a worker of the request's class, unlocked. */
+typedef void (*procfsd_sched_fn)(void *ctx, const struct procfs_ctl_req *req);
+
+struct procfsd_sched;
+
+struct procfsd_sched_worker {
+    struct procfsd_sched *s;
+    uint32_t              prio;
+    pthread_t             thread;
+};
+
+struct procfsd_sched_counts {
+    uint64_t queued;        /* requests pushed */
+    uint64_t served;        /* requests a worker finished */
+    uint64_t refused;       /* pushes refused: the queue was full */
+    uint64_t dropped;       /* queued requests flushed unserved */
+    uint32_t maxdepth;      /* the deepest the queue has been */
+};
+
+struct procfsd_sched_class {
+    struct procfs_ctl_req       q[PROCFSD_SCHED_DEPTH];
+    uint32_t                    head;
+    uint32_t                    depth;      /* requests queued */
+    uint32_t                    busy;       /* requests being served */
+    uint32_t                    nworkers;
+    struct procfsd_sched_worker workers[PROCFSD_SCHED_WORKERS];
+    struct procfsd_sched_counts counts;
+};
+
+struct procfsd_sched {
+    pthread_mutex_t            lock;
+    pthread_cond_t             work[PROCFS_CTL_NPRIO];  /* a class has requests queued */
+    pthread_cond_t             idle;                    /* a worker finished one */
+    int                        stopping;
+    procfsd_sched_fn           fn;
+    void                      *ctx;
+    struct procfsd_sched_class cls[PROCFS_CTL_NPRIO];
+};
+
+/*
+ * The class procfsd serves `req` in, by its type whatever its prio says:
+ * procfsd_src_threads() and the other bulk sources keep static buffers
+ * that two workers at once would race on.
+ */
+uint32_t procfsd_sched_prio(const struct procfs_ctl_req *req);
+
+/*
+ * Start `workers[prio]` workers for each class (1..PROCFSD_SCHED_WORKERS),
+ * serving through `fn`. Returns 0, or an errno with nothing left running.
+ */
+int procfsd_sched_start(struct procfsd_sched *s, const uint32_t workers[PROCFS_CTL_NPRIO],
+    procfsd_sched_fn fn, void *ctx);
+
+/* Queue a copy of `req` for its class. Returns 0, or EBUSY if the queue is full. */
+int procfsd_sched_push(struct procfsd_sched *s, const struct procfs_ctl_req *req);
+
+/*
+ * Drop every queued request and wait for the ones being served to finish,
+ * so nothing is in flight (procfsd calls it before closing a dead socket).
+ * Returns the number dropped.
+ */
+uint32_t procfsd_sched_flush(struct procfsd_sched *s);
+
+/* Flush, then stop and join the workers. */
+void procfsd_sched_stop(struct procfsd_sched *s);
+
+/* A snapshot of class `prio`'s counters. */
+struct procfsd_sched_counts procfsd_sched_counts(struct procfsd_sched *s, uint32_t prio);
+
+/* One line per class for the stats dump. Returns 0, or -1 on a write error. */
+int procfsd_sched_print(struct procfsd_sched *s, FILE *fp);
+
+#endif /* PROCFSD_SCHED_H */
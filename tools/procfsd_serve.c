@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_serve.c
+ *
+ * Request dispatch for procfsd (see procfsd_serve.h). Portable: everything
+ * platform-specific is behind the data sources.
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "procfsd_serve.h"
+
+/*
+ * Copy the request datagram `dgram` of `n` bytes into *req, zero-filling
+ * what an older kext's shorter request leaves out. Returns 0, or -1 if it
+ * is not a request.
+ */
+static int
+procfsd_serve_parse(const void *dgram, size_t n, struct procfs_ctl_req *req)
+{
+    if (n < PROCFS_CTL_REQMIN) {
+        return -1;
+    }
+    memset(req, 0, sizeof(*req));
+    memcpy(req, dgram, n < sizeof(*req) ? n : sizeof(*req));
+    return req->magic == PROCFS_CTL_MAGIC ? 0 : -1;
+}
+
+size_t
+procfsd_serve_one(const struct procfsd_sources *src, const void *dgram, size_t n,
+    void *reply, uint32_t *type, int *error)
+{
+    struct procfs_ctl_req req;
+    if (procfsd_serve_parse(dgram, n, &req) != 0) {
+        return 0;
+    }
+
+    struct procfs_ctl_resp resp = {
+        .magic = PROCFS_CTL_MAGIC,
+        .seq   = req.seq,
+        .error = 0,
+        .len   = 0,
+    };
+    uint8_t *payload = (uint8_t *)reply + sizeof(resp);
+
+    procfsd_source_fn fn = req.type < PROCFSD_NREQ ? src->fn[req.type] : NULL;
+    if (fn == NULL) {
+        resp.error = EINVAL;
+    } else {
+        uint32_t len = 0;
+        resp.error = fn(src->ctx, &req, payload, &len);
+        if (resp.error == 0) {
+            resp.len = len <= PROCFS_CTL_MAXPAYLOAD ? len : PROCFS_CTL_MAXPAYLOAD;
+        }
+    }
+    memcpy(reply, &resp, sizeof(resp));
+
+    if (type != NULL) {
+        *type = req.type;
+    }
+    if (error != NULL) {
+        *error = resp.error;
+    }
+    return sizeof(resp) + resp.len;
+}
+
+size_t
+procfsd_serve_error(const struct procfs_ctl_req *req, int error, void *reply)
+{
+    struct procfs_ctl_resp resp = {
+        .magic = PROCFS_CTL_MAGIC,
+        .seq   = req->seq,
+        .error = error,
+        .len   = 0,
+    };
+    memcpy(reply, &resp, sizeof(resp));
+    return sizeof(resp);
+}
+
+int
+procfsd_serve_queue(struct procfsd_sched *s, const void *dgram, size_t n, void *reply,
+    size_t *len, uint32_t *type)
+{
+    struct procfs_ctl_req req;
+    if (procfsd_serve_parse(dgram, n, &req) != 0) {
+        return PROCFSD_MALFORMED;
+    }
+    if (procfsd_sched_push(s, &req) != 0) {
+        *len  = procfsd_serve_error(&req, EBUSY, reply);
+        *type = req.type;
+        return PROCFSD_REFUSED;
+    }
+    return PROCFSD_QUEUED;
+}
+
+uint32_t
+procfsd_serve_take(struct procfsd_sched *s, struct procfs_ring *reqs,
+    procfsd_unqueued_fn unqueued, void *ctx)
+{
+    const void *rec;
+    uint32_t n, taken = 0;
+    while ((rec = procfs_ring_peek(reqs, &n)) != NULL) {
+        uint8_t  reply[sizeof(struct procfs_ctl_resp)];
+        size_t   len  = 0;
+        uint32_t type = 0;
+        int result = procfsd_serve_queue(s, rec, n, reply, &len, &type);
+        procfs_ring_consume(reqs);
+        if (result != PROCFSD_QUEUED) {
+            unqueued(ctx, result, reply, len, type);
+        }
+        taken++;
+    }
+    return taken;
+}
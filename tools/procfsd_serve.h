@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_serve.h
+ *
+ * procfsd's request dispatch, apart from where the data comes from and how
+ * the datagrams travel. A request datagram is validated and handed to the
+ * data source registered for its type; the source fills the payload and the
+ * reply datagram is built around it. procfsd registers the libproc and Mach
+ * sources; test/host registers synthetic ones and serves a socketpair, so
+ * the same dispatch runs against the kext's slot table in one process.
+ * Between the two, procfsd_serve_queue() and procfsd_serve_take() hand the
+ * datagrams and the records of the shared-memory request ring to the
+ * per-class workers (procfsd_sched.h), for both alike.
+ */
+#ifndef PROCFSD_SERVE_H
+#define PROCFSD_SERVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/fs/procfs/procfs_ctl.h"
+#include "../include/fs/procfs/procfs_ring.h"
+#include "procfsd_sched.h"
+#include "procfsd_stats.h"
+
+/* The largest reply datagram: header plus a full payload. */
+#define PROCFSD_REPLY_MAX   (sizeof(struct procfs_ctl_resp) + PROCFS_CTL_MAXPAYLOAD)
+
+/*
+ * Answer one request. `payload` has room for PROCFS_CTL_MAXPAYLOAD bytes;
+ * the source sets *len to the bytes it wrote and returns 0, or returns an
+ * errno for the kext to fall back on (the payload is then not sent).
+ */
+typedef int (*procfsd_source_fn)(void *ctx, const struct procfs_ctl_req *req,
+    void *payload, uint32_t *len);
+
+/* Data sources by request type; a NULL entry answers EINVAL. */
+struct procfsd_sources {
+    void              *ctx;
+    procfsd_source_fn  fn[PROCFSD_NREQ];
+};
+
+/*
+ * Serve the request datagram `dgram` of `n` bytes into `reply`, which has
+ * room for PROCFSD_REPLY_MAX bytes. Returns the reply length, or 0 if the
+ * datagram is not a request (shorter than PROCFS_CTL_REQMIN, or bad magic)
+ * and nothing is to be sent.
+ * On a reply, *type and *error (either may be NULL) are the request type and
+ * the errno it was answered with.
+ */
+size_t procfsd_serve_one(const struct procfsd_sources *src, const void *dgram, size_t n,
+    void *reply, uint32_t *type, int *error);
+
+/*
+ * Build into `reply` the answer to `req` that it was not served, with
+ * `error` (EBUSY when its queue is full). Returns the reply length.
+ */
+size_t procfsd_serve_error(const struct procfs_ctl_req *req, int error, void *reply);
+
+/* What procfsd_serve_queue() did with a datagram. */
+enum {
+    PROCFSD_QUEUED    = 0,  /* its class's workers have it */
+    PROCFSD_REFUSED   = 1,  /* its class's queue is full: answer it with the EBUSY reply */
+    PROCFSD_MALFORMED = 2,  /* not a request (too short, or bad magic): drop it */
+};
+
+/*
+ * Queue the request datagram `dgram` of `n` bytes on `s`. Returns
+ * PROCFSD_*; on PROCFSD_REFUSED the EBUSY reply is built in `reply` (room
+ * for sizeof(struct procfs_ctl_resp)), *len is its length and *type the
+ * request type.
+ */
+int procfsd_serve_queue(struct procfsd_sched *s, const void *dgram, size_t n, void *reply,
+    size_t *len, uint32_t *type);
+
+/* Told of each record procfsd_serve_take() did not queue, with what procfsd_serve_queue() said. */
+typedef void (*procfsd_unqueued_fn)(void *ctx, int result, const void *reply, size_t len,
+    uint32_t type);
+
+/*
+ * Queue every request in the ring `reqs` on `s`, consuming them, and tell
+ * `unqueued` of those refused or malformed. Returns the records taken.
+ */
+uint32_t procfsd_serve_take(struct procfsd_sched *s, struct procfs_ring *reqs,
+    procfsd_unqueued_fn unqueued, void *ctx);
+
+#endif /* PROCFSD_SERVE_H */
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_stats.c
+ *
+ * Request accounting for procfsd (see procfsd_stats.h). Only procfsd's
+ * request loop records, so the counters are plain integers; the dump is
+ * produced from the same thread, on SIGUSR1 or when the stats file is due.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/fs/procfs/procfs_ctl.h"
+#include "procfsd_stats.h"
+
+static const char *const procfsd_req_names[PROCFSD_NREQ] = {
+    [0]                     = "other",
+    [PROCFS_REQ_TASKINFO]   = "taskinfo",
+    [PROCFS_REQ_THREADINFO] = "threadinfo",
+    [PROCFS_REQ_VMSTAT]     = "vmstat",
+    [PROCFS_REQ_LOADAVG]    = "loadavg",
+    [PROCFS_REQ_REGS]       = "regs",
+    [PROCFS_REQ_FPREGS]     = "fpregs",
+    [PROCFS_REQ_THREADS]    = "threads",
+    [PROCFS_REQ_TASKINFOS]  = "taskinfos",
+    [PROCFS_REQ_IOINFOS]    = "ioinfos",
+};
+
+static const char *const procfsd_call_names[PROCFSD_NCALLS] = {
+    [PROCFSD_CALL_PROC_PIDINFO]     = "proc_pidinfo",
+    [PROCFSD_CALL_TASK_FOR_PID]     = "task_for_pid",
+    [PROCFSD_CALL_TASK_THREADS]     = "task_threads",
+    [PROCFSD_CALL_THREAD_GET_STATE] = "thread_get_state",
+    [PROCFSD_CALL_HOST_STATISTICS]  = "host_statistics64",
+    [PROCFSD_CALL_GETLOADAVG]       = "getloadavg",
+    [PROCFSD_CALL_PROC_PID_RUSAGE]  = "proc_pid_rusage",
+};
+
+void
+procfsd_stats_init(struct procfsd_stats *st, uint64_t now_ns)
+{
+    memset(st, 0, sizeof(*st));
+    st->start_ns = now_ns;
+}
+
+int
+procfsd_stats_bucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    int b = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+    return b < PROCFSD_HIST - 1 ? b : PROCFSD_HIST - 1;
+}
+
+static void
+procfsd_hist_add(struct procfsd_hist *h, uint64_t ns, int failed)
+{
+    h->count++;
+    if (failed) {
+        h->errors++;
+    }
+    h->total_ns += ns;
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+    h->bucket[procfsd_stats_bucket(ns)]++;
+}
+
+void
+procfsd_stats_request(struct procfsd_stats *st, uint32_t type, uint64_t ns, int error)
+{
+    uint32_t slot = (type < PROCFSD_NREQ && procfsd_req_names[type] != NULL) ? type : 0;
+    procfsd_hist_add(&st->req[slot], ns, error != 0);
+}
+
+void
+procfsd_stats_call(struct procfsd_stats *st, enum procfsd_call call, uint64_t ns, int failed)
+{
+    if ((unsigned)call < PROCFSD_NCALLS) {
+        procfsd_hist_add(&st->call[call], ns, failed);
+    }
+}
+
+/* "<kind> count errors total_ns max_ns <1us <2us ... >=16384us" */
+static int
+procfsd_print_header(FILE *fp, const char *kind)
+{
+    if (fprintf(fp, "%s count errors total_ns max_ns <1us", kind) < 0) {
+        return -1;
+    }
+    for (int i = 1; i < PROCFSD_HIST - 1; i++) {
+        if (fprintf(fp, " <%lluus", 1ULL << i) < 0) {
+            return -1;
+        }
+    }
+    return fprintf(fp, " >=%lluus\n", 1ULL << (PROCFSD_HIST - 2)) < 0 ? -1 : 0;
+}
+
+static int
+procfsd_print_hist(FILE *fp, const char *name, const struct procfsd_hist *h)
+{
+    if (fprintf(fp, "%s %llu %llu %llu %llu", name,
+            (unsigned long long)h->count, (unsigned long long)h->errors,
+            (unsigned long long)h->total_ns, (unsigned long long)h->max_ns) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < PROCFSD_HIST; i++) {
+        if (fprintf(fp, " %llu", (unsigned long long)h->bucket[i]) < 0) {
+            return -1;
+        }
+    }
+    return fputc('\n', fp) == EOF ? -1 : 0;
+}
+
+int
+procfsd_stats_print(const struct procfsd_stats *st, uint64_t now_ns, FILE *fp)
+{
+    uint64_t up = now_ns > st->start_ns ? (now_ns - st->start_ns) / 1000000000ULL : 0;
+
+    if (fprintf(fp, "uptime_s %llu\nconnects %llu\ndisconnects %llu\n"
+            "malformed %llu\nsend_errors %llu\n",
+            (unsigned long long)up, (unsigned long long)st->connects,
+            (unsigned long long)st->disconnects, (unsigned long long)st->malformed,
+            (unsigned long long)st->send_errors) < 0) {
+        return -1;
+    }
+
+    if (procfsd_print_header(fp, "request") != 0) {
+        return -1;
+    }
+    for (int t = 1; t <= PROCFSD_NREQ; t++) {
+        int slot = t % PROCFSD_NREQ;        /* "other" last */
+        if (procfsd_req_names[slot] != NULL &&
+            procfsd_print_hist(fp, procfsd_req_names[slot], &st->req[slot]) != 0) {
+            return -1;
+        }
+    }
+
+    if (procfsd_print_header(fp, "call") != 0) {
+        return -1;
+    }
+    for (int c = 0; c < PROCFSD_NCALLS; c++) {
+        if (procfsd_print_hist(fp, procfsd_call_names[c], &st->call[c]) != 0) {
+            return -1;
+        }
+    }
+    return fflush(fp) == EOF ? -1 : 0;
+}
+
+int
+procfsd_stats_write(const struct procfsd_stats *st, uint64_t now_ns, const char *path)
+{
+    size_t n = strlen(path);
+    char *tmp = malloc(n + sizeof(".XXXXXX"));
+    if (tmp == NULL) {
+        return -1;
+    }
+    memcpy(tmp, path, n);
+    memcpy(tmp + n, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+    FILE *fp = NULL;
+    if (fchmod(fd, 0644) != 0 || (fp = fdopen(fd, "w")) == NULL) {
+        int e = errno;
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        errno = e;
+        return -1;
+    }
+
+    int rc = procfsd_stats_print(st, now_ns, fp);
+    int e = errno;
+    if (fclose(fp) != 0 && rc == 0) {
+        rc = -1;
+        e = errno;
+    }
+    if (rc == 0 && rename(tmp, path) != 0) {
+        rc = -1;
+        e = errno;
+    }
+    if (rc != 0) {
+        unlink(tmp);
+    }
+    free(tmp);
+    errno = e;
+    return rc;
+}
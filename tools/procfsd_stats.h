@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2026 Sunneva N. Mariu
+ *
+ * procfsd_stats.h
+ *
+ * Request accounting for procfsd: per-request-type and per-system-call
+ * counts, error counts and latency histograms, plus connection events. The
+ * daemon measures and records; this part only counts and formats, so it
+ * builds and is tested on any host (test/host/test_procfsd_stats.c).
+ */
+#ifndef PROCFSD_STATS_H
+#define PROCFSD_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Latency buckets, as in the kext's procfs_stats: bucket 0 counts calls that
+ * took under 1us, bucket i those under 2^i us, the last everything slower.
+ */
+#define PROCFSD_HIST    16
+
+struct procfsd_hist {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t bucket[PROCFSD_HIST];
+};
+
+/* The system calls procfsd times. */
+enum procfsd_call {
+    PROCFSD_CALL_PROC_PIDINFO,
+    PROCFSD_CALL_TASK_FOR_PID,
+    PROCFSD_CALL_TASK_THREADS,
+    PROCFSD_CALL_THREAD_GET_STATE,
+    PROCFSD_CALL_HOST_STATISTICS,
+    PROCFSD_CALL_GETLOADAVG,
+    PROCFSD_CALL_PROC_PID_RUSAGE,
+    PROCFSD_NCALLS
+};
+
+/* Request slots: one per PROCFS_REQ_* type, slot 0 for anything unknown. */
+#define PROCFSD_NREQ    10
+
+struct procfsd_stats {
+    uint64_t            start_ns;       /* when counting (re)started */
+    uint64_t            connects;       /* successful connects, the first included */
+    uint64_t            disconnects;    /* receive errors that dropped the connection */
+    uint64_t            malformed;      /* short datagrams and bad magic */
+    uint64_t            send_errors;    /* replies the kernel did not accept */
+    struct procfsd_hist req[PROCFSD_NREQ];
+    struct procfsd_hist call[PROCFSD_NCALLS];
+};
+
+/* Zero `st` and start counting at `now_ns`. */
+void procfsd_stats_init(struct procfsd_stats *st, uint64_t now_ns);
+
+/* The latency bucket for `ns` nanoseconds. */
+int procfsd_stats_bucket(uint64_t ns);
+
+/* One request of wire type `type` answered in `ns`, with errno `error` (0 = ok). */
+void procfsd_stats_request(struct procfsd_stats *st, uint32_t type, uint64_t ns, int error);
+
+/* One system call that took `ns`; `failed` is non-zero if it failed. */
+void procfsd_stats_call(struct procfsd_stats *st, enum procfsd_call call, uint64_t ns, int failed);
+
+/* Text dump of `st` as of `now_ns`. Returns 0, or -1 with errno set. */
+int procfsd_stats_print(const struct procfsd_stats *st, uint64_t now_ns, FILE *fp);
+
+/*
+ * Replace the file at `path` with the dump: it is written to a temporary
+ * file next to it and renamed into place, so readers never see a partial
+ * dump. Returns 0, or -1 with errno set.
+ */
+int procfsd_stats_write(const struct procfsd_stats *st, uint64_t now_ns, const char *path);
+
+#endif /* PROCFSD_STATS_H */